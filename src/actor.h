@@ -1171,6 +1171,9 @@ public:
 	void AddToHash ();
 	void RemoveFromHash ();
 
+	// Changes whenever any actor is added to or removed from the TID hash.
+	static DWORD TIDHashGeneration;
+
 private:
 	static AActor *TIDHash[128];
 	static inline int TIDHASH (int key) { return key & 127; }
@@ -107,6 +107,8 @@
 #include "resourcefiles/resourcefile.h"
 #include "r_renderer.h"
 #include "p_local.h"
+#include "m_profile.h"
+#include "m_crc32.h"
 
 EXTERN_CVAR(Bool, hud_althud)
 void DrawHUD();
@@ -160,6 +162,7 @@ extern bool gameisdead;
 extern bool demorecording;
 extern bool M_DemoNoPlay;	// [RH] if true, then skip any demos in the loop
 extern bool insave;
+extern cycle_t ThinkCycles, SightCycles, ACSTicCycles;
 
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
 CVAR(Bool, disableautoload, false, CVAR_ARCHIVE | CVAR_NOINITCALL | CVAR_GLOBALCONFIG)
@@ -632,6 +635,10 @@ void D_Display ()
 	cycles.Reset();
 	cycles.Clock();
 
+	// Nothing holds on to texture pixels between frames, so this is the
+	// place to let the pixel cache evict what has not been used recently.
+	TexPixelCache.NewFrame();
+
 	if (players[consoleplayer].camera == NULL)
 	{
 		players[consoleplayer].camera = players[consoleplayer].mo;
@@ -945,6 +952,121 @@ void D_ErrorCleanup ()
 //
 //==========================================================================
 
+//==========================================================================
+//
+// D_FastForwardDemo
+//
+// Runs the demo as fast as possible without drawing anything or reading
+// input until it reaches the tic that demoseek asked for. Time is frozen
+// so the game does not try to catch up afterwards.
+//
+//==========================================================================
+
+static void D_FastForwardDemo ()
+{
+	cycle_t time;
+	int start = gametic;
+
+	time.Reset();
+	time.Clock();
+	I_FreezeTime (true);
+	while (G_DemoFastForwarding ())
+	{
+		G_Ticker ();
+		gametic++;
+		maketic++;
+		GC::CheckGC ();
+		Net_NewMakeTic ();
+	}
+	I_FreezeTime (false);
+	S_UpdateSounds (players[consoleplayer].camera);
+	time.Unclock();
+	DPrintf ("Fast-forwarded %d tics in %.1f ms\n", gametic - start, time.TimeMS());
+}
+
+//==========================================================================
+//
+// D_PlaysimChecksum
+//
+// Sums up the state of every actor and RNG, so that two runs of the same
+// demo can be compared.
+//
+//==========================================================================
+
+static DWORD D_PlaysimChecksum ()
+{
+	TThinkerIterator<AActor> it;
+	AActor *mo;
+	DWORD crc = 0;
+
+	while ((mo = it.Next ()) != NULL)
+	{
+		DWORD state[] =
+		{
+			DWORD(mo->X()), DWORD(mo->Y()), DWORD(mo->Z()),
+			DWORD(mo->velx), DWORD(mo->vely), DWORD(mo->velz),
+			mo->angle, DWORD(mo->health), DWORD(mo->tics)
+		};
+		crc = AddCRC32 (crc, (const BYTE *)state, sizeof(state));
+	}
+	DWORD rest[] = { FRandom::StaticSumSeeds (), DWORD(level.time) };
+	return AddCRC32 (crc, (const BYTE *)rest, sizeof(rest));
+}
+
+//==========================================================================
+//
+// D_PlaysimBench
+//
+// Handles -playsimbench. Plays a demo as fast as possible, without video,
+// sound or the main loop, and reports how fast it ran, where the time
+// went and a checksum of the final state. Never returns.
+//
+//==========================================================================
+
+static void D_PlaysimBench (const char *demo)
+{
+	cycle_t total, gc;
+	double think = 0, sight = 0, acs = 0;
+	int tics = 0;
+
+	singledemo = true;
+	playsimbench = true;
+	G_DeferedPlayDemo (demo);
+
+	total.Reset();
+	gc.Reset();
+	total.Clock();
+	do
+	{
+		ThinkCycles.Reset();
+		SightCycles.Reset();
+		ACSTicCycles.Reset();
+		G_Ticker ();
+		think += ThinkCycles.TimeMS();
+		sight += SightCycles.TimeMS();
+		acs += ACSTicCycles.TimeMS();
+		gametic++;
+		maketic++;
+		tics++;
+		gc.Clock();
+		GC::CheckGC ();
+		gc.Unclock();
+		Net_NewMakeTic ();
+	} while (demoplayback);
+	total.Unclock();
+
+	if (tics <= 1)
+	{
+		I_FatalError ("Could not play %s", demo);
+	}
+	double ms = total.TimeMS();
+	Printf ("%d tics in %.1f ms, %.1f tics/sec\n", tics, ms, tics * 1000 / ms);
+	Printf ("think %.1f ms (sight %.1f ms, ACS %.1f ms), GC %.1f ms, other %.1f ms\n",
+		think, sight, acs, gc.TimeMS(), ms - think - gc.TimeMS());
+	Printf ("final state checksum %08x\n", D_PlaysimChecksum ());
+	throw CNoRunExit();
+}
+
 void D_DoomLoop ()
 {
 	int lasttic = 0;
@@ -967,7 +1089,11 @@ void D_DoomLoop ()
 			}
 			
 			// process one or more tics
-			if (singletics)
+			if (G_DemoFastForwarding ())
+			{
+				D_FastForwardDemo ();
+			}
+			else if (singletics)
 			{
 				I_StartTic ();
 				D_ProcessEvents ();
@@ -2232,6 +2358,7 @@ void D_DoomMain (void)
 		}
 	}
 
+	M_InitLoadProfiler();
 	D_DoomInit();
 
 	// [RH] Make sure zdoom.pk3 is always loaded,
@@ -2323,6 +2450,7 @@ void D_DoomMain (void)
 		}
 
 		Printf ("W_Init: Init WADfiles.\n");
+		LoadProfiler.Phase("W_Init");
 		Wads.InitMultipleFiles (allwads);
 		allwads.Clear();
 		allwads.ShrinkToFit();
@@ -2351,23 +2479,33 @@ void D_DoomMain (void)
 
 		CT_Init ();
 
+		// -playsimbench never makes a sound.
+		if (!restart && Args->CheckParm ("-playsimbench") && !Args->CheckParm ("-nosound"))
+		{
+			Args->AppendArg ("-nosound");
+		}
+
 		if (!restart)
 		{
 			Printf ("I_Init: Setting up machine state.\n");
+			LoadProfiler.Phase("I_Init");
 			I_Init ();
 			I_CreateRenderer();
 		}
 
 		Printf ("V_Init: allocate screen.\n");
+		LoadProfiler.Phase("V_Init");
 		V_Init (!!restart);
 
 		// Base systems have been inited; enable cvar callbacks
 		FBaseCVar::EnableCallbacks ();
 
 		Printf ("S_Init: Setting up sound.\n");
+		LoadProfiler.Phase("S_Init");
 		S_Init ();
 
 		Printf ("ST_Init: Init startup screen.\n");
+		LoadProfiler.Phase("ST_Init");
 		if (!restart)
 		{
 			StartScreen = FStartupScreen::CreateInstance (TexMan.GuesstimateNumTextures() + 5);
@@ -2386,10 +2524,12 @@ void D_DoomMain (void)
 
 		// [RH] Parse any SNDINFO lumps
 		Printf ("S_InitData: Load sound definitions.\n");
+		LoadProfiler.Phase("S_InitData");
 		S_InitData ();
 
 		// [RH] Parse through all loaded mapinfo lumps
 		Printf ("G_ParseMapInfo: Load map definitions.\n");
+		LoadProfiler.Phase("G_ParseMapInfo");
 		G_ParseMapInfo (iwad_info->MapInfo);
 		ReadStatistics();
 
@@ -2397,13 +2537,16 @@ void D_DoomMain (void)
 		S_ParseMusInfo();
 
 		Printf ("Texman.Init: Init texture manager.\n");
+		LoadProfiler.Phase("Texman.Init");
 		TexMan.Init();
 		C_InitConback();
 
 		// [CW] Parse any TEAMINFO lumps.
 		Printf ("ParseTeamInfo: Load team definitions.\n");
+		LoadProfiler.Phase("ParseTeamInfo");
 		TeamLibrary.ParseTeamInfo ();
 
+		LoadProfiler.Phase("FActorInfo::StaticInit");
 		FActorInfo::StaticInit ();
 
 		// [GRB] Initialize player class list
@@ -2422,10 +2565,12 @@ void D_DoomMain (void)
 		StartScreen->Progress ();
 
 		Printf ("R_Init: Init %s refresh subsystem.\n", gameinfo.ConfigName.GetChars());
+		LoadProfiler.Phase("R_Init");
 		StartScreen->LoadingStatus ("Loading graphics", 0x3f);
 		R_Init ();
 
 		Printf ("DecalLibrary: Load decals.\n");
+		LoadProfiler.Phase("DecalLibrary");
 		DecalLibrary.ReadAllDecals ();
 
 		// [RH] Add any .deh and .bex files on the command line.
@@ -2449,6 +2594,7 @@ void D_DoomMain (void)
 		}
 
 		// Load embedded Dehacked patches
+		LoadProfiler.Phase("D_LoadDehLumps");
 		D_LoadDehLumps();
 
 		// Create replacements for dehacked pickups
@@ -2469,9 +2615,11 @@ void D_DoomMain (void)
 		bglobal.wanted_botnum = bglobal.getspawned.Size();
 
 		Printf ("M_Init: Init menus.\n");
+		LoadProfiler.Phase("M_Init");
 		M_Init ();
 
 		Printf ("P_Init: Init Playloop state.\n");
+		LoadProfiler.Phase("P_Init");
 		StartScreen->LoadingStatus ("Init game engine", 0x3f);
 		AM_StaticInit();
 		P_Init ();
@@ -2498,6 +2646,7 @@ void D_DoomMain (void)
 		if (!restart)
 		{
 			Printf ("D_CheckNetGame: Checking network game status.\n");
+			LoadProfiler.Phase("D_CheckNetGame");
 			StartScreen->LoadingStatus ("Checking network game status.", 0x3f);
 			D_CheckNetGame ();
 		}
@@ -2514,6 +2663,7 @@ void D_DoomMain (void)
 		Net_NewMakeTic ();
 		DThinker::RunThinkers ();
 		gamestate = GS_STARTUP;
+		LoadProfiler.Phase(NULL);
 
 		if (!restart)
 		{
@@ -2545,6 +2695,13 @@ void D_DoomMain (void)
 				throw CNoRunExit();
 			}
 
+			// Runs before V_Init2, so only the dummy frame buffer exists.
+			v = Args->CheckValue ("-playsimbench");
+			if (v != NULL)
+			{
+				D_PlaysimBench (v);	// never returns
+			}
+
 			V_Init2();
 			UpdateJoystickMenu(NULL);
 
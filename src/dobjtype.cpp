@@ -132,6 +132,7 @@ void PClass::StaticShutdown ()
 	{
 		delete[] uniqueFPs[i];
 	}
+	FState::StaticFreeAll();
 	bShutdown = true;
 }
 
@@ -146,11 +147,8 @@ void PClass::StaticFreeData (PClass *type)
 
 	if (type->ActorInfo != NULL)
 	{
-		if (type->ActorInfo->OwnedStates != NULL)
-		{
-			delete[] type->ActorInfo->OwnedStates;
-			type->ActorInfo->OwnedStates = NULL;
-		}
+		// The states themselves are freed all at once by FState::StaticFreeAll.
+		type->ActorInfo->OwnedStates = NULL;
 		if (type->ActorInfo->DamageFactors != NULL)
 		{
 			delete type->ActorInfo->DamageFactors;
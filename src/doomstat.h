@@ -146,6 +146,9 @@ extern	int				demover;
 // Quit after playing a demo from cmdline.
 extern	bool			singledemo; 	
 
+// Playing a demo for -playsimbench.
+extern	bool			playsimbench;
+
 extern	int				SaveVersion;
 
 
@@ -41,7 +41,7 @@
 #include "farchive.h"
 
 
-static cycle_t ThinkCycles;
+cycle_t ThinkCycles;
 extern cycle_t BotSupportCycles;
 extern int BotWTG;
 
@@ -114,6 +114,20 @@ void DThinker::SaveList(FArchive &arc, DThinker *node)
 	}
 }
 
+int DThinker::CountList(DThinker *node)
+{
+	int count = 0;
+	if (node != NULL)
+	{
+		while (!(node->ObjectFlags & OF_Sentinel))
+		{
+			count++;
+			node = node->NextThinker;
+		}
+	}
+	return count;
+}
+
 void DThinker::SerializeAll(FArchive &arc, bool hubLoad)
 {
 	DThinker *thinker;
@@ -130,10 +144,15 @@ void DThinker::SerializeAll(FArchive &arc, bool hubLoad)
 
 	if (arc.IsStoring())
 	{
+		int objcount = 0;
 		for (statcount = i = 0; i <= MAX_STATNUM; i++)
 		{
 			statcount += (!Thinkers[i].IsEmpty() || !FreshThinkers[i].IsEmpty());
+			objcount += CountList(Thinkers[i].GetHead()) + CountList(FreshThinkers[i].GetHead());
 		}
+		// Most objects in an archive are thinkers, so make room for them
+		// all at once instead of growing the object map as they come.
+		arc.ReserveObjects(objcount + objcount / 4);
 		arc << statcount;
 		for (i = 0; i <= MAX_STATNUM; i++)
 		{
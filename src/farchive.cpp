@@ -56,6 +56,7 @@
 #include "d_player.h"
 #include "m_misc.h"
 #include "dobject.h"
+#include "files.h"
 
 // These are special tokens found in the data stream of an archive.
 // Whenever a new object is encountered, it gets created using new and
@@ -133,6 +134,9 @@ static inline void SWAP_FLOAT(float &x)
 // I assume the description in zlib.h is accurate.
 #define OUT_LEN(a)		((a) + (a) / 1000 + 12)
 
+// Size of the uncompressed window used by streaming FCompressedMemFiles.
+#define STREAM_WINDOW	65536
+
 void FCompressedFile::BeEmpty ()
 {
 	m_Pos = 0;
@@ -329,7 +333,7 @@ FFile &FCompressedFile::Seek (int pos, ESeekPos ofs)
 
 CVAR (Bool, nofilecompression, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 
-void FCompressedFile::Implode ()
+void FCompressedFile::Implode (bool quiet, int level)
 {
 	uLong outlen;
 	uLong len = m_BufferSize;
@@ -343,7 +347,7 @@ void FCompressedFile::Implode ()
 		do
 		{
 			compressed = new Bytef[outlen];
-			r = compress (compressed, &outlen, m_Buffer, len);
+			r = compress2 (compressed, &outlen, m_Buffer, len, level);
 			if (r == Z_BUF_ERROR)
 			{
 				delete[] compressed;
@@ -354,10 +358,10 @@ void FCompressedFile::Implode ()
 		// If the data could not be compressed, store it as-is.
 		if (r != Z_OK || outlen >= len)
 		{
-			DPrintf ("cfile could not be compressed\n");
+			if (!quiet) DPrintf ("cfile could not be compressed\n");
 			outlen = 0;
 		}
-		else
+		else if (!quiet)
 		{
 			DPrintf ("cfile shrank from %lu to %lu bytes\n", len, outlen);
 		}
@@ -423,6 +427,11 @@ void FCompressedFile::Explode ()
 FCompressedMemFile::FCompressedMemFile ()
 {
 	m_SourceFromMem = false;
+	m_Deferred = false;
+	m_Level = Z_DEFAULT_COMPRESSION;
+	m_Stream = NULL;
+	m_StreamPos = 0;
+	m_ImplodedSize = m_ImplodedMax = 0;
 	m_ImplodedBuffer = NULL;
 }
 
@@ -437,6 +446,7 @@ FCompressedMemFile::FCompressedMemFile (const char *name, EOpenMode mode)
 
 FCompressedMemFile::~FCompressedMemFile ()
 {
+	EndStream ();
 	if (m_ImplodedBuffer != NULL)
 	{
 		M_Free (m_ImplodedBuffer);
@@ -483,6 +493,7 @@ bool FCompressedMemFile::Open (void *memblock)
 bool FCompressedMemFile::Open ()
 {
 	Close ();
+	m_Deferred = false;
 	m_Mode = EWriting;
 	m_BufferSize = 0;
 	m_MaxBufferSize = 16384;
@@ -491,8 +502,72 @@ bool FCompressedMemFile::Open ()
 	return true;
 }
 
+bool FCompressedMemFile::OpenStream (int level)
+{
+	if (nofilecompression)
+	{
+		return Open ();
+	}
+	Close ();
+	m_Stream = new z_stream;
+	memset (m_Stream, 0, sizeof(*m_Stream));
+	if (deflateInit (m_Stream, level) != Z_OK)
+	{
+		delete m_Stream;
+		m_Stream = NULL;
+		return Open ();
+	}
+	m_Deferred = false;
+	m_Level = level;
+	m_Mode = EWriting;
+	m_BufferSize = 0;
+	m_MaxBufferSize = STREAM_WINDOW;
+	m_Buffer = (BYTE *)M_Malloc (STREAM_WINDOW);
+	m_Pos = 0;
+	m_StreamPos = 0;
+	if (m_ImplodedBuffer != NULL)
+	{
+		M_Free (m_ImplodedBuffer);
+	}
+	// The two sizes go in front of the compressed data.
+	m_ImplodedMax = 8 + STREAM_WINDOW;
+	m_ImplodedSize = 8;
+	m_ImplodedBuffer = (BYTE *)M_Malloc (m_ImplodedMax);
+	return true;
+}
+
+bool FCompressedMemFile::OpenDeferred (int level)
+{
+	Open ();
+	m_Deferred = true;
+	m_Level = level;
+	return true;
+}
+
 bool FCompressedMemFile::Reopen ()
 {
+	if (m_Buffer == NULL && m_ImplodedBuffer && BigLong(((unsigned int *)m_ImplodedBuffer)[0]) != 0)
+	{
+		// Compressed data is inflated a window at a time as it is read.
+		m_Stream = new z_stream;
+		memset (m_Stream, 0, sizeof(*m_Stream));
+		m_Stream->next_in = m_ImplodedBuffer + 8;
+		m_Stream->avail_in = BigLong(((unsigned int *)m_ImplodedBuffer)[0]);
+		int r = inflateInit (m_Stream);
+		if (r != Z_OK)
+		{
+			delete m_Stream;
+			m_Stream = NULL;
+			I_Error ("Could not decompress buffer: %s", M_ZLibError(r).GetChars());
+		}
+		m_Mode = EReading;
+		m_MaxBufferSize = STREAM_WINDOW;
+		m_Buffer = (BYTE *)M_Malloc (STREAM_WINDOW);
+		m_BufferSize = 0;
+		m_Pos = 0;
+		m_StreamPos = 0;
+		return true;
+	}
 	if (m_Buffer == NULL && m_ImplodedBuffer)
 	{
 		m_Mode = EReading;
@@ -518,9 +593,183 @@ bool FCompressedMemFile::Reopen ()
 
 void FCompressedMemFile::Close ()
 {
-	if (m_Mode == EWriting)
+	if (m_Stream != NULL)
+	{
+		if (m_Mode == EWriting)
+		{
+			StreamOut (m_Buffer, m_Pos, Z_FINISH);
+			DWORD *lens = (DWORD *)m_ImplodedBuffer;
+			lens[0] = BigLong(m_ImplodedSize - 8);
+			lens[1] = BigLong(m_StreamPos + m_Pos);
+			m_ImplodedBuffer = (BYTE *)M_Realloc (m_ImplodedBuffer, m_ImplodedSize);
+			m_ImplodedMax = m_ImplodedSize;
+		}
+		EndStream ();
+	}
+	else if (m_Mode == EWriting && !m_Deferred && m_Buffer != NULL)
+	{
+		Implode (false, m_Level);
+		m_ImplodedBuffer = m_Buffer;
+		m_Buffer = NULL;
+	}
+	else if (m_Mode == EReading && m_ImplodedBuffer != NULL && m_Buffer != NULL)
+	{
+		// Drop the exploded copy so that Reopen can be used again.
+		M_Free (m_Buffer);
+		m_Buffer = NULL;
+	}
+}
+
+void FCompressedMemFile::EndStream ()
+{
+	if (m_Stream != NULL)
+	{
+		if (m_Mode == EWriting)
+		{
+			deflateEnd (m_Stream);
+		}
+		else
+		{
+			inflateEnd (m_Stream);
+		}
+		delete m_Stream;
+		m_Stream = NULL;
+		if (m_Buffer != NULL)
+		{
+			M_Free (m_Buffer);
+			m_Buffer = NULL;
+		}
+		m_BufferSize = m_Pos = 0;
+	}
+}
+
+// Compresses everything passed to it, growing m_ImplodedBuffer as needed.
+void FCompressedMemFile::StreamOut (const void *mem, unsigned int len, int flush)
+{
+	m_Stream->next_in = (Bytef *)mem;
+	m_Stream->avail_in = len;
+	for (;;)
+	{
+		if (m_ImplodedSize == m_ImplodedMax)
+		{
+			m_ImplodedMax *= 2;
+			m_ImplodedBuffer = (BYTE *)M_Realloc (m_ImplodedBuffer, m_ImplodedMax);
+		}
+		m_Stream->next_out = m_ImplodedBuffer + m_ImplodedSize;
+		m_Stream->avail_out = m_ImplodedMax - m_ImplodedSize;
+		int r = deflate (m_Stream, flush);
+		m_ImplodedSize = m_ImplodedMax - m_Stream->avail_out;
+		if (r == Z_STREAM_END)
+		{
+			break;
+		}
+		if (r != Z_OK && r != Z_BUF_ERROR)
+		{
+			I_Error ("Could not compress buffer: %s", M_ZLibError(r).GetChars());
+		}
+		if (flush == Z_NO_FLUSH && m_Stream->avail_in == 0)
+		{
+			break;
+		}
+	}
+}
+
+// Refills the window with the next part of the uncompressed data.
+void FCompressedMemFile::StreamIn ()
+{
+	m_StreamPos += m_BufferSize;
+	m_Stream->next_out = m_Buffer;
+	m_Stream->avail_out = STREAM_WINDOW;
+	int r = inflate (m_Stream, Z_NO_FLUSH);
+	m_BufferSize = STREAM_WINDOW - m_Stream->avail_out;
+	m_Pos = 0;
+	if (r != Z_OK && r != Z_STREAM_END)
+	{
+		I_Error ("Could not decompress buffer: %s", M_ZLibError(r).GetChars());
+	}
+	if (m_BufferSize == 0)
+	{
+		I_Error ("Attempt to read past end of cfile");
+	}
+}
+
+FFile &FCompressedMemFile::Write (const void *mem, unsigned int len)
+{
+	if (m_Stream == NULL || m_Mode != EWriting)
+	{
+		return FCompressedFile::Write (mem, len);
+	}
+	if (m_Pos + len > STREAM_WINDOW)
+	{
+		StreamOut (m_Buffer, m_Pos, Z_NO_FLUSH);
+		m_StreamPos += m_Pos;
+		m_Pos = 0;
+		if (len >= STREAM_WINDOW)
+		{
+			StreamOut (mem, len, Z_NO_FLUSH);
+			m_StreamPos += len;
+			return *this;
+		}
+	}
+	if (len == 1)
+		m_Buffer[m_Pos] = *(BYTE *)mem;
+	else
+		memcpy (m_Buffer + m_Pos, mem, len);
+	m_Pos += len;
+	m_BufferSize = m_Pos;
+	return *this;
+}
+
+FFile &FCompressedMemFile::Read (void *mem, unsigned int len)
+{
+	if (m_Stream == NULL || m_Mode != EReading)
+	{
+		return FCompressedFile::Read (mem, len);
+	}
+	BYTE *out = (BYTE *)mem;
+	while (len > 0)
+	{
+		if (m_Pos == m_BufferSize)
+		{
+			StreamIn ();
+		}
+		unsigned int avail = MIN (len, m_BufferSize - m_Pos);
+		if (avail == 1)
+			*out = m_Buffer[m_Pos];
+		else
+			memcpy (out, m_Buffer + m_Pos, avail);
+		m_Pos += avail;
+		out += avail;
+		len -= avail;
+	}
+	return *this;
+}
+
+unsigned int FCompressedMemFile::Tell () const
+{
+	return m_Stream != NULL ? m_StreamPos + m_Pos : FCompressedFile::Tell ();
+}
+
+FFile &FCompressedMemFile::Seek (int pos, ESeekPos ofs)
+{
+	if (m_Stream == NULL)
+	{
+		return FCompressedFile::Seek (pos, ofs);
+	}
+	if ((ofs == ESeekRelative && pos != 0) || (ofs == ESeekSet && (unsigned)pos != Tell ()) || ofs == ESeekEnd)
+	{
+		I_Error ("Cannot seek in a streaming cfile");
+	}
+	return *this;
+}
+
+// Finishes a file opened with OpenDeferred after it has been closed.
+void FCompressedMemFile::Compress ()
+{
+	if (m_Deferred && m_Buffer != NULL)
 	{
-		Implode ();
+		m_Deferred = false;
+		Implode (true, m_Level);
 		m_ImplodedBuffer = m_Buffer;
 		m_Buffer = NULL;
 	}
@@ -567,6 +816,22 @@ void FCompressedMemFile::Serialize (FArchive &arc)
 	}
 }
 
+// Writes the same data as storing to an archive, but without needing one,
+// so it can be used off the game thread.
+void FCompressedMemFile::Serialize (FFile &file)
+{
+	if (m_ImplodedBuffer == NULL)
+	{
+		I_Error ("FCompressedMemFile must be compressed before storing");
+	}
+	file.Write (ZSig, 4);
+
+	DWORD sizes[2];
+	sizes[0] = SWAP_DWORD (((DWORD *)m_ImplodedBuffer)[0]);
+	sizes[1] = SWAP_DWORD (((DWORD *)m_ImplodedBuffer)[1]);
+	file.Write (m_ImplodedBuffer, (sizes[0] ? sizes[0] : sizes[1])+8);
+}
+
 bool FCompressedMemFile::IsOpen () const
 {
 	return !!m_Buffer;
@@ -574,7 +839,12 @@ bool FCompressedMemFile::IsOpen () const
 
 void FCompressedMemFile::GetSizes(unsigned int &compressed, unsigned int &uncompressed) const
 {
-	if (m_ImplodedBuffer != NULL)
+	if (m_Stream != NULL && m_Mode == EWriting)
+	{
+		compressed = m_ImplodedSize - 8;
+		uncompressed = m_StreamPos + m_Pos;
+	}
+	else if (m_ImplodedBuffer != NULL)
 	{
 		compressed = BigLong(*(unsigned int *)m_ImplodedBuffer);
 		uncompressed = BigLong(*(unsigned int *)(m_ImplodedBuffer + 4));
@@ -586,13 +856,13 @@ void FCompressedMemFile::GetSizes(unsigned int &compressed, unsigned int &uncomp
 	}
 }
 
-FPNGChunkFile::FPNGChunkFile (FILE *file, DWORD id)
-	: FCompressedFile (file, EWriting, true, false), m_ChunkID (id)
+FPNGChunkFile::FPNGChunkFile (FileWriter *file, DWORD id)
+	: FCompressedFile (NULL, EWriting, true, false), m_ChunkID (id), m_Writer (file)
 {
 }
 
 FPNGChunkFile::FPNGChunkFile (FILE *file, DWORD id, size_t chunklen)
-	: FCompressedFile (file, EReading, true, false), m_ChunkID (id)
+	: FCompressedFile (file, EReading, true, false), m_ChunkID (id), m_Writer (NULL)
 {
 	m_Buffer = (BYTE *)M_Malloc (chunklen);
 	m_BufferSize = (unsigned int)chunklen;
@@ -607,26 +877,24 @@ void FPNGChunkFile::Close ()
 	DWORD data[2];
 	DWORD crc;
 
-	if (m_File)
+	if (m_Writer)
 	{
-		if (m_Mode == EWriting)
-		{
-			crc = CalcCRC32 ((BYTE *)&m_ChunkID, 4);
-			crc = AddCRC32 (crc, (BYTE *)m_Buffer, m_BufferSize);
-
-			data[0] = BigLong(m_BufferSize);
-			data[1] = m_ChunkID;
-			fwrite (data, 8, 1, m_File);
-			fwrite (m_Buffer, m_BufferSize, 1, m_File);
-			crc = SWAP_DWORD (crc);
-			fwrite (&crc, 4, 1, m_File);
-		}
-		m_File = NULL;
+		crc = CalcCRC32 ((BYTE *)&m_ChunkID, 4);
+		crc = AddCRC32 (crc, (BYTE *)m_Buffer, m_BufferSize);
+
+		data[0] = BigLong(m_BufferSize);
+		data[1] = m_ChunkID;
+		m_Writer->Write (data, 8);
+		m_Writer->Write (m_Buffer, m_BufferSize);
+		crc = SWAP_DWORD (crc);
+		m_Writer->Write (&crc, 4);
+		m_Writer = NULL;
 	}
+	m_File = NULL;
 	FCompressedFile::Close ();
 }
 
-FPNGChunkArchive::FPNGChunkArchive (FILE *file, DWORD id)
+FPNGChunkArchive::FPNGChunkArchive (FileWriter *file, DWORD id)
 	: FArchive (), Chunk (file, id)
 {
 	AttachToFile (Chunk);
@@ -668,6 +936,8 @@ void FArchive::AttachToFile (FFile &file)
 	m_File = &file;
 	m_MaxObjectCount = m_ObjectCount = 0;
 	m_ObjectMap = NULL;
+	m_ObjectTable = NULL;
+	m_ObjectTableSize = 0;
 	if (file.Mode() == FFile::EReading)
 	{
 		m_Loading = true;
@@ -687,11 +957,7 @@ void FArchive::AttachToFile (FFile &file)
 		m_TypeMap[i].toCurrent = NULL;
 	}
 	m_ClassCount = 0;
-	for (i = 0; i < EObjectHashSize; i++)
-	{
-		m_ObjectHash[i] = ~0;
-		m_NameHash[i] = NameMap::NO_INDEX;
-	}
+	ClearMaps ();
 	m_NumSprites = 0;
 	m_SpriteMap = new int[sprites.Size()];
 	for (size_t s = 0; s < sprites.Size(); ++s)
@@ -707,6 +973,8 @@ FArchive::~FArchive ()
 		delete[] m_TypeMap;
 	if (m_ObjectMap)
 		M_Free (m_ObjectMap);
+	if (m_ObjectTable)
+		M_Free (m_ObjectTable);
 	if (m_SpriteMap)
 		delete[] m_SpriteMap;
 }
@@ -1340,50 +1608,117 @@ int FArchive::ReadSprite ()
 	}
 }
 
+//==========================================================================
+//
+// FArchive :: ClearMaps
+//
+// Forgets every object and name written so far.
+//
+//==========================================================================
+
+void FArchive::ClearMaps ()
+{
+	m_ObjectCount = 0;
+	for (DWORD i = 0; i < m_ObjectTableSize; ++i)
+	{
+		m_ObjectTable[i] = TypeMap::NO_INDEX;
+	}
+	m_Names.Clear ();
+	m_NameStorage.Clear ();
+	if (m_NameTable.Size() == 0)
+	{
+		m_NameTable.Resize (64);
+	}
+	for (unsigned int i = 0; i < m_NameTable.Size(); ++i)
+	{
+		m_NameTable[i] = NameMap::NO_INDEX;
+	}
+}
+
 DWORD FArchive::AddName (const char *name)
 {
 	DWORD index;
-	unsigned int hash = MakeKey (name) % EObjectHashSize;
+	unsigned int hash = MakeKey (name);
 
 	index = FindName (name, hash);
 	if (index == NameMap::NO_INDEX)
 	{
 		DWORD namelen = (DWORD)(strlen (name) + 1);
 		DWORD strpos = (DWORD)m_NameStorage.Reserve (namelen);
-		NameMap mapper = { strpos, (DWORD)m_NameHash[hash] };
+		NameMap mapper = { strpos, hash };
 
 		memcpy (&m_NameStorage[strpos], name, namelen);
-		m_NameHash[hash] = index = (DWORD)m_Names.Push (mapper);
+		index = (DWORD)m_Names.Push (mapper);
+		InsertName (index);
 	}
 	return index;
 }
 
 DWORD FArchive::AddName (unsigned int start)
 {
-	DWORD hash = MakeKey (&m_NameStorage[start]) % EObjectHashSize;
-	NameMap mapper = { (DWORD)start, (DWORD)m_NameHash[hash] };
-	return (DWORD)(m_NameHash[hash] = m_Names.Push (mapper));
+	NameMap mapper = { (DWORD)start, MakeKey (&m_NameStorage[start]) };
+	DWORD index = (DWORD)m_Names.Push (mapper);
+	InsertName (index);
+	return index;
+}
+
+//==========================================================================
+//
+// FArchive :: InsertName
+//
+// Adds an entry of m_Names to m_NameTable, doubling the table first if it
+// would become more than half full.
+//
+//==========================================================================
+
+void FArchive::InsertName (DWORD index)
+{
+	unsigned int size = m_NameTable.Size();
+	unsigned int i;
+
+	if (m_Names.Size() * 2 > size)
+	{
+		size *= 2;
+		m_NameTable.Resize (size);
+		for (i = 0; i < size; ++i)
+		{
+			m_NameTable[i] = NameMap::NO_INDEX;
+		}
+		for (DWORD j = 0; j < m_Names.Size(); ++j)
+		{
+			if (j != index)
+			{
+				for (i = m_Names[j].Hash & (size - 1); m_NameTable[i] != NameMap::NO_INDEX; i = (i + 1) & (size - 1))
+				{
+				}
+				m_NameTable[i] = j;
+			}
+		}
+	}
+	for (i = m_Names[index].Hash & (size - 1); m_NameTable[i] != NameMap::NO_INDEX; i = (i + 1) & (size - 1))
+	{
+	}
+	m_NameTable[i] = index;
 }
 
 DWORD FArchive::FindName (const char *name) const
 {
-	return FindName (name, MakeKey (name) % EObjectHashSize);
+	return FindName (name, MakeKey (name));
 }
 
-DWORD FArchive::FindName (const char *name, unsigned int bucket) const
+DWORD FArchive::FindName (const char *name, unsigned int hash) const
 {
-	unsigned int map = m_NameHash[bucket];
+	unsigned int mask = m_NameTable.Size() - 1;
 
-	while (map != NameMap::NO_INDEX)
+	for (unsigned int i = hash & mask; m_NameTable[i] != NameMap::NO_INDEX; i = (i + 1) & mask)
 	{
-		const NameMap *mapping = &m_Names[map];
-		if (strcmp (name, &m_NameStorage[mapping->StringStart]) == 0)
+		const NameMap *mapping = &m_Names[m_NameTable[i]];
+		if (mapping->Hash == hash && strcmp (name, &m_NameStorage[mapping->StringStart]) == 0)
 		{
-			return (DWORD)map;
+			return m_NameTable[i];
 		}
-		map = mapping->HashNext;
 	}
-	return (DWORD)map;
+	return NameMap::NO_INDEX;
 }
 
 DWORD FArchive::WriteClass (const PClass *info)
@@ -1464,44 +1799,96 @@ const PClass *FArchive::ReadStoredClass (const PClass *wanttype)
 	return type;
 }
 
-DWORD FArchive::MapObject (const DObject *obj)
+//==========================================================================
+//
+// FArchive :: ReserveObjects
+//
+// Makes room for at least count objects without growing the maps again.
+//
+//==========================================================================
+
+void FArchive::ReserveObjects (DWORD count)
 {
-	DWORD i;
+	if (count <= m_MaxObjectCount)
+	{
+		return;
+	}
+	m_MaxObjectCount = count;
+	m_ObjectMap = (ObjectMap *)M_Realloc (m_ObjectMap, sizeof(ObjectMap)*m_MaxObjectCount);
 
-	if (m_ObjectCount >= m_MaxObjectCount)
+	if (m_Storing)
 	{
-		m_MaxObjectCount = m_MaxObjectCount ? m_MaxObjectCount * 2 : 1024;
-		m_ObjectMap = (ObjectMap *)M_Realloc (m_ObjectMap, sizeof(ObjectMap)*m_MaxObjectCount);
-		for (i = m_ObjectCount; i < m_MaxObjectCount; i++)
+		DWORD size = 1024;
+		while (size < count * 2)
 		{
-			m_ObjectMap[i].hashNext = ~0;
-			m_ObjectMap[i].object = NULL;
+			size <<= 1;
+		}
+		if (size > m_ObjectTableSize)
+		{
+			m_ObjectTableSize = size;
+			m_ObjectTable = (DWORD *)M_Realloc (m_ObjectTable, sizeof(DWORD)*size);
+			for (DWORD i = 0; i < size; ++i)
+			{
+				m_ObjectTable[i] = TypeMap::NO_INDEX;
+			}
+			for (DWORD j = 0; j < m_ObjectCount; ++j)
+			{
+				DWORD i = HashObject (m_ObjectMap[j].object);
+				while (m_ObjectTable[i] != TypeMap::NO_INDEX)
+				{
+					i = (i + 1) & (size - 1);
+				}
+				m_ObjectTable[i] = j;
+			}
 		}
 	}
+}
 
-	DWORD index = m_ObjectCount++;
-	DWORD hash = HashObject (obj);
+DWORD FArchive::MapObject (const DObject *obj)
+{
+	if (m_ObjectCount >= m_MaxObjectCount)
+	{
+		ReserveObjects (m_MaxObjectCount ? m_MaxObjectCount * 2 : 1024);
+	}
 
+	DWORD index = m_ObjectCount++;
 	m_ObjectMap[index].object = obj;
-	m_ObjectMap[index].hashNext = m_ObjectHash[hash];
-	m_ObjectHash[hash] = index;
 
+	// Loading only ever looks objects up by index.
+	if (m_Storing)
+	{
+		DWORD i = HashObject (obj);
+		while (m_ObjectTable[i] != TypeMap::NO_INDEX)
+		{
+			i = (i + 1) & (m_ObjectTableSize - 1);
+		}
+		m_ObjectTable[i] = index;
+	}
 	return index;
 }
 
 DWORD FArchive::HashObject (const DObject *obj) const
 {
-	return (DWORD)((size_t)obj % EObjectHashSize);
+	// Fibonacci hashing, so that the alignment of the pointers does not
+	// leave most of the table unused.
+	QWORD key = (QWORD)(size_t)obj * 0x9E3779B97F4A7C15ull;
+	return (DWORD)(key >> 32) & (m_ObjectTableSize - 1);
 }
 
 DWORD FArchive::FindObjectIndex (const DObject *obj) const
 {
-	DWORD index = m_ObjectHash[HashObject (obj)];
-	while (index != TypeMap::NO_INDEX && m_ObjectMap[index].object != obj)
+	if (m_ObjectTableSize == 0)
 	{
-		index = m_ObjectMap[index].hashNext;
+		return TypeMap::NO_INDEX;
 	}
-	return index;
+	for (DWORD i = HashObject (obj); m_ObjectTable[i] != TypeMap::NO_INDEX; i = (i + 1) & (m_ObjectTableSize - 1))
+	{
+		if (m_ObjectMap[m_ObjectTable[i]].object == obj)
+		{
+			return m_ObjectTable[i];
+		}
+	}
+	return TypeMap::NO_INDEX;
 }
 
 void FArchive::UserWriteClass (const PClass *type)
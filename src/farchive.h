@@ -39,6 +39,8 @@
 #include "r_state.h"
 #include "tflags.h"
 
+class FileWriter;
+
 class FFile
 {
 public:
@@ -103,7 +105,7 @@ protected:
 	EOpenMode m_Mode;
 	FILE *m_File;
 
-	void Implode ();
+	void Implode (bool quiet = false, int level = -1);	// -1 is zlib's default level
 	void Explode ();
 	virtual bool FreeOnExplode () { return true; }
 	void PostOpen ();
@@ -122,31 +124,54 @@ public:
 	bool Open (const char *name, EOpenMode mode);	// Works for reading only
 	bool Open (void *memblock);	// Open for reading only
 	bool Open ();	// Open for writing only
+	bool OpenStream (int level);	// Open for writing, compressing as it goes
+	bool OpenDeferred (int level);	// Like Open, but Close leaves compression to Compress
 	bool Reopen ();	// Re-opens imploded file for reading only
 	void Close ();
+	void Compress ();	// Does not print, so it can run on a worker thread
 	bool IsOpen () const;
 	void GetSizes(unsigned int &one, unsigned int &two) const;
 
+	FFile &Write (const void *, unsigned int);
+	FFile &Read (void *, unsigned int);
+	unsigned int Tell () const;
+	FFile &Seek (int, ESeekPos);
+
 	void Serialize (FArchive &arc);
+	void Serialize (FFile &file);
 
 protected:
 	bool FreeOnExplode () { return !m_SourceFromMem; }
 
 private:
+	void StreamOut (const void *mem, unsigned int len, int flush);
+	void StreamIn ();
+	void EndStream ();
+
 	bool m_SourceFromMem;
+	bool m_Deferred;
+	int m_Level;
+
+	// While streaming, m_Buffer is only a window onto the uncompressed
+	// data and m_ImplodedBuffer is filled or drained as it moves.
+	struct z_stream_s *m_Stream;
+	unsigned int m_StreamPos;		// Uncompressed bytes before the window
+	unsigned int m_ImplodedSize;
+	unsigned int m_ImplodedMax;
 	unsigned char *m_ImplodedBuffer;
 };
 
 class FPNGChunkFile : public FCompressedFile
 {
 public:
-	FPNGChunkFile (FILE *file, DWORD id);					// Create for writing
+	FPNGChunkFile (FileWriter *file, DWORD id);				// Create for writing
 	FPNGChunkFile (FILE *file, DWORD id, size_t chunklen);	// Create for reading
 
 	void Close ();
 
 private:
 	DWORD m_ChunkID;
+	FileWriter *m_Writer;
 };
 
 class FArchive
@@ -194,6 +219,8 @@ virtual void Read (void *mem, unsigned int len);
 		void WriteSprite (int spritenum);
 		int ReadSprite ();
 
+		void ReserveObjects (DWORD count);
+
 inline	FArchive& operator<< (SBYTE &c) { return operator<< ((BYTE &)c); }
 inline	FArchive& operator<< (SWORD &s) { return operator<< ((WORD &)s); }
 inline	FArchive& operator<< (SDWORD &i) { return operator<< ((DWORD &)i); }
@@ -204,8 +231,6 @@ inline	FArchive& operator<< (bool &b) { return operator<< ((BYTE &)b); }
 inline  FArchive& operator<< (DObject* &object) { return ReadObject (object, RUNTIME_CLASS(DObject)); }
 
 protected:
-		enum { EObjectHashSize = 137 };
-
 		DWORD FindObjectIndex (const DObject *obj) const;
 		DWORD MapObject (const DObject *obj);
 		DWORD WriteClass (const PClass *info);
@@ -216,7 +241,9 @@ protected:
 		DWORD AddName (const char *name);
 		DWORD AddName (unsigned int start);	// Name has already been added to storage
 		DWORD FindName (const char *name) const;
-		DWORD FindName (const char *name, unsigned int bucket) const;
+		DWORD FindName (const char *name, unsigned int hash) const;
+		void InsertName (DWORD index);
+		void ClearMaps ();
 
 		bool m_Persistent;		// meant for persistent storage (disk)?
 		bool m_Loading;			// extracting objects?
@@ -238,19 +265,23 @@ protected:
 		struct ObjectMap
 		{
 			const DObject *object;
-			DWORD hashNext;
 		} *m_ObjectMap;
-		DWORD m_ObjectHash[EObjectHashSize];
+
+		// Open addressed tables of indices into m_ObjectMap and m_Names.
+		// Their sizes are powers of two, kept at least twice the number of
+		// entries. The object table is only used while storing.
+		DWORD *m_ObjectTable;
+		DWORD m_ObjectTableSize;
 
 		struct NameMap
 		{
 			DWORD StringStart;	// index into m_NameStorage
-			DWORD HashNext;		// next in hash bucket
+			DWORD Hash;
 			enum { NO_INDEX = 0xffffffff };
 		};
 		TArray<NameMap> m_Names;
 		TArray<char> m_NameStorage;
-		unsigned int m_NameHash[EObjectHashSize];
+		TArray<DWORD> m_NameTable;
 
 		int *m_SpriteMap;
 		size_t m_NumSprites;
@@ -267,7 +298,7 @@ private:
 class FPNGChunkArchive : public FArchive
 {
 public:
-	FPNGChunkArchive (FILE *file, DWORD chunkid);
+	FPNGChunkArchive (FileWriter *file, DWORD chunkid);
 	FPNGChunkArchive (FILE *file, DWORD chunkid, size_t chunklen);
 	~FPNGChunkArchive ();
 	FPNGChunkFile Chunk;
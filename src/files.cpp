@@ -600,3 +600,39 @@ char *MemoryArrayReader::Gets(char *strbuf, int len)
 {
     return GetsFromBuffer((char*)&buf[0], strbuf, len);
 }
+
+//==========================================================================
+//
+// FileWriter
+//
+// writes data to an already opened file
+//
+//==========================================================================
+
+size_t FileWriter::Write (const void *buffer, size_t len)
+{
+	if (File == NULL)
+	{
+		return 0;
+	}
+	return fwrite (buffer, 1, len, File);
+}
+
+//==========================================================================
+//
+// BufferWriter
+//
+// writes data to a growing block of memory
+//
+//==========================================================================
+
+size_t BufferWriter::Write (const void *buffer, size_t len)
+{
+	if (len == 0)
+	{
+		return 0;
+	}
+	unsigned int ofs = Buffer.Reserve ((unsigned int)len);
+	memcpy (&Buffer[ofs], buffer, len);
+	return len;
+}
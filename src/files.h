@@ -356,4 +356,34 @@ protected:
 };
 
 
+class FileWriter
+{
+public:
+	FileWriter (FILE *file = NULL) : File(file) {}
+	virtual ~FileWriter () {}
+
+	virtual size_t Write (const void *buffer, size_t len);
+
+protected:
+	FILE *File;		// not owned
+
+private:
+	// This may be handed to other threads, so don't allow copying.
+	FileWriter (const FileWriter &) {}
+	FileWriter &operator= (const FileWriter &) { return *this; }
+};
+
+class BufferWriter : public FileWriter
+{
+public:
+	BufferWriter () {}
+
+	virtual size_t Write (const void *buffer, size_t len);
+	TArray<BYTE> &GetArray() { return Buffer; }
+
+protected:
+	TArray<BYTE> Buffer;
+};
+
+
 #endif
@@ -194,7 +194,18 @@ static void add_char(char *tokn, char c)
 char *FParser::GetTokens(char *s)
 {
 	char *tokn = NULL;
+	bool cacheable = s >= Script->data && s < Script->data + Script->len;
 
+	if (cacheable)
+	{
+		int *index = Script->tokencache.StatementMap.CheckKey(Script->MakeIndex(s));
+		if (index != NULL)
+		{
+			return GetCachedTokens(*index);
+		}
+	}
+
+	Statement = -1;
 	Rover = s;
 	NumTokens = 1;
 	Tokens[0][0] = 0; TokenType[NumTokens-1] = name_;
@@ -296,6 +307,77 @@ char *FParser::GetTokens(char *s)
 	}
 	
 	Rover++;
+	if (cacheable)
+	{
+		CacheTokens(Script->MakeIndex(s));
+	}
+	return Rover;
+}
+
+//==========================================================================
+//
+// CacheTokens
+//
+// Stores the statement that was just tokenized so that the next time
+// execution reaches this offset the lexer doesn't need to run again.
+//
+//==========================================================================
+
+void FParser::CacheTokens(int offset)
+{
+	FFsTokenCache &cache = Script->tokencache;
+	FFsStatement st;
+	int i;
+
+	st.NumTokens = NumTokens;
+	st.FirstToken = cache.TokenText.Size();
+	st.TextLen = NumTokens > 0 ? int(Tokens[NumTokens-1] - Tokens[0]) + (int)strlen(Tokens[NumTokens-1]) + 1 : 1;
+	st.Text = cache.Text.Reserve(st.TextLen);
+	st.LineStart = Script->MakeIndex(LineStart);
+	st.End = Script->MakeIndex(Rover);
+	st.Section = Section;
+	st.BraceType = BraceType;
+
+	memcpy(&cache.Text[st.Text], Tokens[0], st.TextLen);
+	for (i = 0; i < NumTokens; i++)
+	{
+		cache.TokenText.Push(int(Tokens[i] - Tokens[0]));
+		cache.TokenType.Push((BYTE)TokenType[i]);
+	}
+	Statement = cache.Statements.Push(st);
+	cache.StatementMap[offset] = Statement;
+}
+
+//==========================================================================
+//
+// GetCachedTokens
+//
+// Restores a statement's tokens from the script's token cache.
+// Sets up everything GetTokens would have.
+//
+//==========================================================================
+
+char *FParser::GetCachedTokens(int index)
+{
+	FFsTokenCache &cache = Script->tokencache;
+	const FFsStatement &st = cache.Statements[index];
+	int i;
+
+	memcpy(Tokens[0], &cache.Text[st.Text], st.TextLen);
+	NumTokens = st.NumTokens;
+	for (i = 0; i < NumTokens; i++)
+	{
+		Tokens[i] = Tokens[0] + cache.TokenText[st.FirstToken + i];
+		TokenType[i] = (tokentype_t)cache.TokenType[st.FirstToken + i];
+	}
+	LineStart = Script->data + st.LineStart;
+	Section = st.Section;
+	if (Section != NULL)
+	{
+		BraceType = st.BraceType;
+	}
+	Statement = index;
+	Rover = Script->data + st.End;
 	return Rover;
 }
 
@@ -633,6 +715,74 @@ void FParser::PointlessBrackets(int *start, int *stop)
     }
 }
 
+//==========================================================================
+//
+// SplitExpression
+//
+// Removes pointless brackets and finds the operator with the lowest
+// precedence in a token range. Returns the operator's index (its position
+// is returned in n), -1 for a single token or num_operators if nothing
+// was found. The result only depends on the tokens so it is remembered
+// for every range of a cached statement.
+//
+//==========================================================================
+
+int FParser::SplitExpression(int &start, int &stop, int &n)
+{
+	bool memo = Statement >= 0 && Statement < 65536 && start >= 0 && start <= stop && stop < NumTokens;
+	unsigned int key = 0;
+	int i;
+
+	if (memo)
+	{
+		key = ((unsigned int)Statement << 16) | (start << 8) | stop;
+		unsigned int *split = Script->tokencache.Splits.CheckKey(key);
+		if (split != NULL)
+		{
+			start = *split & 255;
+			stop = (*split >> 8) & 255;
+			n = (*split >> 16) & 255;
+			return int(*split >> 24) - 1;
+		}
+	}
+
+	// possible pointless brackets
+	if(TokenType[start] == operator_ && TokenType[stop] == operator_)
+		PointlessBrackets(&start, &stop);
+
+	n = -1;
+	if(start == stop)       // only 1 thing to evaluate
+	{
+		i = -1;
+	}
+	else
+	{
+		// go through each operator in order of precedence
+		for(i=0; i<num_operators; i++)
+		{
+			// check backwards for the token. it has to be
+			// done backwards for left-to-right reading: eg so
+			// 5-3-2 is (5-3)-2 not 5-(3-2)
+
+			if (operators[i].direction==forward)
+			{
+				n = FindOperatorBackwards(start, stop, operators[i].string);
+			}
+			else
+			{
+				n = FindOperator(start, stop, operators[i].string);
+			}
+			if (n != -1) break;
+		}
+	}
+
+	if (memo)
+	{
+		Script->tokencache.Splits[key] = start | (stop << 8) | ((n & 255) << 16) | ((i + 1) << 24);
+	}
+	return i;
+}
+
 //==========================================================================
 //
 // evaluate_expresion is the basic function used to evaluate
@@ -652,41 +802,20 @@ void FParser::PointlessBrackets(int *start, int *stop)
 void FParser::EvaluateExpression(svalue_t &result, int start, int stop)
 {
 	int i, n;
-	
-	// possible pointless brackets
-	if(TokenType[start] == operator_ && TokenType[stop] == operator_)
-		PointlessBrackets(&start, &stop);
 
-	if(start == stop)       // only 1 thing to evaluate
-    {
+	i = SplitExpression(start, stop, n);
+	if (i < 0)
+	{
 		SimpleEvaluate(result, start);
 		return;
-    }
-	
-	// go through each operator in order of precedence
-	for(i=0; i<num_operators; i++)
-    {
-		// check backwards for the token. it has to be
-		// done backwards for left-to-right reading: eg so
-		// 5-3-2 is (5-3)-2 not 5-(3-2)
-		
-		if (operators[i].direction==forward)
-		{
-			n = FindOperatorBackwards(start, stop, operators[i].string);
-		}
-		else
-		{
-			n = FindOperator(start, stop, operators[i].string);
-		}
+	}
+	if (i < num_operators)
+	{
+		// call the operator function and evaluate this chunk of tokens
+		(this->*operators[i].handler)(result, start, n, stop);
+		return;
+	}
 
-		if( n != -1)
-		{
-			// call the operator function and evaluate this chunk of tokens
-			(this->*operators[i].handler)(result, start, n, stop);
-			return;
-		}
-    }
-	
 	if(TokenType[start] == function)
 	{
 		EvaluateFunction(result, start, stop);
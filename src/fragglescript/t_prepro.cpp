@@ -139,6 +139,8 @@ void DFsScript::ClearSections()
 		}
 		sections[i] = NULL;
 	}
+	// the token cache holds pointers to the sections
+	tokencache.Clear();
 }
 
 //==========================================================================
@@ -397,8 +399,9 @@ void DFsScript::DryRunScript()
 void DFsScript::Preprocess()
 {
 	len = (int)strlen(data);
+	tokencache.Clear();
 	ProcessFindChar(data, 0);  // fill in everything
-	DryRunScript();
+	DryRunScript();            // this also fills the token cache
 }
 
 //==========================================================================
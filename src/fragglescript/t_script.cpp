@@ -55,6 +55,7 @@
 #include "doomerrors.h"
 #include "doomstat.h"
 #include "farchive.h"
+#include "m_profile.h"
 
 //==========================================================================
 //
@@ -201,6 +202,22 @@ void DFsScript::Serialize(FArchive &arc)
 	if (parent == NULL) parent = global_script;
 }
 
+//==========================================================================
+//
+// Names a script for the scripting profiler
+//
+//==========================================================================
+
+static FString ProfiledScriptName(const void *key)
+{
+	const DFsScript *script = (const DFsScript *)key;
+	FString name;
+
+	if (script->scriptnum == -1) name = "levelscript";
+	else name.Format("script %d", script->scriptnum);
+	return name;
+}
+
 //==========================================================================
 //
 // run_script
@@ -211,6 +228,8 @@ void DFsScript::Serialize(FArchive &arc)
 
 void DFsScript::ParseScript(char *position)
 {
+	FScriptProfileScope profile(SPT_FraggleScript, this, ProfiledScriptName);
+
 	if (position == NULL) 
 	{
 		lastiftrue = false;
@@ -270,6 +270,50 @@ class CFsTerminator
 	int fill;
 };
 
+//==========================================================================
+//
+// Token cache
+//
+// Every statement is lexed only once. The result is stored by the
+// statement's offset in the script text, so control flow (sections,
+// labels, save points) keeps working with text positions while repeated
+// executions just copy the tokens back. The operator splits found by
+// EvaluateExpression are memoized here as well.
+//
+//==========================================================================
+
+struct FFsStatement
+{
+	int NumTokens;
+	int FirstToken;			// index into FFsTokenCache::TokenText
+	int Text;				// start of the token text in FFsTokenCache::Text
+	int TextLen;
+	int LineStart;			// offsets into the script text
+	int End;
+	DFsSection *Section;	// section of the brace ending this statement
+	int BraceType;
+};
+
+struct FFsTokenCache
+{
+	TMap<int, int> StatementMap;	// text offset -> index into Statements
+	TArray<FFsStatement> Statements;
+	TArray<int> TokenText;			// token text, relative to the statement's text
+	TArray<BYTE> TokenType;
+	TArray<char> Text;
+	TMap<unsigned int, unsigned int> Splits;
+
+	void Clear()
+	{
+		StatementMap.Clear();
+		Statements.Clear();
+		TokenText.Clear();
+		TokenType.Clear();
+		Text.Clear();
+		Splits.Clear();
+	}
+};
+
 //==========================================================================
 //
 // Scripts
@@ -315,6 +359,8 @@ public:
 	bool lastiftrue;     // haleyjd: whether last "if" statement was 
 	// true or false
 
+	FFsTokenCache tokencache;	// not serialized, rebuilt as the script runs
+
 	DFsScript();
 	void Destroy();
 	void Serialize(FArchive &ar);
@@ -380,6 +426,7 @@ struct FParser
 	char *Tokens[T_MAXTOKENS];
 	tokentype_t TokenType[T_MAXTOKENS];
 	int NumTokens;
+	int Statement;           // index into Script->tokencache, -1 if not cached
 	DFsScript *Script;       // the current script
 	DFsSection *Section;
 	DFsSection *PrevSection;
@@ -396,6 +443,7 @@ struct FParser
 		Rover = NULL;
 		Tokens[0] = new char[scr->len+32];	// 32 for safety. FS seems to need a few bytes more than the script's actual length.
 		NumTokens = 0;
+		Statement = -1;
 		Script = scr;
 		Section = PrevSection = NULL;
 		BraceType = 0;
@@ -408,6 +456,8 @@ struct FParser
 
 	void NextToken();
 	char *GetTokens(char *s);
+	char *GetCachedTokens(int index);
+	void CacheTokens(int offset);
 	void PrintTokens();
 	void ErrorMessage(FString msg);
 
@@ -417,6 +467,7 @@ struct FParser
 	int FindOperatorBackwards(int start, int stop, const char *value);
 	void SimpleEvaluate(svalue_t &, int n);
 	void PointlessBrackets(int *start, int *stop);
+	int SplitExpression(int &start, int &stop, int &n);
 	void EvaluateExpression(svalue_t &, int start, int stop);
 	void EvaluateFunction(svalue_t &, int start, int stop);
 
@@ -81,6 +81,9 @@
 #include "farchive.h"
 #include "r_renderer.h"
 #include "r_data/colormaps.h"
+#include "files.h"
+#include "m_threadpool.h"
+#include "stats.h"
 
 #include <zlib.h>
 
@@ -107,7 +110,13 @@ void	G_DoWorldDone (void);
 void	G_DoSaveGame (bool okForQuicksave, FString filename, const char *description);
 void	G_DoAutoSave ();
 
-void STAT_Write(FILE *file);
+static void G_DoDemoSeek ();
+static void G_TakeDemoKeyframe ();
+
+static int DemoTic;				// Tics played since the demo started
+static int DemoSeekTo = -1;
+
+void STAT_Write(FileWriter *file);
 void STAT_Read(PNGHandle *png);
 
 FIntCVar gameskill ("skill", 2, CVAR_SERVERINFO|CVAR_LATCH);
@@ -117,7 +126,9 @@ CVAR (Bool, storesavepic, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR (Bool, longsavemessages, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR (String, save_dir, "", CVAR_ARCHIVE|CVAR_GLOBALCONFIG);
 CVAR (Bool, cl_waitforsave, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
+CVAR (Bool, save_async, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 EXTERN_CVAR (Float, con_midtime);
+EXTERN_CVAR (Int, hub_compression);
 
 //==========================================================================
 //
@@ -150,6 +161,7 @@ bool 			usergame;				// ok to save / end game
 bool			insave;					// Game is saving - used to block exit commands
 
 bool			timingdemo; 			// if true, exit with report on completion 
+bool			playsimbench;			// -playsimbench is playing its demo
 bool 			nodrawers;				// for comparative timing purposes 
 bool 			noblit; 				// for comparative timing purposes 
 
@@ -1015,6 +1027,8 @@ void G_Ticker ()
 	int i;
 	gamestate_t	oldgamestate;
 
+	G_FinishSaveGame (false);
+
 	// do player reborns if needed
 	for (i = 0; i < MAXPLAYERS; i++)
 	{
@@ -1122,6 +1136,19 @@ void G_Ticker ()
 		}
 	}
 
+	if (demoplayback && gameaction == ga_nothing)
+	{
+		if (DemoSeekTo >= 0)
+		{
+			G_DoDemoSeek ();
+		}
+		// Keyframes would only skew the results of timedemo and -playsimbench.
+		if (gamestate == GS_LEVEL && !timingdemo && !playsimbench)
+		{
+			G_TakeDemoKeyframe ();
+		}
+	}
+
 	// get commands, check consistancy, and build new consistancy check
 	int buf = (gametic/ticdup)%BACKUPTICS;
 
@@ -1189,6 +1216,11 @@ void G_Ticker ()
 		}
 	}
 
+	if (demoplayback)
+	{
+		DemoTic++;
+	}
+
 	// do main actions
 	switch (gamestate)
 	{
@@ -1842,6 +1874,9 @@ void G_DoLoadGame ()
 	hidecon = gameaction == ga_loadgamehidecon;
 	gameaction = ga_nothing;
 
+	// Don't read a savegame that is still being written.
+	G_FinishSaveGame (true);
+
 	FILE *stdfile = fopen (savename.GetChars(), "rb");
 	if (stdfile == NULL)
 	{
@@ -2112,7 +2147,7 @@ void G_DoAutoSave ()
 }
 
 
-static void PutSaveWads (FILE *file)
+static void PutSaveWads (FileWriter *file)
 {
 	const char *name;
 
@@ -2128,7 +2163,7 @@ static void PutSaveWads (FILE *file)
 	}
 }
 
-static void PutSaveComment (FILE *file)
+static void PutSaveComment (FileWriter *file)
 {
 	char comment[256];
 	const char *readableTime;
@@ -2161,7 +2196,7 @@ static void PutSaveComment (FILE *file)
 	M_AppendPNGText (file, "Comment", comment);
 }
 
-static void PutSavePic (FILE *file, int width, int height)
+static void PutSavePic (FileWriter *file, int width, int height)
 {
 	if (width <= 0 || height <= 0 || !storesavepic)
 	{
@@ -2173,8 +2208,133 @@ static void PutSavePic (FILE *file, int width, int height)
 	}
 }
 
+//==========================================================================
+//
+// FSaveGameJob
+//
+// Everything that needs the game state is written into memory on the game
+// thread. The job then compresses the current level's snapshot, writes the
+// file and reads it back to check it, none of which needs to hold up play.
+//
+//==========================================================================
+
+struct FSaveGameJob : public FJob
+{
+	FString Filename;
+	FString Description;
+	bool OkForQuicksave;
+
+	BufferWriter Chunks;			// Everything except the snapshot and IEND
+	FCompressedMemFile *Snapshot;	// Deferred, so still uncompressed
+	DWORD SnapshotVer;
+	FString SnapshotMap;
+	bool SnapshotIsDefault;
+
+	bool Created;
+	bool Success;
+
+	FSaveGameJob() : Snapshot(NULL), Created(false), Success(false) {}
+	~FSaveGameJob() { if (Snapshot != NULL) delete Snapshot; }
+	void Run();
+};
+
+static FSaveGameJob *SaveJob;
+extern level_info_t TheDefaultLevelInfo;
+
+void FSaveGameJob::Run ()
+{
+	if (Snapshot != NULL)
+	{
+		Snapshot->Compress ();
+	}
+
+	FILE *stdfile = fopen (Filename, "wb");
+	if (stdfile == NULL)
+	{
+		return;
+	}
+	Created = true;
+
+	TArray<BYTE> &chunks = Chunks.GetArray();
+	FileWriter writer (stdfile);
+	bool written = writer.Write (&chunks[0], chunks.Size()) == chunks.Size();
+	if (Snapshot != NULL)
+	{
+		G_WriteSnapshotChunk (&writer, Snapshot, SnapshotVer, SnapshotMap, SnapshotIsDefault);
+	}
+	written &= M_FinishPNG (&writer);
+	written &= fclose (stdfile) == 0;
+
+	// Check whether the file is ok.
+	stdfile = fopen (Filename, "rb");
+	if (stdfile != NULL)
+	{
+		PNGHandle *pngh = M_VerifyPNG(stdfile);
+		if (pngh != NULL)
+		{
+			Success = written;
+			delete pngh;
+		}
+		fclose(stdfile);
+	}
+}
+
+//==========================================================================
+//
+// G_FinishSaveGame
+//
+// Reports the outcome of a savegame that was being written in the
+// background. If wait is false and it isn't done yet, this does nothing.
+//
+//==========================================================================
+
+void G_FinishSaveGame (bool wait)
+{
+	if (SaveJob == NULL)
+	{
+		return;
+	}
+	if (!SaveJob->IsDone())
+	{
+		if (!wait)
+		{
+			return;
+		}
+		ThreadPool.Wait (SaveJob);
+	}
+
+	FSaveGameJob *job = SaveJob;
+	SaveJob = NULL;
+
+	if (!job->Created)
+	{
+		Printf ("Could not create savegame '%s'\n", job->Filename.GetChars());
+	}
+	else
+	{
+		M_NotifyNewSave (job->Filename.GetChars(), job->Description, job->OkForQuicksave);
+
+		if (job->Success)
+		{
+			if (longsavemessages) Printf ("%s (%s)\n", GStrings("GGSAVED"), job->Filename.GetChars());
+			else Printf ("%s\n", GStrings("GGSAVED"));
+		}
+		else Printf(PRINT_HIGH, "Save failed\n");
+	}
+	delete job;
+}
+
+static void G_FinishSaveGameAtExit ()
+{
+	// The atterm chain runs before the pool's destructor shuts it down, so
+	// a save still being written is always waited for here, never dropped.
+	assert (SaveJob == NULL || SaveJob->IsDone() || ThreadPool.IsRunning());
+	G_FinishSaveGame (true);
+}
+
 void G_DoSaveGame (bool okForQuicksave, FString filename, const char *description)
 {
+	static bool registered;
 	char buf[100];
 
 	// Do not even try, if we're not in a level. (Can happen after
@@ -2189,21 +2349,28 @@ void G_DoSaveGame (bool okForQuicksave, FString filename, const char *descriptio
 		filename = G_BuildSaveName ("demosave.zds", -1);
 	}
 
+	// Only one save may be in flight, so an older one cannot finish
+	// after, and overwrite, a newer one to the same slot.
+	G_FinishSaveGame (true);
+
+	if (!registered)
+	{
+		registered = true;
+		atterm (G_FinishSaveGameAtExit);
+	}
+
 	if (cl_waitforsave)
 		I_FreezeTime(true);
 
 	insave = true;
-	G_SnapshotLevel ();
+	G_SnapshotLevel (true);
 
-	FILE *stdfile = fopen (filename, "wb");
+	FSaveGameJob *job = new FSaveGameJob;
+	FileWriter *stdfile = &job->Chunks;
 
-	if (stdfile == NULL)
-	{
-		Printf ("Could not create savegame '%s'\n", filename.GetChars());
-		insave = false;
-		I_FreezeTime(false);
-		return;
-	}
+	job->Filename = filename;
+	job->Description = description;
+	job->OkForQuicksave = okForQuicksave;
 
 	SaveVersion = SAVEVER;
 	PutSavePic (stdfile, SAVEPICWIDTH, SAVEPICHEIGHT);
@@ -2230,6 +2397,17 @@ void G_DoSaveGame (bool okForQuicksave, FString filename, const char *descriptio
 		M_AppendPNGChunk (stdfile, MAKE_ID('p','t','I','c'), (BYTE *)&time, 8);
 	}
 
+	// The current level's snapshot is compressed and written by the job.
+	// We don't need it here any longer once the save has been made.
+	if (level.info->snapshot != NULL)
+	{
+		job->Snapshot = level.info->snapshot;
+		job->SnapshotVer = level.info->snapshotVer;
+		job->SnapshotMap = level.info->MapName;
+		job->SnapshotIsDefault = level.info == &TheDefaultLevelInfo;
+		level.info->snapshot = NULL;
+	}
+
 	G_WriteSnapshots (stdfile);
 	STAT_Write(stdfile);
 	FRandom::StaticWriteRNGState (stdfile);
@@ -2243,42 +2421,17 @@ void G_DoSaveGame (bool okForQuicksave, FString filename, const char *descriptio
 		M_AppendPNGChunk (stdfile, MAKE_ID('s','n','X','t'), &next, 1);
 	}
 
-	M_FinishPNG (stdfile);
-	fclose (stdfile);
-
-	M_NotifyNewSave (filename.GetChars(), description, okForQuicksave);
-
-	// Check whether the file is ok.
-	bool success = false;
-	stdfile = fopen (filename.GetChars(), "rb");
-	if (stdfile != NULL)
-	{
-		PNGHandle *pngh = M_VerifyPNG(stdfile);
-		if (pngh != NULL)
-		{
-			success = true;
-			delete pngh;
-		}
-		fclose(stdfile);
-	}
-	if (success) 
-	{
-		if (longsavemessages) Printf ("%s (%s)\n", GStrings("GGSAVED"), filename.GetChars());
-		else Printf ("%s\n", GStrings("GGSAVED"));
-	}
-	else Printf(PRINT_HIGH, "Save failed\n");
-
 	BackupSaveName = filename;
 
-	// We don't need the snapshot any longer.
-	if (level.info->snapshot != NULL)
-	{
-		delete level.info->snapshot;
-		level.info->snapshot = NULL;
-	}
-		
 	insave = false;
 	I_FreezeTime(false);
+
+	SaveJob = job;
+	ThreadPool.Queue (job);
+	if (!save_async)
+	{
+		G_FinishSaveGame (true);
+	}
 }
 
 
@@ -2739,9 +2892,284 @@ void G_DoPlayDemo (void)
 
 		usergame = false;
 		demoplayback = true;
+		G_ClearDemoKeyframes ();
 	}
 }
 
+//==========================================================================
+//
+// Demo keyframes
+//
+// While a demo plays, the state of the level is kept in memory every
+// demo_keyframes seconds, so that demoseek can jump back to it. Only the
+// keyframes of the current level are kept, and once there are more than
+// demo_maxkeyframes, every other one is dropped and they are taken half as
+// often from then on. Seeking forward past the last
+// one runs the playsim without drawing anything until the target is
+// reached, which D_DoomLoop takes care of.
+//
+//==========================================================================
+
+CUSTOM_CVAR (Int, demo_keyframes, 10, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0)
+	{
+		self = 0;
+	}
+}
+
+CUSTOM_CVAR (Int, demo_maxkeyframes, 60, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 2)
+	{
+		self = 2;
+	}
+}
+
+struct FDemoKeyframe
+{
+	int Tic;
+	size_t DemoPos;
+	int LevelTime;
+	ticcmd_t Cmds[MAXPLAYERS];
+	SDWORD WorldVars[NUM_WORLDVARS];
+	SDWORD GlobalVars[NUM_GLOBALVARS];
+	FWorldGlobalArray WorldArrays[NUM_WORLDVARS];
+	FWorldGlobalArray GlobalArrays[NUM_GLOBALVARS];
+	FCompressedMemFile Snapshot;
+};
+
+static TDeletingArray<FDemoKeyframe *> DemoKeyframes;
+static int DemoKeyframeLevel;	// level.starttime of the level they were taken on
+static int DemoKeyframeThinned;	// times the keyframes have been thinned out on this level
+static int DemoFastForwardTo = -1;
+
+static void G_DeleteDemoKeyframes ()
+{
+	for (unsigned int i = 0; i < DemoKeyframes.Size(); ++i)
+	{
+		delete DemoKeyframes[i];
+	}
+	DemoKeyframes.Clear ();
+	DemoKeyframeThinned = 0;
+}
+
+void G_ClearDemoKeyframes ()
+{
+	G_DeleteDemoKeyframes ();
+	DemoTic = 0;
+	DemoSeekTo = DemoFastForwardTo = -1;
+}
+
+//==========================================================================
+//
+// G_TakeDemoKeyframe
+//
+// Called at the start of a tic, before its commands are read.
+//
+//==========================================================================
+
+static void G_TakeDemoKeyframe ()
+{
+	int i;
+
+	if (DemoKeyframes.Size() > 0 && DemoKeyframeLevel != level.starttime)
+	{
+		G_DeleteDemoKeyframes ();
+	}
+	if (demo_keyframes <= 0 ||
+		(DemoKeyframes.Size() > 0 && DemoTic - DemoKeyframes.Last()->Tic < (demo_keyframes * TICRATE) << DemoKeyframeThinned))
+	{
+		return;
+	}
+
+	FDemoKeyframe *key = new FDemoKeyframe;
+
+	key->Tic = DemoTic;
+	key->DemoPos = demo_p - demobuffer;
+	key->LevelTime = level.time;
+	for (i = 0; i < MAXPLAYERS; ++i)
+	{
+		key->Cmds[i] = players[i].cmd;
+	}
+	memcpy (key->WorldVars, ACS_WorldVars, sizeof(ACS_WorldVars));
+	memcpy (key->GlobalVars, ACS_GlobalVars, sizeof(ACS_GlobalVars));
+	for (i = 0; i < NUM_WORLDVARS; ++i)
+	{
+		key->WorldArrays[i] = ACS_WorldArrays[i];
+	}
+	for (i = 0; i < NUM_GLOBALVARS; ++i)
+	{
+		key->GlobalArrays[i] = ACS_GlobalArrays[i];
+	}
+
+	key->Snapshot.OpenStream (hub_compression);
+	{
+		FArchive arc (key->Snapshot);
+		SaveVersion = SAVEVER;
+		FRandom::StaticSerializeState (arc);
+		G_SerializeLevel (arc, false);
+		// ACS variables and the level refer to strings by their pool index.
+		GlobalACSStrings.WriteStrings (arc);
+	}
+	DemoKeyframeLevel = level.starttime;
+	DemoKeyframes.Push (key);
+
+	if (DemoKeyframes.Size() > (unsigned)*demo_maxkeyframes)
+	{
+		unsigned int kept = 0;
+		for (unsigned int j = 0; j < DemoKeyframes.Size(); ++j)
+		{
+			if (j & 1)
+			{
+				delete DemoKeyframes[j];
+			}
+			else
+			{
+				DemoKeyframes[kept++] = DemoKeyframes[j];
+			}
+		}
+		DemoKeyframes.Resize (kept);
+		if (DemoKeyframeThinned < 16)
+		{
+			DemoKeyframeThinned++;
+		}
+	}
+}
+
+//==========================================================================
+//
+// G_RestoreDemoKeyframe
+//
+//==========================================================================
+
+static void G_RestoreDemoKeyframe (FDemoKeyframe *key)
+{
+	int i;
+
+	// The level has moved on since the keyframe was taken, so anything the
+	// snapshot left out has to be put back first.
+	P_RestorePristineWorld ();
+	key->Snapshot.Reopen ();
+	{
+		FArchive arc (key->Snapshot);
+		SaveVersion = SAVEVER;
+		FRandom::StaticSerializeState (arc);
+		G_SerializeLevel (arc, false);
+		GlobalACSStrings.ReadStrings (arc);
+	}
+	G_ResetPlayerViews ();
+
+	DemoTic = key->Tic;
+	demo_p = demobuffer + key->DemoPos;
+	level.time = key->LevelTime;
+	for (i = 0; i < MAXPLAYERS; ++i)
+	{
+		players[i].cmd = key->Cmds[i];
+	}
+	memcpy (ACS_WorldVars, key->WorldVars, sizeof(ACS_WorldVars));
+	memcpy (ACS_GlobalVars, key->GlobalVars, sizeof(ACS_GlobalVars));
+	for (i = 0; i < NUM_WORLDVARS; ++i)
+	{
+		ACS_WorldArrays[i] = key->WorldArrays[i];
+	}
+	for (i = 0; i < NUM_GLOBALVARS; ++i)
+	{
+		ACS_GlobalArrays[i] = key->GlobalArrays[i];
+	}
+}
+
+//==========================================================================
+//
+// G_DoDemoSeek
+//
+//==========================================================================
+
+static void G_DoDemoSeek ()
+{
+	int target = DemoSeekTo;
+	FDemoKeyframe *key = NULL;
+
+	DemoSeekTo = -1;
+	if (gamestate == GS_LEVEL && DemoKeyframes.Size() > 0 && DemoKeyframeLevel == level.starttime)
+	{
+		for (unsigned int i = 0; i < DemoKeyframes.Size() && DemoKeyframes[i]->Tic <= target; ++i)
+		{
+			key = DemoKeyframes[i];
+		}
+		if (key == NULL && target < DemoTic)
+		{
+			Printf ("Cannot seek back past the start of this level.\n");
+			key = DemoKeyframes[0];
+		}
+		// Only go back if there is no other way, or if it saves time.
+		if (key != NULL && (target < DemoTic || key->Tic > DemoTic))
+		{
+			cycle_t time;
+
+			time.Reset();
+			time.Clock();
+			G_RestoreDemoKeyframe (key);
+			time.Unclock();
+			DPrintf ("Restored keyframe at %.1f seconds in %.2f ms\n", key->Tic / float(TICRATE), time.TimeMS());
+		}
+	}
+	else if (target < DemoTic)
+	{
+		Printf ("No keyframes to seek back to.\n");
+	}
+	if (target > DemoTic)
+	{
+		DemoFastForwardTo = target;
+	}
+}
+
+//==========================================================================
+//
+// G_DemoFastForwarding
+//
+// True while a seek still has to run the playsim to reach its target.
+//
+//==========================================================================
+
+bool G_DemoFastForwarding ()
+{
+	if (DemoFastForwardTo >= 0 && (!demoplayback || DemoTic >= DemoFastForwardTo))
+	{
+		DemoFastForwardTo = -1;
+	}
+	return DemoFastForwardTo >= 0;
+}
+
+//==========================================================================
+//
+// CCMD demoseek
+//
+// Seeks to a time in seconds since the demo started, or relative to the
+// current time if it starts with + or -.
+//
+//==========================================================================
+
+CCMD (demoseek)
+{
+	if (!demoplayback)
+	{
+		Printf ("Not playing a demo.\n");
+		return;
+	}
+	if (argv.argc() < 2)
+	{
+		Printf ("Usage: demoseek [+|-]<seconds>\n"
+				"At %.1f seconds, %u keyframes on this level\n",
+				DemoTic / float(TICRATE), DemoKeyframes.Size());
+		return;
+	}
+	const char *arg = argv[1];
+	int tics = int(atof (arg) * TICRATE);
+
+	DemoSeekTo = MAX (0, (*arg == '+' || *arg == '-') ? DemoTic + tics : tics);
+}
+
 //
 // G_TimeDemo
 //
@@ -2785,6 +3213,7 @@ bool G_CheckDemoStatus (void)
 		C_RestoreCVars ();		// [RH] Restore cvars demo might have changed
 		M_Free (demobuffer);
 		demobuffer = NULL;
+		G_ClearDemoKeyframes ();
 
 		P_SetupWeapons_ntohton();
 		demoplayback = false;
@@ -50,6 +50,9 @@ void G_DoLoadGame (void);
 // Called by M_Responder.
 void G_SaveGame (const char *filename, const char *description);
 
+// Reports on a savegame that is being written in the background.
+void G_FinishSaveGame (bool wait);
+
 // Only called by startup code.
 void G_RecordDemo (const char* name);
 
@@ -58,6 +61,8 @@ void G_BeginRecording (const char *startmap);
 void G_PlayDemo (char* name);
 void G_TimeDemo (const char* name);
 bool G_CheckDemoStatus (void);
+void G_ClearDemoKeyframes ();
+bool G_DemoFastForwarding ();
 
 void G_WorldDone (void);
 
@@ -166,7 +166,7 @@ static void G_SerializeHub(FArchive & arc)
 	else hubdata.Clear();
 }
 
-void G_WriteHubInfo (FILE *file)
+void G_WriteHubInfo (FileWriter *file)
 {
 	FPNGChunkArchive arc(file, HUBS_ID);
 	G_SerializeHub(arc);
@@ -87,6 +87,7 @@
 #include "gi.h"
 
 #include "g_hub.h"
+#include "stats.h"
 
 void STAT_StartNewGame(const char *lev);
 void STAT_ChangeLevel(const char *newl);
@@ -96,6 +97,25 @@ EXTERN_CVAR (Float, sv_gravity)
 EXTERN_CVAR (Float, sv_aircontrol)
 EXTERN_CVAR (Int, disableautosave)
 EXTERN_CVAR (String, playerclass)
+EXTERN_CVAR (Bool, showloadtimes)
+
+// zlib levels for level snapshots. Hub travel has to wait for its snapshot,
+// so it defaults to the fastest level. Savegames compress theirs on the
+// save thread and can afford to squeeze harder.
+CUSTOM_CVAR (Int, hub_compression, 1, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0)
+		self = 0;
+	else if (self > 9)
+		self = 9;
+}
+CUSTOM_CVAR (Int, save_compression, 6, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0)
+		self = 0;
+	else if (self > 9)
+		self = 9;
+}
 
 #define SNAP_ID			MAKE_ID('s','n','A','p')
 #define DSNP_ID			MAKE_ID('d','s','N','p')
@@ -1011,17 +1031,10 @@ void G_DoLoadLevel (int position, bool autosave)
 	}
 
 	level.starttime = gametic;
+	P_RecordPristineWorld ();
 	G_UnSnapshotLevel (!savegamerestore);	// [RH] Restore the state of the level.
 	G_FinishTravel ();
-	// For each player, if they are viewing through a player, make sure it is themselves.
-	for (int ii = 0; ii < MAXPLAYERS; ++ii)
-	{
-		if (playeringame[ii] && (players[ii].camera == NULL || players[ii].camera->player != NULL))
-		{
-			players[ii].camera = players[ii].mo;
-		}
-	}
-	StatusBar->AttachToPlayer (&players[consoleplayer]);
+	G_ResetPlayerViews ();
 	P_DoDeferedScripts ();	// [RH] Do script actions that were triggered on another map.
 	
 	if (demoplayback || oldgs == GS_STARTUP || oldgs == GS_TITLELEVEL)
@@ -1037,6 +1050,29 @@ void G_DoLoadLevel (int position, bool autosave)
 }
 
 
+//==========================================================================
+//
+// G_ResetPlayerViews
+//
+// For each player, if they are viewing through a player, make sure it is
+// themselves. Needed whenever the players have been restored from an
+// archive.
+//
+//==========================================================================
+
+void G_ResetPlayerViews ()
+{
+	for (int i = 0; i < MAXPLAYERS; ++i)
+	{
+		if (playeringame[i] && (players[i].camera == NULL || players[i].camera->player != NULL))
+		{
+			players[i].camera = players[i].mo;
+		}
+	}
+	StatusBar->AttachToPlayer (&players[consoleplayer]);
+}
+
+
 //==========================================================================
 //
 // G_WorldDone 
@@ -1641,25 +1677,57 @@ void G_SerializeLevel (FArchive &arc, bool hubLoad)
 
 //==========================================================================
 //
-// Archives the current level
+// Archives the current level. With deferred set, the snapshot is left
+// uncompressed so the savegame writer can compress it on another thread.
 //
 //==========================================================================
 
-void G_SnapshotLevel ()
+void G_SnapshotLevel (bool deferred)
 {
 	if (level.info->snapshot)
 		delete level.info->snapshot;
 
 	if (level.info->isValid())
 	{
+		cycle_t time;
+
+		time.Reset();
+		time.Clock();
 		level.info->snapshotVer = SAVEVER;
 		level.info->snapshot = new FCompressedMemFile;
-		level.info->snapshot->Open ();
+		if (deferred)
+		{
+			// The caller is responsible for calling Compress.
+			level.info->snapshot->OpenDeferred (save_compression);
+		}
+		else
+		{
+			level.info->snapshot->OpenStream (hub_compression);
+		}
 
 		FArchive arc (*level.info->snapshot);
 
 		SaveVersion = SAVEVER;
 		G_SerializeLevel (arc, false);
+		arc.Close ();
+		time.Unclock();
+
+		if (showloadtimes)
+		{
+			unsigned int comp, uncomp;
+
+			level.info->snapshot->GetSizes (comp, uncomp);
+			if (deferred)
+			{
+				Printf ("Snapshot of %s: %u bytes in %.3f ms\n",
+					level.MapName.GetChars(), uncomp, time.TimeMS());
+			}
+			else
+			{
+				Printf ("Snapshot of %s: %u bytes, %u compressed, in %.3f ms\n",
+					level.MapName.GetChars(), uncomp, comp, time.TimeMS());
+			}
+		}
 	}
 }
 
@@ -1677,6 +1745,10 @@ void G_UnSnapshotLevel (bool hubLoad)
 
 	if (level.info->isValid())
 	{
+		cycle_t time;
+
+		time.Reset();
+		time.Clock();
 		SaveVersion = level.info->snapshotVer;
 		level.info->snapshot->Reopen ();
 		FArchive arc (*level.info->snapshot);
@@ -1685,6 +1757,11 @@ void G_UnSnapshotLevel (bool hubLoad)
 		G_SerializeLevel (arc, hubLoad);
 		arc.Close ();
 		level.FromSnapshot = true;
+		time.Unclock();
+		if (showloadtimes)
+		{
+			Printf ("Restored snapshot of %s in %.3f ms\n", level.MapName.GetChars(), time.TimeMS());
+		}
 
 		TThinkerIterator<APlayerPawn> it;
 		APlayerPawn *pawn, *next;
@@ -1734,10 +1811,42 @@ static void writeSnapShot (FArchive &arc, level_info_t *i)
 
 //==========================================================================
 //
+// G_WriteSnapshotChunk
+//
+// Writes the same chunk as writeSnapShot for a snapshot that has been
+// detached from its level, without using FArchive. This is what allows
+// the savegame thread to write the current level's snapshot.
 //
 //==========================================================================
 
-void G_WriteSnapshots (FILE *file)
+void G_WriteSnapshotChunk (FileWriter *file, FCompressedMemFile *snapshot, DWORD snapshotver, const char *mapname, bool isdefault)
+{
+	FPNGChunkFile chunk (file, isdefault ? DSNP_ID : SNAP_ID);
+	DWORD ver = BigLong ((unsigned int)snapshotver);
+	DWORD len = (DWORD)strlen (mapname);
+	DWORD count = len + 1;
+
+	chunk.Write (&ver, 4);
+	// Same encoding as FArchive::WriteString
+	do
+	{
+		BYTE out = count & 0x7f;
+		if (count >= 0x80)
+			out |= 0x80;
+		chunk.Write (&out, 1);
+		count >>= 7;
+	} while (count);
+	chunk.Write (mapname, len);
+	snapshot->Serialize (chunk);
+	chunk.Close ();
+}
+
+//==========================================================================
+//
+//
+//==========================================================================
+
+void G_WriteSnapshots (FileWriter *file)
 {
 	unsigned int i;
 
@@ -1917,6 +2026,183 @@ void G_ReadSnapshots (PNGHandle *png)
 	png->File->ResetFilePtr();
 }
 
+//==========================================================================
+//
+// CCMD snapshotbench
+//
+// Snapshots the current level at the hub and savegame levels, streamed
+// and in one piece, and reports how big they are and how long it takes
+// to write and read them back. The level itself is not touched.
+//
+//==========================================================================
+
+CCMD(snapshotbench)
+{
+	static const struct { const char *Name; bool Stream; } modes[] =
+	{
+		{ "streamed", true },
+		{ "one piece", false },
+	};
+
+	if (gamestate != GS_LEVEL)
+	{
+		Printf ("You must be in a level to benchmark snapshots.\n");
+		return;
+	}
+	int passes = argv.argc() > 1 ? MAX (1, atoi (argv[1])) : 4;
+	int levels[2] = { hub_compression, save_compression };
+	int changedsectors, changedlines;
+
+	P_CountChangedWorld (changedsectors, changedlines);
+	Printf ("%d of %d sectors and %d of %d lines differ from the map\n",
+		changedsectors, numsectors, changedlines, numlines);
+
+	for (int l = 0; l < 2; ++l)
+	{
+		for (size_t m = 0; m < countof(modes); ++m)
+		{
+			cycle_t writetime, readtime;
+			unsigned int comp = 0, uncomp = 0;
+
+			writetime.Reset();
+			readtime.Reset();
+			for (int i = 0; i < passes; ++i)
+			{
+				FCompressedMemFile snapshot;
+
+				writetime.Clock();
+				if (modes[m].Stream)
+				{
+					snapshot.OpenStream (levels[l]);
+				}
+				else
+				{
+					snapshot.OpenDeferred (levels[l]);
+				}
+				{
+					FArchive arc (snapshot);
+					SaveVersion = SAVEVER;
+					G_SerializeLevel (arc, false);
+				}
+				snapshot.Compress ();
+				writetime.Unclock();
+				snapshot.GetSizes (comp, uncomp);
+
+				// Reading is the same for both, so this only measures
+				// decompression, not unarchiving.
+				BYTE buffer[4096];
+				readtime.Clock();
+				snapshot.Reopen ();
+				for (unsigned int left = uncomp; left > 0; )
+				{
+					unsigned int len = MIN<unsigned int> (left, sizeof(buffer));
+					snapshot.Read (buffer, len);
+					left -= len;
+				}
+				snapshot.Close ();
+				readtime.Unclock();
+			}
+			Printf ("level %d, %-9s: %u -> %u bytes, write %.2f ms, read %.2f ms\n",
+				levels[l], modes[m].Name, uncomp, comp,
+				writetime.TimeMS() / passes, readtime.TimeMS() / passes);
+		}
+	}
+}
+
+//==========================================================================
+//
+// CCMD serializebench
+//
+// Adds a number of actors to the current level, archives it the way a
+// savegame does and reads it back, and reports the speed of both. The
+// archive is not compressed so that only serialization is measured.
+// Reading replaces the level with what was just written, much like a
+// quickload, and the extra actors are removed again at the end.
+//
+//==========================================================================
+
+EXTERN_CVAR (Bool, nofilecompression)
+
+CCMD(serializebench)
+{
+	if (gamestate != GS_LEVEL || netgame || players[consoleplayer].mo == NULL)
+	{
+		Printf ("You must be in a single player level to benchmark serialization.\n");
+		return;
+	}
+	int count = argv.argc() > 1 ? MAX (0, atoi (argv[1])) : 30000;
+	int passes = argv.argc() > 2 ? MAX (1, atoi (argv[2])) : 4;
+	const char *classname = argv.argc() > 3 ? argv[3] : "MapSpot";
+	const PClass *type = PClass::FindClass (classname);
+
+	if (type == NULL || !type->IsDescendantOf (RUNTIME_CLASS(AActor)))
+	{
+		Printf ("%s is not an actor class.\n", classname);
+		return;
+	}
+	int tid = P_FindUniqueTID (0, 0);
+	if (tid == 0)
+	{
+		Printf ("No free TID for the benchmark actors.\n");
+		return;
+	}
+
+	AActor *mo = players[consoleplayer].mo;
+	for (int i = 0; i < count; ++i)
+	{
+		AActor *actor = Spawn (type, mo->Pos(), NO_REPLACE);
+		actor->tid = tid;
+		actor->AddToHash ();
+	}
+
+	bool nocompress = nofilecompression;
+	cycle_t writetime, readtime;
+	unsigned int comp, uncomp;
+
+	nofilecompression = true;
+	writetime.Reset();
+	readtime.Reset();
+	for (int i = 0; i < passes; ++i)
+	{
+		FCompressedMemFile snapshot;
+
+		snapshot.Open ();
+		writetime.Clock();
+		{
+			FArchive arc (snapshot);
+			SaveVersion = SAVEVER;
+			G_SerializeLevel (arc, false);
+		}
+		writetime.Unclock();
+		snapshot.GetSizes (comp, uncomp);
+
+		snapshot.Reopen ();
+		readtime.Clock();
+		{
+			FArchive arc (snapshot);
+			SaveVersion = SAVEVER;
+			G_SerializeLevel (arc, false);
+		}
+		readtime.Unclock();
+	}
+	nofilecompression = nocompress;
+
+	G_ResetPlayerViews ();
+
+	FActorIterator it (tid);
+	AActor *actor;
+	while ((actor = it.Next ()) != NULL)
+	{
+		actor->Destroy ();
+	}
+
+	double mb = uncomp / (1024. * 1024.);
+	double writems = writetime.TimeMS() / passes;
+	double readms = readtime.TimeMS() / passes;
+	Printf ("%d extra actors, %u bytes: write %.2f ms (%.1f MB/s), read %.2f ms (%.1f MB/s)\n",
+		count, uncomp, writems, mb * 1000 / writems, readms, mb * 1000 / readms);
+}
+
 //==========================================================================
 
 CCMD(listsnapshots)
@@ -1948,7 +2234,7 @@ static void writeDefereds (FArchive &arc, level_info_t *i)
 //
 //==========================================================================
 
-void P_WriteACSDefereds (FILE *file)
+void P_WriteACSDefereds (FileWriter *file)
 {
 	FPNGChunkArchive *arc = NULL;
 
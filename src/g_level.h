@@ -43,6 +43,8 @@
 struct level_info_t;
 struct cluster_info_t;
 class FScanner;
+class FileWriter;
+class FArchive;
 
 #if defined(_MSC_VER)
 #pragma data_seg(".yreg$u")
@@ -573,11 +575,14 @@ void G_ParseMapInfo(FString basemapinfo);
 
 void G_ClearSnapshots(void);
 void P_RemoveDefereds();
-void G_SnapshotLevel(void);
+void G_SnapshotLevel(bool deferred = false);
 void G_UnSnapshotLevel(bool keepPlayers);
+void G_SerializeLevel(FArchive &arc, bool hubLoad);
+void G_ResetPlayerViews();
 struct PNGHandle;
 void G_ReadSnapshots(PNGHandle* png);
-void G_WriteSnapshots(FILE* file);
+void G_WriteSnapshots(FileWriter *file);
+void G_WriteSnapshotChunk(FileWriter *file, FCompressedMemFile *snapshot, DWORD snapshotver, const char *mapname, bool isdefault);
 void G_ClearHubInfo();
 
 enum ESkillProperty
@@ -60,18 +60,18 @@ enum
 	SPR_NOCHANGE,	// Do not change sprite (frame change is okay)
 };
 
+extern bool ScriptProfiling;
+
 struct FState
 {
+	// Everything AActor::SetState needs comes first so that a state
+	// transition only touches the start of the state.
 	FState		*NextState;
 	actionf_p	ActionFunc;
 	WORD		sprite;
 	SWORD		Tics;
 	WORD		TicRange;
 	BYTE		Frame;
-	BYTE		DefineFlags;	// Unused byte so let's use it during state creation.
-	int			Misc1;			// Was changed to SBYTE, reverted to long for MBF compat
-	int			Misc2;			// Was changed to BYTE, reverted to long for MBF compat
-	short		Light;
 	BYTE		Fullbright:1;	// State is fullbright
 	BYTE		SameFrame:1;	// Ignore Frame (except when spawning actor)
 	BYTE		Fast:1;
@@ -80,6 +80,12 @@ struct FState
 	BYTE		Slow:1;			// Inverse of fast
 	int			ParameterIndex;
 
+	// Rarely used data
+	int			Misc1;			// Was changed to SBYTE, reverted to long for MBF compat
+	int			Misc2;			// Was changed to BYTE, reverted to long for MBF compat
+	short		Light;
+	BYTE		DefineFlags;	// Unused byte so let's use it during state creation.
+
 	inline int GetFrame() const
 	{
 		return Frame;
@@ -141,7 +147,14 @@ struct FState
 	{
 		if (ActionFunc != NULL)
 		{
-			ActionFunc(self, stateowner, this, ParameterIndex-1, statecall);
+			if (ScriptProfiling)
+			{
+				CallProfiledAction(self, stateowner, statecall);
+			}
+			else
+			{
+				ActionFunc(self, stateowner, this, ParameterIndex-1, statecall);
+			}
 			return true;
 		}
 		else
@@ -149,8 +162,11 @@ struct FState
 			return false;
 		}
 	}
+	void CallProfiledAction(AActor *self, AActor *stateowner, StateCallData *statecall);
 	static const PClass *StaticFindStateOwner (const FState *state);
 	static const PClass *StaticFindStateOwner (const FState *state, const FActorInfo *info);
+	static FState *StaticAllocate (int count);
+	static void StaticFreeAll ();
 	static FRandom pr_statetics;
 };
 
@@ -162,12 +178,25 @@ struct FStateLabel
 	FStateLabels *Children;
 };
 
+// One slot of the hash table that maps (label list, name) pairs of a class's
+// whole label tree to their labels.
+struct FStateLabelLookup
+{
+	const FStateLabels *Parent;
+	FName Label;
+	FStateLabel *Slot;
+};
+
 struct FStateLabels
 {
+	FStateLabelLookup *Lookup;	// only set for the top level list
+	unsigned int LookupMask;
 	int NumLabels;
 	FStateLabel Labels[1];
 
 	FStateLabel *FindLabel (FName label);
+	FStateLabel *LookupLabel (const FStateLabels *parent, FName label) const;
+	void BuildLookup();
 
 	void Destroy();	// intentionally not a destructor!
 };
@@ -597,10 +597,11 @@ void WritePNGfile (FILE *file, const BYTE *buffer, const PalEntry *palette,
 				   ESSType color_type, int width, int height, int pitch)
 {
 	char software[100];
+	FileWriter writer(file);
 	mysnprintf(software, countof(software), GAMENAME " %s", GetVersionString());
-	if (!M_CreatePNG (file, buffer, palette, color_type, width, height, pitch) ||
-		!M_AppendPNGText (file, "Software", software) ||
-		!M_FinishPNG (file))
+	if (!M_CreatePNG (&writer, buffer, palette, color_type, width, height, pitch) ||
+		!M_AppendPNGText (&writer, "Software", software) ||
+		!M_FinishPNG (&writer))
 	{
 		Printf ("Could not create screenshot.\n");
 	}
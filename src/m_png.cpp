@@ -49,6 +49,10 @@
 #include "m_png.h"
 #include "templates.h"
 #include "files.h"
+#include "x86.h"
+#include "c_dispatch.h"
+#include "w_wad.h"
+#include "stats.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -101,8 +105,8 @@ PNGHandle::~PNGHandle ()
 
 static inline void MakeChunk (void *where, DWORD type, size_t len);
 static inline void StuffPalette (const PalEntry *from, BYTE *to);
-static bool WriteIDAT (FILE *file, const BYTE *data, int len);
-static void UnfilterRow (int width, BYTE *dest, BYTE *stream, BYTE *prev, int bpp);
+static bool WriteIDAT (FileWriter *file, const BYTE *data, int len);
+static void UnfilterRow (int width, BYTE *dest, BYTE filter, BYTE *row, const BYTE *prev, int bpp);
 static void UnpackPixels (int width, int bytesPerRow, int bitdepth, const BYTE *rowin, BYTE *rowout, bool grayscale);
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
@@ -131,7 +135,7 @@ CVAR(Float, png_gamma, 0.f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 //
 //==========================================================================
 
-bool M_CreatePNG (FILE *file, const BYTE *buffer, const PalEntry *palette,
+bool M_CreatePNG (FileWriter *file, const BYTE *buffer, const PalEntry *palette,
 				  ESSType color_type, int width, int height, int pitch)
 {
 	BYTE work[8 +				// signature
@@ -171,7 +175,7 @@ bool M_CreatePNG (FILE *file, const BYTE *buffer, const PalEntry *palette,
 		work_len = sizeof(work) - (12+256*3);
 	}
 
-	if (fwrite (work, 1, work_len, file) != work_len)
+	if (file->Write (work, work_len) != work_len)
 		return false;
 
 	return M_SaveBitmap (buffer, color_type, width, height, pitch, file);
@@ -185,7 +189,7 @@ bool M_CreatePNG (FILE *file, const BYTE *buffer, const PalEntry *palette,
 //
 //==========================================================================
 
-bool M_CreateDummyPNG (FILE *file)
+bool M_CreateDummyPNG (FileWriter *file)
 {
 	static const BYTE dummyPNG[] =
 	{
@@ -195,7 +199,7 @@ bool M_CreateDummyPNG (FILE *file)
 		0,0,0,10,'I','D','A','T',
 		104,222,99,96,0,0,0,2,0,1,0x9f,0x65,0x0e,0x18
 	};
-	return fwrite (dummyPNG, 1, sizeof(dummyPNG), file) == sizeof(dummyPNG);
+	return file->Write (dummyPNG, sizeof(dummyPNG)) == sizeof(dummyPNG);
 }
 
 
@@ -207,10 +211,10 @@ bool M_CreateDummyPNG (FILE *file)
 //
 //==========================================================================
 
-bool M_FinishPNG (FILE *file)
+bool M_FinishPNG (FileWriter *file)
 {
 	static const BYTE iend[12] = { 0,0,0,0,73,69,78,68,174,66,96,130 };
-	return fwrite (iend, 1, 12, file) == 12;
+	return file->Write (iend, 12) == 12;
 }
 
 //==========================================================================
@@ -221,13 +225,13 @@ bool M_FinishPNG (FILE *file)
 //
 //==========================================================================
 
-bool M_AppendPNGChunk (FILE *file, DWORD chunkID, const BYTE *chunkData, DWORD len)
+bool M_AppendPNGChunk (FileWriter *file, DWORD chunkID, const BYTE *chunkData, DWORD len)
 {
 	DWORD head[2] = { BigLong((unsigned int)len), chunkID };
 	DWORD crc;
 
-	if (fwrite (head, 1, 8, file) == 8 &&
-		(len == 0 || fwrite (chunkData, 1, len, file) == len))
+	if (file->Write (head, 8) == 8 &&
+		(len == 0 || file->Write (chunkData, len) == len))
 	{
 		crc = CalcCRC32 ((BYTE *)&head[1], 4);
 		if (len != 0)
@@ -235,7 +239,7 @@ bool M_AppendPNGChunk (FILE *file, DWORD chunkID, const BYTE *chunkData, DWORD l
 			crc = AddCRC32 (crc, chunkData, len);
 		}
 		crc = BigLong((unsigned int)crc);
-		return fwrite (&crc, 1, 4, file) == 4;
+		return file->Write (&crc, 4) == 4;
 	}
 	return false;
 }
@@ -248,7 +252,7 @@ bool M_AppendPNGChunk (FILE *file, DWORD chunkID, const BYTE *chunkData, DWORD l
 //
 //==========================================================================
 
-bool M_AppendPNGText (FILE *file, const char *keyword, const char *text)
+bool M_AppendPNGText (FileWriter *file, const char *keyword, const char *text)
 {
 	struct { DWORD len, id; char key[80]; } head;
 	int len = (int)strlen (text);
@@ -261,8 +265,8 @@ bool M_AppendPNGText (FILE *file, const char *keyword, const char *text)
 	strncpy (head.key, keyword, keylen);
 	head.key[keylen] = 0;
 
-	if ((int)fwrite (&head, 1, keylen + 9, file) == keylen + 9 &&
-		(int)fwrite (text, 1, len, file) == len)
+	if ((int)file->Write (&head, keylen + 9) == keylen + 9 &&
+		(int)file->Write (text, len) == len)
 	{
 		crc = CalcCRC32 ((BYTE *)&head+4, keylen + 5);
 		if (len != 0)
@@ -270,7 +274,7 @@ bool M_AppendPNGText (FILE *file, const char *keyword, const char *text)
 			crc = AddCRC32 (crc, (BYTE *)text, len);
 		}
 		crc = BigLong((unsigned int)crc);
-		return fwrite (&crc, 1, 4, file) == 4;
+		return file->Write (&crc, 4) == 4;
 	}
 	return false;
 }
@@ -486,6 +490,8 @@ bool M_ReadIDAT (FileReader *file, BYTE *buffer, int width, int height, int pitc
 
 	Byte *inputLine, *prev, *curr, *adam7buff[3], *bufferend;
 	Byte chunkbuffer[4096];
+	Byte filter;
+	bool direct, infilter;
 	z_stream stream;
 	int err;
 	int i, pass, passbuff, passpitch, passwidth;
@@ -532,6 +538,8 @@ bool M_ReadIDAT (FileReader *file, BYTE *buffer, int width, int height, int pitc
 	curr = prev = 0;
 	passwidth = passpitch = bytesPerRowIn = 0;
 	passbuff = 0;
+	direct = infilter = false;
+	filter = 0;
 
 	while (err != Z_STREAM_END && pass < 8 - interlace)
 	{
@@ -566,8 +574,22 @@ bool M_ReadIDAT (FileReader *file, BYTE *buffer, int width, int height, int pitc
 			}
 			curr = buffer + rowoffset*pitch + coloffset*bytesPerPixel;
 			passpitch = pitch << passheightshift[pass];
-			stream.next_out = inputLine;
-			stream.avail_out = bytesPerRowIn + 1;
+
+			// The last two passes fill whole rows, so they can be inflated
+			// straight into the output buffer and unfiltered in place. The
+			// filter byte that precedes each row is read on its own.
+			direct = pass >= 6;
+			infilter = direct;
+			if (direct)
+			{
+				stream.next_out = &filter;
+				stream.avail_out = 1;
+			}
+			else
+			{
+				stream.next_out = inputLine;
+				stream.avail_out = bytesPerRowIn + 1;
+			}
 		}
 		if (stream.avail_in == 0 && chunklen > 0)
 		{
@@ -583,12 +605,18 @@ bool M_ReadIDAT (FileReader *file, BYTE *buffer, int width, int height, int pitc
 			return false;
 		}
 
-		if (stream.avail_out == 0)
+		if (stream.avail_out == 0 && infilter)
+		{
+			infilter = false;
+			stream.next_out = curr;
+			stream.avail_out = bytesPerRowIn;
+		}
+		else if (stream.avail_out == 0)
 		{
-			if (pass >= 6)
+			if (direct)
 			{
-				// Store pixels directly into the output buffer
-				UnfilterRow (bytesPerRowIn, curr, inputLine, prev, bytesPerPixel);
+				// The row is already in the output buffer
+				UnfilterRow (bytesPerRowIn, curr, filter, curr, prev, bytesPerPixel);
 				prev = curr;
 			}
 			else
@@ -598,7 +626,7 @@ bool M_ReadIDAT (FileReader *file, BYTE *buffer, int width, int height, int pitc
 				int colstep, x;
 
 				// Store pixels into a temporary buffer
-				UnfilterRow (bytesPerRowIn, adam7buff[passbuff], inputLine, prev, bytesPerPixel);
+				UnfilterRow (bytesPerRowIn, adam7buff[passbuff], inputLine[0], inputLine + 1, prev, bytesPerPixel);
 				prev = adam7buff[passbuff];
 				passbuff ^= 1;
 				in = prev;
@@ -656,8 +684,17 @@ bool M_ReadIDAT (FileReader *file, BYTE *buffer, int width, int height, int pitc
 				++pass;
 				initpass = true;
 			}
-			stream.next_out = inputLine;
-			stream.avail_out = bytesPerRowIn + 1;
+			else if (direct)
+			{
+				infilter = true;
+				stream.next_out = &filter;
+				stream.avail_out = 1;
+			}
+			else
+			{
+				stream.next_out = inputLine;
+				stream.avail_out = bytesPerRowIn + 1;
+			}
 		}
 
 		if (chunklen == 0 && !lastIDAT)
@@ -900,7 +937,7 @@ static int SelectFilter(Byte row[5][1 + MAXWIDTH*3], Byte prior[MAXWIDTH*3], int
 //
 //==========================================================================
 
-bool M_SaveBitmap(const BYTE *from, ESSType color_type, int width, int height, int pitch, FILE *file)
+bool M_SaveBitmap(const BYTE *from, ESSType color_type, int width, int height, int pitch, FileWriter *file)
 {
 #if USE_FILTER_HEURISTIC
 	Byte prior[MAXWIDTH*3];
@@ -1040,7 +1077,7 @@ bool M_SaveBitmap(const BYTE *from, ESSType color_type, int width, int height, i
 //
 //==========================================================================
 
-static bool WriteIDAT (FILE *file, const BYTE *data, int len)
+static bool WriteIDAT (FileWriter *file, const BYTE *data, int len)
 {
 	DWORD foo[2], crc;
 
@@ -1049,9 +1086,9 @@ static bool WriteIDAT (FILE *file, const BYTE *data, int len)
 	crc = CalcCRC32 ((BYTE *)&foo[1], 4);
 	crc = BigLong ((unsigned int)AddCRC32 (crc, data, len));
 
-	if (fwrite (foo, 1, 8, file) != 8 ||
-		fwrite (data, 1, len, file) != (size_t)len ||
-		fwrite (&crc, 1, 4, file) != 4)
+	if (file->Write (foo, 8) != 8 ||
+		file->Write (data, len) != (size_t)len ||
+		file->Write (&crc, 4) != 4)
 	{
 		return false;
 	}
@@ -1065,14 +1102,25 @@ static bool WriteIDAT (FILE *file, const BYTE *data, int len)
 // Unfilters the given row. Unknown filter types are silently ignored.
 // bpp is bytes per pixel, not bits per pixel.
 // width is in bytes, not pixels.
+// dest and row may point to the same buffer.
 //
 //==========================================================================
 
-void UnfilterRow (int width, BYTE *dest, BYTE *row, BYTE *prev, int bpp)
+static bool UseSSE2Unfilter = true;
+
+void UnfilterRow (int width, BYTE *dest, BYTE filter, BYTE *row, const BYTE *prev, int bpp)
 {
 	int x;
 
-	switch (*row++)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__i386__) || defined(__amd64__)
+	if (UseSSE2Unfilter && CPU.bSSE2 && filter >= 1 && filter <= 4 && (filter == 2 || bpp >= 3))
+	{
+		UnfilterRow_SSE2 (width, dest, filter, row, prev, bpp);
+		return;
+	}
+#endif
+
+	switch (filter)
 	{
 	case 1:		// Sub
 		x = bpp;
@@ -1138,7 +1186,10 @@ void UnfilterRow (int width, BYTE *dest, BYTE *row, BYTE *prev, int bpp)
 		break;
 
 	default:	// Treat everything else as filter type 0 (none)
-		memcpy (dest, row, width);
+		if (dest != row)
+		{
+			memcpy (dest, row, width);
+		}
 		break;
 	}
 }
@@ -1283,3 +1334,125 @@ static void UnpackPixels (int width, int bytesPerRow, int bitdepth, const BYTE *
 		}
 	}
 }
+
+//==========================================================================
+//
+// CCMD pngbench
+//
+// Decodes every PNG lump in memory and reports the throughput, once with
+// the scalar unfilter and once with the SSE2 one where available. Only the
+// inflate/unfilter stage is timed; lumps are read beforehand.
+//
+//==========================================================================
+
+CCMD (pngbench)
+{
+	struct BenchPNG
+	{
+		FMemLump Data;
+		DWORD IDATOffset, IDATLen;
+		int Width, Height;
+		BYTE BitDepth, ColorType, Interlace;
+	};
+	TArray<BenchPNG> pngs;
+	int passes = argv.argc() > 1 ? MAX(1, atoi(argv[1])) : 1;
+	size_t outbytes = 0;
+	size_t maxbuffer = 0;
+
+	for (int i = 0; i < Wads.GetNumLumps(); ++i)
+	{
+		DWORD sig[2];
+
+		if (Wads.LumpLength(i) < 8 + 8 + 13)
+		{
+			continue;
+		}
+		{
+			FWadLump lump = Wads.OpenLumpNum(i);
+			if (lump.Read(sig, 8) != 8 || sig[0] != MAKE_ID(137,'P','N','G') || sig[1] != MAKE_ID(13,10,26,10))
+			{
+				continue;
+			}
+		}
+
+		BenchPNG png;
+		png.Data = Wads.ReadLump(i);
+		const BYTE *data = (const BYTE *)png.Data.GetMem();
+		DWORD size = (DWORD)png.Data.GetSize();
+		DWORD pos = 8;
+
+		if (BigLong(*(DWORD *)(data + 8)) < 13 || *(DWORD *)(data + 12) != MAKE_ID('I','H','D','R'))
+		{
+			continue;
+		}
+		png.Width = BigLong(*(DWORD *)(data + 16));
+		png.Height = BigLong(*(DWORD *)(data + 20));
+		png.BitDepth = data[24];
+		png.ColorType = data[25];
+		png.Interlace = data[28];
+		png.IDATOffset = 0;
+		while (pos + 8 <= size)
+		{
+			DWORD len = BigLong(*(DWORD *)(data + pos));
+			if (*(DWORD *)(data + pos + 4) == MAKE_ID('I','D','A','T'))
+			{
+				png.IDATOffset = pos + 8;
+				png.IDATLen = MIN(len, size - pos - 8);
+				break;
+			}
+			if (size - pos < 12 || len > size - pos - 12)
+			{ // Truncated or corrupt chunk; adding its length could wrap around.
+				break;
+			}
+			pos += len + 12;
+		}
+		if (png.IDATOffset == 0 || png.Width <= 0 || png.Height <= 0 || png.BitDepth > 8)
+		{
+			continue;
+		}
+		int bytesPerPixel = png.ColorType == 2 ? 3 : png.ColorType == 4 ? 2 : png.ColorType == 6 ? 4 : 1;
+		size_t bytes = (size_t)png.Width * png.Height * bytesPerPixel;
+		outbytes += bytes;
+		maxbuffer = MAX(maxbuffer, bytes);
+		pngs.Push(png);
+	}
+
+	if (pngs.Size() == 0)
+	{
+		Printf ("No PNG lumps loaded\n");
+		return;
+	}
+
+	BYTE *buffer = new BYTE[maxbuffer];
+	for (int mode = 0; mode < 2; ++mode)
+	{
+		cycle_t clock;
+
+		UseSSE2Unfilter = mode != 0;
+		if (UseSSE2Unfilter && !CPU.bSSE2)
+		{
+			break;
+		}
+		clock.Reset();
+		for (int p = 0; p < passes; ++p)
+		{
+			for (unsigned i = 0; i < pngs.Size(); ++i)
+			{
+				BenchPNG &png = pngs[i];
+				int bytesPerPixel = png.ColorType == 2 ? 3 : png.ColorType == 4 ? 2 : png.ColorType == 6 ? 4 : 1;
+				MemoryReader lump((const char *)png.Data.GetMem(), (long)png.Data.GetSize());
+
+				lump.Seek (png.IDATOffset, SEEK_SET);
+				clock.Clock();
+				M_ReadIDAT (&lump, buffer, png.Width, png.Height, png.Width * bytesPerPixel,
+					png.BitDepth, png.ColorType, png.Interlace, png.IDATLen);
+				clock.Unclock();
+			}
+		}
+		double ms = clock.TimeMS();
+		Printf ("%s: %u PNGs x %d, %.2f ms, %.1f MB/s\n", mode ? "SSE2" : "scalar", pngs.Size(), passes,
+			ms, ms > 0 ? double(outbytes) * passes / (1024*1024) / (ms / 1000) : 0.);
+	}
+	UseSSE2Unfilter = true;
+	delete[] buffer;
+}
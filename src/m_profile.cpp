@@ -0,0 +1,698 @@
+/*
+** m_profile.cpp
+** Hierarchical scope timer for startup and level loading, and the
+** scripting profiler
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 RZDoom contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** The profiler is enabled with -loadprofile <file> (nested JSON report) or
+** -loadtrace <file> (Chrome trace event format, viewable in about:tracing
+** or Perfetto). Both files are written when the program exits, or on demand
+** with the dumploadprofile console command.
+**
+** The scripting profiler is controlled with the scriptprofile console
+** command and shown with "stat scripts".
+*/
+
+#include "doomtype.h"
+#include "m_profile.h"
+#include "m_argv.h"
+#include "stats.h"
+#include "i_system.h"
+#include "c_dispatch.h"
+#include "version.h"
+#include "v_text.h"
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+FScopeProfiler LoadProfiler;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static FString LoadProfileFile;
+static FString LoadTraceFile;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// FScopeProfiler Constructor
+//
+//==========================================================================
+
+FScopeProfiler::FScopeProfiler()
+{
+	Epoch = 0;
+	Dropped = 0;
+	PhaseScope = -1;
+	Enabled = false;
+}
+
+//==========================================================================
+//
+// CurrentMS
+//
+// cycle_t has no notion of absolute time, but unclocking a reset counter
+// yields the platform timer's current value, which is all we need.
+//
+//==========================================================================
+
+static double CurrentMS()
+{
+	cycle_t clock;
+	clock.Reset();
+	clock.Unclock();
+	return clock.TimeMS();
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: Now
+//
+//==========================================================================
+
+double FScopeProfiler::Now() const
+{
+	return CurrentMS() - Epoch;
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: Enable
+//
+//==========================================================================
+
+void FScopeProfiler::Enable()
+{
+	if (!Enabled)
+	{
+		Epoch = 0;
+		Epoch = Now();
+		Enabled = true;
+	}
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: Begin
+//
+//==========================================================================
+
+int FScopeProfiler::Begin(const char *name)
+{
+	if (!Enabled)
+	{
+		return -1;
+	}
+	if (Events.Size() >= MAX_EVENTS)
+	{
+		Dropped++;
+		return -1;
+	}
+	FEvent ev;
+	ev.Name = name;
+	ev.Depth = OpenStack.Size();
+	ev.Duration = -1;
+	ev.Start = Now();
+	int scope = Events.Push(ev);
+	OpenStack.Push(scope);
+	return scope;
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: End
+//
+// Any scopes still open inside the one being ended are closed along with
+// it. Ending a scope that has already been closed that way does nothing.
+//
+//==========================================================================
+
+void FScopeProfiler::End(int scope)
+{
+	if (scope < 0 || !Enabled)
+	{
+		return;
+	}
+	for (int i = OpenStack.Size() - 1; i >= 0; --i)
+	{
+		if (OpenStack[i] == scope)
+		{
+			double now = Now();
+			while (OpenStack.Size() > unsigned(i))
+			{
+				int closing;
+				OpenStack.Pop(closing);
+				Events[closing].Duration = now - Events[closing].Start;
+			}
+			return;
+		}
+	}
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: Phase
+//
+//==========================================================================
+
+void FScopeProfiler::Phase(const char *name)
+{
+	End(PhaseScope);
+	PhaseScope = name != NULL ? Begin(name) : -1;
+}
+
+//==========================================================================
+//
+// WriteJSONString
+//
+//==========================================================================
+
+static void WriteJSONString(FILE *file, const char *str)
+{
+	fputc('"', file);
+	for (; *str != 0; ++str)
+	{
+		unsigned char c = *str;
+		if (c == '"' || c == '\\')
+		{
+			fprintf(file, "\\%c", c);
+		}
+		else if (c < 0x20)
+		{
+			fprintf(file, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+//==========================================================================
+//
+// WriteIndent
+//
+//==========================================================================
+
+static void WriteIndent(FILE *file, int depth)
+{
+	for (int i = 0; i < depth; ++i)
+	{
+		fputc('\t', file);
+	}
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: WriteJSON
+//
+// Events are stored in the order they began, so each event's children are
+// the run of deeper events that directly follow it.
+//
+//==========================================================================
+
+void FScopeProfiler::WriteJSON(FILE *file) const
+{
+	double now = Now();
+	int depth = -1;
+
+	fprintf(file, "{\n\t\"version\": ");
+	WriteJSONString(file, GetVersionString());
+	fprintf(file, ",\n\t\"total_ms\": %.4f,\n\t\"dropped_events\": %u,\n\t\"events\": [", now, Dropped);
+	for (unsigned i = 0; i < Events.Size(); ++i)
+	{
+		const FEvent &ev = Events[i];
+		int indent = ev.Depth * 2 + 2;
+
+		for (; depth >= ev.Depth; --depth)
+		{
+			fprintf(file, " ]\n");
+			WriteIndent(file, depth * 2 + 2);
+			fputc('}', file);
+		}
+		if (i > 0 && Events[i-1].Depth >= ev.Depth)
+		{
+			fputc(',', file);
+		}
+		fputc('\n', file);
+		WriteIndent(file, indent);
+		fprintf(file, "{\n");
+		WriteIndent(file, indent + 1);
+		fprintf(file, "\"name\": ");
+		WriteJSONString(file, ev.Name);
+		fprintf(file, ",\n");
+		WriteIndent(file, indent + 1);
+		fprintf(file, "\"start_ms\": %.4f,\n", ev.Start);
+		WriteIndent(file, indent + 1);
+		fprintf(file, "\"duration_ms\": %.4f,\n", ev.Duration >= 0 ? ev.Duration : now - ev.Start);
+		WriteIndent(file, indent + 1);
+		fprintf(file, "\"children\": [");
+		depth = ev.Depth;
+	}
+	for (; depth >= 0; --depth)
+	{
+		fprintf(file, " ]\n");
+		WriteIndent(file, depth * 2 + 2);
+		fputc('}', file);
+	}
+	fprintf(file, "\n\t]\n}\n");
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: WriteChromeTrace
+//
+// Writes complete ("X") events, which the trace viewers nest by time.
+//
+//==========================================================================
+
+void FScopeProfiler::WriteChromeTrace(FILE *file) const
+{
+	double now = Now();
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (unsigned i = 0; i < Events.Size(); ++i)
+	{
+		const FEvent &ev = Events[i];
+		double duration = ev.Duration >= 0 ? ev.Duration : now - ev.Start;
+
+		fprintf(file, "{\"name\":");
+		WriteJSONString(file, ev.Name);
+		fprintf(file, ",\"cat\":\"load\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+			ev.Start * 1000, duration * 1000, i + 1 < Events.Size() ? "," : "");
+	}
+	fprintf(file, "],\"otherData\":{\"dropped_events\":\"%u\"}}\n", Dropped);
+}
+
+//==========================================================================
+//
+// FScopeProfiler :: Dump
+//
+//==========================================================================
+
+bool FScopeProfiler::Dump(const char *filename, bool chrometrace) const
+{
+	FILE *file = fopen(filename, "w");
+	if (file == NULL)
+	{
+		Printf("Could not write load profile to %s\n", filename);
+		return false;
+	}
+	if (chrometrace)
+	{
+		WriteChromeTrace(file);
+	}
+	else
+	{
+		WriteJSON(file);
+	}
+	fclose(file);
+	if (Dropped > 0)
+	{
+		Printf("Load profile is missing %u scopes past the limit of %d\n", Dropped, MAX_EVENTS);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// M_DumpLoadProfile
+//
+//==========================================================================
+
+static void M_DumpLoadProfile()
+{
+	if (LoadProfileFile.IsNotEmpty())
+	{
+		LoadProfiler.Dump(LoadProfileFile, false);
+	}
+	if (LoadTraceFile.IsNotEmpty())
+	{
+		LoadProfiler.Dump(LoadTraceFile, true);
+	}
+}
+
+//==========================================================================
+//
+// M_InitLoadProfiler
+//
+// Called at the very start of D_DoomMain so that WAD loading is included.
+//
+//==========================================================================
+
+void M_InitLoadProfiler()
+{
+	LoadProfileFile = Args->CheckValue("-loadprofile");
+	LoadTraceFile = Args->CheckValue("-loadtrace");
+	if (LoadProfileFile.IsNotEmpty() || LoadTraceFile.IsNotEmpty())
+	{
+		LoadProfiler.Enable();
+		atterm(M_DumpLoadProfile);
+	}
+}
+
+//==========================================================================
+//
+// CCMD dumploadprofile
+//
+//==========================================================================
+
+CCMD(dumploadprofile)
+{
+	if (!LoadProfiler.IsEnabled())
+	{
+		Printf("Load profiling is not active. Start with -loadprofile or -loadtrace.\n");
+		return;
+	}
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: dumploadprofile <filename> [chrome]\n");
+		return;
+	}
+	bool chrome = argv.argc() > 2 && !stricmp(argv[2], "chrome");
+	if (LoadProfiler.Dump(argv[1], chrome))
+	{
+		Printf("Load profile written to %s\n", argv[1]);
+	}
+}
+
+//==========================================================================
+//
+// Scripting profiler
+//
+//==========================================================================
+
+bool ScriptProfiling;
+FScriptProfiler ScriptProfiler;
+
+static const char *const ScriptProfileTypeNames[NUM_SCRIPT_PROFILE_TYPES] =
+{
+	"ACS", "ACSFunc", "Action", "State", "FraggleScript"
+};
+
+FScriptProfiler::FScriptProfiler()
+{
+	NextHandle = 1;
+}
+
+void FScriptProfiler::Enable(bool on)
+{
+	ScriptProfiling = on;
+}
+
+void FScriptProfiler::Clear()
+{
+	Entries.Clear();
+	Frames.Clear();
+	Names.Clear();
+	NewLevel();
+}
+
+void FScriptProfiler::NewLevel()
+{
+	for (int i = 0; i < NUM_SCRIPT_PROFILE_TYPES; i++)
+	{
+		Keys[i].Clear();
+	}
+}
+
+//==========================================================================
+//
+// FScriptProfiler :: Find
+//
+// Returns the entry for a piece of script code. The name is only
+// generated the first time the code runs on a level.
+//
+//==========================================================================
+
+int FScriptProfiler::Find(int type, const void *key, NameFunc namer)
+{
+	int *entry = Keys[type].CheckKey(key);
+	if (entry != NULL)
+	{
+		return *entry;
+	}
+
+	FString name;
+	name << ScriptProfileTypeNames[type] << ' ' << namer(key);
+
+	int *named = Names.CheckKey(name);
+	int index;
+	if (named != NULL)
+	{
+		index = *named;
+	}
+	else
+	{
+		FEntry newentry;
+		newentry.Name = name;
+		newentry.Type = type;
+		newentry.Calls = 0;
+		newentry.Total = newentry.Self = newentry.Max = 0;
+		index = Entries.Push(newentry);
+		Names[name] = index;
+	}
+	Keys[type][key] = index;
+	return index;
+}
+
+//==========================================================================
+//
+// FScriptProfiler :: Enter
+//
+//==========================================================================
+
+unsigned int FScriptProfiler::Enter(int entry)
+{
+	FFrame frame;
+
+	frame.Entry = entry;
+	frame.Handle = NextHandle;
+	frame.Nested = 0;
+	frame.Start = CurrentMS();
+	Frames.Push(frame);
+	if (++NextHandle == 0)
+	{
+		NextHandle = 1;
+	}
+	return frame.Handle;
+}
+
+//==========================================================================
+//
+// FScriptProfiler :: Leave
+//
+// Calls still open inside the one being left (e.g. an ACS function whose
+// script was terminated) end along with it. Leaving a call that has already
+// ended that way, or was dropped by Clear(), does nothing.
+//
+//==========================================================================
+
+void FScriptProfiler::Leave(unsigned int handle)
+{
+	for (int i = Frames.Size() - 1; i >= 0; --i)
+	{
+		if (Frames[i].Handle == handle)
+		{
+			double now = CurrentMS();
+			while (Frames.Size() > unsigned(i))
+			{
+				FFrame frame;
+				Frames.Pop(frame);
+
+				double ms = now - frame.Start;
+				FEntry &e = Entries[frame.Entry];
+				e.Calls++;
+				e.Total += ms;
+				e.Self += ms - frame.Nested;
+				if (ms > e.Max) e.Max = ms;
+				if (Frames.Size() > 0)
+				{
+					Frames.Last().Nested += ms;
+				}
+			}
+			return;
+		}
+	}
+}
+
+//==========================================================================
+//
+// FScriptProfiler :: Print
+//
+//==========================================================================
+
+static int STACK_ARGS SortBySelf(const void *a_, const void *b_)
+{
+	const FScriptProfiler::FEntry *a = *(const FScriptProfiler::FEntry **)a_;
+	const FScriptProfiler::FEntry *b = *(const FScriptProfiler::FEntry **)b_;
+	return a->Self < b->Self ? 1 : a->Self > b->Self ? -1 : 0;
+}
+
+void FScriptProfiler::Print(int limit)
+{
+	TArray<FEntry *> sorted(Entries.Size());
+
+	for (unsigned i = 0; i < Entries.Size(); i++)
+	{
+		sorted.Push(&Entries[i]);
+	}
+	if (sorted.Size() == 0)
+	{
+		Printf("No script profile data\n");
+		return;
+	}
+	qsort(&sorted[0], sorted.Size(), sizeof(sorted[0]), SortBySelf);
+
+	Printf(TEXTCOLOR_YELLOW "%-40s %8s %10s %10s %8s %8s\n", "Name", "Calls", "Self ms", "Total ms", "Avg ms", "Max ms");
+	for (unsigned i = 0; i < sorted.Size() && (limit <= 0 || (int)i < limit); i++)
+	{
+		FEntry *e = sorted[i];
+		Printf("%-40s %8u %10.3f %10.3f %8.4f %8.4f\n", e->Name.GetChars(), e->Calls, e->Self, e->Total,
+			e->Calls > 0 ? e->Total / e->Calls : 0., e->Max);
+	}
+}
+
+//==========================================================================
+//
+// FScriptProfiler :: DumpCSV
+//
+//==========================================================================
+
+bool FScriptProfiler::DumpCSV(const char *filename)
+{
+	FILE *f = fopen(filename, "w");
+	if (f == NULL)
+	{
+		Printf("Could not open %s\n", filename);
+		return false;
+	}
+	fprintf(f, "type,name,calls,self_ms,total_ms,avg_ms,max_ms\n");
+	for (unsigned i = 0; i < Entries.Size(); i++)
+	{
+		const FEntry &e = Entries[i];
+		FString name = e.Name.Mid(strlen(ScriptProfileTypeNames[e.Type]) + 1);
+		name.Substitute("\"", "\"\"");
+		fprintf(f, "%s,\"%s\",%u,%.4f,%.4f,%.6f,%.4f\n", ScriptProfileTypeNames[e.Type], name.GetChars(),
+			e.Calls, e.Self, e.Total, e.Calls > 0 ? e.Total / e.Calls : 0., e.Max);
+	}
+	fclose(f);
+	return true;
+}
+
+//==========================================================================
+//
+// FScriptProfiler :: GetStats
+//
+// The per-engine figures add up self times, so script code run from other
+// script code is not counted twice. ACS functions are included with ACS.
+//
+//==========================================================================
+
+FString FScriptProfiler::GetStats()
+{
+	double self[NUM_SCRIPT_PROFILE_TYPES] = { 0 };
+	unsigned int calls[NUM_SCRIPT_PROFILE_TYPES] = { 0 };
+	const FEntry *top = NULL;
+	FString out;
+
+	for (unsigned i = 0; i < Entries.Size(); i++)
+	{
+		const FEntry &e = Entries[i];
+		self[e.Type] += e.Self;
+		calls[e.Type] += e.Calls;
+		if (e.Type != SPT_State && (top == NULL || e.Self > top->Self))
+		{
+			top = &e;
+		}
+	}
+	// States only show where the action functions were called from,
+	// so they are not added up.
+	out.Format("ACS %u/%.2f ms, DECORATE %u/%.2f ms, FS %u/%.2f ms (calls/self)",
+		calls[SPT_ACS], self[SPT_ACS] + self[SPT_ACSFunction], calls[SPT_Action], self[SPT_Action],
+		calls[SPT_FraggleScript], self[SPT_FraggleScript]);
+	if (!ScriptProfiling)
+	{
+		out += " [off]";
+	}
+	if (top != NULL)
+	{
+		out.AppendFormat("\nTop: %s, %u calls, %.2f ms self, %.2f ms total", top->Name.GetChars(), top->Calls, top->Self, top->Total);
+	}
+	return out;
+}
+
+ADD_STAT(scripts)
+{
+	return ScriptProfiler.GetStats();
+}
+
+//==========================================================================
+//
+// CCMD scriptprofile
+//
+//==========================================================================
+
+CCMD(scriptprofile)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: scriptprofile on|off|clear|csv <filename>|<limit>\n");
+		return;
+	}
+	if (!stricmp(argv[1], "on"))
+	{
+		ScriptProfiler.Enable(true);
+	}
+	else if (!stricmp(argv[1], "off"))
+	{
+		ScriptProfiler.Enable(false);
+	}
+	else if (!stricmp(argv[1], "clear"))
+	{
+		ScriptProfiler.Clear();
+	}
+	else if (!stricmp(argv[1], "csv"))
+	{
+		if (argv.argc() < 3)
+		{
+			Printf("Usage: scriptprofile csv <filename>\n");
+		}
+		else if (ScriptProfiler.DumpCSV(argv[2]))
+		{
+			Printf("Script profile written to %s\n", argv[2]);
+		}
+	}
+	else
+	{
+		ScriptProfiler.Print(atoi(argv[1]));
+	}
+}
@@ -0,0 +1,234 @@
+/*
+** m_profile.h
+** Hierarchical scope timer for startup and level loading, and the
+** scripting profiler
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 RZDoom contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#ifndef __M_PROFILE_H__
+#define __M_PROFILE_H__
+
+#include <stdio.h>
+#include "tarray.h"
+#include "zstring.h"
+#include "stats.h"
+
+//==========================================================================
+//
+// FScopeProfiler
+//
+// Records nested, named time spans. Scopes are identified by the index
+// Begin() returns so that a scope which outlives its parent (e.g. a script
+// scanner that is never explicitly closed) cannot corrupt the nesting of
+// the scopes that follow it. When the profiler is disabled, Begin() returns
+// -1 and End() ignores it, so the calls may be left in place permanently.
+// The same happens once MAX_EVENTS scopes have been recorded; those that
+// are dropped after that are only counted.
+//
+//==========================================================================
+
+class FScopeProfiler
+{
+public:
+	struct FEvent
+	{
+		FString Name;
+		double Start;		// ms since the profiler was enabled
+		double Duration;	// ms, negative while the scope is still open
+		int Depth;
+	};
+
+	enum { MAX_EVENTS = 262144 };
+
+	FScopeProfiler();
+
+	void Enable();
+	bool IsEnabled() const { return Enabled; }
+
+	int Begin(const char *name);
+	void End(int scope);
+
+	// Ends the current top-level phase (if any) and starts a new one.
+	// Passing NULL only ends the current phase.
+	void Phase(const char *name);
+
+	const TArray<FEvent> &GetEvents() const { return Events; }
+	unsigned int GetDroppedEvents() const { return Dropped; }
+
+	void WriteJSON(FILE *file) const;
+	void WriteChromeTrace(FILE *file) const;
+	bool Dump(const char *filename, bool chrometrace) const;
+
+private:
+	double Now() const;
+
+	TArray<FEvent> Events;
+	TArray<int> OpenStack;
+	double Epoch;
+	unsigned int Dropped;
+	int PhaseScope;
+	bool Enabled;
+};
+
+extern FScopeProfiler LoadProfiler;
+
+//==========================================================================
+//
+// FProfileScope
+//
+// Times the enclosing block with LoadProfiler.
+//
+//==========================================================================
+
+class FProfileScope
+{
+public:
+	FProfileScope(const char *name)
+	{
+		Scope = LoadProfiler.Begin(name);
+	}
+	~FProfileScope()
+	{
+		LoadProfiler.End(Scope);
+	}
+
+private:
+	int Scope;
+};
+
+void M_InitLoadProfiler();
+
+//==========================================================================
+//
+// FScriptProfiler
+//
+// Counts the calls of script code: ACS scripts and functions, DECORATE
+// action functions, the states calling them and FraggleScript scripts.
+// Each entry keeps both its total time and its self time, which leaves out
+// any script code it ran in turn (an ACS function, ACS_ExecuteWithResult
+// from DECORATE, a nested FraggleScript), so self times can be added up
+// without counting anything twice. Code is identified by a pointer that is
+// only valid during the current level, so the pointers are forgotten by
+// NewLevel() and the numbers are accumulated by name.
+//
+//==========================================================================
+
+enum EScriptProfileType
+{
+	SPT_ACS,
+	SPT_ACSFunction,
+	SPT_Action,
+	SPT_State,
+	SPT_FraggleScript,
+
+	NUM_SCRIPT_PROFILE_TYPES
+};
+
+extern bool ScriptProfiling;
+
+class FScriptProfiler
+{
+public:
+	typedef FString (*NameFunc)(const void *key);
+
+	struct FEntry
+	{
+		FString Name;
+		int Type;
+		unsigned int Calls;
+		double Total;		// ms, including nested script code
+		double Self;		// ms, excluding it
+		double Max;
+	};
+
+	FScriptProfiler();
+
+	void Enable(bool on);
+	void Clear();
+	void NewLevel();
+
+	int Find(int type, const void *key, NameFunc namer);
+
+	// Enter() starts timing a call and returns a handle for Leave(), which
+	// also ends any calls made inside it that are still open.
+	unsigned int Enter(int entry);
+	void Leave(unsigned int frame);
+
+	void Print(int limit);
+	bool DumpCSV(const char *filename);
+	FString GetStats();
+
+private:
+	struct FFrame
+	{
+		int Entry;
+		unsigned int Handle;
+		double Start;
+		double Nested;		// ms spent in calls made from this one
+	};
+
+	TArray<FEntry> Entries;
+	TArray<FFrame> Frames;
+	TMap<FString, int> Names;
+	TMap<const void *, int> Keys[NUM_SCRIPT_PROFILE_TYPES];
+	unsigned int NextHandle;
+};
+
+extern FScriptProfiler ScriptProfiler;
+
+//==========================================================================
+//
+// FScriptProfileScope
+//
+// Times the enclosing block as a call of the given script code.
+//
+//==========================================================================
+
+class FScriptProfileScope
+{
+public:
+	FScriptProfileScope(int type, const void *key, FScriptProfiler::NameFunc namer)
+	{
+		Frame = ScriptProfiling && key != NULL ? ScriptProfiler.Enter(ScriptProfiler.Find(type, key, namer)) : 0;
+	}
+	~FScriptProfileScope()
+	{
+		if (Frame != 0)
+		{
+			ScriptProfiler.Leave(Frame);
+		}
+	}
+
+private:
+	unsigned int Frame;
+};
+
+#endif //__M_PROFILE_H__
@@ -291,7 +291,7 @@ DWORD FRandom::StaticSumSeeds ()
 //
 //==========================================================================
 
-void FRandom::StaticWriteRNGState (FILE *file)
+void FRandom::StaticWriteRNGState (FileWriter *file)
 {
 	FRandom *rng;
 	FPNGChunkArchive arc (file, RAND_ID);
@@ -369,6 +369,29 @@ void FRandom::StaticReadRNGState (PNGHandle *png)
 	}
 }
 
+//==========================================================================
+//
+// FRandom :: StaticSerializeState
+//
+// Saves or restores every RNG, named or not. Unlike the savegame version,
+// this relies on the RNG list being the same, so it is only good for
+// archives that never leave the running game, such as demo keyframes.
+//
+//==========================================================================
+
+void FRandom::StaticSerializeState (FArchive &arc)
+{
+	arc << rngseed;
+	for (FRandom *rng = FRandom::RNGList; rng != NULL; rng = rng->Next)
+	{
+		arc << rng->idx;
+		for (int i = 0; i < SFMT::N32; ++i)
+		{
+			arc << rng->sfmt.u[i];
+		}
+	}
+}
+
 //==========================================================================
 //
 // FRandom :: StaticFindRNG
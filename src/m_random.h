@@ -40,6 +40,8 @@
 #include "sfmt/SFMT.h"
 
 struct PNGHandle;
+class FileWriter;
+class FArchive;
 
 class FRandom
 {
@@ -175,7 +177,8 @@ public:
 	static void StaticClearRandom ();
 	static DWORD StaticSumSeeds ();
 	static void StaticReadRNGState (PNGHandle *png);
-	static void StaticWriteRNGState (FILE *file);
+	static void StaticWriteRNGState (FileWriter *file);
+	static void StaticSerializeState (FArchive &arc);
 	static FRandom *StaticFindRNG(const char *name);
 
 #ifndef NDEBUG
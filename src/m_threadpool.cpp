@@ -0,0 +1,318 @@
+/*
+** m_threadpool.cpp
+** A small pool of worker threads for background and parallel jobs
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 RZDoom contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include "doomtype.h"
+#include "m_threadpool.h"
+#include "templates.h"
+#include "c_cvars.h"
+#include "i_system.h"
+
+// 0 picks one thread less than the number of hardware threads. Only takes
+// effect before the pool is first used.
+CVAR(Int, sys_workerthreads, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+FThreadPool ThreadPool;
+
+//==========================================================================
+//
+// FThreadPool Constructor
+//
+//==========================================================================
+
+FThreadPool::FThreadPool()
+{
+	PendingHead = 0;
+	Started = false;
+	Quitting = false;
+}
+
+//==========================================================================
+//
+// FThreadPool Destructor
+//
+//==========================================================================
+
+FThreadPool::~FThreadPool()
+{
+	Shutdown();
+}
+
+//==========================================================================
+//
+// FThreadPool :: Start
+//
+// Must be called with Lock held.
+//
+//==========================================================================
+
+void FThreadPool::Start()
+{
+	int count = sys_workerthreads;
+	if (count <= 0)
+	{
+		count = (int)std::thread::hardware_concurrency() - 1;
+	}
+	count = clamp(count, 1, 32);
+	Started = true;
+	Quitting = false;
+	for (int i = 0; i < count; ++i)
+	{
+		Threads.Push(new std::thread(&FThreadPool::WorkerLoop, this));
+	}
+}
+
+//==========================================================================
+//
+// FThreadPool :: GetNumThreads
+//
+//==========================================================================
+
+int FThreadPool::GetNumThreads()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	if (!Started) Start();
+	return Threads.Size();
+}
+
+//==========================================================================
+//
+// FThreadPool :: Shutdown
+//
+// Stops the workers. They run everything that is still queued before they
+// exit, so no job is ever dropped, but owners should still Wait on their
+// jobs before this is called at exit.
+//
+//==========================================================================
+
+void FThreadPool::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		if (!Started) return;
+		Quitting = true;
+	}
+	Wakeup.notify_all();
+	for (unsigned i = 0; i < Threads.Size(); ++i)
+	{
+		Threads[i]->join();
+		delete Threads[i];
+	}
+	Threads.Clear();
+	assert(PendingHead == Pending.Size());
+	Pending.Clear();
+	PendingHead = 0;
+	Started = false;
+}
+
+//==========================================================================
+//
+// FThreadPool :: Queue
+//
+//==========================================================================
+
+void FThreadPool::Queue(FJob *job)
+{
+	job->Done.store(false, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		if (!Started) Start();
+		Pending.Push(job);
+	}
+	Wakeup.notify_one();
+}
+
+//==========================================================================
+//
+// FThreadPool :: Dequeue
+//
+// Returns the oldest job nobody has started yet.
+// Must be called with Lock held.
+//
+//==========================================================================
+
+FJob *FThreadPool::Dequeue()
+{
+	FJob *job = NULL;
+	if (PendingHead < Pending.Size())
+	{
+		job = Pending[PendingHead++];
+	}
+	if (PendingHead == Pending.Size())
+	{
+		Pending.Clear();
+		PendingHead = 0;
+	}
+	return job;
+}
+
+//==========================================================================
+//
+// FThreadPool :: Claim
+//
+// Takes a job out of the queue so the caller can run it. Returns false if
+// it is not queued anymore because somebody else already started it. A job
+// is only ever in the queue until it starts, so the queue never refers to
+// a job its owner may have freed.
+// Must be called with Lock held.
+//
+//==========================================================================
+
+bool FThreadPool::Claim(FJob *job)
+{
+	for (unsigned i = PendingHead; i < Pending.Size(); ++i)
+	{
+		if (Pending[i] == job)
+		{
+			Pending.Delete(i);
+			if (PendingHead == Pending.Size())
+			{
+				Pending.Clear();
+				PendingHead = 0;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// FThreadPool :: Finish
+//
+//==========================================================================
+
+void FThreadPool::Finish(FJob *job)
+{
+	{
+		// Taking the lock makes sure a waiter cannot miss the notification
+		// between checking IsDone() and going to sleep.
+		std::lock_guard<std::mutex> lock(Lock);
+		job->Done.store(true, std::memory_order_release);
+	}
+	JobDone.notify_all();
+}
+
+//==========================================================================
+//
+// FThreadPool :: WorkerLoop
+//
+//==========================================================================
+
+void FThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		FJob *job;
+		{
+			std::unique_lock<std::mutex> lock(Lock);
+			while ((job = Dequeue()) == NULL)
+			{
+				if (Quitting) return;
+				Wakeup.wait(lock);
+			}
+		}
+		job->Run();
+		Finish(job);
+	}
+}
+
+//==========================================================================
+//
+// FThreadPool :: Wait
+//
+// If no worker has started the job yet, it is run on the calling thread,
+// so waiting on a job from the main thread can never deadlock even if all
+// workers are busy. Other queued jobs are left to the workers: they may be
+// long-running (a savegame write, for instance) and would stall the caller.
+//
+//==========================================================================
+
+void FThreadPool::Wait(FJob *job)
+{
+	if (job->IsDone())
+	{
+		return;
+	}
+	bool mine;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		mine = Claim(job);
+	}
+	if (mine)
+	{
+		job->Run();
+		Finish(job);
+		return;
+	}
+	std::unique_lock<std::mutex> lock(Lock);
+	while (!job->IsDone())
+	{
+		JobDone.wait(lock);
+	}
+}
+
+//==========================================================================
+//
+// FThreadPool :: RunAll
+//
+// Runs all jobs to completion, using the calling thread as one more worker
+// for this batch only. The caller takes jobs from the back of the batch
+// while the workers take them from the front.
+//
+//==========================================================================
+
+void FThreadPool::RunAll(FJob **jobs, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Queue(jobs[i]);
+	}
+	for (unsigned i = count; i-- > 0; )
+	{
+		bool mine;
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			mine = Claim(jobs[i]);
+		}
+		if (mine)
+		{
+			jobs[i]->Run();
+			Finish(jobs[i]);
+		}
+	}
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Wait(jobs[i]);
+	}
+}
@@ -0,0 +1,107 @@
+/*
+** m_threadpool.h
+** A small pool of worker threads for background and parallel jobs
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 RZDoom contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#ifndef __M_THREADPOOL_H__
+#define __M_THREADPOOL_H__
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "tarray.h"
+
+//==========================================================================
+//
+// FJob
+//
+// A unit of work for the thread pool. Jobs are owned by whoever queues
+// them and must stay alive until IsDone() returns true. Run() must not
+// touch game state that the main thread may change in the meantime.
+//
+//==========================================================================
+
+class FJob
+{
+	friend class FThreadPool;
+
+public:
+	FJob() : Done(false) {}
+	virtual ~FJob() {}
+	virtual void Run() = 0;
+
+	bool IsDone() const { return Done.load(std::memory_order_acquire); }
+
+private:
+	std::atomic<bool> Done;
+};
+
+//==========================================================================
+//
+// FThreadPool
+//
+//==========================================================================
+
+class FThreadPool
+{
+public:
+	FThreadPool();
+	~FThreadPool();
+
+	void Queue(FJob *job);
+	void Wait(FJob *job);
+	void RunAll(FJob **jobs, unsigned count);
+	int GetNumThreads();
+	bool IsRunning() { std::lock_guard<std::mutex> lock(Lock); return Started; }
+	void Shutdown();
+
+private:
+	void Start();
+	void WorkerLoop();
+	FJob *Dequeue();
+	bool Claim(FJob *job);
+	void Finish(FJob *job);
+
+	std::mutex Lock;
+	std::condition_variable Wakeup;
+	std::condition_variable JobDone;
+	TArray<FJob *> Pending;
+	unsigned PendingHead;
+	TArray<std::thread *> Threads;
+	bool Started;
+	bool Quitting;
+};
+
+extern FThreadPool ThreadPool;
+
+#endif //__M_THREADPOOL_H__
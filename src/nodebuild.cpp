@@ -51,22 +51,59 @@
 #include "m_bbox.h"
 #include "c_console.h"
 #include "r_state.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "m_threadpool.h"
+#include "stats.h"
+#include "v_text.h"
 
 const int MaxSegs = 64;
 const int SplitCost = 8;
 const int AAPreference = 16;
 
+// Splitter scoring goes parallel once it is at least this much work.
+const unsigned MinParallelSplitters = 32;
+const unsigned MinParallelWork = 32768;
+const unsigned MaxSplitterJobs = 32;
+
+CVAR (Bool, nodebuild_threads, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
 #if 0
 #define D(x) x
 #else
 #define D(x) do{}while(0)
 #endif
 
+// Scores one slice of the candidate list. Heuristic only reads the segs
+// and vertices, so each job just needs its own scratch lists.
+
+struct FNodeBuilder::FSplitterJob : public FJob
+{
+	FNodeBuilder *Builder;
+	DWORD Set;
+	bool NoSplit;
+	unsigned Start, End;
+	TArray<int> Touched;
+	TArray<int> Colinear;
+
+	void Run()
+	{
+		for (unsigned i = Start; i < End; ++i)
+		{
+			node_t node;
+			Builder->SetNodeFromSeg (node, &Builder->Segs[Builder->Candidates[i]]);
+			Builder->Scores[i] = Builder->Heuristic (node, Set, NoSplit, Touched, Colinear);
+		}
+	}
+};
+
 FNodeBuilder::FNodeBuilder(FLevel &level)
 : Level(level), GLNodes(false), SegsStuffed(0)
 {
 	VertexMap = NULL;
 	OldVertexTable = NULL;
+	SplitterJobs = NULL;
+	ResetTimes ();
 }
 
 FNodeBuilder::FNodeBuilder (FLevel &level,
@@ -74,11 +111,15 @@ FNodeBuilder::FNodeBuilder (FLevel &level,
 							bool makeGLNodes)
 	: Level(level), GLNodes(makeGLNodes), SegsStuffed(0)
 {
+	SplitterJobs = NULL;
+	ResetTimes ();
+	Times[TIME_Setup].Clock();
 	VertexMap = new FVertexMap (*this, Level.MinX, Level.MinY, Level.MaxX, Level.MaxY);
 	FindUsedVertices (Level.Vertices, Level.NumVertices);
 	MakeSegsFromSides ();
 	FindPolyContainers (polyspots, anchors);
 	GroupSegPlanes ();
+	Times[TIME_Setup].Unclock();
 	BuildTree ();
 }
 
@@ -92,6 +133,10 @@ FNodeBuilder::~FNodeBuilder()
 	{
 		delete[] OldVertexTable;
 	}
+	if (SplitterJobs != NULL)
+	{
+		delete[] SplitterJobs;
+	}
 }
 
 void FNodeBuilder::BuildMini(bool makeGLNodes)
@@ -114,6 +159,8 @@ void FNodeBuilder::Clear()
 	Planes.Clear();
 	Touched.Clear();
 	Colinear.Clear();
+	Candidates.Clear();
+	Scores.Clear();
 	SplitSharers.Clear();
 	if (VertexMap == NULL)
 	{
@@ -129,10 +176,43 @@ void FNodeBuilder::BuildTree ()
 	HackSeg = DWORD_MAX;
 	HackMate = DWORD_MAX;
 	CreateNode (0, Segs.Size(), bbox);
+	Times[TIME_Subsectors].Clock();
 	CreateSubsectorsForReal ();
+	Times[TIME_Subsectors].Unclock();
 	C_InitTicker (NULL, 0);
 }
 
+void FNodeBuilder::ResetTimes ()
+{
+	for (int i = 0; i < NUM_TIMES; ++i)
+	{
+		Times[i].Reset();
+	}
+}
+
+// Prints where the time went for showloadtimes. Splitter selection and
+// splitting are timed across the whole recursion; the extract time is only
+// known once Extract has been called.
+
+void FNodeBuilder::PrintTimes ()
+{
+	static const char *const names[NUM_TIMES] =
+	{
+		"setup",
+		"select splitters",
+		"split segs",
+		"minisegs",
+		"subsectors",
+		"extract"
+	};
+
+	Printf ("---Node builder times---\n");
+	for (int i = 0; i < NUM_TIMES; ++i)
+	{
+		Printf ("%-17s:%9.4f ms\n", names[i], Times[i].TimeMS());
+	}
+}
+
 int FNodeBuilder::CreateNode (DWORD set, unsigned int count, fixed_t bbox[4])
 {
 	node_t node;
@@ -144,11 +224,15 @@ int FNodeBuilder::CreateNode (DWORD set, unsigned int count, fixed_t bbox[4])
 	// When building GL nodes, count may not be an exact count of the number of segs
 	// in the set. That's okay, because we just use it to get a skip count, so an
 	// estimate is fine.
-	if ((selstat = SelectSplitter (set, node, splitseg, skip, true)) > 0 ||
+	Times[TIME_Select].Clock();
+	bool split = (selstat = SelectSplitter (set, node, splitseg, skip, true)) > 0 ||
 		(skip > 0 && (selstat = SelectSplitter (set, node, splitseg, 1, true)) > 0) ||
 		(selstat < 0 && (SelectSplitter (set, node, splitseg, skip, false) > 0 ||
 						(skip > 0 && SelectSplitter (set, node, splitseg, 1, false)))) ||
-		CheckSubsector (set, node, splitseg))
+		CheckSubsector (set, node, splitseg);
+	Times[TIME_Select].Unclock();
+
+	if (split)
 	{
 		// Create a normal node
 		DWORD set1, set2;
@@ -442,7 +526,7 @@ bool FNodeBuilder::ShoveSegBehind (DWORD set, node_t &node, DWORD seg, DWORD mat
 		node.dx = -node.dx;
 		node.dy = -node.dy;
 	}
-	return Heuristic (node, set, false) > 0;
+	return Heuristic (node, set, false, Touched, Colinear) > 0;
 }
 
 // Splitters are chosen to coincide with segs in the given set. To reduce the
@@ -458,6 +542,7 @@ int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int
 	int bestvalue;
 	DWORD bestseg;
 	DWORD seg;
+	unsigned setsize;
 	bool nosplitters = false;
 
 	bestvalue = 0;
@@ -465,8 +550,10 @@ int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int
 
 	seg = set;
 	stepleft = 0;
+	setsize = 0;
 
 	memset (&PlaneChecked[0], 0, PlaneChecked.Size());
+	Candidates.Clear();
 
 	D(Printf (PRINT_LOG, "Processing set %d\n", set));
 
@@ -487,28 +574,36 @@ int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int
 				}
 
 				stepleft = step;
-				SetNodeFromSeg (node, pseg);
-
-				int value = Heuristic (node, set, nosplit);
-
-				D(Printf (PRINT_LOG, "Seg %5d, ld %d (%5d,%5d)-(%5d,%5d) scores %d\n", seg, Segs[seg].linedef, node.x>>16, node.y>>16,
-					(node.x+node.dx)>>16, (node.y+node.dy)>>16, value));
-
-				if (value > bestvalue)
-				{
-					bestvalue = value;
-					bestseg = seg;
-				}
-				else if (value < 0)
-				{
-					nosplitters = true;
-				}
+				Candidates.Push (seg);
 			}
 		}
 
+		setsize++;
 		seg = pseg->next;
 	}
 
+	// The candidates are scored independently of each other, possibly on
+	// several threads, but the best one is picked in seg order, so the
+	// result does not depend on how the work was split up.
+	ScoreSplitters (set, nosplit, setsize);
+
+	for (unsigned i = 0; i < Candidates.Size(); ++i)
+	{
+		int value = Scores[i];
+
+		D(Printf (PRINT_LOG, "Seg %5d, ld %d scores %d\n", Candidates[i], Segs[Candidates[i]].linedef, value));
+
+		if (value > bestvalue)
+		{
+			bestvalue = value;
+			bestseg = Candidates[i];
+		}
+		else if (value < 0)
+		{
+			nosplitters = true;
+		}
+	}
+
 	if (bestseg == DWORD_MAX)
 	{ // No lines split any others into two sets, so this is a convex region.
 	D(Printf (PRINT_LOG, "set %d, step %d, nosplit %d has no good splitter (%d)\n", set, step, nosplit, nosplitters));
@@ -522,13 +617,57 @@ int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int
 	return 1;
 }
 
+// Fills Scores with the heuristic value of every candidate splitter. Each
+// score costs a pass over the whole set, so big sets near the top of the
+// tree are spread over the worker pool. Small ones are not worth the
+// synchronization.
+
+void FNodeBuilder::ScoreSplitters (DWORD set, bool nosplit, unsigned setsize)
+{
+	unsigned count = Candidates.Size();
+
+	Scores.Resize (count);
+	if (nodebuild_threads && count >= MinParallelSplitters && count * setsize >= MinParallelWork)
+	{
+		FSplitterJob *jobs;
+		FJob *jobptrs[MaxSplitterJobs];
+		unsigned numjobs = MIN<unsigned> (ThreadPool.GetNumThreads() + 1, MaxSplitterJobs);
+
+		numjobs = MIN (numjobs, count / (MinParallelSplitters / 2));
+		if (SplitterJobs == NULL)
+		{
+			SplitterJobs = new FSplitterJob[MaxSplitterJobs];
+		}
+		jobs = SplitterJobs;
+		for (unsigned i = 0; i < numjobs; ++i)
+		{
+			jobs[i].Builder = this;
+			jobs[i].Set = set;
+			jobs[i].NoSplit = nosplit;
+			jobs[i].Start = count * i / numjobs;
+			jobs[i].End = count * (i + 1) / numjobs;
+			jobptrs[i] = &jobs[i];
+		}
+		ThreadPool.RunAll (jobptrs, numjobs);
+	}
+	else
+	{
+		for (unsigned i = 0; i < count; ++i)
+		{
+			node_t node;
+			SetNodeFromSeg (node, &Segs[Candidates[i]]);
+			Scores[i] = Heuristic (node, set, nosplit, Touched, Colinear);
+		}
+	}
+}
+
 // Given a splitter (node), returns a score based on how "good" the resulting
 // split in a set of segs is. Higher scores are better. -1 means this splitter
 // splits something it shouldn't and will only be returned if honorNoSplit is
 // true. A score of 0 means that the splitter does not split any of the segs
 // in the set.
 
-int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit)
+int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit, TArray<int> &touched, TArray<int> &colinear)
 {
 	// Set the initial score above 0 so that near vertex anti-weighting is less likely to produce a negative score.
 	int score = 1000000;
@@ -543,8 +682,8 @@ int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit)
 	unsigned int max, m2, p, q;
 	double frac;
 
-	Touched.Clear ();
-	Colinear.Clear ();
+	touched.Clear ();
+	colinear.Clear ();
 
 	while (i != DWORD_MAX)
 	{
@@ -570,32 +709,32 @@ int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit)
 			{
 				if ((sidev[0] | sidev[1]) != 0)
 				{
-					max = Touched.Size();
+					max = touched.Size();
 					for (p = 0; p < max; ++p)
 					{
-						if (Touched[p] == test->loopnum)
+						if (touched[p] == test->loopnum)
 						{
 							break;
 						}
 					}
 					if (p == max)
 					{
-						Touched.Push (test->loopnum);
+						touched.Push (test->loopnum);
 					}
 				}
 				else
 				{
-					max = Colinear.Size();
+					max = colinear.Size();
 					for (p = 0; p < max; ++p)
 					{
-						if (Colinear[p] == test->loopnum)
+						if (colinear[p] == test->loopnum)
 						{
 							break;
 						}
 					}
 					if (p == max)
 					{
-						Colinear.Push (test->loopnum);
+						colinear.Push (test->loopnum);
 					}
 				}
 			}
@@ -712,8 +851,8 @@ int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit)
 	// seg of that sector must be crossing the container's corner and does not
 	// actually split the container.
 
-	max = Touched.Size ();
-	m2 = Colinear.Size ();
+	max = touched.Size ();
+	m2 = colinear.Size ();
 
 	// If honorNoSplit is false, then both these lists will be empty.
 
@@ -726,10 +865,10 @@ int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit)
 
 	for (p = 0; p < max; ++p)
 	{
-		int look = Touched[p];
+		int look = touched[p];
 		for (q = 0; q < m2; ++q)
 		{
-			if (look == Colinear[q])
+			if (look == colinear[q])
 			{
 				break;
 			}
@@ -773,6 +912,7 @@ void FNodeBuilder::SplitSegs (DWORD set, node_t &node, DWORD splitseg, DWORD &ou
 	outset0 = DWORD_MAX;
 	outset1 = DWORD_MAX;
 
+	Times[TIME_Split].Clock();
 	Events.DeleteAll ();
 	SplitSharers.Clear ();
 
@@ -913,11 +1053,16 @@ void FNodeBuilder::SplitSegs (DWORD set, node_t &node, DWORD splitseg, DWORD &ou
 		}
 		set = next;
 	}
+	Times[TIME_Split].Unclock();
+
+	Times[TIME_Minisegs].Clock();
+	Events.Sort ();
 	FixSplitSharers (node);
 	if (GLNodes)
 	{
 		AddMinisegs (node, splitseg, outset0, outset1);
 	}
+	Times[TIME_Minisegs].Unclock();
 	count0 = _count0;
 	count1 = _count1;
 }
@@ -1077,3 +1222,210 @@ void FNodeBuilder::PrintSet (int l, DWORD set)
 	}
 	Printf (PRINT_LOG, "*\n");
 }
+
+//==========================================================================
+//
+// CCMD nodebench
+//
+// Rebuilds the current level's GL nodes with and without threaded
+// splitter scoring, and checks that both trees come out the same. Nodes,
+// segs and subsectors are compared with their pointers turned into
+// indices, so a threaded build that picks a different splitter with the
+// same score shows up as a difference.
+//
+//==========================================================================
+
+struct FBenchSeg
+{
+	fixed_t x1, y1, x2, y2;
+	int sidedef, linedef, frontsector, backsector, partner, subsector;
+};
+
+struct FBenchSubsector
+{
+	int sector, firstline, numlines;
+};
+
+struct FBenchTree
+{
+	TArray<node_t> Nodes;		// children[] hold indices in intchildren[]
+	TArray<FBenchSeg> Segs;
+	TArray<FBenchSubsector> Subsectors;
+};
+
+template<class T> static inline int BenchIndex (const T *ptr, const T *base)
+{
+	return ptr == NULL ? -1 : int(ptr - base);
+}
+
+static void BenchKeepTree (FBenchTree &out, node_t *nodes, int numnodes, seg_t *segs,
+	glsegextra_t *glsegextras, int numsegs, subsector_t *subs, int numsubs)
+{
+	out.Nodes.Resize (numnodes);
+	for (int i = 0; i < numnodes; ++i)
+	{
+		node_t &node = out.Nodes[i];
+
+		node = nodes[i];
+		for (int j = 0; j < 2; ++j)
+		{
+			void *child = nodes[i].children[j];
+
+			node.children[j] = NULL;
+			if ((size_t)child & 1)
+			{
+				node.intchildren[j] = BenchIndex ((subsector_t *)((BYTE *)child - 1), subs) | 0x80000000;
+			}
+			else
+			{
+				node.intchildren[j] = BenchIndex ((node_t *)child, nodes);
+			}
+		}
+	}
+
+	out.Segs.Resize (numsegs);
+	for (int i = 0; i < numsegs; ++i)
+	{
+		seg_t *seg = &segs[i];
+		FBenchSeg &bseg = out.Segs[i];
+
+		bseg.x1 = seg->v1->x;
+		bseg.y1 = seg->v1->y;
+		bseg.x2 = seg->v2->x;
+		bseg.y2 = seg->v2->y;
+		bseg.sidedef = BenchIndex (seg->sidedef, sides);
+		bseg.linedef = BenchIndex (seg->linedef, lines);
+		bseg.frontsector = BenchIndex (seg->frontsector, sectors);
+		bseg.backsector = BenchIndex (seg->backsector, sectors);
+		if (glsegextras != NULL)
+		{
+			bseg.partner = int(glsegextras[i].PartnerSeg);
+			bseg.subsector = BenchIndex (glsegextras[i].Subsector, subs);
+		}
+		else
+		{
+			bseg.partner = BenchIndex (seg->PartnerSeg, segs);
+			bseg.subsector = BenchIndex (seg->Subsector, subs);
+		}
+	}
+
+	out.Subsectors.Resize (numsubs);
+	for (int i = 0; i < numsubs; ++i)
+	{
+		out.Subsectors[i].sector = BenchIndex (subs[i].sector, sectors);
+		out.Subsectors[i].firstline = BenchIndex (subs[i].firstline, segs);
+		out.Subsectors[i].numlines = int(subs[i].numlines);
+	}
+}
+
+static bool BenchSameTree (const FBenchTree &a, const FBenchTree &b)
+{
+	if (a.Nodes.Size() != b.Nodes.Size() || a.Segs.Size() != b.Segs.Size() ||
+		a.Subsectors.Size() != b.Subsectors.Size())
+	{
+		return false;
+	}
+	for (unsigned i = 0; i < a.Nodes.Size(); ++i)
+	{
+		const node_t &na = a.Nodes[i], &nb = b.Nodes[i];
+
+		if (na.x != nb.x || na.y != nb.y || na.dx != nb.dx || na.dy != nb.dy ||
+			na.intchildren[0] != nb.intchildren[0] || na.intchildren[1] != nb.intchildren[1] ||
+			memcmp (na.bbox, nb.bbox, sizeof(na.bbox)) != 0)
+		{
+			return false;
+		}
+	}
+	for (unsigned i = 0; i < a.Segs.Size(); ++i)
+	{
+		if (memcmp (&a.Segs[i], &b.Segs[i], sizeof(FBenchSeg)) != 0)
+		{
+			return false;
+		}
+	}
+	for (unsigned i = 0; i < a.Subsectors.Size(); ++i)
+	{
+		if (memcmp (&a.Subsectors[i], &b.Subsectors[i], sizeof(FBenchSubsector)) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static double BenchNodeBuild (int passes, bool threaded, FBenchTree &out)
+{
+	TArray<FNodeBuilder::FPolyStart> polyspots, anchors;
+	TArray<vertex_t *> lineverts;
+	cycle_t clock;
+	bool wasthreaded = nodebuild_threads;
+
+	// The builder turns the lines' vertex pointers into indices and Extract
+	// points them at its own output, so they must be put back afterwards.
+	lineverts.Resize (numlines * 2);
+	for (int i = 0; i < numlines; ++i)
+	{
+		lineverts[i*2] = lines[i].v1;
+		lineverts[i*2+1] = lines[i].v2;
+	}
+
+	nodebuild_threads = threaded;
+	clock.Reset();
+	for (int i = 0; i < passes; ++i)
+	{
+		FNodeBuilder::FLevel leveldata =
+		{
+			vertexes, numvertexes,
+			sides, numsides,
+			lines, numlines,
+			0, 0, 0, 0
+		};
+		node_t *nodes;
+		seg_t *segs;
+		glsegextra_t *glsegextras;
+		subsector_t *subs;
+		vertex_t *verts;
+		int numnodes, numsegs, numsubs, numverts;
+
+		clock.Clock();
+		leveldata.FindMapBounds ();
+		FNodeBuilder builder (leveldata, polyspots, anchors, true);
+		builder.Extract (nodes, numnodes, segs, glsegextras, numsegs, subs, numsubs, verts, numverts);
+		clock.Unclock();
+
+		for (int j = 0; j < numlines; ++j)
+		{
+			lines[j].v1 = lineverts[j*2];
+			lines[j].v2 = lineverts[j*2+1];
+		}
+		BenchKeepTree (out, nodes, numnodes, segs, glsegextras, numsegs, subs, numsubs);
+		delete[] nodes;
+		delete[] segs;
+		delete[] glsegextras;
+		delete[] subs;
+		delete[] verts;
+	}
+	nodebuild_threads = wasthreaded;
+	return clock.TimeMS() / passes;
+}
+
+CCMD (nodebench)
+{
+	if (numlines == 0)
+	{
+		Printf ("No level loaded\n");
+		return;
+	}
+
+	int passes = argv.argc() > 1 ? MAX(1, atoi (argv[1])) : 3;
+	FBenchTree serial, threaded;
+
+	double serialms = BenchNodeBuild (passes, false, serial);
+	double threadedms = BenchNodeBuild (passes, true, threaded);
+	bool same = BenchSameTree (serial, threaded);
+
+	Printf ("%u nodes, %u segs, %u subsectors\n", serial.Nodes.Size(), serial.Segs.Size(), serial.Subsectors.Size());
+	Printf ("serial: %.3f ms, threaded (%d workers): %.3f ms, speedup %.2fx\n",
+		serialms, ThreadPool.GetNumThreads(), threadedms, threadedms > 0 ? serialms / threadedms : 0.);
+	Printf ("%s\n", same ? "Trees are identical" : TEXTCOLOR_RED "Trees differ!");
+}
@@ -2,6 +2,7 @@
 #include "tarray.h"
 #include "r_defs.h"
 #include "x86.h"
+#include "stats.h"
 
 struct FPolySeg;
 struct FMiniBSP;
@@ -14,38 +15,29 @@ struct FEventInfo
 
 struct FEvent
 {
-	FEvent *Parent, *Left, *Right;
 	double Distance;
 	FEventInfo Info;
 };
 
-class FEventTree
+// The vertices where the current splitter crosses or touches segs. They are
+// collected unsorted while the segs are split, then sorted once by their
+// distance along the splitter so neighbours are adjacent in memory.
+class FEventList
 {
 public:
-	FEventTree ();
-	~FEventTree ();
+	void Add (double distance, int vertex);
+	void Sort ();
+	void DeleteAll () { Events.Clear(); }
 
-	FEvent *GetMinimum ();
-	FEvent *GetSuccessor (FEvent *event) const { FEvent *node = Successor(event); return node == &Nil ? NULL : node; }
-	FEvent *GetPredecessor (FEvent *event) const { FEvent *node = Predecessor(event); return node == &Nil ? NULL : node; }
+	FEvent *GetMinimum () { return Events.Size() > 0 ? &Events[0] : NULL; }
+	FEvent *GetSuccessor (FEvent *event) { return event < &Events[Events.Size() - 1] ? event + 1 : NULL; }
+	FEvent *GetPredecessor (FEvent *event) { return event > &Events[0] ? event - 1 : NULL; }
+	FEvent *FindEvent (double distance);
 
-	FEvent *GetNewNode ();
-	void Insert (FEvent *event);
-	FEvent *FindEvent (double distance) const;
-	void DeleteAll ();
-
-	void PrintTree () const { PrintTree (Root); }
+	void PrintTree () const;
 
 private:
-	FEvent Nil;
-	FEvent *Root;
-	FEvent *Spare;
-
-	void DeletionTraverser (FEvent *event);
-	FEvent *Successor (FEvent *event) const;
-	FEvent *Predecessor (FEvent *event) const;
-
-	void PrintTree (const FEvent *event) const;
+	TArray<FEvent> Events;
 };
 
 struct FSimpleVert
@@ -131,8 +123,17 @@ class FNodeBuilder
 		int SelectVertexClose (FPrivVert &vert);
 
 	private:
+		// Each cell keeps a copy of its vertices' coordinates so a lookup
+		// scans one contiguous array instead of chasing indices into the
+		// builder's vertex list.
+		struct FGridVert
+		{
+			fixed_t x, y;
+			int vertnum;
+		};
+
 		FNodeBuilder &MyBuilder;
-		TArray<int> *VertexGrid;
+		TArray<FGridVert> *VertexGrid;
 
 		fixed_t MinX, MinY, MaxX, MaxY;
 		int BlocksWide, BlocksTall;
@@ -167,6 +168,9 @@ class FNodeBuilder
 	friend class FVertexMap;
 	friend class FVertexMapSimple;
 
+	struct FSplitterJob;
+	friend struct FSplitterJob;
+
 public:
 	struct FLevel
 	{
@@ -213,6 +217,20 @@ public:
 
 	static angle_t PointToAngle (fixed_t dx, fixed_t dy);
 
+	// Per-phase build times, shown by showloadtimes
+	enum
+	{
+		TIME_Setup,			// Vertices, segs, polyobject containers and planes
+		TIME_Select,		// Choosing splitters, including the heuristic
+		TIME_Split,			// Splitting segs along the chosen splitter
+		TIME_Minisegs,		// Sorting intersections and adding minisegs
+		TIME_Subsectors,	// Creating the final subsectors
+		TIME_Extract,		// Converting to the game's node format
+
+		NUM_TIMES
+	};
+	void PrintTimes ();
+
 	//  < 0 : in front of line
 	// == 0 : on line
 	//  > 0 : behind line
@@ -234,7 +252,10 @@ private:
 
 	TArray<int> Touched;	// Loops a splitter touches on a vertex
 	TArray<int> Colinear;	// Loops with edges colinear to a splitter
-	FEventTree Events;		// Vertices intersected by the current splitter
+	TArray<DWORD> Candidates;	// Splitters considered by SelectSplitter
+	TArray<int> Scores;		// Heuristic score for each candidate
+	FSplitterJob *SplitterJobs;	// Scoring jobs, kept for the builder's lifetime
+	FEventList Events;		// Vertices intersected by the current splitter
 
 	TArray<FSplitSharer> SplitSharers;	// Segs colinear with the current splitter
 
@@ -246,6 +267,10 @@ private:
 	// Progress meter stuff
 	int SegsStuffed;
 
+	cycle_t Times[NUM_TIMES];
+
+	void ResetTimes ();
+
 	void FindUsedVertices (vertex_t *vertices, int max);
 	void BuildTree ();
 	void MakeSegsFromSides ();
@@ -262,9 +287,10 @@ private:
 	bool CheckSubsector (DWORD set, node_t &node, DWORD &splitseg);
 	bool CheckSubsectorOverlappingSegs (DWORD set, node_t &node, DWORD &splitseg);
 	bool ShoveSegBehind (DWORD set, node_t &node, DWORD seg, DWORD mate);	int SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int step, bool nosplit);
+	void ScoreSplitters (DWORD set, bool nosplit, unsigned setsize);
 	void SplitSegs (DWORD set, node_t &node, DWORD splitseg, DWORD &outset0, DWORD &outset1, unsigned int &count0, unsigned int &count1);
 	DWORD SplitSeg (DWORD segnum, int splitvert, int v1InFront);
-	int Heuristic (node_t &node, DWORD set, bool honorNoSplit);
+	int Heuristic (node_t &node, DWORD set, bool honorNoSplit, TArray<int> &touched, TArray<int> &colinear);
 
 	// Returns:
 	//	0 = seg is in front
@@ -1,7 +1,7 @@
 /*
 ** nodebuild_events.cpp
 **
-** A red-black tree for keeping track of segs that get touched by a splitter.
+** A sorted list for keeping track of segs that get touched by a splitter.
 **
 **---------------------------------------------------------------------------
 ** Copyright 2002-2006 Randy Heit
@@ -38,189 +38,80 @@
 */
 
 #include <string.h>
+#include <algorithm>
 #include "doomtype.h"
 #include "nodebuild.h"
 
-FEventTree::FEventTree ()
-: Root (&Nil), Spare (NULL)
+static bool EventLess (const FEvent &a, const FEvent &b)
 {
-	memset (&Nil, 0, sizeof(Nil));
+	return a.Distance < b.Distance;
 }
 
-FEventTree::~FEventTree ()
+void FEventList::Add (double distance, int vertex)
 {
-	FEvent *probe;
+	FEvent event;
 
-	DeleteAll ();
-	probe = Spare;
-	while (probe != NULL)
-	{
-		FEvent *next = probe->Left;
-		delete probe;
-		probe = next;
-	}
+	event.Distance = distance;
+	event.Info.Vertex = vertex;
+	event.Info.FrontSeg = DWORD_MAX;
+	Events.Push (event);
 }
 
-void FEventTree::DeleteAll ()
-{
-	DeletionTraverser (Root);
-	Root = &Nil;
-}
-
-void FEventTree::DeletionTraverser (FEvent *node)
-{
-	if (node != &Nil && node != NULL)
-	{
-		DeletionTraverser (node->Left);
-		DeletionTraverser (node->Right);
-		node->Left = Spare;
-		Spare = node;
-	}
-}
+// Sorts the events by distance. When several vertices were added at the
+// same distance, the first one added is kept, which is what the old tree
+// did by refusing to insert a second event at an existing distance.
 
-FEvent *FEventTree::GetNewNode ()
+void FEventList::Sort ()
 {
-	FEvent *node;
+	unsigned int i, j;
 
-	if (Spare != NULL)
+	if (Events.Size() < 2)
 	{
-		node = Spare;
-		Spare = node->Left;
+		return;
 	}
-	else
+	std::stable_sort (&Events[0], &Events[0] + Events.Size(), EventLess);
+	for (i = j = 1; i < Events.Size(); ++i)
 	{
-		node = new FEvent;
-	}
-	return node;
-}
-
-void FEventTree::Insert (FEvent *z)
-{
-	FEvent *y = &Nil;
-	FEvent *x = Root;
-
-	while (x != &Nil)
-	{
-		y = x;
-		if (z->Distance < x->Distance)
-		{
-			x = x->Left;
-		}
-		else
+		if (Events[i].Distance != Events[j-1].Distance)
 		{
-			x = x->Right;
+			Events[j++] = Events[i];
 		}
 	}
-	z->Parent = y;
-	if (y == &Nil)
-	{
-		Root = z;
-	}
-	else if (z->Distance < y->Distance)
-	{
-		y->Left = z;
-	}
-	else
-	{
-		y->Right = z;
-	}
-	z->Left = &Nil;
-	z->Right = &Nil;
+	Events.Resize (j);
 }
 
-FEvent *FEventTree::Successor (FEvent *event) const
+FEvent *FEventList::FindEvent (double key)
 {
-	if (event->Right != &Nil)
-	{
-		event = event->Right;
-		while (event->Left != &Nil)
-		{
-			event = event->Left;
-		}
-		return event;
-	}
-	else
-	{
-		FEvent *y = event->Parent;
-		while (y != &Nil && event == y->Right)
-		{
-			event = y;
-			y = y->Parent;
-		}
-		return y;
-	}
-}
+	unsigned int min = 0, max = Events.Size();
 
-FEvent *FEventTree::Predecessor (FEvent *event) const
-{
-	if (event->Left != &Nil)
+	while (min < max)
 	{
-		event = event->Left;
-		while (event->Right != &Nil)
-		{
-			event = event->Right;
-		}
-		return event;
-	}
-	else
-	{
-		FEvent *y = event->Parent;
-		while (y != &Nil && event == y->Left)
-		{
-			event = y;
-			y = y->Parent;
-		}
-		return y;
-	}
-}
-
-FEvent *FEventTree::FindEvent (double key) const
-{
-	FEvent *node = Root;
+		unsigned int mid = (min + max) / 2;
 
-	while (node != &Nil)
-	{
-		if (node->Distance == key)
+		if (Events[mid].Distance == key)
 		{
-			return node;
+			return &Events[mid];
 		}
-		else if (node->Distance > key)
+		else if (Events[mid].Distance > key)
 		{
-			node = node->Left;
+			max = mid;
 		}
 		else
 		{
-			node = node->Right;
+			min = mid + 1;
 		}
 	}
 	return NULL;
 }
 
-FEvent *FEventTree::GetMinimum ()
-{
-	FEvent *node = Root;
-
-	if (node == &Nil)
-	{
-		return NULL;
-	}
-	while (node->Left != &Nil)
-	{
-		node = node->Left;
-	}
-	return node;
-}
-
-void FEventTree::PrintTree (const FEvent *event) const
+void FEventList::PrintTree () const
 {
 	// Use the CRT's sprintf so that it shares the same formatting as ZDBSP's output.
 	char buff[100];
-	if (event != &Nil)
+	for (unsigned int i = 0; i < Events.Size(); ++i)
 	{
-		PrintTree(event->Left);
 		sprintf(buff, " Distance %g, vertex %d, seg %u\n",
-			sqrt(event->Distance/4294967296.0), event->Info.Vertex, (unsigned)event->Info.FrontSeg);
+			sqrt(Events[i].Distance/4294967296.0), Events[i].Info.Vertex, (unsigned)Events[i].Info.FrontSeg);
 		Printf(PRINT_LOG, "%s", buff);
-		PrintTree(event->Right);
 	}
 }
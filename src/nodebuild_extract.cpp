@@ -59,6 +59,7 @@ void FNodeBuilder::Extract (node_t *&outNodes, int &nodeCount,
 {
 	int i;
 
+	Times[TIME_Extract].Clock();
 	vertCount = Vertices.Size ();
 	outVerts = new vertex_t[vertCount];
 
@@ -159,6 +160,7 @@ void FNodeBuilder::Extract (node_t *&outNodes, int &nodeCount,
 		Level.Lines[i].v1 = outVerts + (size_t)Level.Lines[i].v1;
 		Level.Lines[i].v2 = outVerts + (size_t)Level.Lines[i].v2;
 	}
+	Times[TIME_Extract].Unclock();
 }
 
 void FNodeBuilder::ExtractMini (FMiniBSP *bsp)
@@ -54,25 +54,13 @@ static const angle_t ANGLE_EPSILON = 5000;
 
 double FNodeBuilder::AddIntersection (const node_t &node, int vertex)
 {
-	static const FEventInfo defaultInfo =
-	{
-		-1, DWORD_MAX
-	};
-
 	// Calculate signed distance of intersection vertex from start of splitter.
 	// Only ordering is important, so we don't need a sqrt.
 	FPrivVert *v = &Vertices[vertex];
 	double dist = (double(v->x) - node.x)*(node.dx) + (double(v->y) - node.y)*(node.dy);
 
-	FEvent *event = Events.FindEvent (dist);
-	if (event == NULL)
-	{
-		event = Events.GetNewNode ();
-		event->Distance = dist;
-		event->Info = defaultInfo;
-		event->Info.Vertex = vertex;
-		Events.Insert (event);
-	}
+	// Duplicates are weeded out when the events are sorted.
+	Events.Add (dist, vertex);
 	return dist;
 }
 
@@ -644,7 +644,7 @@ FNodeBuilder::FVertexMap::FVertexMap (FNodeBuilder &builder,
 	BlocksTall = int(((double(maxy) - miny + 1) + (BLOCK_SIZE - 1)) / BLOCK_SIZE);
 	MaxX = MinX + BlocksWide * BLOCK_SIZE - 1;
 	MaxY = MinY + BlocksTall * BLOCK_SIZE - 1;
-	VertexGrid = new TArray<int>[BlocksWide * BlocksTall];
+	VertexGrid = new TArray<FGridVert>[BlocksWide * BlocksTall];
 }
 
 FNodeBuilder::FVertexMap::~FVertexMap ()
@@ -654,15 +654,15 @@ FNodeBuilder::FVertexMap::~FVertexMap ()
 
 int FNodeBuilder::FVertexMap::SelectVertexExact (FNodeBuilder::FPrivVert &vert)
 {
-	TArray<int> &block = VertexGrid[GetBlock (vert.x, vert.y)];
-	FPrivVert *vertices = &MyBuilder.Vertices[0];
-	unsigned int i;
+	TArray<FGridVert> &block = VertexGrid[GetBlock (vert.x, vert.y)];
+	const FGridVert *verts = block.Size() > 0 ? &block[0] : NULL;
+	unsigned int i, count = block.Size();
 
-	for (i = 0; i < block.Size(); ++i)
+	for (i = 0; i < count; ++i)
 	{
-		if (vertices[block[i]].x == vert.x && vertices[block[i]].y == vert.y)
+		if (verts[i].x == vert.x && verts[i].y == vert.y)
 		{
-			return block[i];
+			return verts[i].vertnum;
 		}
 	}
 
@@ -672,20 +672,20 @@ int FNodeBuilder::FVertexMap::SelectVertexExact (FNodeBuilder::FPrivVert &vert)
 
 int FNodeBuilder::FVertexMap::SelectVertexClose (FNodeBuilder::FPrivVert &vert)
 {
-	TArray<int> &block = VertexGrid[GetBlock (vert.x, vert.y)];
-	FPrivVert *vertices = &MyBuilder.Vertices[0];
-	unsigned int i;
+	TArray<FGridVert> &block = VertexGrid[GetBlock (vert.x, vert.y)];
+	const FGridVert *verts = block.Size() > 0 ? &block[0] : NULL;
+	unsigned int i, count = block.Size();
 
-	for (i = 0; i < block.Size(); ++i)
+	for (i = 0; i < count; ++i)
 	{
 #if VERTEX_EPSILON <= 1
-		if (vertices[block[i]].x == vert.x && vertices[block[i]].y == vert.y)
+		if (verts[i].x == vert.x && verts[i].y == vert.y)
 #else
-		if (abs(vertices[block[i]].x - vert.x) < VERTEX_EPSILON &&
-			abs(vertices[block[i]].y - vert.y) < VERTEX_EPSILON)
+		if (abs(verts[i].x - vert.x) < VERTEX_EPSILON &&
+			abs(verts[i].y - vert.y) < VERTEX_EPSILON)
 #endif
 		{
-			return block[i];
+			return verts[i].vertnum;
 		}
 	}
 
@@ -723,11 +723,12 @@ int FNodeBuilder::FVertexMap::InsertVertex (FNodeBuilder::FPrivVert &vert)
 		VertexGrid[blk[2]].Size(),
 		VertexGrid[blk[3]].Size()
 	};
+	FGridVert gridvert = { vert.x, vert.y, vertnum };
 	for (int i = 0; i < 4; ++i)
 	{
 		if (VertexGrid[blk[i]].Size() == blkcount[i])
 		{
-			VertexGrid[blk[i]].Push (vertnum);
+			VertexGrid[blk[i]].Push (gridvert);
 		}
 	}
 
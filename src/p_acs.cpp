@@ -80,6 +80,8 @@
 #include "p_effect.h"
 
 #include "g_shared/a_pickups.h"
+#include "stats.h"
+#include "m_profile.h"
 
 extern FILE *Logfile;
 
@@ -147,14 +149,15 @@ enum
 
 struct CallReturn
 {
-	CallReturn(int pc, ScriptFunction *func, FBehavior *module, SDWORD *locals, ACSLocalArrays *arrays, bool discard, unsigned int runaway)
+	CallReturn(int pc, ScriptFunction *func, FBehavior *module, SDWORD *locals, ACSLocalArrays *arrays, bool discard, unsigned int runaway, unsigned int profileframe)
 		: ReturnFunction(func),
 		  ReturnModule(module),
 		  ReturnLocals(locals),
 		  ReturnArrays(arrays),
 		  ReturnAddress(pc),
 		  bDiscardResult(discard),
-		  EntryInstrCount(runaway)
+		  EntryInstrCount(runaway),
+		  ProfileFrame(profileframe)
 	{}
 
 	ScriptFunction *ReturnFunction;
@@ -164,6 +167,7 @@ struct CallReturn
 	int ReturnAddress;
 	int bDiscardResult;
 	unsigned int EntryInstrCount;
+	unsigned int ProfileFrame;	// 0 if the call is not being profiled
 };
 
 static DLevelScript *P_GetScriptGoing (AActor *who, line_t *where, int num, const ScriptPtr *code, FBehavior *module,
@@ -217,6 +221,148 @@ FWorldGlobalArray ACS_WorldArrays[NUM_WORLDVARS];
 SDWORD ACS_GlobalVars[NUM_GLOBALVARS];
 FWorldGlobalArray ACS_GlobalArrays[NUM_GLOBALVARS];
 
+//============================================================================
+//
+// FWorldGlobalArray :: Grow
+//
+// Called for indices outside the dense part. If the index is close enough
+// to the end of it, the dense part grows to include it, taking over any
+// elements that were in the map until now. Otherwise, the element goes to
+// the map.
+//
+//============================================================================
+
+SDWORD &FWorldGlobalArray::Grow(SDWORD index)
+{
+	unsigned int size = Dense.Size();
+	unsigned int newsize = MAX<unsigned int>(size * 2, MIN_DENSE);
+
+	if (index < 0 || (unsigned)index >= newsize || newsize > MAX_DENSE)
+	{
+		return Sparse[index];
+	}
+	Dense.Resize(newsize);
+	memset(&Dense[size], 0, (newsize - size) * sizeof(SDWORD));
+
+	if (Sparse.CountUsed() > 0)
+	{
+		SparseMap::Iterator it(Sparse);
+		SparseMap::Pair *pair;
+		TArray<SDWORD> moved;
+
+		while (it.NextPair(pair))
+		{
+			if ((unsigned)pair->Key < newsize)
+			{
+				Dense[pair->Key] = pair->Value;
+				moved.Push(pair->Key);
+			}
+		}
+		for (unsigned int i = 0; i < moved.Size(); ++i)
+		{
+			Sparse.Remove(moved[i]);
+		}
+	}
+	return Dense[index];
+}
+
+//============================================================================
+//
+// FWorldGlobalArray :: CountUsed
+//
+// Returns the number of elements the iterator will return.
+//
+//============================================================================
+
+unsigned int FWorldGlobalArray::CountUsed() const
+{
+	unsigned int count = Sparse.CountUsed();
+
+	for (unsigned int i = 0; i < Dense.Size(); ++i)
+	{
+		count += (Dense[i] != 0);
+	}
+	return count;
+}
+
+//============================================================================
+//
+// FWorldGlobalArray :: Clear
+//
+//============================================================================
+
+void FWorldGlobalArray::Clear()
+{
+	Dense.Clear();
+	Sparse.Clear();
+}
+
+//============================================================================
+//
+// FWorldGlobalArray :: ConstIterator
+//
+// Returns the non-zero elements of the dense part, then everything in
+// the map.
+//
+//============================================================================
+
+FWorldGlobalArray::ConstIterator::ConstIterator(const FWorldGlobalArray &array)
+: Array(array), DenseIndex(0), SparseIt(array.Sparse)
+{
+}
+
+bool FWorldGlobalArray::ConstIterator::NextPair(ConstPair *&pair)
+{
+	SparseMap::ConstPair *sparsepair;
+
+	while (DenseIndex < Array.Dense.Size())
+	{
+		unsigned int i = DenseIndex++;
+		if (Array.Dense[i] != 0)
+		{
+			Current.Key = i;
+			Current.Value = Array.Dense[i];
+			pair = &Current;
+			return true;
+		}
+	}
+	if (SparseIt.NextPair(sparsepair))
+	{
+		Current.Key = sparsepair->Key;
+		Current.Value = sparsepair->Value;
+		pair = &Current;
+		return true;
+	}
+	return false;
+}
+
+// Run simple p-codes through the pre-decoded interpreter
+CVAR (Bool, acs_fastdispatch, true, 0)
+
+// Run every p-code the decoded interpreter handles through both it and
+// the switch in RunScript, and report where they disagree
+CVAR (Bool, acs_checkdispatch, false, 0)
+
+// Fuse common p-code sequences into single decoded instructions
+CUSTOM_CVAR (Bool, acs_fuse, true, 0)
+{
+	FBehavior::StaticRedecode ();
+}
+
+// Per-tic interpreter statistics, for the acs stat and acsbench
+static unsigned int ACSTicPCodes, ACSLastTicPCodes;
+cycle_t ACSTicCycles;
+
+static struct
+{
+	int Tics;				// Tics to spend with each setting
+	int Left;				// Tics left with the current setting
+	int Phase;				// -1 = not running, 0 = unfused, 1 = fused
+	bool OldFuse;
+	double MS[2];
+	unsigned long long PCodes[2];
+} ACSBench = { 0, 0, -1 };
+
 //----------------------------------------------------------------------------
 //
 // ACS stack manager
@@ -303,10 +449,15 @@ FACSStack::~FACSStack()
 
 ACSStringPool GlobalACSStrings;
 
+// Statistics for the acsstrings stat
+static cycle_t ACSStringGCCycles, ACSStringTicCycles;
+static unsigned int ACSStringsFreed, ACSTempStringsFreed;
+
 ACSStringPool::ACSStringPool()
 {
-	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
 	FirstFreeEntry = 0;
+	NumUsed = 0;
+	Rehash(MIN_TABLE_SIZE);
 }
 
 //============================================================================
@@ -320,8 +471,11 @@ ACSStringPool::ACSStringPool()
 void ACSStringPool::Clear()
 {
 	Pool.Clear();
-	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
+	TempStrings.Clear();
+	TempArena.FreeAll();
 	FirstFreeEntry = 0;
+	NumUsed = 0;
+	Rehash(MIN_TABLE_SIZE);
 }
 
 //============================================================================
@@ -337,26 +491,23 @@ int ACSStringPool::AddString(const char *str)
 {
 	size_t len = strlen(str);
 	unsigned int h = SuperFastHash(str, len);
-	unsigned int bucketnum = h % NUM_BUCKETS;
-	int i = FindString(str, len, h, bucketnum);
+	int i = FindString(str, len, h);
 	if (i >= 0)
 	{
 		return i | STRPOOL_LIBRARYID_OR;
 	}
-	FString fstr(str);
-	return InsertString(fstr, h, bucketnum);
+	return InsertString(str, len, h);
 }
 
 int ACSStringPool::AddString(FString &str)
 {
 	unsigned int h = SuperFastHash(str.GetChars(), str.Len());
-	unsigned int bucketnum = h % NUM_BUCKETS;
-	int i = FindString(str, str.Len(), h, bucketnum);
+	int i = FindString(str, str.Len(), h);
 	if (i >= 0)
 	{
 		return i | STRPOOL_LIBRARYID_OR;
 	}
-	return InsertString(str, h, bucketnum);
+	return InsertString(str, str.Len(), h);
 }
 
 //============================================================================
@@ -369,13 +520,76 @@ const char *ACSStringPool::GetString(int strnum)
 {
 	assert((strnum & LIBRARYID_MASK) == STRPOOL_LIBRARYID_OR);
 	strnum &= ~LIBRARYID_MASK;
-	if ((unsigned)strnum < Pool.Size() && Pool[strnum].Next != FREE_ENTRY)
+	if ((unsigned)strnum < Pool.Size() && !Pool[strnum].Free)
 	{
-		return Pool[strnum].Str;
+		return Pool[strnum].Chars;
 	}
 	return NULL;
 }
 
+//============================================================================
+//
+// ACSStringPool :: EndTic
+//
+// Strings added during a tic keep their text in TempArena, since most of
+// them are HUD text that is thrown away again right after. At the end of
+// the tic, the ones that are no longer referenced are freed, the rest are
+// moved to the heap and the arena is reset. This can't be done any sooner
+// because native code may still be holding pointers to the text.
+//
+//============================================================================
+
+void ACSStringPool::EndTic()
+{
+	if (TempStrings.Size() == 0)
+	{
+		return;
+	}
+
+	// Like InsertString, don't collect while the pool is still small.
+	bool collect = Pool.Size() >= MIN_GC_SIZE;
+	unsigned int freed = 0;
+
+	if (collect)
+	{
+		P_MarkACSGlobalStrings();
+	}
+	for (unsigned int i = 0; i < TempStrings.Size(); ++i)
+	{
+		PoolEntry *entry = &Pool[TempStrings[i]];
+		if (!entry->Temp)
+		{ // Already freed by PurgeStrings or listed twice
+			continue;
+		}
+		if (collect && entry->LockCount == 0)
+		{
+			FreeEntry(TempStrings[i]);
+			freed++;
+		}
+		else
+		{
+			entry->Str = FString(entry->Chars, entry->Len);
+			entry->Chars = entry->Str.GetChars();
+			entry->Temp = false;
+		}
+	}
+	if (collect)
+	{
+		// Remove P_MarkACSGlobalStrings's marks.
+		for (unsigned int i = 0; i < Pool.Size(); ++i)
+		{
+			Pool[i].LockCount &= 0x7FFFFFFF;
+		}
+	}
+	if (freed > 0)
+	{
+		Rehash(Table.Size());
+	}
+	ACSTempStringsFreed = freed;
+	TempStrings.Clear();
+	TempArena.FreeAll();
+}
+
 //============================================================================
 //
 // ACSStringPool :: LockString
@@ -557,39 +771,25 @@ void ACSStringPool::UnlockAll()
 
 void ACSStringPool::PurgeStrings()
 {
-	// Clear the hash buckets. We'll rebuild them as we decide what strings
-	// to keep and which to toss.
-	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
-	size_t usedcount = 0, freedcount = 0;
 	for (unsigned int i = 0; i < Pool.Size(); ++i)
 	{
 		PoolEntry *entry = &Pool[i];
-		if (entry->Next != FREE_ENTRY)
+		if (!entry->Free)
 		{
 			if (entry->LockCount == 0)
 			{
-				freedcount++;
-				// Mark this entry as free.
-				entry->Next = FREE_ENTRY;
-				if (i < FirstFreeEntry)
-				{
-					FirstFreeEntry = i;
-				}
-				// And free the string.
-				entry->Str = "";
+				FreeEntry(i);
 			}
 			else
 			{
-				usedcount++;
-				// Rehash this entry.
-				unsigned int h = entry->Hash % NUM_BUCKETS;
-				entry->Next = PoolBuckets[h];
-				PoolBuckets[h] = i;
 				// Remove MarkString's mark.
 				entry->LockCount &= 0x7FFFFFFF;
 			}
 		}
 	}
+	// The table has no way to delete single entries, so rebuild it with
+	// just the strings that are left.
+	Rehash(Table.Size());
 }
 
 //============================================================================
@@ -601,19 +801,20 @@ void ACSStringPool::PurgeStrings()
 //
 //============================================================================
 
-int ACSStringPool::FindString(const char *str, size_t len, unsigned int h, unsigned int bucketnum)
+int ACSStringPool::FindString(const char *str, size_t len, unsigned int h)
 {
-	unsigned int i = PoolBuckets[bucketnum];
-	while (i != NO_ENTRY)
+	unsigned int mask = Table.Size() - 1;
+	unsigned int i;
+
+	for (unsigned int slot = h & mask; (i = Table[slot]) != NO_ENTRY; slot = (slot + 1) & mask)
 	{
 		PoolEntry *entry = &Pool[i];
-		assert(entry->Next != FREE_ENTRY);
-		if (entry->Hash == h && entry->Str.Len() == len &&
-			memcmp(entry->Str.GetChars(), str, len) == 0)
+		assert(!entry->Free);
+		if (entry->Hash == h && entry->Len == len &&
+			memcmp(entry->Chars, str, len) == 0)
 		{
 			return i;
 		}
-		i = entry->Next;
 	}
 	return -1;
 }
@@ -626,8 +827,14 @@ int ACSStringPool::FindString(const char *str, size_t len, unsigned int h, unsig
 //
 //============================================================================
 
-int ACSStringPool::InsertString(FString &str, unsigned int h, unsigned int bucketnum)
+int ACSStringPool::InsertString(const char *str, size_t len, unsigned int h)
 {
+	// Copy the text first, because the collection below may free the
+	// string it came from.
+	char *chars = (char *)TempArena.Alloc(len + 1);
+	memcpy(chars, str, len);
+	chars[len] = '\0';
+
 	unsigned int index = FirstFreeEntry;
 	if (index >= MIN_GC_SIZE && index == Pool.Max())
 	{ // We will need to grow the array. Try a garbage collection first.
@@ -647,15 +854,92 @@ int ACSStringPool::InsertString(FString &str, unsigned int h, unsigned int bucke
 	{ // Scan for the next free entry
 		FindFirstFreeEntry(FirstFreeEntry + 1);
 	}
+	if ((NumUsed + 1) * 2 > Table.Size())
+	{ // Keep the table at most half full.
+		Rehash(Table.Size() * 2);
+	}
 	PoolEntry *entry = &Pool[index];
-	entry->Str = str;
+	entry->Chars = chars;
+	entry->Len = (unsigned int)len;
 	entry->Hash = h;
-	entry->Next = PoolBuckets[bucketnum];
 	entry->LockCount = 0;
-	PoolBuckets[bucketnum] = index;
+	entry->Free = false;
+	entry->Temp = true;
+	NumUsed++;
+	LinkEntry(index);
+	TempStrings.Push(index);
 	return index | STRPOOL_LIBRARYID_OR;
 }
 
+//============================================================================
+//
+// ACSStringPool :: FreeEntry
+//
+// Marks an entry as free. It stays in the hash table until the next Rehash.
+//
+//============================================================================
+
+void ACSStringPool::FreeEntry(unsigned int index)
+{
+	PoolEntry *entry = &Pool[index];
+	entry->Str = "";
+	entry->Chars = NULL;
+	entry->Len = 0;
+	entry->LockCount = 0;
+	entry->Free = true;
+	entry->Temp = false;
+	if (index < FirstFreeEntry)
+	{
+		FirstFreeEntry = index;
+	}
+	NumUsed--;
+}
+
+//============================================================================
+//
+// ACSStringPool :: LinkEntry
+//
+// Adds an entry to the hash table.
+//
+//============================================================================
+
+void ACSStringPool::LinkEntry(unsigned int index)
+{
+	unsigned int mask = Table.Size() - 1;
+	unsigned int slot = Pool[index].Hash & mask;
+
+	while (Table[slot] != NO_ENTRY)
+	{
+		slot = (slot + 1) & mask;
+	}
+	Table[slot] = index;
+}
+
+//============================================================================
+//
+// ACSStringPool :: Rehash
+//
+// Rebuilds the hash table with at least the given number of slots.
+//
+//============================================================================
+
+void ACSStringPool::Rehash(unsigned int size)
+{
+	while (size < NumUsed * 2)
+	{
+		size <<= 1;
+	}
+	Table.Resize(size);
+	memset(&Table[0], 0xFF, size * sizeof(Table[0]));
+	for (unsigned int i = 0; i < Pool.Size(); ++i)
+	{
+		if (!Pool[i].Free)
+		{
+			LinkEntry(i);
+		}
+	}
+}
+
 //============================================================================
 //
 // ACSStringPool :: FindFirstFreeEntry
@@ -666,7 +950,7 @@ int ACSStringPool::InsertString(FString &str, unsigned int h, unsigned int bucke
 
 void ACSStringPool::FindFirstFreeEntry(unsigned base)
 {
-	while (base < Pool.Size() && Pool[base].Next != FREE_ENTRY)
+	while (base < Pool.Size() && !Pool[base].Free)
 	{
 		base++;
 	}
@@ -683,46 +967,75 @@ void ACSStringPool::FindFirstFreeEntry(unsigned base)
 
 void ACSStringPool::ReadStrings(PNGHandle *png, DWORD id)
 {
-	Clear();
-
 	size_t len = M_FindPNGChunk(png, id);
 	if (len != 0)
 	{
 		FPNGChunkArchive arc(png->File->GetFile(), id, len);
-		int32 i, j, poolsize;
-		unsigned int h, bucketnum;
-		char *str = NULL;
+		ReadStrings(arc);
+	}
+	else
+	{
+		Clear();
+	}
+}
+
+//============================================================================
+//
+// ACSStringPool :: ReadStrings
+//
+// Replaces the pool with the strings written by WriteStrings to an archive.
+//
+//============================================================================
 
-		arc << poolsize;
+void ACSStringPool::ReadStrings(FArchive &arc)
+{
+	int32 i, j, poolsize;
+	char *str = NULL;
 
-		Pool.Resize(poolsize);
-		i = 0;
-		j = arc.ReadCount();
-		while (j >= 0)
-		{
-			// Mark skipped entries as free
-			for (; i < j; ++i)
-			{
-				Pool[i].Next = FREE_ENTRY;
-				Pool[i].LockCount = 0;
-			}
-			arc << str;
-			h = SuperFastHash(str, strlen(str));
-			bucketnum = h % NUM_BUCKETS;
-			Pool[i].Str = str;
-			Pool[i].Hash = h;
-			Pool[i].LockCount = arc.ReadCount();
-			Pool[i].Next = PoolBuckets[bucketnum];
-			PoolBuckets[bucketnum] = i;
-			i++;
-			j = arc.ReadCount();
-		}
-		if (str != NULL)
+	Clear();
+
+	arc << poolsize;
+
+	Pool.Resize(poolsize);
+	i = 0;
+	j = arc.ReadCount();
+	while (j >= 0)
+	{
+		// Mark skipped entries as free
+		for (; i < j; ++i)
 		{
-			delete[] str;
+			Pool[i].Chars = NULL;
+			Pool[i].Free = true;
+			Pool[i].Temp = false;
+			Pool[i].LockCount = 0;
 		}
-		FindFirstFreeEntry(0);
+		arc << str;
+		PoolEntry *entry = &Pool[i];
+		entry->Str = str;
+		entry->Chars = entry->Str.GetChars();
+		entry->Len = (unsigned int)entry->Str.Len();
+		entry->Hash = SuperFastHash(entry->Chars, entry->Len);
+		entry->LockCount = arc.ReadCount();
+		entry->Free = false;
+		entry->Temp = false;
+		NumUsed++;
+		i++;
+		j = arc.ReadCount();
+	}
+	// And so are any after the last one written
+	for (; i < poolsize; ++i)
+	{
+		Pool[i].Chars = NULL;
+		Pool[i].Free = true;
+		Pool[i].Temp = false;
+		Pool[i].LockCount = 0;
+	}
+	if (str != NULL)
+	{
+		delete[] str;
 	}
+	Rehash(MIN_TABLE_SIZE);
+	FindFirstFreeEntry(0);
 }
 
 //============================================================================
@@ -733,24 +1046,36 @@ void ACSStringPool::ReadStrings(PNGHandle *png, DWORD id)
 //
 //============================================================================
 
-void ACSStringPool::WriteStrings(FILE *file, DWORD id) const
+void ACSStringPool::WriteStrings(FileWriter *file, DWORD id) const
 {
-	int32 i, poolsize = (int32)Pool.Size();
-	
-	if (poolsize == 0)
+	if (Pool.Size() == 0)
 	{ // No need to write if we don't have anything.
 		return;
 	}
 	FPNGChunkArchive arc(file, id);
+	WriteStrings(arc);
+}
+
+//============================================================================
+//
+// ACSStringPool :: WriteStrings
+//
+// Writes all strings and their lock counts to an archive.
+//
+//============================================================================
+
+void ACSStringPool::WriteStrings(FArchive &arc) const
+{
+	int32 i, poolsize = (int32)Pool.Size();
 
 	arc << poolsize;
 	for (i = 0; i < poolsize; ++i)
 	{
 		PoolEntry *entry = &Pool[i];
-		if (entry->Next != FREE_ENTRY)
+		if (!entry->Free)
 		{
 			arc.WriteCount(i);
-			arc.WriteString(entry->Str);
+			arc.WriteString(entry->Chars);
 			arc.WriteCount(entry->LockCount);
 		}
 	}
@@ -769,12 +1094,12 @@ void ACSStringPool::Dump() const
 {
 	for (unsigned int i = 0; i < Pool.Size(); ++i)
 	{
-		if (Pool[i].Next != FREE_ENTRY)
+		if (!Pool[i].Free)
 		{
-			Printf("%4u. (%2d) \"%s\"\n", i, Pool[i].LockCount, Pool[i].Str.GetChars());
+			Printf("%4u. (%2d)%c\"%s\"\n", i, Pool[i].LockCount, Pool[i].Temp ? '*' : ' ', Pool[i].Chars);
 		}
 	}
-	Printf("First free %u\n", FirstFreeEntry);
+	Printf("First free %u, %u used, %u hash slots\n", FirstFreeEntry, NumUsed, Table.Size());
 }
 
 //============================================================================
@@ -809,13 +1134,13 @@ void P_MarkGlobalVarStrings()
 
 //============================================================================
 //
-// P_CollectACSGlobalStrings
+// P_MarkACSGlobalStrings
 //
-// Garbage collect ACS global strings.
+// Marks every ACS global string that is still referenced.
 //
 //============================================================================
 
-void P_CollectACSGlobalStrings()
+void P_MarkACSGlobalStrings()
 {
 	for (FACSStack *stack = FACSStack::head; stack != NULL; stack = stack->next)
 	{
@@ -824,7 +1149,37 @@ void P_CollectACSGlobalStrings()
 	FBehavior::StaticMarkLevelVarStrings();
 	P_MarkWorldVarStrings();
 	P_MarkGlobalVarStrings();
+}
+
+//============================================================================
+//
+// P_CollectACSGlobalStrings
+//
+// Garbage collect ACS global strings.
+//
+//============================================================================
+
+void P_CollectACSGlobalStrings()
+{
+	unsigned int used = GlobalACSStrings.NumStrings();
+
+	ACSStringGCCycles.Reset();
+	ACSStringGCCycles.Clock();
+	P_MarkACSGlobalStrings();
 	GlobalACSStrings.PurgeStrings();
+	ACSStringGCCycles.Unclock();
+	ACSStringsFreed = used - GlobalACSStrings.NumStrings();
+}
+
+ADD_STAT (acsstrings)
+{
+	FString out;
+	out.Format ("Strings: %u used, %u new, %u entries, %u slots. GC: %04.2f ms, %u freed. Tic end: %04.2f ms, %u freed",
+		GlobalACSStrings.NumStrings(), GlobalACSStrings.NumTempStrings(),
+		GlobalACSStrings.PoolSize(), GlobalACSStrings.TableSize(),
+		ACSStringGCCycles.TimeMS(), ACSStringsFreed,
+		ACSStringTicCycles.TimeMS(), ACSTempStringsFreed);
+	return out;
 }
 
 #ifdef _DEBUG
@@ -904,7 +1259,7 @@ void P_ClearACSVars(bool alsoglobal)
 //
 //============================================================================
 
-static void WriteVars (FILE *file, SDWORD *vars, size_t count, DWORD id)
+static void WriteVars (FileWriter *file, SDWORD *vars, size_t count, DWORD id)
 {
 	size_t i, j;
 
@@ -968,7 +1323,7 @@ static void ReadVars (PNGHandle *png, SDWORD *vars, size_t count, DWORD id)
 //
 //============================================================================
 
-static void WriteArrayVars (FILE *file, FWorldGlobalArray *vars, unsigned int count, DWORD id)
+static void WriteArrayVars (FileWriter *file, FWorldGlobalArray *vars, unsigned int count, DWORD id)
 {
 	unsigned int i, j;
 
@@ -1067,7 +1422,7 @@ void P_ReadACSVars(PNGHandle *png)
 //
 //============================================================================
 
-void P_WriteACSVars(FILE *stdfile)
+void P_WriteACSVars(FileWriter *stdfile)
 {
 	WriteVars (stdfile, ACS_WorldVars, NUM_WORLDVARS, MAKE_ID('w','v','A','r'));
 	WriteVars (stdfile, ACS_GlobalVars, NUM_GLOBALVARS, MAKE_ID('g','v','A','r'));
@@ -2224,6 +2579,11 @@ bool FBehavior::Init(int lumpnum, FileReader * fr, int len)
 		}
 	}
 
+	if (acs_fastdispatch && Format != ACS_Unknown)
+	{
+		PredecodeScripts ();
+	}
+
 	DPrintf ("Loaded %d scripts, %d functions\n", NumScripts, NumFunctions);
 	return true;
 }
@@ -3018,12 +3378,49 @@ void DACSThinker::Tick ()
 {
 	DLevelScript *script = Scripts;
 
+	ACSTicCycles.Reset();
+	ACSTicCycles.Clock();
 	while (script)
 	{
 		DLevelScript *next = script->next;
 		script->RunScript ();
 		script = next;
 	}
+	ACSTicCycles.Unclock();
+
+	ACSStringTicCycles.Reset();
+	ACSStringTicCycles.Clock();
+	GlobalACSStrings.EndTic();
+	ACSStringTicCycles.Unclock();
+	ACSLastTicPCodes = ACSTicPCodes;
+	ACSTicPCodes = 0;
+
+	if (ACSBench.Phase >= 0)
+	{
+		ACSBench.MS[ACSBench.Phase] += ACSTicCycles.TimeMS();
+		ACSBench.PCodes[ACSBench.Phase] += ACSLastTicPCodes;
+		if (--ACSBench.Left <= 0)
+		{
+			if (ACSBench.Phase == 0)
+			{
+				ACSBench.Phase = 1;
+				ACSBench.Left = ACSBench.Tics;
+				acs_fuse = true;
+			}
+			else
+			{
+				static const char *const names[2] = { "unfused", "fused" };
+				for (int i = 0; i < 2; ++i)
+				{
+					Printf ("%-7s: %llu p-codes in %.2f ms (%.2f M p-codes/s)\n", names[i],
+						ACSBench.PCodes[i], ACSBench.MS[i],
+						ACSBench.MS[i] > 0 ? ACSBench.PCodes[i] / (ACSBench.MS[i] * 1000) : 0.);
+				}
+				ACSBench.Phase = -1;
+				acs_fuse = ACSBench.OldFuse;
+			}
+		}
+	}
 
 //	GlobalACSStrings.Clear();
 
@@ -3677,6 +4074,27 @@ int DoGetMasterTID (AActor *self)
 	else return 0;
 }
 
+//============================================================================
+//
+// SingleActorFromTID
+//
+// Scripts tend to poll the same few TIDs every tic, so the first actor
+// found for a TID is remembered in a small direct-mapped cache. Entries
+// are only valid as long as the TID hash hasn't changed since they were
+// filled.
+//
+//============================================================================
+
+struct FTIDCacheEntry
+{
+	int TID;
+	DWORD Generation;
+	AActor *Actor;
+};
+
+static FTIDCacheEntry TIDCache[64];
+static unsigned int TIDCacheHits, TIDCacheMisses;
+
 AActor *SingleActorFromTID (int tid, AActor *defactor)
 {
 	if (tid == 0)
@@ -3685,11 +4103,31 @@ AActor *SingleActorFromTID (int tid, AActor *defactor)
 	}
 	else
 	{
+		FTIDCacheEntry *entry = &TIDCache[tid & (countof(TIDCache) - 1)];
+
+		if (entry->TID == tid && entry->Generation == AActor::TIDHashGeneration)
+		{
+			TIDCacheHits++;
+			return entry->Actor;
+		}
 		FActorIterator iterator (tid);
-		return iterator.Next();
+		TIDCacheMisses++;
+		entry->TID = tid;
+		entry->Generation = AActor::TIDHashGeneration;
+		entry->Actor = iterator.Next();
+		return entry->Actor;
 	}
 }
 
+ADD_STAT (acstid)
+{
+	FString out;
+	unsigned int total = TIDCacheHits + TIDCacheMisses;
+	out.Format ("TID cache: %u hits, %u misses (%.1f%% hit rate)",
+		TIDCacheHits, TIDCacheMisses, total > 0 ? TIDCacheHits * 100. / total : 0.);
+	return out;
+}
+
 enum
 {
 	APROP_Health		= 0,
@@ -6124,25 +6562,1169 @@ static bool CharArrayParms(int &capacity, int &offset, int &a, int *Stack, int &
 	return true;
 }
 
-int DLevelScript::RunScript ()
-{
-	DACSThinker *controller = DACSThinker::ActiveThinker;
-	SDWORD *locals = localvars;
-	ACSLocalArrays noarrays;
-	ACSLocalArrays *localarrays = &noarrays;
-	ScriptFunction *activeFunction = NULL;
+//==========================================================================
+//
+// Pre-decoded p-code
+//
+// Runs of p-code are decoded on first use into FACSInsn arrays, which
+// RunDecoded executes without having to care about the module's format or
+// check for the runaway limit separately. Only the simple, frequent
+// p-codes are handled this way; anything else is decoded as ACSOP_EXIT,
+// which hands control back to the regular interpreter in RunScript for a
+// single instruction.
+//
+//==========================================================================
+
+#define ACS_DECODED_OPS(xx) \
+	xx(EXIT) xx(LINK) xx(NOP) xx(PUSHNUMBER) xx(PUSHBYTES) xx(DUP) xx(SWAP) xx(DROP) \
+	xx(ADD) xx(SUBTRACT) xx(MULTIPLY) xx(DIVIDE) xx(MODULUS) \
+	xx(EQ) xx(NE) xx(LT) xx(GT) xx(LE) xx(GE) \
+	xx(ANDLOGICAL) xx(ORLOGICAL) xx(ANDBITWISE) xx(ORBITWISE) xx(EORBITWISE) \
+	xx(NEGATELOGICAL) xx(NEGATEBINARY) xx(LSHIFT) xx(RSHIFT) xx(UNARYMINUS) \
+	xx(ASSIGNSCRIPTVAR) xx(ASSIGNMAPVAR) xx(ASSIGNWORLDVAR) xx(ASSIGNGLOBALVAR) \
+	xx(PUSHSCRIPTVAR) xx(PUSHMAPVAR) xx(PUSHWORLDVAR) xx(PUSHGLOBALVAR) \
+	xx(ADDSCRIPTVAR) xx(ADDMAPVAR) xx(SUBSCRIPTVAR) xx(SUBMAPVAR) \
+	xx(INCSCRIPTVAR) xx(INCMAPVAR) xx(INCWORLDVAR) xx(INCGLOBALVAR) \
+	xx(DECSCRIPTVAR) xx(DECMAPVAR) xx(DECWORLDVAR) xx(DECGLOBALVAR) \
+	xx(PUSHWORLDARRAY) xx(PUSHGLOBALARRAY) xx(ASSIGNWORLDARRAY) xx(ASSIGNGLOBALARRAY) \
+	xx(GOTO) xx(IFGOTO) xx(IFNOTGOTO) xx(CASEGOTO) \
+	xx(LSPEC) xx(LSPECIMM) xx(CALLFUNC) \
+	xx(JVARLT) xx(JVARLE) xx(JVARGT) xx(JVARGE) xx(JVAREQ) xx(JVARNE)
+
+enum
+{
+#define xx(op) ACSOP_##op,
+	ACS_DECODED_OPS(xx)
+#undef xx
+	NUM_ACSOPS
+};
+
+static const unsigned int ACS_RUNAWAY_LIMIT = 2000000;
+
+static inline bool IsJumpOp (int op)
+{
+	return op == ACSOP_GOTO || op == ACSOP_IFGOTO || op == ACSOP_IFNOTGOTO || op == ACSOP_CASEGOTO ||
+		(op >= ACSOP_JVARLT && op <= ACSOP_JVARNE);
+}
+
+//==========================================================================
+//
+// FBehavior :: DecodeAt
+//
+// Returns the index of the decoded instruction for the p-code at ofs,
+// decoding a run of code starting there if it hasn't been seen yet. The
+// run ends at an unconditional jump, at a p-code that is not handled by
+// RunDecoded, or where it meets previously decoded code.
+//
+//==========================================================================
+
+int FBehavior::DecodeAt (DWORD ofs)
+{
+	int *found = DecodedIndex.CheckKey(ofs);
+	if (found != NULL)
+	{
+		return *found;
+	}
+
+	const int start = DecodedCode.Size();
+	const ACSFormat fmt = Format;
+
+	for (;;)
+	{
+		FACSInsn insn;
+
+		insn.Op = ACSOP_EXIT;
+		insn.Arg = insn.Arg2 = 0;
+		insn.Target = -1;
+		insn.Ofs = ofs;
+		insn.TargetOfs = 0;
+
+		found = DecodedIndex.CheckKey(ofs);
+		if (found != NULL)
+		{
+			// Flowed into code that was decoded earlier.
+			insn.Op = ACSOP_LINK;
+			insn.Target = *found;
+			DecodedCode.Push(insn);
+			break;
+		}
+		if (ofs + 8 > (DWORD)DataSize)
+		{
+			insn.Arg = -1;
+			DecodedIndex[ofs] = DecodedCode.Push(insn);
+			break;
+		}
+
+		int *pc = Ofs2PC(ofs);
+		int pcd;
+
+		if (fmt == ACS_LittleEnhanced)
+		{
+			pcd = getbyte(pc);
+			if (pcd >= 256-16)
+			{
+				pcd = (256-16) + ((pcd - (256-16)) << 8) + getbyte(pc);
+			}
+		}
+		else
+		{
+			pcd = NEXTWORD;
+		}
+
+		switch (pcd)
+		{
+#define xx(op) case DLevelScript::PCD_##op: insn.Op = ACSOP_##op; break;
+		xx(NOP) xx(DUP) xx(SWAP) xx(DROP)
+		xx(ADD) xx(SUBTRACT) xx(MULTIPLY) xx(DIVIDE) xx(MODULUS)
+		xx(EQ) xx(NE) xx(LT) xx(GT) xx(LE) xx(GE)
+		xx(ANDLOGICAL) xx(ORLOGICAL) xx(ANDBITWISE) xx(ORBITWISE) xx(EORBITWISE)
+		xx(NEGATELOGICAL) xx(NEGATEBINARY) xx(LSHIFT) xx(RSHIFT) xx(UNARYMINUS)
+#undef xx
+
+#define xx(op) case DLevelScript::PCD_##op: insn.Op = ACSOP_##op; insn.Arg = NEXTBYTE; break;
+		xx(ASSIGNSCRIPTVAR) xx(ASSIGNMAPVAR) xx(ASSIGNWORLDVAR) xx(ASSIGNGLOBALVAR)
+		xx(PUSHSCRIPTVAR) xx(PUSHMAPVAR) xx(PUSHWORLDVAR) xx(PUSHGLOBALVAR)
+		xx(ADDSCRIPTVAR) xx(ADDMAPVAR) xx(SUBSCRIPTVAR) xx(SUBMAPVAR)
+		xx(INCSCRIPTVAR) xx(INCMAPVAR) xx(INCWORLDVAR) xx(INCGLOBALVAR)
+		xx(DECSCRIPTVAR) xx(DECMAPVAR) xx(DECWORLDVAR) xx(DECGLOBALVAR)
+		xx(PUSHWORLDARRAY) xx(PUSHGLOBALARRAY) xx(ASSIGNWORLDARRAY) xx(ASSIGNGLOBALARRAY)
+#undef xx
+
+		case DLevelScript::PCD_PUSHNUMBER:
+			insn.Op = ACSOP_PUSHNUMBER;
+			insn.Arg = uallong(pc[0]);
+			pc++;
+			break;
+
+		case DLevelScript::PCD_PUSHBYTE:
+			insn.Op = ACSOP_PUSHNUMBER;
+			insn.Arg = *(BYTE *)pc;
+			pc = (int *)((BYTE *)pc + 1);
+			break;
+
+		case DLevelScript::PCD_PUSH2BYTES:
+		case DLevelScript::PCD_PUSH3BYTES:
+		case DLevelScript::PCD_PUSH4BYTES:
+		case DLevelScript::PCD_PUSH5BYTES:
+			insn.Op = ACSOP_PUSHBYTES;
+			insn.Arg = PC2Ofs(pc);
+			insn.Arg2 = pcd - DLevelScript::PCD_PUSH2BYTES + 2;
+			pc = (int *)((BYTE *)pc + insn.Arg2);
+			break;
+
+		case DLevelScript::PCD_PUSHBYTES:
+			insn.Op = ACSOP_PUSHBYTES;
+			insn.Arg2 = *(BYTE *)pc;
+			insn.Arg = PC2Ofs(pc) + 1;
+			pc = (int *)((BYTE *)pc + insn.Arg2 + 1);
+			break;
+
+		case DLevelScript::PCD_GOTO:
+		case DLevelScript::PCD_IFGOTO:
+		case DLevelScript::PCD_IFNOTGOTO:
+			insn.Op = pcd == DLevelScript::PCD_GOTO ? ACSOP_GOTO :
+					  pcd == DLevelScript::PCD_IFGOTO ? ACSOP_IFGOTO : ACSOP_IFNOTGOTO;
+			insn.TargetOfs = LittleLong(*pc);
+			pc++;
+			break;
+
+		case DLevelScript::PCD_CASEGOTO:
+			insn.Op = ACSOP_CASEGOTO;
+			insn.Arg = uallong(pc[0]);
+			insn.TargetOfs = uallong(pc[1]);
+			pc += 2;
+			break;
+
+		case DLevelScript::PCD_LSPEC1:
+		case DLevelScript::PCD_LSPEC2:
+		case DLevelScript::PCD_LSPEC3:
+		case DLevelScript::PCD_LSPEC4:
+		case DLevelScript::PCD_LSPEC5:
+			insn.Op = ACSOP_LSPEC;
+			insn.Arg = NEXTBYTE;
+			insn.Arg2 = pcd - DLevelScript::PCD_LSPEC1 + 1;
+			break;
+
+		// Immediate arguments go to DecodedArgs as
+		// <p-code count> <arg count> <apply special arg mask> <args...>
+		case DLevelScript::PCD_LSPEC1DIRECT:
+		case DLevelScript::PCD_LSPEC2DIRECT:
+		case DLevelScript::PCD_LSPEC3DIRECT:
+		case DLevelScript::PCD_LSPEC4DIRECT:
+		case DLevelScript::PCD_LSPEC5DIRECT:
+		{
+			int count = pcd - DLevelScript::PCD_LSPEC1DIRECT + 1;
+			insn.Op = ACSOP_LSPECIMM;
+			insn.Arg = NEXTBYTE;
+			insn.Arg2 = DecodedArgs.Push(1);
+			DecodedArgs.Push(count);
+			DecodedArgs.Push(true);
+			for (int i = 0; i < count; ++i)
+			{
+				DecodedArgs.Push(uallong(pc[i]));
+			}
+			pc += count;
+			break;
+		}
+
+		case DLevelScript::PCD_LSPEC1DIRECTB:
+		case DLevelScript::PCD_LSPEC2DIRECTB:
+		case DLevelScript::PCD_LSPEC3DIRECTB:
+		case DLevelScript::PCD_LSPEC4DIRECTB:
+		case DLevelScript::PCD_LSPEC5DIRECTB:
+		{
+			int count = pcd - DLevelScript::PCD_LSPEC1DIRECTB + 1;
+			insn.Op = ACSOP_LSPECIMM;
+			insn.Arg = ((BYTE *)pc)[0];
+			insn.Arg2 = DecodedArgs.Push(1);
+			DecodedArgs.Push(count);
+			DecodedArgs.Push(false);
+			for (int i = 1; i <= count; ++i)
+			{
+				DecodedArgs.Push(((BYTE *)pc)[i]);
+			}
+			pc = (int *)((BYTE *)pc + count + 1);
+			break;
+		}
+
+		case DLevelScript::PCD_CALLFUNC:
+			insn.Op = ACSOP_CALLFUNC;
+			insn.Arg = NEXTBYTE;
+			insn.Arg2 = NEXTSHORT;
+			break;
+
+		default:
+			insn.Arg = pcd;		// For acsdecode
+			break;
+		}
+
+		DecodedIndex[ofs] = DecodedCode.Push(insn);
+		if (insn.Op == ACSOP_EXIT || insn.Op == ACSOP_GOTO)
+		{
+			break;
+		}
+		ofs = PC2Ofs(pc);
+	}
+	if (acs_fuse)
+	{
+		FuseDecoded (start);
+	}
+	return start;
+}
+
+//==========================================================================
+//
+// FBehavior :: FuseDecoded
+//
+// Replaces the first instruction of common sequences with a single
+// instruction that does the work of all of them. The rest of the sequence
+// stays in place, since something may still jump into its middle. These
+// are the sequences acsprofile and acsdecode showed to dominate in mods
+// that run HUD and inventory scripts every tic:
+//
+//   pushscriptvar, pushnumber, <compare>, ifgoto/ifnotgoto -> JVAR*
+//   pushnumber x N, lspecN -> LSPECIMM
+//
+//==========================================================================
+
+void FBehavior::FuseDecoded (int start)
+{
+	FACSInsn *code = &DecodedCode[0];
+	int end = DecodedCode.Size();
+
+	for (int i = start; i < end; ++i)
+	{
+		if (code[i].Op == ACSOP_PUSHSCRIPTVAR && i + 3 < end &&
+			code[i+1].Op == ACSOP_PUSHNUMBER &&
+			(code[i+3].Op == ACSOP_IFGOTO || code[i+3].Op == ACSOP_IFNOTGOTO))
+		{
+			static const int fused[][2] =
+			{	// compare, op for ifgoto; inverse[] has the op for ifnotgoto
+				{ ACSOP_LT, ACSOP_JVARLT }, { ACSOP_LE, ACSOP_JVARLE },
+				{ ACSOP_GT, ACSOP_JVARGT }, { ACSOP_GE, ACSOP_JVARGE },
+				{ ACSOP_EQ, ACSOP_JVAREQ }, { ACSOP_NE, ACSOP_JVARNE },
+			};
+			static const int inverse[] = { ACSOP_JVARGE, ACSOP_JVARGT, ACSOP_JVARLE, ACSOP_JVARLT, ACSOP_JVARNE, ACSOP_JVAREQ };
+
+			for (unsigned j = 0; j < countof(fused); ++j)
+			{
+				if (code[i+2].Op == fused[j][0])
+				{
+					code[i].Op = code[i+3].Op == ACSOP_IFGOTO ? fused[j][1] : inverse[j];
+					code[i].Arg2 = code[i+1].Arg;
+					code[i].Target = code[i+3].Target;
+					code[i].TargetOfs = code[i+3].TargetOfs;
+					break;
+				}
+			}
+		}
+		else if (code[i].Op == ACSOP_PUSHNUMBER)
+		{
+			int count = 1;
+			while (count < 5 && i + count < end && code[i + count].Op == ACSOP_PUSHNUMBER)
+			{
+				count++;
+			}
+			if (i + count < end && code[i + count].Op == ACSOP_LSPEC && code[i + count].Arg2 == count)
+			{
+				int args = DecodedArgs.Push(count + 1);
+				DecodedArgs.Push(count);
+				DecodedArgs.Push(true);
+				for (int j = 0; j < count; ++j)
+				{
+					DecodedArgs.Push(code[i + j].Arg);
+				}
+				code[i].Op = ACSOP_LSPECIMM;
+				code[i].Arg = code[i + count].Arg;
+				code[i].Arg2 = args;
+			}
+		}
+	}
+}
+
+//==========================================================================
+//
+// FBehavior :: StaticRedecode
+//
+// Throws away all decoded code so that it gets decoded again with the
+// current settings.
+//
+//==========================================================================
+
+void FBehavior::StaticRedecode ()
+{
+	for (unsigned int i = 0; i < StaticModules.Size(); ++i)
+	{
+		FBehavior *module = StaticModules[i];
+		module->DecodedCode.Clear();
+		module->DecodedIndex.Clear();
+		module->DecodedArgs.Clear();
+		if (acs_fastdispatch && module->Format != ACS_Unknown)
+		{
+			module->PredecodeScripts();
+		}
+	}
+}
+
+//==========================================================================
+//
+// FBehavior :: PredecodeScripts
+//
+// Decodes everything reachable from the scripts and functions in this
+// module up front, so that running them never has to stop to decode.
+//
+//==========================================================================
+
+void FBehavior::PredecodeScripts ()
+{
+	int i;
+
+	for (i = 0; i < NumScripts; ++i)
+	{
+		DecodeAt (Scripts[i].Address);
+	}
+	for (i = 0; i < NumFunctions; ++i)
+	{
+		ScriptFunction *func = &Functions[i];
+		if (func->ImportNum == 0 && func->Address != 0)
+		{
+			DecodeAt (func->Address);
+		}
+	}
+	// DecodeAt appends, so this also visits whatever gets decoded here.
+	for (unsigned int j = 0; j < DecodedCode.Size(); ++j)
+	{
+		if (IsJumpOp(DecodedCode[j].Op) && DecodedCode[j].Target < 0)
+		{
+			int target = DecodeAt (DecodedCode[j].TargetOfs);
+			DecodedCode[j].Target = target;
+		}
+	}
+}
+
+//==========================================================================
+//
+// DLevelScript :: RunDecoded
+//
+// Executes decoded instructions starting at pc for as long as possible.
+// Returns with pc at the first p-code that RunScript has to handle, or
+// with state changed if the script had to stop.
+//
+//==========================================================================
+
+#if defined(__GNUC__)
+#define ACS_DISPATCH	goto *OpLabels[(insn = &code[ip++])->Op]
+#define ACS_OP(op)		Op_##op:
+#else
+#define ACS_DISPATCH	goto dispatch
+#define ACS_OP(op)		case ACSOP_##op:
+#endif
+
+// Every decoded instruction but EXIT and LINK counts as one executed p-code.
+#define ACS_NEXT \
+	if (++runaway > ACS_RUNAWAY_LIMIT) \
+	{ \
+		runaway--; \
+		pc = module->Ofs2PC(code[ip].Ofs); \
+		return; \
+	} \
+	ACS_DISPATCH
+
+// Specials and functions can do anything, including running other scripts
+// (which may decode more code) or stopping this one.
+#define ACS_AFTERCALL \
+	code = module->GetDecodedCode(); \
+	if (state != SCRIPT_Running) \
+	{ \
+		pc = module->Ofs2PC(code[ip].Ofs); \
+		return; \
+	}
+
+// Resolves a jump target and continues there.
+#define ACS_JUMP \
+	if ((ip = insn->Target) < 0) \
+	{ \
+		int index = insn - code; \
+		ip = module->DecodeAt(insn->TargetOfs); \
+		code = module->GetDecodedCode(); \
+		code[index].Target = ip; \
+	} \
+	ACS_NEXT
+
+void DLevelScript::RunDecoded(int *&pc, SDWORD *Stack, int &sp, SDWORD *locals, unsigned int &runaway)
+{
+#if defined(__GNUC__)
+	static void *const OpLabels[NUM_ACSOPS] =
+	{
+#define xx(op) &&Op_##op,
+		ACS_DECODED_OPS(xx)
+#undef xx
+	};
+#endif
+	FBehavior *const module = activeBehavior;
+	const int specialargmask = ((level.flags2 & LEVEL2_HEXENHACK) && module->GetFormat() == ACS_Old) ? 255 : ~0;
+	int ip = module->DecodeAt(module->PC2Ofs(pc));
+	FACSInsn *code = module->GetDecodedCode();
+	FACSInsn *insn;
+
+	if (code[ip].Op == ACSOP_EXIT)
+	{
+		return;
+	}
+	ACS_NEXT;
+
+#if !defined(__GNUC__)
+dispatch:
+	insn = &code[ip++];
+	switch (insn->Op)
+#endif
+	{
+	ACS_OP(EXIT)
+		runaway--;
+		pc = module->Ofs2PC(insn->Ofs);
+		return;
+
+	ACS_OP(LINK)
+		runaway--;
+		ip = insn->Target;
+		ACS_NEXT;
+
+	ACS_OP(NOP)
+		ACS_NEXT;
+
+	ACS_OP(PUSHNUMBER)
+		PushToStack (insn->Arg);
+		ACS_NEXT;
+
+	ACS_OP(PUSHBYTES)
+		{
+			const BYTE *bytes = (const BYTE *)module->Ofs2PC(insn->Arg);
+			for (int i = 0; i < insn->Arg2; ++i)
+			{
+				PushToStack (bytes[i]);
+			}
+		}
+		ACS_NEXT;
+
+	ACS_OP(DUP)
+		Stack[sp] = Stack[sp-1];
+		sp++;
+		ACS_NEXT;
+
+	ACS_OP(SWAP)
+		swapvalues(Stack[sp-2], Stack[sp-1]);
+		ACS_NEXT;
+
+	ACS_OP(DROP)
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ADD)
+		STACK(2) = STACK(2) + STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(SUBTRACT)
+		STACK(2) = STACK(2) - STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(MULTIPLY)
+		STACK(2) = STACK(2) * STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(DIVIDE)
+		if (STACK(1) == 0)
+		{
+			state = SCRIPT_DivideBy0;
+			pc = module->Ofs2PC(insn->Ofs);
+			return;
+		}
+		STACK(2) = STACK(2) / STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(MODULUS)
+		if (STACK(1) == 0)
+		{
+			state = SCRIPT_ModulusBy0;
+			pc = module->Ofs2PC(insn->Ofs);
+			return;
+		}
+		STACK(2) = STACK(2) % STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(EQ)
+		STACK(2) = (STACK(2) == STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(NE)
+		STACK(2) = (STACK(2) != STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(LT)
+		STACK(2) = (STACK(2) < STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(GT)
+		STACK(2) = (STACK(2) > STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(LE)
+		STACK(2) = (STACK(2) <= STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(GE)
+		STACK(2) = (STACK(2) >= STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ANDLOGICAL)
+		STACK(2) = (STACK(2) && STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ORLOGICAL)
+		STACK(2) = (STACK(2) || STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ANDBITWISE)
+		STACK(2) = (STACK(2) & STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ORBITWISE)
+		STACK(2) = (STACK(2) | STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(EORBITWISE)
+		STACK(2) = (STACK(2) ^ STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(NEGATELOGICAL)
+		STACK(1) = !STACK(1);
+		ACS_NEXT;
+
+	ACS_OP(NEGATEBINARY)
+		STACK(1) = ~STACK(1);
+		ACS_NEXT;
+
+	ACS_OP(LSHIFT)
+		STACK(2) = (STACK(2) << STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(RSHIFT)
+		STACK(2) = (STACK(2) >> STACK(1));
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(UNARYMINUS)
+		STACK(1) = -STACK(1);
+		ACS_NEXT;
+
+	ACS_OP(ASSIGNSCRIPTVAR)
+		locals[insn->Arg] = STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ASSIGNMAPVAR)
+		*(module->MapVars[insn->Arg]) = STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ASSIGNWORLDVAR)
+		ACS_WorldVars[insn->Arg] = STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ASSIGNGLOBALVAR)
+		ACS_GlobalVars[insn->Arg] = STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(PUSHSCRIPTVAR)
+		PushToStack (locals[insn->Arg]);
+		ACS_NEXT;
+
+	ACS_OP(PUSHMAPVAR)
+		PushToStack (*(module->MapVars[insn->Arg]));
+		ACS_NEXT;
+
+	ACS_OP(PUSHWORLDVAR)
+		PushToStack (ACS_WorldVars[insn->Arg]);
+		ACS_NEXT;
+
+	ACS_OP(PUSHGLOBALVAR)
+		PushToStack (ACS_GlobalVars[insn->Arg]);
+		ACS_NEXT;
+
+	ACS_OP(ADDSCRIPTVAR)
+		locals[insn->Arg] += STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(ADDMAPVAR)
+		*(module->MapVars[insn->Arg]) += STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(SUBSCRIPTVAR)
+		locals[insn->Arg] -= STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(SUBMAPVAR)
+		*(module->MapVars[insn->Arg]) -= STACK(1);
+		sp--;
+		ACS_NEXT;
+
+	ACS_OP(INCSCRIPTVAR)
+		++locals[insn->Arg];
+		ACS_NEXT;
+
+	ACS_OP(INCMAPVAR)
+		*(module->MapVars[insn->Arg]) += 1;
+		ACS_NEXT;
+
+	ACS_OP(INCWORLDVAR)
+		++ACS_WorldVars[insn->Arg];
+		ACS_NEXT;
+
+	ACS_OP(INCGLOBALVAR)
+		++ACS_GlobalVars[insn->Arg];
+		ACS_NEXT;
+
+	ACS_OP(DECSCRIPTVAR)
+		--locals[insn->Arg];
+		ACS_NEXT;
+
+	ACS_OP(DECMAPVAR)
+		*(module->MapVars[insn->Arg]) -= 1;
+		ACS_NEXT;
+
+	ACS_OP(DECWORLDVAR)
+		--ACS_WorldVars[insn->Arg];
+		ACS_NEXT;
+
+	ACS_OP(DECGLOBALVAR)
+		--ACS_GlobalVars[insn->Arg];
+		ACS_NEXT;
+
+	ACS_OP(PUSHWORLDARRAY)
+		STACK(1) = ACS_WorldArrays[insn->Arg][STACK(1)];
+		ACS_NEXT;
+
+	ACS_OP(PUSHGLOBALARRAY)
+		STACK(1) = ACS_GlobalArrays[insn->Arg][STACK(1)];
+		ACS_NEXT;
+
+	ACS_OP(ASSIGNWORLDARRAY)
+		ACS_WorldArrays[insn->Arg][STACK(2)] = STACK(1);
+		sp -= 2;
+		ACS_NEXT;
+
+	ACS_OP(ASSIGNGLOBALARRAY)
+		ACS_GlobalArrays[insn->Arg][STACK(2)] = STACK(1);
+		sp -= 2;
+		ACS_NEXT;
+
+	ACS_OP(GOTO)
+		ACS_JUMP;
+
+	ACS_OP(IFGOTO)
+		if (Stack[--sp])
+		{
+			ACS_JUMP;
+		}
+		ACS_NEXT;
+
+	ACS_OP(IFNOTGOTO)
+		if (!Stack[--sp])
+		{
+			ACS_JUMP;
+		}
+		ACS_NEXT;
+
+	ACS_OP(CASEGOTO)
+		if (STACK(1) == insn->Arg)
+		{
+			sp--;
+			ACS_JUMP;
+		}
+		ACS_NEXT;
+
+	ACS_OP(LSPEC)
+		{
+			int args[5] = { 0, 0, 0, 0, 0 };
+			int count = insn->Arg2;
+			for (int i = 0; i < count; ++i)
+			{
+				args[i] = STACK(count - i) & specialargmask;
+			}
+			P_ExecuteSpecial(insn->Arg, activationline, activator, backSide,
+				args[0], args[1], args[2], args[3], args[4]);
+			sp -= count;
+		}
+		ACS_AFTERCALL;
+		ACS_NEXT;
+
+	ACS_OP(LSPECIMM)
+		{
+			const int *imm = module->GetDecodedArgs(insn->Arg2);
+			int args[5] = { 0, 0, 0, 0, 0 };
+			int mask = imm[2] ? specialargmask : ~0;
+			for (int i = 0; i < imm[1]; ++i)
+			{
+				args[i] = imm[3 + i] & mask;
+			}
+			// Skip the pushes this was fused from.
+			runaway += imm[0] - 1;
+			ip += imm[0] - 1;
+			P_ExecuteSpecial(insn->Arg, activationline, activator, backSide,
+				args[0], args[1], args[2], args[3], args[4]);
+		}
+		ACS_AFTERCALL;
+		ACS_NEXT;
+
+	ACS_OP(CALLFUNC)
+		{
+			int argCount = insn->Arg;
+			int retval = CallFunction(argCount, insn->Arg2, &STACK(argCount));
+			sp -= argCount-1;
+			STACK(1) = retval;
+		}
+		ACS_AFTERCALL;
+		ACS_NEXT;
+
+#define ACS_JVAR(op, cond) \
+	ACS_OP(op) \
+		runaway += 3; \
+		if (locals[insn->Arg] cond insn->Arg2) \
+		{ \
+			ACS_JUMP; \
+		} \
+		ip += 3; \
+		ACS_NEXT;
+
+	ACS_JVAR(JVARLT, <)
+	ACS_JVAR(JVARLE, <=)
+	ACS_JVAR(JVARGT, >)
+	ACS_JVAR(JVARGE, >=)
+	ACS_JVAR(JVAREQ, ==)
+	ACS_JVAR(JVARNE, !=)
+#undef ACS_JVAR
+	}
+}
+
+#undef ACS_DISPATCH
+#undef ACS_OP
+#undef ACS_NEXT
+#undef ACS_JUMP
+#undef ACS_AFTERCALL
+
+//==========================================================================
+//
+// DLevelScript :: CheckDecoded
+//
+// Used instead of RunDecoded when acs_checkdispatch is on. Each p-code
+// that RunDecoded can handle without calling out of the script is first
+// run by it on its own, after which the script's state is put back and the
+// same p-code is left to the switch in RunScript. Once the switch has
+// caught up (fused instructions count as several p-codes), both results
+// are compared. Specials and function calls cannot be undone, so they are
+// only ever run by the switch.
+//
+//==========================================================================
+
+struct FDecodedCheck
+{
+	FDecodedCheck() : Pending(false) {}
+
+	bool Pending;
+	int Op;
+	DWORD Ofs;
+	unsigned int Runaway;	// The switch's count once it has caught up
+	int *PC;
+	int SP;
+	int State;
+	SDWORD *Var;			// Variable the instruction changes, if any
+	SDWORD VarValue;
+	TArray<SDWORD> Stack;
+	TArray<SDWORD> Saved;
+};
+
+static QWORD DecodedChecks;
+static unsigned int DecodedMismatches;
+
+static const char *const DecodedOpNames[NUM_ACSOPS] =
+{
+#define xx(op) #op,
+	ACS_DECODED_OPS(xx)
+#undef xx
+};
+
+void DLevelScript::CheckDecoded(int *pc, SDWORD *Stack, int sp, SDWORD *locals, unsigned int runaway, FDecodedCheck &check)
+{
+	if (check.Pending)
+	{
+		if (runaway < check.Runaway)
+		{
+			return;
+		}
+		FinishDecodedCheck(pc, Stack, sp, check);
+	}
+	if (runaway + 16 > ACS_RUNAWAY_LIMIT)
+	{
+		return;
+	}
+
+	FBehavior *const module = activeBehavior;
+	// A copy, since RunDecoded may decode more code and move the array.
+	const FACSInsn insn = module->GetDecodedCode()[module->DecodeAt(module->PC2Ofs(pc))];
+	SDWORD *var = NULL;
+
+	switch (insn.Op)
+	{
+	case ACSOP_EXIT:
+	case ACSOP_LSPEC:
+	case ACSOP_LSPECIMM:
+	case ACSOP_CALLFUNC:
+		return;
+
+	case ACSOP_ASSIGNSCRIPTVAR: case ACSOP_ADDSCRIPTVAR: case ACSOP_SUBSCRIPTVAR:
+	case ACSOP_INCSCRIPTVAR: case ACSOP_DECSCRIPTVAR:
+		var = &locals[insn.Arg];
+		break;
+
+	case ACSOP_ASSIGNMAPVAR: case ACSOP_ADDMAPVAR: case ACSOP_SUBMAPVAR:
+	case ACSOP_INCMAPVAR: case ACSOP_DECMAPVAR:
+		var = module->MapVars[insn.Arg];
+		break;
+
+	case ACSOP_ASSIGNWORLDVAR: case ACSOP_INCWORLDVAR: case ACSOP_DECWORLDVAR:
+		var = &ACS_WorldVars[insn.Arg];
+		break;
+
+	case ACSOP_ASSIGNGLOBALVAR: case ACSOP_INCGLOBALVAR: case ACSOP_DECGLOBALVAR:
+		var = &ACS_GlobalVars[insn.Arg];
+		break;
+
+	case ACSOP_ASSIGNWORLDARRAY:
+		var = &ACS_WorldArrays[insn.Arg][STACK(2)];
+		break;
+
+	case ACSOP_ASSIGNGLOBALARRAY:
+		var = &ACS_GlobalArrays[insn.Arg][STACK(2)];
+		break;
+	}
+
+	// Everything RunDecoded may change: the stack up to sp (which includes
+	// the locals of a function), one variable and the script's state.
+	const int oldstate = state;
+	const SDWORD oldvar = var != NULL ? *var : 0;
+	check.Saved.Resize(sp);
+	if (sp > 0) memcpy(&check.Saved[0], Stack, sp * sizeof(SDWORD));
+
+	// Starting one short of the runaway limit makes RunDecoded return after
+	// a single instruction.
+	int *dpc = pc;
+	int dsp = sp;
+	unsigned int steps = ACS_RUNAWAY_LIMIT - 1;
+	RunDecoded(dpc, Stack, dsp, locals, steps);
+
+	check.Pending = true;
+	check.Op = insn.Op;
+	check.Ofs = insn.Ofs;
+	check.Runaway = runaway + (steps - (ACS_RUNAWAY_LIMIT - 1));
+	check.PC = dpc;
+	check.SP = dsp;
+	check.State = state;
+	check.Var = var;
+	check.VarValue = var != NULL ? *var : 0;
+	check.Stack.Resize(dsp);
+	if (dsp > 0) memcpy(&check.Stack[0], Stack, dsp * sizeof(SDWORD));
+
+	if (sp > 0) memcpy(Stack, &check.Saved[0], sp * sizeof(SDWORD));
+	if (var != NULL) *var = oldvar;
+	state = oldstate;
+	DecodedChecks++;
+}
+
+//==========================================================================
+//
+// DLevelScript :: FinishDecodedCheck
+//
+// Compares the switch's result with what the decoded instruction did.
+//
+//==========================================================================
+
+void DLevelScript::FinishDecodedCheck(int *pc, SDWORD *Stack, int sp, FDecodedCheck &check)
+{
+	const char *what = NULL;
+
+	check.Pending = false;
+	if (state != check.State)
+	{
+		what = "state";
+	}
+	else if (state == SCRIPT_Running && pc != check.PC)
+	{
+		what = "pc";
+	}
+	else if (sp != check.SP)
+	{
+		what = "sp";
+	}
+	else if (sp > 0 && memcmp(Stack, &check.Stack[0], sp * sizeof(SDWORD)) != 0)
+	{
+		what = "stack";
+	}
+	else if (check.Var != NULL && *check.Var != check.VarValue)
+	{
+		what = "variable";
+	}
+	if (what != NULL)
+	{
+		DecodedMismatches++;
+		Printf ("%s, %s at offset %u: decoded %s differs in %s\n", ScriptPresentation(script).GetChars(),
+			activeBehavior->GetModuleName(), check.Ofs, DecodedOpNames[check.Op], what);
+	}
+}
+
+//==========================================================================
+//
+// CCMD acsdecode
+//
+// Shows how much of each loaded module the decoded interpreter covers and
+// which p-codes it leaves to RunScript most often, and the results of
+// acs_checkdispatch so far.
+//
+//==========================================================================
+
+CCMD (acsdecode)
+{
+	FBehavior *module;
+	TMap<int, unsigned int> fallbacks;
+
+	for (int lib = 0; (module = FBehavior::StaticGetModule(lib)) != NULL; ++lib)
+	{
+		FACSInsn *code;
+		unsigned int count, exits = 0, links = 0, fused = 0;
+
+		module->PredecodeScripts();
+		code = module->GetNumDecoded() > 0 ? module->GetDecodedCode() : NULL;
+		count = module->GetNumDecoded();
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			if (code[i].Op == ACSOP_EXIT)
+			{
+				exits++;
+				fallbacks[code[i].Arg]++;
+			}
+			else if (code[i].Op == ACSOP_LINK)
+			{
+				links++;
+			}
+			else if ((code[i].Op == ACSOP_LSPECIMM && module->GetDecodedArgs(code[i].Arg2)[0] > 1) ||
+				(code[i].Op >= ACSOP_JVARLT && code[i].Op <= ACSOP_JVARNE))
+			{
+				fused++;
+			}
+		}
+		count -= links;
+		Printf ("%-8s: %u p-codes, %u decoded (%.1f%%), %u fused sequences\n", module->GetModuleName(), count, count - exits,
+			count > 0 ? 100. * (count - exits) / count : 0., fused);
+	}
+
+	TMap<int, unsigned int>::Iterator it(fallbacks);
+	TMap<int, unsigned int>::Pair *pair;
+	TArray<TMap<int, unsigned int>::Pair *> sorted;
+	while (it.NextPair(pair))
+	{
+		unsigned int i;
+		for (i = 0; i < sorted.Size() && sorted[i]->Value >= pair->Value; ++i)
+		{
+		}
+		sorted.Insert(i, pair);
+	}
+	for (unsigned int i = 0; i < sorted.Size() && i < 10; ++i)
+	{
+		Printf ("  p-code %d: %u\n", sorted[i]->Key, sorted[i]->Value);
+	}
+	if (DecodedChecks > 0)
+	{
+		Printf ("%llu decoded instructions checked against the switch, %u mismatches\n",
+			(unsigned long long)DecodedChecks, DecodedMismatches);
+	}
+}
+
+//==========================================================================
+//
+// CCMD acsbench
+//
+// Runs the next <tics> tics without fusion and the same number with it,
+// then reports the p-code throughput of both.
+//
+//==========================================================================
+
+CCMD (acsbench)
+{
+	if (ACSBench.Phase >= 0)
+	{
+		Printf ("acsbench is already running\n");
+		return;
+	}
+	ACSBench.Tics = argv.argc() > 1 ? atoi(argv[1]) : TICRATE * 10;
+	if (ACSBench.Tics <= 0)
+	{
+		Printf ("Usage: acsbench [tics]\n");
+		return;
+	}
+	ACSBench.Left = ACSBench.Tics;
+	ACSBench.Phase = 0;
+	ACSBench.OldFuse = acs_fuse;
+	ACSBench.MS[0] = ACSBench.MS[1] = 0;
+	ACSBench.PCodes[0] = ACSBench.PCodes[1] = 0;
+	acs_fuse = false;
+}
+
+ADD_STAT (acs)
+{
+	FString out;
+	out.Format ("ACS: %u p-codes in %04.2f ms (%s)", ACSLastTicPCodes, ACSTicCycles.TimeMS(),
+		!acs_fastdispatch ? "switch" : acs_fuse ? "fused" : "decoded");
+	return out;
+}
+
+//==========================================================================
+//
+// Names a script for the scripting profiler.
+//
+//==========================================================================
+
+static FString ProfiledScriptName(const void *key)
+{
+	const ScriptPtr *ptr = (const ScriptPtr *)key;
+
+	FBehavior *module;
+
+	for (int i = 0; (module = FBehavior::StaticGetModule(i)) != NULL; ++i)
+	{
+		if (module->GetScriptIndex(ptr) >= 0)
+		{
+			FString name;
+			name << module->GetModuleName() << ' ' << ScriptPresentation(ptr->Number);
+			return name;
+		}
+	}
+	return ScriptPresentation(ptr->Number);
+}
+
+//==========================================================================
+//
+// Names a function for the scripting profiler.
+//
+//==========================================================================
+
+static FString ProfiledFunctionName(const void *key)
+{
+	const ScriptFunction *func = (const ScriptFunction *)key;
+
+	FBehavior *module;
+
+	for (int i = 0; (module = FBehavior::StaticGetModule(i)) != NULL; ++i)
+	{
+		int index = module->GetFunctionIndex(func);
+		if (index >= 0)
+		{
+			FString name;
+			DWORD *fnames = (DWORD *)module->FindChunk(MAKE_ID('F','N','A','M'));
+			if (fnames != NULL && index < (int)LittleLong(fnames[2]))
+			{
+				name.Format("%s %s", module->GetModuleName(), (char *)(fnames + 2) + LittleLong(fnames[3+index]));
+			}
+			else
+			{
+				name.Format("%s function %d", module->GetModuleName(), index);
+			}
+			return name;
+		}
+	}
+	return "(unknown)";
+}
+
+int DLevelScript::RunScript ()
+{
+	DACSThinker *controller = DACSThinker::ActiveThinker;
+	SDWORD *locals = localvars;
+	ACSLocalArrays noarrays;
+	ACSLocalArrays *localarrays = &noarrays;
+	ScriptFunction *activeFunction = NULL;
 	FRemapTable *translation = 0;
 	int resultValue = 1;
+	ScriptPtr *scriptptr = NULL;
 
 	if (InModuleScriptNumber >= 0)
 	{
-		ScriptPtr *ptr = activeBehavior->GetScriptPtr(InModuleScriptNumber);
-		assert(ptr != NULL);
-		if (ptr != NULL)
+		scriptptr = activeBehavior->GetScriptPtr(InModuleScriptNumber);
+		assert(scriptptr != NULL);
+		if (scriptptr != NULL)
 		{
-			localarrays = &ptr->LocalArrays;
+			localarrays = &scriptptr->LocalArrays;
 		}
 	}
+	FScriptProfileScope profile(SPT_ACS, scriptptr, ProfiledScriptName);
 
 	// Hexen truncates all special arguments to bytes (only when using an old MAPINFO and old ACS format
 	const int specialargmask = ((level.flags2 & LEVEL2_HEXENHACK) && activeBehavior->GetFormat() == ACS_Old) ? 255 : ~0;
@@ -6208,6 +7790,7 @@ int DLevelScript::RunScript ()
 	ACSFormat fmt = activeBehavior->GetFormat();
 	FBehavior* const savedActiveBehavior = activeBehavior;
 	unsigned int runaway = 0;	// used to prevent infinite loops
+	FDecodedCheck check;
 	int pcd;
 	FString work;
 	const char *lookup;
@@ -6216,7 +7799,23 @@ int DLevelScript::RunScript ()
 
 	while (state == SCRIPT_Running)
 	{
-		if (++runaway > 2000000)
+		if (acs_fastdispatch)
+		{
+			if (acs_checkdispatch)
+			{
+				CheckDecoded(pc, Stack, sp, locals, runaway, check);
+			}
+			else
+			{
+				RunDecoded(pc, Stack, sp, locals, runaway);
+				if (state != SCRIPT_Running)
+				{
+					break;
+				}
+			}
+		}
+
+		if (++runaway > ACS_RUNAWAY_LIMIT)
 		{
 			Printf ("Runaway %s terminated\n", ScriptPresentation(script).GetChars());
 			state = SCRIPT_PleaseRemove;
@@ -6514,7 +8113,8 @@ int DLevelScript::RunScript ()
 				}
 				sp += i;
 				::new(&Stack[sp]) CallReturn(activeBehavior->PC2Ofs(pc), activeFunction,
-					activeBehavior, mylocals, localarrays, pcd == PCD_CALLDISCARD, runaway);
+					activeBehavior, mylocals, localarrays, pcd == PCD_CALLDISCARD, runaway,
+					ScriptProfiling ? ScriptProfiler.Enter(ScriptProfiler.Find(SPT_ACSFunction, func, ProfiledFunctionName)) : 0);
 				sp += (sizeof(CallReturn) + sizeof(int) - 1) / sizeof(int);
 				pc = module->Ofs2PC (func->Address);
 				localarrays = &func->LocalArrays;
@@ -6545,6 +8145,10 @@ int DLevelScript::RunScript ()
 				sp -= sizeof(CallReturn)/sizeof(int);
 				retsp = &Stack[sp];
 				activeBehavior->GetFunctionProfileData(activeFunction)->AddRun(runaway - ret->EntryInstrCount);
+				if (ret->ProfileFrame != 0)
+				{
+					ScriptProfiler.Leave(ret->ProfileFrame);
+				}
 				sp = int(locals - Stack);
 				pc = ret->ReturnModule->Ofs2PC(ret->ReturnAddress);
 				activeFunction = ret->ReturnFunction;
@@ -9538,6 +11142,13 @@ scriptwait:
  		}
  	}
 
+	if (check.Pending)
+	{
+		// The checked instruction stopped the script.
+		FinishDecodedCheck(pc, Stack, sp, check);
+	}
+
+	ACSTicPCodes += runaway;
 	if (runaway != 0 && InModuleScriptNumber >= 0)
 	{
 		activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.AddRun(runaway);
@@ -38,12 +38,14 @@
 #include "dobject.h"
 #include "dthinker.h"
 #include "doomtype.h"
+#include "memarena.h"
 
 #define LOCAL_SIZE				20
 #define NUM_MAPVARS				128
 
 class FFont;
 class FileReader;
+class FileWriter;
 
 
 enum
@@ -59,7 +61,71 @@ struct InitIntToZero
 		v = 0;
 	}
 };
-typedef TMap<SDWORD, SDWORD, THashTraits<SDWORD>, InitIntToZero> FWorldGlobalArray;
+
+// World and global arrays have no declared size, so any index is valid.
+// Indices that are used contiguously from 0 are stored in a plain array;
+// only the ones that don't fit into it go to a hash map. Like the map,
+// reading an element that was never written creates it with a value of 0,
+// but elements that are 0 are not reported by the iterator or CountUsed.
+class FWorldGlobalArray
+{
+public:
+	typedef TMap<SDWORD, SDWORD, THashTraits<SDWORD>, InitIntToZero> SparseMap;
+	struct Pair
+	{
+		SDWORD Key;
+		SDWORD Value;
+	};
+	typedef const Pair ConstPair;
+
+	class ConstIterator
+	{
+	public:
+		ConstIterator(const FWorldGlobalArray &array);
+		bool NextPair(ConstPair *&pair);
+
+	private:
+		const FWorldGlobalArray &Array;
+		unsigned int DenseIndex;
+		SparseMap::ConstIterator SparseIt;
+		Pair Current;
+	};
+
+	SDWORD &operator[] (SDWORD index)
+	{
+		if ((unsigned)index < Dense.Size())
+		{
+			return Dense[index];
+		}
+		return Grow(index);
+	}
+	void Insert(SDWORD index, SDWORD value)
+	{
+		(*this)[index] = value;
+	}
+	unsigned int CountUsed() const;
+	unsigned int DenseSize() const
+	{
+		return Dense.Size();
+	}
+	unsigned int SparseSize() const
+	{
+		return Sparse.CountUsed();
+	}
+	const SDWORD *DenseElements() const
+	{
+		return Dense.Size() > 0 ? &Dense[0] : NULL;
+	}
+	void Clear();
+
+private:
+	enum { MIN_DENSE = 64, MAX_DENSE = 1 << 18 };
+
+	SDWORD &Grow(SDWORD index);
+
+	TArray<SDWORD> Dense;
+	SparseMap Sparse;
+};
 
 // ACS variables with world scope
 extern SDWORD ACS_WorldVars[NUM_WORLDVARS];
@@ -83,6 +149,7 @@ public:
 	int AddString(const char *str);
 	int AddString(FString &str);
 	const char *GetString(int strnum);
+	void EndTic();
 	void LockString(int strnum);
 	void UnlockString(int strnum);
 	void UnlockAll();
@@ -95,33 +162,49 @@ public:
 	void Clear();
 	void Dump() const;
 	void ReadStrings(PNGHandle *png, DWORD id);
-	void WriteStrings(FILE *file, DWORD id) const;
+	void WriteStrings(FileWriter *file, DWORD id) const;
+	void ReadStrings(FArchive &arc);
+	void WriteStrings(FArchive &arc) const;
+
+	unsigned int NumStrings() const { return NumUsed; }
+	unsigned int NumTempStrings() const { return TempStrings.Size(); }
+	unsigned int PoolSize() const { return Pool.Size(); }
+	unsigned int TableSize() const { return Table.Size(); }
 
 private:
-	int FindString(const char *str, size_t len, unsigned int h, unsigned int bucketnum);
-	int InsertString(FString &str, unsigned int h, unsigned int bucketnum);
+	int FindString(const char *str, size_t len, unsigned int h);
+	int InsertString(const char *str, size_t len, unsigned int h);
 	void FindFirstFreeEntry(unsigned int base);
+	void FreeEntry(unsigned int index);
+	void LinkEntry(unsigned int index);
+	void Rehash(unsigned int size);
 
-	enum { NUM_BUCKETS = 251 };
-	enum { FREE_ENTRY = 0xFFFFFFFE };	// Stored in PoolEntry's Next field
+	enum { MIN_TABLE_SIZE = 256 };		// Must be a power of 2
 	enum { NO_ENTRY = 0xFFFFFFFF };
 	enum { MIN_GC_SIZE = 100 };			// Don't auto-collect until there are this many strings
 	struct PoolEntry
 	{
-		FString Str;
+		FString Str;					// Empty for strings still in TempArena
+		const char *Chars;
+		unsigned int Len;
 		unsigned int Hash;
-		unsigned int Next;
 		unsigned int LockCount;
+		bool Free;
+		bool Temp;
 	};
 	TArray<PoolEntry> Pool;
-	unsigned int PoolBuckets[NUM_BUCKETS];
+	TArray<unsigned int> Table;			// Open addressing with linear probing
+	TArray<unsigned int> TempStrings;	// Entries added since the last EndTic
+	FMemArena TempArena;				// Text of those entries
 	unsigned int FirstFreeEntry;
+	unsigned int NumUsed;
 };
 extern ACSStringPool GlobalACSStrings;
 
+void P_MarkACSGlobalStrings();
 void P_CollectACSGlobalStrings();
 void P_ReadACSVars(PNGHandle *);
-void P_WriteACSVars(FILE*);
+void P_WriteACSVars(FileWriter*);
 void P_ClearACSVars(bool);
 void P_SerializeACSScriptNumber(FArchive &arc, int &scriptnum, bool was2byte);
 
@@ -280,6 +363,21 @@ enum
 
 enum ACSFormat { ACS_Old, ACS_Enhanced, ACS_LittleEnhanced, ACS_Unknown };
 
+// A p-code decoded into a fixed-width form for DLevelScript::RunDecoded.
+// Operands are already read in the module's format and jump targets are
+// resolved to instruction indices once they have been decoded.
+struct FACSInsn
+{
+	int Op;				// One of the ACSOP_* values in p_acs.cpp
+	int Arg;			// Immediate value, variable number or data offset
+	int Arg2;
+	int Target;			// Index of the jump target, or -1 if not decoded yet
+	DWORD Ofs;			// Offset of the original p-code
+	DWORD TargetOfs;
+};
+
+struct FDecodedCheck;
+
 class FBehavior
 {
 public:
@@ -308,6 +406,7 @@ public:
 	int *GetScriptAddress (const ScriptPtr *ptr) const { return (int *)(ptr->Address + Data); }
 	int GetScriptIndex (const ScriptPtr *ptr) const { ptrdiff_t index = ptr - Scripts; return index >= NumScripts ? -1 : (int)index; }
 	ScriptPtr *GetScriptPtr(int index) const { return index >= 0 && index < NumScripts ? &Scripts[index] : NULL; }
+	int GetFunctionIndex (const ScriptFunction *func) const { ptrdiff_t index = func - Functions; return index < 0 || index >= NumFunctions ? -1 : (int)index; }
 	int GetLumpNum() const { return LumpNum; }
 	int GetDataSize() const { return DataSize; }
 	const char *GetModuleName() const { return ModuleName; }
@@ -315,6 +414,12 @@ public:
 	ACSProfileInfo *GetFunctionProfileData(ScriptFunction *func) { return GetFunctionProfileData((int)(func - (ScriptFunction *)Functions)); }
 	const char *LookupString (DWORD index) const;
 
+	int DecodeAt (DWORD ofs);
+	void PredecodeScripts ();
+	FACSInsn *GetDecodedCode () { return &DecodedCode[0]; }
+	unsigned int GetNumDecoded () const { return DecodedCode.Size(); }
+	const int *GetDecodedArgs (int index) const { return &DecodedArgs[index]; }
+
 	SDWORD *MapVars[NUM_MAPVARS];
 
 	static FBehavior *StaticLoadModule (int lumpnum, FileReader * fr=NULL, int len=0);
@@ -331,6 +436,7 @@ public:
 	static const char *StaticLookupString (DWORD index);
 	static void StaticStartTypedScripts (WORD type, AActor *activator, bool always, int arg1=0, bool runNow=false);
 	static void StaticStopMyScripts (AActor *actor);
+	static void StaticRedecode ();
 
 private:
 	struct ArrayInfo;
@@ -356,10 +462,14 @@ private:
 	DWORD LibraryID;
 	char ModuleName[9];
 	TArray<int> JumpPoints;
+	TArray<FACSInsn> DecodedCode;
+	TMap<DWORD, int> DecodedIndex;
+	TArray<int> DecodedArgs;
 
 	static TArray<FBehavior *> StaticModules;
 
 	void LoadScriptsDirectory ();
+	void FuseDecoded (int start);
 
 	static int STACK_ARGS SortScripts (const void *a, const void *b);
 	void UnencryptStrings ();
@@ -911,6 +1021,9 @@ protected:
 	int DoSpawnSpotFacing (int type, int spot, int tid, bool forced);
 	int DoClassifyActor (int tid);
 	int CallFunction(int argCount, int funcIndex, SDWORD *args);
+	void RunDecoded(int *&pc, SDWORD *Stack, int &sp, SDWORD *locals, unsigned int &runaway);
+	void CheckDecoded(int *pc, SDWORD *Stack, int sp, SDWORD *locals, unsigned int runaway, FDecodedCheck &check);
+	void FinishDecodedCheck(int *pc, SDWORD *Stack, int sp, FDecodedCheck &check);
 
 	void DoFadeTo (int r, int g, int b, int a, fixed_t time);
 	void DoFadeRange (int r1, int g1, int b1, int a1,
@@ -70,6 +70,7 @@ void P_GetPolySpots (MapData * lump, TArray<FNodeBuilder::FPolyStart> &spots, TA
 
 CVAR(Bool, gl_cachenodes, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR(Float, gl_cachetime, 0.6f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+EXTERN_CVAR(Bool, showloadtimes)
 
 void P_LoadZNodes (FileReader &dalump, DWORD id);
 static bool CheckCachedNodes(MapData *map);
@@ -1017,6 +1018,7 @@ bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime)
 				subsectors, numsubsectors,
 				vertexes, numvertexes);
 			endTime = I_FPSTime ();
+			if (showloadtimes) builder.PrintTimes ();
 			DPrintf ("BSP generation took %.3f sec (%d segs)\n", (endTime - startTime) * 0.001, numsegs);
 			buildtime = endTime - startTime;
 		}
@@ -1058,7 +1060,7 @@ bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime)
 typedef TArray<BYTE> MemFile;
 
 
-static FString CreateCacheName(MapData *map, bool create)
+FString P_CreateCacheName(MapData *map, bool create, const char *extension)
 {
 	FString path = M_GetCachePath(create);
 	FString lumpname = Wads.GetLumpFullPath(map->lumpnum);
@@ -1067,7 +1069,7 @@ static FString CreateCacheName(MapData *map, bool create)
 	if (create) CreatePath(path);
 
 	lumpname.ReplaceChars('/', '%');
-	path << '/' << lumpname.Right(lumpname.Len() - separator - 1) << ".gzc";
+	path << '/' << lumpname.Right(lumpname.Len() - separator - 1) << extension;
 	return path;
 }
 
@@ -1185,7 +1187,7 @@ static void CreateCachedNodes(MapData *map)
 	}
 	memcpy(compressed + offset - 4, "ZGL3", 4);
 
-	FString path = CreateCacheName(map, true);
+	FString path = P_CreateCacheName(map, true, ".gzc");
 	FILE *f = fopen(path, "wb");
 
 	if (f != NULL)
@@ -1214,7 +1216,7 @@ static bool CheckCachedNodes(MapData *map)
 	DWORD numlin;
 	DWORD *verts = NULL;
 
-	FString path = CreateCacheName(map, false);
+	FString path = P_CreateCacheName(map, false, ".gzc");
 	FILE *f = fopen(path, "rb");
 	if (f == NULL) return false;
 
@@ -2759,6 +2759,7 @@ void P_NightmareRespawn (AActor *mobj)
 
 
 AActor *AActor::TIDHash[128];
+DWORD AActor::TIDHashGeneration = 1;
 
 //
 // P_ClearTidHashes
@@ -2769,6 +2770,7 @@ AActor *AActor::TIDHash[128];
 void AActor::ClearTIDHashes ()
 {
 	memset(TIDHash, 0, sizeof(TIDHash));
+	TIDHashGeneration++;
 }
 
 //
@@ -2796,6 +2798,7 @@ void AActor::AddToHash ()
 		{
 			inext->iprev = &inext;
 		}
+		TIDHashGeneration++;
 	}
 }
 
@@ -2815,6 +2818,7 @@ void AActor::RemoveFromHash ()
 		}
 		iprev = NULL;
 		inext = NULL;
+		TIDHashGeneration++;
 	}
 	tid = 0;
 }
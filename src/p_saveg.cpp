@@ -53,6 +53,7 @@
 #include "p_lnspec.h"
 #include "p_acs.h"
 #include "p_terrain.h"
+#include "version.h"
 
 static void CopyPlayer (player_t *dst, player_t *src, const char *name);
 static void ReadOnePlayer (FArchive &arc, bool skipload);
@@ -324,171 +325,549 @@ static void SpawnExtraPlayers ()
 	}
 }
 
+//==========================================================================
 //
-// P_ArchiveWorld
+// SerializeSector
 //
-void P_SerializeWorld (FArchive &arc)
-{
-	int i, j;
-	sector_t *sec;
-	line_t *li;
-	zone_t *zn;
+//==========================================================================
 
-	// do sectors
-	for (i = 0, sec = sectors; i < numsectors; i++, sec++)
+static void SerializeSector (FArchive &arc, sector_t *sec)
+{
+	arc << sec->floorplane
+		<< sec->ceilingplane;
+	if (SaveVersion < 3223)
 	{
-		arc << sec->floorplane
-			<< sec->ceilingplane;
-		if (SaveVersion < 3223)
-		{
-			BYTE bytelight;
-			arc << bytelight;
-			sec->lightlevel = bytelight;
-		}
-		else
-		{
-			arc << sec->lightlevel;
-		}
-		arc << sec->special;
-		if (SaveVersion < 4523)
+		BYTE bytelight;
+		arc << bytelight;
+		sec->lightlevel = bytelight;
+	}
+	else
+	{
+		arc << sec->lightlevel;
+	}
+	arc << sec->special;
+	if (SaveVersion < 4523)
+	{
+		short tag;
+		arc << tag;
+	}
+	arc << sec->soundtraversed
+		<< sec->seqType
+		<< sec->friction
+		<< sec->movefactor
+		<< sec->floordata
+		<< sec->ceilingdata
+		<< sec->lightingdata
+		<< sec->stairlock
+		<< sec->prevsec
+		<< sec->nextsec
+		<< sec->planes[sector_t::floor]
+		<< sec->planes[sector_t::ceiling]
+		<< sec->heightsec
+		<< sec->bottommap << sec->midmap << sec->topmap
+		<< sec->gravity;
+	if (SaveVersion >= 4530)
+	{
+		P_SerializeTerrain(arc, sec->terrainnum[0]);
+		P_SerializeTerrain(arc, sec->terrainnum[1]);
+	}
+	if (SaveVersion >= 4529)
+	{
+		arc << sec->damageamount;
+	}
+	else
+	{
+		short dmg;
+		arc << dmg;
+		sec->damageamount = dmg;
+	}
+	if (SaveVersion >= 4528)
+	{
+		arc << sec->damageinterval
+			<< sec->leakydamage
+			<< sec->damagetype;
+	}
+	else
+	{
+		short damagemod;
+		arc << damagemod;
+		sec->damagetype = MODtoDamageType(damagemod);
+		if (sec->damageamount < 20)
 		{
-			short tag;
-			arc << tag;
+			sec->leakydamage = 0;
+			sec->damageinterval = 32;
 		}
-		arc << sec->soundtraversed
-			<< sec->seqType
-			<< sec->friction
-			<< sec->movefactor
-			<< sec->floordata
-			<< sec->ceilingdata
-			<< sec->lightingdata
-			<< sec->stairlock
-			<< sec->prevsec
-			<< sec->nextsec
-			<< sec->planes[sector_t::floor]
-			<< sec->planes[sector_t::ceiling]
-			<< sec->heightsec
-			<< sec->bottommap << sec->midmap << sec->topmap
-			<< sec->gravity;
-		if (SaveVersion >= 4530)
+		else if (sec->damageamount < 50)
 		{
-			P_SerializeTerrain(arc, sec->terrainnum[0]);
-			P_SerializeTerrain(arc, sec->terrainnum[1]);
+			sec->leakydamage = 5;
+			sec->damageinterval = 32;
 		}
-		if (SaveVersion >= 4529)
+		else
 		{
-			arc << sec->damageamount;
+			sec->leakydamage = 256;
+			sec->damageinterval = 1;
 		}
-		else
+	}
+
+	arc << sec->SoundTarget
+		<< sec->SecActTarget
+		<< sec->sky
+		<< sec->MoreFlags
+		<< sec->Flags
+		<< sec->SkyBoxes[sector_t::floor] << sec->SkyBoxes[sector_t::ceiling]
+		<< sec->ZoneNumber;
+	if (SaveVersion < 4529)
+	{
+		short secretsector;
+		arc << secretsector;
+		if (secretsector) sec->Flags |= SECF_WASSECRET;
+		P_InitSectorSpecial(sec, sec->special, true);
+	}
+	arc	<< sec->interpolations[0]
+		<< sec->interpolations[1]
+		<< sec->interpolations[2]
+		<< sec->interpolations[3]
+		<< sec->SeqName;
+
+	sec->e->Serialize(arc);
+	if (arc.IsStoring ())
+	{
+		arc << sec->ColorMap->Color
+			<< sec->ColorMap->Fade;
+		BYTE sat = sec->ColorMap->Desaturate;
+		arc << sat;
+	}
+	else
+	{
+		PalEntry color, fade;
+		BYTE desaturate;
+		arc << color << fade
+			<< desaturate;
+		sec->ColorMap = GetSpecialLights (color, fade, desaturate);
+	}
+}
+
+//==========================================================================
+//
+// SerializeLine
+//
+// Also does the line's sides.
+//
+//==========================================================================
+
+static void SerializeLine (FArchive &arc, line_t *li)
+{
+	int j;
+
+	arc << li->flags
+		<< li->activation
+		<< li->special
+		<< li->Alpha;
+
+	if (SaveVersion < 4523)
+	{
+		int id;
+		arc << id;
+	}
+	if (P_IsACSSpecial(li->special))
+	{
+		P_SerializeACSScriptNumber(arc, li->args[0], false);
+	}
+	else
+	{
+		arc << li->args[0];
+	}
+	arc << li->args[1] << li->args[2] << li->args[3] << li->args[4];
+
+	for (j = 0; j < 2; j++)
+	{
+		if (li->sidedef[j] == NULL)
+			continue;
+
+		side_t *si = li->sidedef[j];
+		arc << si->textures[side_t::top]
+			<< si->textures[side_t::mid]
+			<< si->textures[side_t::bottom]
+			<< si->Light
+			<< si->Flags
+			<< si->LeftSide
+			<< si->RightSide
+			<< si->Index;
+		DBaseDecal::SerializeChain (arc, &si->AttachedDecals);
+	}
+}
+
+//==========================================================================
+//
+// Pristine world state
+//
+// Right after a level has been set up, every sector and line that does
+// not reference any objects is archived on its own and kept. Snapshots
+// only store the ones that no longer archive the same way, because a
+// snapshot is always restored onto a freshly set up level. Anything that
+// references an object is always stored, since those objects will not
+// survive the thinkers being restored.
+//
+//==========================================================================
+
+struct FPristineElement
+{
+	unsigned int Start;
+	unsigned int Length;
+	enum { NO_PRISTINE = 0xffffffff };
+};
+
+static TArray<BYTE> PristineData;
+static TArray<FPristineElement> PristineSectors;
+static TArray<FPristineElement> PristineLines;
+
+// Archives a single element into memory, with nothing carried over from
+// the previous one, so that it always comes out the same way. Can also
+// read one back.
+class FElementArchive : public FArchive
+{
+public:
+	FElementArchive (bool loading = false)
+	{
+		Dummy.OpenDeferred (0);
+		AttachToFile (Dummy);
+		m_Loading = loading;
+		m_Storing = !loading;
+		Source = SourceEnd = NULL;
+	}
+	~FElementArchive ()
+	{
+		Close ();
+	}
+
+	void Write (const void *mem, unsigned int len)
+	{
+		unsigned int ofs = Bytes.Reserve (len);
+		memcpy (&Bytes[ofs], mem, len);
+	}
+
+	void Read (void *mem, unsigned int len)
+	{
+		if (len > unsigned(SourceEnd - Source))
 		{
-			short dmg;
-			arc << dmg;
-			sec->damageamount = dmg;
+			I_Error ("Pristine world data is corrupt");
 		}
-		if (SaveVersion >= 4528)
+		memcpy (mem, Source, len);
+		Source += len;
+	}
+
+	void Begin ()
+	{
+		Bytes.Clear ();
+		ClearMaps ();
+	}
+
+	void Begin (const BYTE *source, unsigned int len)
+	{
+		Source = source;
+		SourceEnd = source + len;
+		ClearMaps ();
+	}
+
+	bool SawObjects () const
+	{
+		return m_ObjectCount != 0;
+	}
+
+	TArray<BYTE> Bytes;
+
+private:
+	FCompressedMemFile Dummy;
+	const BYTE *Source, *SourceEnd;
+};
+
+static bool SectorHasObjects (sector_t *sec)
+{
+	return sec->floordata != NULL || sec->ceilingdata != NULL || sec->lightingdata != NULL ||
+		sec->SoundTarget != NULL || sec->SecActTarget != NULL ||
+		sec->SkyBoxes[sector_t::floor] != NULL || sec->SkyBoxes[sector_t::ceiling] != NULL ||
+		sec->interpolations[0] != NULL || sec->interpolations[1] != NULL ||
+		sec->interpolations[2] != NULL || sec->interpolations[3] != NULL;
+}
+
+static bool LineHasObjects (line_t *li)
+{
+	for (int j = 0; j < 2; ++j)
+	{
+		side_t *si = li->sidedef[j];
+		if (si != NULL && (si->AttachedDecals != NULL ||
+			si->textures[side_t::top].interpolation != NULL ||
+			si->textures[side_t::mid].interpolation != NULL ||
+			si->textures[side_t::bottom].interpolation != NULL))
 		{
-			arc << sec->damageinterval
-				<< sec->leakydamage
-				<< sec->damagetype;
+			return true;
 		}
-		else
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// P_RecordPristineWorld
+//
+// Call after setting up a level, before a snapshot is restored onto it.
+//
+//==========================================================================
+
+void P_RecordPristineWorld ()
+{
+	FElementArchive arc;
+	int oldversion = SaveVersion;
+	int i;
+
+	SaveVersion = SAVEVER;
+	P_ClearPristineWorld ();
+	PristineSectors.Resize (numsectors);
+	PristineLines.Resize (numlines);
+
+	for (i = 0; i < numsectors; ++i)
+	{
+		FPristineElement &el = PristineSectors[i];
+		el.Length = FPristineElement::NO_PRISTINE;
+		if (!SectorHasObjects (&sectors[i]))
 		{
-			short damagemod;
-			arc << damagemod;
-			sec->damagetype = MODtoDamageType(damagemod);
-			if (sec->damageamount < 20)
-			{
-				sec->leakydamage = 0;
-				sec->damageinterval = 32;
-			}
-			else if (sec->damageamount < 50)
+			arc.Begin ();
+			SerializeSector (arc, &sectors[i]);
+			if (!arc.SawObjects ())
 			{
-				sec->leakydamage = 5;
-				sec->damageinterval = 32;
+				el.Start = PristineData.Reserve (arc.Bytes.Size());
+				el.Length = arc.Bytes.Size();
+				memcpy (&PristineData[el.Start], &arc.Bytes[0], el.Length);
 			}
-			else
+		}
+	}
+	for (i = 0; i < numlines; ++i)
+	{
+		FPristineElement &el = PristineLines[i];
+		el.Length = FPristineElement::NO_PRISTINE;
+		if (!LineHasObjects (&lines[i]))
+		{
+			arc.Begin ();
+			SerializeLine (arc, &lines[i]);
+			if (!arc.SawObjects ())
 			{
-				sec->leakydamage = 256;
-				sec->damageinterval = 1;
+				el.Start = PristineData.Reserve (arc.Bytes.Size());
+				el.Length = arc.Bytes.Size();
+				memcpy (&PristineData[el.Start], &arc.Bytes[0], el.Length);
 			}
 		}
+	}
+	SaveVersion = oldversion;
+}
 
-		arc << sec->SoundTarget
-			<< sec->SecActTarget
-			<< sec->sky
-			<< sec->MoreFlags
-			<< sec->Flags
-			<< sec->SkyBoxes[sector_t::floor] << sec->SkyBoxes[sector_t::ceiling]
-			<< sec->ZoneNumber;
-		if (SaveVersion < 4529)
+//==========================================================================
+//
+// P_RestorePristineWorld
+//
+// Puts every sector and line that a snapshot might leave out back the way
+// it was when the level was set up. Needed before restoring a snapshot
+// onto a level that has been played since then, because the snapshot
+// only stores what differs from the pristine state.
+//
+//==========================================================================
+
+void P_RestorePristineWorld ()
+{
+	if (PristineSectors.Size() != (unsigned)numsectors || PristineLines.Size() != (unsigned)numlines)
+	{
+		return;
+	}
+
+	FElementArchive arc (true);
+	int oldversion = SaveVersion;
+	int i;
+
+	SaveVersion = SAVEVER;
+	for (i = 0; i < numsectors; ++i)
+	{
+		const FPristineElement &el = PristineSectors[i];
+		if (el.Length != FPristineElement::NO_PRISTINE)
+		{
+			arc.Begin (&PristineData[el.Start], el.Length);
+			SerializeSector (arc, &sectors[i]);
+		}
+	}
+	for (i = 0; i < numlines; ++i)
+	{
+		const FPristineElement &el = PristineLines[i];
+		if (el.Length != FPristineElement::NO_PRISTINE)
 		{
-			short secretsector;
-			arc << secretsector;
-			if (secretsector) sec->Flags |= SECF_WASSECRET;
-			P_InitSectorSpecial(sec, sec->special, true);
+			arc.Begin (&PristineData[el.Start], el.Length);
+			SerializeLine (arc, &lines[i]);
 		}
-		arc	<< sec->interpolations[0]
-			<< sec->interpolations[1]
-			<< sec->interpolations[2]
-			<< sec->interpolations[3]
-			<< sec->SeqName;
+	}
+	SaveVersion = oldversion;
+}
 
-		sec->e->Serialize(arc);
-		if (arc.IsStoring ())
+void P_ClearPristineWorld ()
+{
+	PristineData.Clear ();
+	PristineSectors.Clear ();
+	PristineLines.Clear ();
+}
+
+//==========================================================================
+//
+// FindChangedSectors / FindChangedLines
+//
+// Fills changed with one entry per element, true if it must be stored.
+//
+//==========================================================================
+
+static bool IsPristine (FElementArchive &arc, const TArray<FPristineElement> &pristine, int i)
+{
+	const FPristineElement &el = pristine[i];
+	return !arc.SawObjects () && el.Length == arc.Bytes.Size() &&
+		(el.Length == 0 || memcmp (&PristineData[el.Start], &arc.Bytes[0], el.Length) == 0);
+}
+
+static void FindChangedSectors (FElementArchive &arc, TArray<bool> &changed)
+{
+	bool recorded = PristineSectors.Size() == (unsigned)numsectors;
+
+	changed.Resize (numsectors);
+	for (int i = 0; i < numsectors; ++i)
+	{
+		changed[i] = true;
+		if (recorded && PristineSectors[i].Length != FPristineElement::NO_PRISTINE &&
+			!SectorHasObjects (&sectors[i]))
 		{
-			arc << sec->ColorMap->Color
-				<< sec->ColorMap->Fade;
-			BYTE sat = sec->ColorMap->Desaturate;
-			arc << sat;
+			arc.Begin ();
+			SerializeSector (arc, &sectors[i]);
+			changed[i] = !IsPristine (arc, PristineSectors, i);
 		}
-		else
+	}
+}
+
+static void FindChangedLines (FElementArchive &arc, TArray<bool> &changed)
+{
+	bool recorded = PristineLines.Size() == (unsigned)numlines;
+
+	changed.Resize (numlines);
+	for (int i = 0; i < numlines; ++i)
+	{
+		changed[i] = true;
+		if (recorded && PristineLines[i].Length != FPristineElement::NO_PRISTINE &&
+			!LineHasObjects (&lines[i]))
 		{
-			PalEntry color, fade;
-			BYTE desaturate;
-			arc << color << fade
-				<< desaturate;
-			sec->ColorMap = GetSpecialLights (color, fade, desaturate);
+			arc.Begin ();
+			SerializeLine (arc, &lines[i]);
+			changed[i] = !IsPristine (arc, PristineLines, i);
 		}
 	}
+}
 
-	// do lines
-	for (i = 0, li = lines; i < numlines; i++, li++)
+//==========================================================================
+//
+// P_CountChangedWorld
+//
+//==========================================================================
+
+void P_CountChangedWorld (int &changedsectors, int &changedlines)
+{
+	FElementArchive arc;
+	TArray<bool> changed;
+	unsigned int i;
+
+	FindChangedSectors (arc, changed);
+	for (changedsectors = 0, i = 0; i < changed.Size(); ++i)
 	{
-		arc << li->flags
-			<< li->activation
-			<< li->special
-			<< li->Alpha;
+		changedsectors += changed[i];
+	}
+	FindChangedLines (arc, changed);
+	for (changedlines = 0, i = 0; i < changed.Size(); ++i)
+	{
+		changedlines += changed[i];
+	}
+}
 
-		if (SaveVersion < 4523)
+//==========================================================================
+//
+// SerializeChangedMask
+//
+// One bit per element, set for every one that follows in the archive.
+//
+//==========================================================================
+
+static void SerializeChangedMask (FArchive &arc, TArray<bool> &changed, int count)
+{
+	if (arc.IsLoading ())
+	{
+		changed.Resize (count);
+	}
+	for (int i = 0; i < count; i += 8)
+	{
+		BYTE bits = 0;
+		int j;
+
+		if (arc.IsStoring ())
 		{
-			int id;
-			arc << id;
+			for (j = 0; j < 8 && i + j < count; ++j)
+			{
+				bits |= changed[i + j] << j;
+			}
 		}
-		if (P_IsACSSpecial(li->special))
+		arc << bits;
+		if (arc.IsLoading ())
 		{
-			P_SerializeACSScriptNumber(arc, li->args[0], false);
+			for (j = 0; j < 8 && i + j < count; ++j)
+			{
+				changed[i + j] = !!(bits & (1 << j));
+			}
 		}
-		else
+	}
+}
+
+//
+// P_ArchiveWorld
+//
+void P_SerializeWorld (FArchive &arc)
+{
+	TArray<bool> changed;
+	int i;
+	zone_t *zn;
+
+	// Older snapshots store every sector and line.
+	bool delta = SaveVersion >= 4532;
+	FElementArchive *elarc = delta && arc.IsStoring () ? new FElementArchive : NULL;
+
+	// do sectors
+	if (delta)
+	{
+		if (elarc != NULL)
 		{
-			arc << li->args[0];
+			FindChangedSectors (*elarc, changed);
 		}
-		arc << li->args[1] << li->args[2] << li->args[3] << li->args[4];
-
-		for (j = 0; j < 2; j++)
+		SerializeChangedMask (arc, changed, numsectors);
+	}
+	for (i = 0; i < numsectors; i++)
+	{
+		if (!delta || changed[i])
 		{
-			if (li->sidedef[j] == NULL)
-				continue;
+			SerializeSector (arc, &sectors[i]);
+		}
+	}
 
-			side_t *si = li->sidedef[j];
-			arc << si->textures[side_t::top]
-				<< si->textures[side_t::mid]
-				<< si->textures[side_t::bottom]
-				<< si->Light
-				<< si->Flags
-				<< si->LeftSide
-				<< si->RightSide
-				<< si->Index;
-			DBaseDecal::SerializeChain (arc, &si->AttachedDecals);
+	// do lines
+	if (delta)
+	{
+		if (elarc != NULL)
+		{
+			FindChangedLines (*elarc, changed);
+			delete elarc;
+		}
+		SerializeChangedMask (arc, changed, numlines);
+	}
+	for (i = 0; i < numlines; i++)
+	{
+		if (!delta || changed[i])
+		{
+			SerializeLine (arc, &lines[i]);
 		}
 	}
 
@@ -510,6 +889,7 @@ void P_SerializeWorld (FArchive &arc)
 	}
 }
 
+
 void extsector_t::Serialize(FArchive &arc)
 {
 	arc << FakeFloor.Sectors
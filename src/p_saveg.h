@@ -36,6 +36,7 @@
 
 class FArchive;
 struct PNGHandle;
+class FileWriter;
 
 // Persistent storage/archiving.
 // These are the load / save game routines.
@@ -47,7 +48,12 @@ void P_SerializePolyobjs (FArchive &arc);
 void P_SerializeSubsectors(FArchive &arc);
 void P_SerializeSounds (FArchive &arc);
 
+void P_RecordPristineWorld ();
+void P_RestorePristineWorld ();
+void P_ClearPristineWorld ();
+void P_CountChangedWorld (int &changedsectors, int &changedlines);
+
 void P_ReadACSDefereds (PNGHandle *png);
-void P_WriteACSDefereds (FILE *file);
+void P_WriteACSDefereds (FileWriter *file);
 
 #endif // __P_SAVEG_H__
@@ -68,8 +68,10 @@
 #include "po_man.h"
 #include "r_renderer.h"
 #include "r_data/colormaps.h"
+#include "p_saveg.h"
 
 #include "fragglescript/t_fs.h"
+#include "m_profile.h"
 
 #define MISSING_TEXTURE_WARN_LIMIT		20
 
@@ -95,6 +97,66 @@ CVAR (Bool, genblockmap, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
 CVAR (Bool, gennodes, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
 CVAR (Bool, genglnodes, false, CVAR_SERVERINFO);
 CVAR (Bool, showloadtimes, false, 0);
+CVAR (Bool, cacheblockmap, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG);
+
+static const char *LoadTimeNames[] =
+{
+	"load vertexes",
+	"load sectors",
+	"load sides",
+	"load lines",
+	"load sides 2",
+	"load lines 2",
+	"loop sides",
+	"load subsectors",
+	"load nodes",
+	"load segs",
+	"load blockmap",
+	"load reject",
+	"group lines",
+	"flood zones",
+	"load things",
+	"translate teleports",
+	"init polys",
+	"precache"
+};
+
+//==========================================================================
+//
+// FLoadTimer
+//
+// A cycle_t for showloadtimes that also reports each timed span to the
+// load profiler.
+//
+//==========================================================================
+
+struct FLoadTimer
+{
+	cycle_t Cycles;
+	const char *Name;
+	int Scope;
+
+	void Reset(const char *name)
+	{
+		Cycles.Reset();
+		Name = name;
+		Scope = -1;
+	}
+	void Clock(const char *name = NULL)
+	{
+		Cycles.Clock();
+		Scope = LoadProfiler.Begin(name != NULL ? name : Name);
+	}
+	void Unclock()
+	{
+		LoadProfiler.End(Scope);
+		Cycles.Unclock();
+	}
+	double TimeMS()
+	{
+		return Cycles.TimeMS();
+	}
+};
 
 static void P_Shutdown ();
 
@@ -2746,7 +2808,7 @@ static void CreatePackedBlockmap (TArray<int> &BlockMap, TArray<int> *blocks, in
 #define BLOCKBITS 7
 #define BLOCKSIZE 128
 
-static void P_CreateBlockMap ()
+static int P_CreateBlockMap ()
 {
 	TArray<int> *BlockLists, *block, *endblock;
 	int adder;
@@ -2756,7 +2818,7 @@ static void P_CreateBlockMap ()
 	int line;
 
 	if (numvertexes <= 0)
-		return;
+		return 0;
 
 	// Find map extents for the blockmap
 	minx = maxx = vertexes[0].x;
@@ -2912,6 +2974,99 @@ static void P_CreateBlockMap ()
 	{
 		blockmaplump[ii] = BlockMap[ii];
 	}
+	return BlockMap.Size();
+}
+
+//===========================================================================
+//
+// Blockmap cache
+//
+// After the nodes, creating the blockmap is the most expensive part of
+// setting up a big map, and UDMF maps never come with one. The result only
+// depends on the map's lines and vertices, so it is kept in the same cache
+// directory as the GL nodes, keyed by the map's checksum, and read back
+// with a single read the next time the map is entered.
+//
+//===========================================================================
+
+static const DWORD BLOCKMAP_CACHE_VERSION = 1;
+static const int BLOCKMAP_CACHE_HEADER = 9;	// magic, version, md5, counts
+
+static void P_MakeBlockMapCacheHeader (MapData *map, DWORD header[BLOCKMAP_CACHE_HEADER], int count)
+{
+	header[0] = MAKE_ID('B','M','A','P');
+	header[1] = LittleLong(BLOCKMAP_CACHE_VERSION);
+	map->GetChecksum((BYTE *)&header[2]);
+	header[6] = LittleLong(DWORD(numvertexes));
+	header[7] = LittleLong(DWORD(numlines));
+	header[8] = LittleLong(DWORD(count));
+}
+
+static void P_WriteCachedBlockMap (MapData *map, int count)
+{
+	DWORD header[BLOCKMAP_CACHE_HEADER];
+	FString path = P_CreateCacheName(map, true, ".bmc");
+	FILE *f = fopen(path, "wb");
+
+	if (f == NULL)
+	{
+		DPrintf("Cannot open blockmap cache %s for writing\n", path.GetChars());
+		return;
+	}
+
+	P_MakeBlockMapCacheHeader(map, header, count);
+	TArray<DWORD> data(count);
+	for (int i = 0; i < count; ++i)
+	{
+		data.Push(LittleLong(DWORD(blockmaplump[i])));
+	}
+	if (fwrite(header, sizeof(header), 1, f) != 1 ||
+		fwrite(&data[0], sizeof(DWORD), count, f) != (size_t)count)
+	{
+		Printf("Error saving blockmap to %s\n", path.GetChars());
+	}
+	fclose(f);
+}
+
+static int P_ReadCachedBlockMap (MapData *map)
+{
+	DWORD header[BLOCKMAP_CACHE_HEADER], expected[BLOCKMAP_CACHE_HEADER];
+	FString path = P_CreateCacheName(map, false, ".bmc");
+	FILE *f = fopen(path, "rb");
+	int count;
+
+	if (f == NULL)
+	{
+		return 0;
+	}
+	if (fread(header, sizeof(header), 1, f) != 1)
+	{
+		fclose(f);
+		return 0;
+	}
+	count = LittleLong(header[8]);
+	P_MakeBlockMapCacheHeader(map, expected, count);
+	if (count < 4 || DWORD(count) > (Q_filelength(f) - sizeof(header)) / sizeof(int) ||
+		memcmp(header, expected, sizeof(header)) != 0)
+	{
+		fclose(f);
+		return 0;
+	}
+
+	blockmaplump = new int[count];
+	if (fread(blockmaplump, sizeof(int), count, f) != (size_t)count)
+	{
+		delete[] blockmaplump;
+		blockmaplump = NULL;
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	for (int i = 0; i < count; ++i)
+	{
+		blockmaplump[i] = LittleLong(blockmaplump[i]);
+	}
+	return count;
 }
 
 
@@ -3005,8 +3160,20 @@ void P_LoadBlockMap (MapData * map)
 		Args->CheckParm("-blockmap")
 		)
 	{
-		DPrintf ("Generating BLOCKMAP\n");
-		P_CreateBlockMap ();
+		if (!cacheblockmap || (count = P_ReadCachedBlockMap (map)) == 0 || !P_VerifyBlockMap (count))
+		{
+			if (blockmaplump != NULL)
+			{
+				delete[] blockmaplump;
+				blockmaplump = NULL;
+			}
+			DPrintf ("Generating BLOCKMAP\n");
+			count = P_CreateBlockMap ();
+			if (cacheblockmap && count > 0)
+			{
+				P_WriteCachedBlockMap (map, count);
+			}
+		}
 	}
 	else
 	{
@@ -3364,6 +3531,7 @@ void P_FreeLevelData ()
 		wminfo.maxfrags = 0;
 		
 	FBehavior::StaticUnloadModules ();
+	P_ClearPristineWorld ();
 	if (vertexes != NULL)
 	{
 		delete[] vertexes;
@@ -3521,7 +3689,7 @@ void P_FreeExtraLevelData()
 // [RH] position indicates the start spot to spawn at
 void P_SetupLevel (const char *lumpname, int position)
 {
-	cycle_t times[20];
+	FLoadTimer times[20];
 	FMapThing *buildthings;
 	int numbuildthings;
 	int i;
@@ -3534,9 +3702,16 @@ void P_SetupLevel (const char *lumpname, int position)
 
 	for (i = 0; i < (int)countof(times); ++i)
 	{
-		times[i].Reset();
+		times[i].Reset(i < (int)countof(LoadTimeNames) ? LoadTimeNames[i] : "unnamed");
 	}
 
+	FString profilename;
+	profilename.Format("P_SetupLevel %s", lumpname);
+	FProfileScope profilescope(profilename);
+
+	// The scripts of the previous level are gone.
+	ScriptProfiler.NewLevel();
+
 	level.maptype = MAPTYPE_UNKNOWN;
 	wminfo.partime = 180;
 
@@ -3603,7 +3778,7 @@ void P_SetupLevel (const char *lumpname, int position)
 		BYTE *mapdata = new BYTE[map->Size(0)];
 		map->Seek(0);
 		map->file->Read(mapdata, map->Size(0));
-		times[0].Clock();
+		times[0].Clock("load build map");
 		buildmap = P_LoadBuildMap (mapdata, map->Size(0), &buildthings, &numbuildthings);
 		times[0].Unclock();
 		delete[] mapdata;
@@ -3720,7 +3895,7 @@ void P_SetupLevel (const char *lumpname, int position)
 		}
 		else
 		{
-			times[0].Clock();
+			times[0].Clock("parse textmap");
 			P_ParseTextMap(map, missingtex);
 			times[0].Unclock();
 		}
@@ -3873,6 +4048,7 @@ void P_SetupLevel (const char *lumpname, int position)
 			subsectors, numsubsectors,
 			vertexes, numvertexes);
 		endTime = I_FPSTime ();
+		if (showloadtimes) builder.PrintTimes ();
 		DPrintf ("BSP generation took %.3f sec (%d segs)\n", (endTime - startTime) * 0.001, numsegs);
 		oldvertextable = builder.GetOldVertexTable();
 		reloop = true;
@@ -4089,28 +4265,7 @@ void P_SetupLevel (const char *lumpname, int position)
 		Printf ("---Total load times---\n");
 		for (i = 0; i < 18; ++i)
 		{
-			static const char *timenames[] =
-			{
-				"load vertexes",
-				"load sectors",
-				"load sides",
-				"load lines",
-				"load sides 2",
-				"load lines 2",
-				"loop sides",
-				"load subsectors",
-				"load nodes",
-				"load segs",
-				"load blockmap",
-				"load reject",
-				"group lines",
-				"flood zones",
-				"load things",
-				"translate teleports",
-				"init polys",
-				"precache"
-			};
-			Printf ("Time%3d:%9.4f ms (%s)\n", i, times[i].TimeMS(), timenames[i]);
+			Printf ("Time%3d:%9.4f ms (%s)\n", i, times[i].TimeMS(), LoadTimeNames[i]);
 		}
 	}
 	MapThingsConverted.Clear();
@@ -115,6 +115,7 @@ struct line_t;
 struct maplinedef_t;
 
 void P_LoadTranslator(const char *lumpname);
+const char *P_GetTranslatorName();
 void P_TranslateLineDef (line_t *ld, maplinedef_t *mld, int lineindexforid = -1);
 int P_TranslateSectorSpecial (int);
 
@@ -123,6 +124,7 @@ fixed_t GetUDMFFixed(int type, int index, const char *key);
 
 bool P_LoadGLNodes(MapData * map);
 bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime);
+FString P_CreateCacheName(MapData *map, bool create, const char *extension);
 bool P_CheckForGLNodes();
 void P_SetRenderSector();
 
@@ -40,7 +40,7 @@ This uses specialized forms of the maputils routines for optimized performance
 
 // Performance meters
 static int sightcounts[6];
-static cycle_t SightCycles;
+cycle_t SightCycles;
 static cycle_t MaxSightCycles;
 
 static TArray<intercept_t> intercepts (128);
@@ -41,6 +41,9 @@
 #include "c_dispatch.h"
 #include "v_text.h"
 #include "thingdef/thingdef.h"
+#include "stats.h"
+#include "memarena.h"
+#include "m_profile.h"
 
 // Each state is owned by an actor. Actors can own any number of
 // states, but a single state cannot be owned by more than one
@@ -159,6 +162,116 @@ const PClass *FState::StaticFindStateOwner (const FState *state, const FActorInf
 }
 
 
+//==========================================================================
+//
+// Calls a state's action function with the scripting profiler active.
+// The call is counted both for the action function and for the state
+// calling it.
+//
+//==========================================================================
+
+static FString ActionName(const void *key)
+{
+	AFuncDesc *desc = FindFunctionByPointer((actionf_p)key);
+	return desc != NULL ? FString(desc->Name) : FString("(unknown)");
+}
+
+static FString StateName(const void *key)
+{
+	const FState *state = (const FState *)key;
+	const PClass *owner = FState::StaticFindStateOwner(state);
+	FString name;
+
+	if (owner == NULL)
+	{
+		name = "(unknown)";
+	}
+	else
+	{
+		name.Format("%s.%d", owner->TypeName.GetChars(), int(state - owner->ActorInfo->OwnedStates));
+	}
+	name << ' ' << ActionName((const void *)state->ActionFunc);
+	return name;
+}
+
+void FState::CallProfiledAction(AActor *self, AActor *stateowner, StateCallData *statecall)
+{
+	// The call site encloses the action so that the action's self time
+	// holds the work and the state only adds a total.
+	FScriptProfileScope callsite(SPT_State, this, StateName);
+	FScriptProfileScope action(SPT_Action, (const void *)ActionFunc, ActionName);
+
+	ActionFunc(self, stateowner, this, ParameterIndex-1, statecall);
+}
+
+//==========================================================================
+//
+// All states are allocated from one arena instead of one block per class.
+// Classes are defined in load order, right after their parents, so this
+// keeps the states an actor jumps between when it inherits parts of its
+// state sequences close together in memory.
+//
+//==========================================================================
+
+static FMemArena StateArena;
+static unsigned int StateBlocks, StatesAllocated;
+
+FState *FState::StaticAllocate (int count)
+{
+	FState *states = (FState *)StateArena.Alloc(count * sizeof(FState));
+	memset(states, 0, count * sizeof(FState));
+	StateBlocks++;
+	StatesAllocated += count;
+	return states;
+}
+
+void FState::StaticFreeAll ()
+{
+	StateArena.FreeAllBlocks();
+	StateBlocks = StatesAllocated = 0;
+}
+
+//==========================================================================
+//
+// Reports the memory used by the state tables. The separate allocations
+// per class this replaced are estimated with 16 bytes of allocator
+// overhead and rounding each.
+//
+//==========================================================================
+
+CCMD(statememory)
+{
+	const size_t hot = myoffsetof(FState, Misc1);
+	unsigned int crossjumps = 0, farjumps = 0;
+	size_t separate = 0;
+
+	for (unsigned int i = 0; i < PClass::m_RuntimeActors.Size(); ++i)
+	{
+		FActorInfo *info = PClass::m_RuntimeActors[i]->ActorInfo;
+		if (info->NumOwnedStates == 0) continue;
+
+		separate += (info->NumOwnedStates * sizeof(FState) + 16 + 15) & ~15;
+		for (int j = 0; j < info->NumOwnedStates; j++)
+		{
+			FState *next = info->OwnedStates[j].NextState;
+			if (next != NULL && !info->OwnsState(next))
+			{
+				crossjumps++;
+				ptrdiff_t distance = (BYTE *)next - (BYTE *)&info->OwnedStates[j];
+				if (distance >= 64*1024 || distance <= -64*1024)
+				{
+					farjumps++;
+				}
+			}
+		}
+	}
+	Printf("%u states in %u blocks, %u bytes each (%u hot, %u cold)\n", StatesAllocated, StateBlocks,
+		(unsigned)sizeof(FState), (unsigned)hot, unsigned(sizeof(FState) - hot));
+	Printf("Separate allocations: ~%u bytes\n", (unsigned)separate);
+	Printf("State arena: %u bytes\n", unsigned(StatesAllocated * sizeof(FState)));
+	Printf("%u transitions into other classes' states, %u of them 64k or more away\n", crossjumps, farjumps);
+}
+
 //==========================================================================
 //
 //
@@ -169,8 +282,113 @@ FStateLabel *FStateLabels::FindLabel (FName label)
 	return const_cast<FStateLabel *>(BinarySearch<FStateLabel, FName> (Labels, NumLabels, &FStateLabel::Label, label));
 }
 
+//==========================================================================
+//
+// The label lookup table covers a class's whole label tree, so every level
+// of a nested label like Death.Fire is a single hash probe. Entries are
+// keyed by the label list they belong to and the label's name.
+//
+//==========================================================================
+
+static inline unsigned int LabelHash(const FStateLabels *parent, FName label)
+{
+	unsigned int hash = (unsigned int)((size_t)parent >> 3) * 2654435761u + (unsigned int)label.GetIndex() * 40503u;
+	return hash ^ (hash >> 15);
+}
+
+static int CountLabels(const FStateLabels *list)
+{
+	int count = list->NumLabels;
+
+	for (int i = 0; i < list->NumLabels; i++)
+	{
+		if (list->Labels[i].Children != NULL)
+		{
+			count += CountLabels(list->Labels[i].Children);
+		}
+	}
+	return count;
+}
+
+static void InsertLabels(FStateLabelLookup *lookup, unsigned int mask, FStateLabels *list)
+{
+	for (int i = 0; i < list->NumLabels; i++)
+	{
+		unsigned int slot = LabelHash(list, list->Labels[i].Label) & mask;
+
+		while (lookup[slot].Slot != NULL)
+		{
+			slot = (slot + 1) & mask;
+		}
+		lookup[slot].Parent = list;
+		lookup[slot].Label = list->Labels[i].Label;
+		lookup[slot].Slot = &list->Labels[i];
+
+		if (list->Labels[i].Children != NULL)
+		{
+			InsertLabels(lookup, mask, list->Labels[i].Children);
+		}
+	}
+}
+
+//==========================================================================
+//
+// FStateLabels :: BuildLookup
+//
+// Creates the lookup table for this label tree. The table is kept at most
+// half full so that probe sequences stay short.
+//
+//==========================================================================
+
+void FStateLabels::BuildLookup ()
+{
+	unsigned int count = CountLabels(this);
+	unsigned int size;
+
+	if (Lookup != NULL)
+	{
+		delete[] Lookup;
+	}
+	for (size = 8; size < count * 2; size <<= 1)
+	{
+	}
+	Lookup = new FStateLabelLookup[size]();
+	LookupMask = size - 1;
+	InsertLabels(Lookup, LookupMask, this);
+}
+
+//==========================================================================
+//
+// FStateLabels :: LookupLabel
+//
+// Finds a label in one of the lists of this label tree.
+//
+//==========================================================================
+
+FStateLabel *FStateLabels::LookupLabel (const FStateLabels *parent, FName label) const
+{
+	for (unsigned int slot = LabelHash(parent, label) & LookupMask; Lookup[slot].Slot != NULL; slot = (slot + 1) & LookupMask)
+	{
+		if (Lookup[slot].Parent == parent && Lookup[slot].Label == label)
+		{
+			return Lookup[slot].Slot;
+		}
+	}
+	return NULL;
+}
+
+//==========================================================================
+//
+//
+//==========================================================================
+
 void FStateLabels::Destroy ()
 {
+	if (Lookup != NULL)
+	{
+		delete[] Lookup;
+		Lookup = NULL;
+	}
 	for(int i=0; i<NumLabels;i++)
 	{
 		if (Labels[i].Children != NULL)
@@ -287,7 +505,7 @@ FState *FActorInfo::FindState (int numnames, FName *names, bool exact) const
 		while (labels != NULL && count < numnames)
 		{
 			label = *names++;
-			slabel = labels->FindLabel (label);
+			slabel = StateList->Lookup != NULL ? StateList->LookupLabel (labels, label) : labels->FindLabel (label);
 
 			if (slabel != NULL)
 			{
@@ -463,6 +681,8 @@ FStateLabels * FStateDefinitions::CreateStateLabelList(TArray<FStateDefine> & st
 	if (count == 0) return NULL;
 
 	FStateLabels * list = (FStateLabels*)M_Malloc(sizeof(FStateLabels)+(count-1)*sizeof(FStateLabel));
+	list->Lookup = NULL;
+	list->LookupMask = 0;
 	list->NumLabels = count;
 
 	for (int i=0;i<count;i++)
@@ -500,6 +720,10 @@ void FStateDefinitions::InstallStates(FActorInfo *info, AActor *defaults)
 		M_Free(info->StateList);
 	}
 	info->StateList = CreateStateLabelList(StateLabels);
+	if (info->StateList != NULL)
+	{
+		info->StateList->BuildLookup();
+	}
 
 	// Cache these states as member veriables.
 	defaults->SpawnState = info->FindState(NAME_Spawn);
@@ -907,7 +1131,7 @@ int FStateDefinitions::FinishStates (FActorInfo *actor, AActor *defaults)
 
 	if (count > 0)
 	{
-		FState *realstates = new FState[count];
+		FState *realstates = FState::StaticAllocate(count);
 		int i;
 
 		memcpy(realstates, &StateArray[0], count*sizeof(FState));
@@ -998,3 +1222,131 @@ CCMD(dumpstates)
 		Printf(PRINT_LOG, "----------------------------\n");
 	}
 }
+
+//==========================================================================
+//
+// Benchmarks state label lookups for all classes. Every label of every
+// class is looked up along with a few common names most classes don't
+// define, once through the hashed label table and once by searching
+// each level of the label tree separately.
+//
+//==========================================================================
+
+static void CollectStatePaths(const FStateLabels *list, TArray<FName> &path, TArray<FName> &names, TArray<int> &lengths)
+{
+	for (int i = 0; i < list->NumLabels; i++)
+	{
+		path.Push(list->Labels[i].Label);
+		for (unsigned j = 0; j < path.Size(); j++)
+		{
+			names.Push(path[j]);
+		}
+		lengths.Push(path.Size());
+		if (list->Labels[i].Children != NULL)
+		{
+			CollectStatePaths(list->Labels[i].Children, path, names, lengths);
+		}
+		path.Pop();
+	}
+}
+
+static FState *FindStateBinary(const FStateLabels *labels, int numnames, FName *names, bool exact)
+{
+	FState *best = NULL;
+	int count = 0;
+
+	while (labels != NULL && count < numnames)
+	{
+		FStateLabel *slabel = const_cast<FStateLabels *>(labels)->FindLabel(*names++);
+		if (slabel == NULL) break;
+		count++;
+		labels = slabel->Children;
+		best = slabel->State;
+	}
+	return (count < numnames && exact) ? NULL : best;
+}
+
+CCMD(statebench)
+{
+	static const FName common[][2] =
+	{
+		{ NAME_Spawn, NAME_None }, { NAME_Pain, NAME_None }, { NAME_Missile, NAME_None },
+		{ NAME_Death, NAME_Fire }, { NAME_Death, NAME_Extreme }, { NAME_Wound, NAME_None },
+		{ NAME_Crash, NAME_None }, { NAME_Raise, NAME_None },
+	};
+	int passes = argv.argc() > 1 ? atoi(argv[1]) : 100;
+	TArray<FName> path, names;
+	TArray<int> lengths;
+	TArray<const FActorInfo *> infos;
+	cycle_t hashed, binary;
+	unsigned int lookups = 0, mismatches = 0;
+
+	if (passes < 1) passes = 1;
+
+	for (unsigned int i = 0; i < PClass::m_RuntimeActors.Size(); ++i)
+	{
+		const FActorInfo *info = PClass::m_RuntimeActors[i]->ActorInfo;
+		if (info->StateList == NULL) continue;
+
+		unsigned int first = lengths.Size();
+		CollectStatePaths(info->StateList, path, names, lengths);
+		for (size_t j = 0; j < countof(common); j++)
+		{
+			int len = common[j][1] == NAME_None ? 1 : 2;
+			names.Push(common[j][0]);
+			if (len > 1) names.Push(common[j][1]);
+			lengths.Push(len);
+		}
+		for (unsigned int j = first; j < lengths.Size(); j++)
+		{
+			infos.Push(info);
+		}
+	}
+	if (lengths.Size() == 0)
+	{
+		Printf("No state labels defined\n");
+		return;
+	}
+
+	hashed.Reset();
+	binary.Reset();
+	for (int pass = 0; pass < passes; pass++)
+	{
+		FName *name = &names[0];
+		hashed.Clock();
+		for (unsigned int i = 0; i < lengths.Size(); i++)
+		{
+			infos[i]->FindState(lengths[i], name);
+			name += lengths[i];
+		}
+		hashed.Unclock();
+
+		name = &names[0];
+		binary.Clock();
+		for (unsigned int i = 0; i < lengths.Size(); i++)
+		{
+			FindStateBinary(infos[i]->StateList, lengths[i], name, false);
+			name += lengths[i];
+		}
+		binary.Unclock();
+		lookups += lengths.Size();
+	}
+
+	FName *name = &names[0];
+	for (unsigned int i = 0; i < lengths.Size(); i++)
+	{
+		if (infos[i]->FindState(lengths[i], name) != FindStateBinary(infos[i]->StateList, lengths[i], name, false))
+		{
+			mismatches++;
+		}
+		name += lengths[i];
+	}
+
+	Printf("%u lookups in %u classes\n", lookups, PClass::m_RuntimeActors.Size());
+	Printf("hashed: %.3f ms (%.2f million/s)\n", hashed.TimeMS(), lookups / (hashed.TimeMS() * 1000.));
+	Printf("binary: %.3f ms (%.2f million/s)\n", binary.TimeMS(), lookups / (binary.TimeMS() * 1000.));
+	if (mismatches > 0)
+	{
+		Printf("%u lookups returned different states\n", mismatches);
+	}
+}
@@ -86,7 +86,7 @@ void FTagManager::AddSectorTag(int sector, int tag)
 			}
 		}
 	}
-	FTagItem it = { sector, tag, -1 };
+	FTagItem it = { sector, tag };
 	allTags.Push(it);
 }
 
@@ -142,7 +142,7 @@ void FTagManager::AddLineID(int line, int tag)
 			}
 		}
 	}
-	FTagItem it = { line, tag, -1 };
+	FTagItem it = { line, tag };
 	allIDs.Push(it);
 }
 
@@ -155,35 +155,63 @@ void FTagManager::AddLineID(int line, int tag)
 void FTagManager::HashTags()
 {
 	// add an end marker so we do not need to check for the array's size in the other functions.
-	static FTagItem it = { -1, -1, -1 };
+	static FTagItem it = { -1, -1 };
 	allTags.Push(it);
 	allIDs.Push(it);
 
-	// Initially make all slots empty.
-	memset(TagHashFirst, -1, sizeof(TagHashFirst));
-	memset(IDHashFirst, -1, sizeof(IDHashFirst));
+	BuildSpans(allTags, tagSpans, sectorsByTag);
+	BuildSpans(allIDs, idSpans, linesByID);
+}
+
+//-----------------------------------------------------------------------------
+//
+// Groups the targets of all valid entries by tag so that iterating over
+// one tag is a walk over a contiguous range. Within a group the targets
+// keep the order of the item list, so lower targets come first.
+//
+//-----------------------------------------------------------------------------
 
-	// Proceed from last to first so that lower targets appear first
-	for (int i = allTags.Size() - 1; i >= 0; i--)
+void FTagManager::BuildSpans(const TArray<FTagItem> &items, TMap<int, FTagSpan> &spans, TArray<int> &targets)
+{
+	TMap<int, FTagSpan>::Pair *pair;
+	int total = 0;
+
+	spans.Clear();
+	for (unsigned i = 0; i < items.Size(); i++)
 	{
-		if (allTags[i].target >= 0)	// only link valid entries
+		if (items[i].target >= 0)	// only count valid entries
 		{
-			int hash = ((unsigned int)allTags[i].tag) % FTagManager::TAG_HASH_SIZE;
-			allTags[i].nexttag = TagHashFirst[hash];
-			TagHashFirst[hash] = i;
+			FTagSpan *span = spans.CheckKey(items[i].tag);
+			if (span == NULL)
+			{
+				FTagSpan newspan = { 0, 1 };
+				spans.Insert(items[i].tag, newspan);
+			}
+			else
+			{
+				span->count++;
+			}
 		}
 	}
 
-	for (int i = allIDs.Size() - 1; i >= 0; i--)
+	// Assign each tag its range and reset the counts so that they can be used as fill pointers.
+	TMap<int, FTagSpan>::Iterator it(spans);
+	while (it.NextPair(pair))
 	{
-		if (allIDs[i].target >= 0)	// only link valid entries
+		pair->Value.first = total;
+		total += pair->Value.count;
+		pair->Value.count = 0;
+	}
+
+	targets.Resize(total);
+	for (unsigned i = 0; i < items.Size(); i++)
+	{
+		if (items[i].target >= 0)
 		{
-			int hash = ((unsigned int)allIDs[i].tag) % FTagManager::TAG_HASH_SIZE;
-			allIDs[i].nexttag = IDHashFirst[hash];
-			IDHashFirst[hash] = i;
+			FTagSpan *span = spans.CheckKey(items[i].tag);
+			targets[span->first + span->count++] = items[i].target;
 		}
 	}
-
 }
 
 //-----------------------------------------------------------------------------
@@ -295,12 +323,64 @@ CCMD(dumptags)
 	tagManager.DumpTags();
 }
 
+//-----------------------------------------------------------------------------
+//
+// Verifies that the tag iterators return the same targets in the same
+// order as a linear scan through all tag entries.
+//
+//-----------------------------------------------------------------------------
+
+static int CheckTagList(const TArray<FTagItem> &items, bool lines)
+{
+	TMap<int, bool> checked;
+	int errors = 0;
+
+	for (unsigned i = 0; i < items.Size(); i++)
+	{
+		int tag = items[i].tag;
+		if (items[i].target < 0 || (!lines && tag == 0) || checked.CheckKey(tag) != NULL) continue;
+		checked[tag] = true;
+
+		FSectorTagIterator sit(tag);
+		FLineIdIterator lit(tag);
+		for (unsigned j = i; j < items.Size(); j++)
+		{
+			if (items[j].target < 0 || items[j].tag != tag) continue;
+			int target = lines ? lit.Next() : sit.Next();
+			if (target != items[j].target)
+			{
+				Printf("%s %d: expected %d, got %d\n", lines ? "Line ID" : "Sector tag", tag, items[j].target, target);
+				errors++;
+				break;
+			}
+		}
+		if ((lines ? lit.Next() : sit.Next()) != -1)
+		{
+			Printf("%s %d: too many targets\n", lines ? "Line ID" : "Sector tag", tag);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+void FTagManager::CheckTags()
+{
+	int errors = CheckTagList(allTags, false) + CheckTagList(allIDs, true);
+	Printf("%d tags, %d line IDs checked, %d errors\n", tagSpans.CountUsed(), idSpans.CountUsed(), errors);
+}
+
+CCMD(checktags)
+{
+	tagManager.CheckTags();
+}
+
 //-----------------------------------------------------------------------------
 //
 // RETURN NEXT SECTOR # THAT LINE TAG REFERS TO
 //
 // Find the next sector with a specified tag.
-// Rewritten by Lee Killough to use chained hashing to improve speed
+// Rewritten by Lee Killough to use chained hashing to improve speed,
+// now walks the precomputed range of sectors for the tag.
 //
 //-----------------------------------------------------------------------------
 
@@ -314,10 +394,8 @@ int FSectorTagIterator::Next()
 	}
 	else if (searchtag != 0)
 	{
-		while (start >= 0 && tagManager.allTags[start].tag != searchtag) start = tagManager.allTags[start].nexttag;
-		if (start == -1) return -1;
-		ret = tagManager.allTags[start].target;
-		start = tagManager.allTags[start].nexttag;
+		if (start >= end) return -1;
+		ret = tagManager.sectorsByTag[start++];
 	}
 	else
 	{
@@ -359,9 +437,5 @@ int FSectorTagIterator::NextCompat(bool compat, int start)
 
 int FLineIdIterator::Next()
 {
-	while (start >= 0 && tagManager.allIDs[start].tag != searchtag) start = tagManager.allIDs[start].nexttag;
-	if (start == -1) return -1;
-	int ret = tagManager.allIDs[start].target;
-	start = tagManager.allIDs[start].nexttag;
-	return ret;
+	return start < end ? tagManager.linesByID[start++] : -1;
 }
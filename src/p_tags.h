@@ -8,7 +8,14 @@ struct FTagItem
 {
 	int target;		// either sector or line
 	int tag;
-	int nexttag;	// for hashing
+};
+
+// The range of all targets with the same tag in FTagManager's sectorsByTag
+// or linesByID arrays.
+struct FTagSpan
+{
+	int first;
+	int count;
 };
 
 class FSectorTagIterator;
@@ -16,11 +23,6 @@ class FLineIdIterator;
 
 class FTagManager
 {
-	enum
-	{
-		TAG_HASH_SIZE = 256
-	};
-
 	friend class FSectorTagIterator;
 	friend class FLineIdIterator;
 
@@ -28,8 +30,28 @@ class FTagManager
 	TArray<FTagItem> allIDs;
 	TArray<int> startForSector;
 	TArray<int> startForLine;
-	int TagHashFirst[TAG_HASH_SIZE];
-	int IDHashFirst[TAG_HASH_SIZE];
+
+	// All targets grouped by tag, in ascending order within each group.
+	TArray<int> sectorsByTag;
+	TArray<int> linesByID;
+	TMap<int, FTagSpan> tagSpans;
+	TMap<int, FTagSpan> idSpans;
+
+	static void BuildSpans(const TArray<FTagItem> &items, TMap<int, FTagSpan> &spans, TArray<int> &targets);
+
+	void FindSpan(const TMap<int, FTagSpan> &spans, int tag, int &start, int &end) const
+	{
+		const FTagSpan *span = spans.CheckKey(tag);
+		if (span != NULL)
+		{
+			start = span->first;
+			end = span->first + span->count;
+		}
+		else
+		{
+			start = end = 0;
+		}
+	}
 
 	bool SectorHasTags(int sect) const
 	{
@@ -48,8 +70,10 @@ public:
 		allIDs.Clear();
 		startForSector.Clear();
 		startForLine.Clear();
-		memset(TagHashFirst, -1, sizeof(TagHashFirst));
-		memset(IDHashFirst, -1, sizeof(IDHashFirst));
+		sectorsByTag.Clear();
+		linesByID.Clear();
+		tagSpans.Clear();
+		idSpans.Clear();
 	}
 
 	bool SectorHasTags(const sector_t *sector) const;
@@ -66,6 +90,11 @@ public:
 	void RemoveSectorTags(int sect);
 
 	void DumpTags();
+	void CheckTags();
+
+	// The tags and IDs in the order they were added, for the compiled map cache.
+	const TArray<FTagItem> &GetSectorTagList() const { return allTags; }
+	const TArray<FTagItem> &GetLineIDList() const { return allIDs; }
 };
 
 extern FTagManager tagManager;
@@ -75,12 +104,14 @@ class FSectorTagIterator
 protected:
 	int searchtag;
 	int start;
+	int end;
 
 public:
 	FSectorTagIterator(int tag)
 	{
 		searchtag = tag;
-		start = tag == 0 ? 0 : tagManager.TagHashFirst[((unsigned int)tag) % FTagManager::TAG_HASH_SIZE];
+		if (tag == 0) start = end = 0;
+		else tagManager.FindSpan(tagManager.tagSpans, tag, start, end);
 	}
 
 	// Special constructor for actions that treat tag 0 as  'back of activation line'
@@ -90,11 +121,12 @@ public:
 		{
 			searchtag = INT_MIN;
 			start = (line == NULL || line->backsector == NULL)? -1 : (int)(line->backsector - sectors);
+			end = 0;
 		}
 		else
 		{
 			searchtag = tag;
-			start = tagManager.TagHashFirst[((unsigned int)tag) % FTagManager::TAG_HASH_SIZE];
+			tagManager.FindSpan(tagManager.tagSpans, tag, start, end);
 		}
 	}
 
@@ -107,12 +139,13 @@ class FLineIdIterator
 protected:
 	int searchtag;
 	int start;
+	int end;
 
 public:
 	FLineIdIterator(int id)
 	{
 		searchtag = id;
-		start = tagManager.IDHashFirst[((unsigned int)id) % FTagManager::TAG_HASH_SIZE];
+		tagManager.FindSpan(tagManager.idSpans, id, start, end);
 	}
 
 	int Next();
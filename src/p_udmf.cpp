@@ -33,6 +33,8 @@
 **
 */
 
+#include <sys/stat.h>
+
 #include "doomstat.h"
 #include "p_setup.h"
 #include "p_lnspec.h"
@@ -48,6 +50,11 @@
 #include "w_wad.h"
 #include "p_tags.h"
 #include "p_terrain.h"
+#include "cmdlib.h"
+#include "v_text.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "version.h"
 
 //===========================================================================
 //
@@ -139,13 +146,449 @@ extern TArray<int>		linemap;
 //
 //===========================================================================
 
+//===========================================================================
+//
+// FUDMFScanner Constructor
+//
+//===========================================================================
+
+FUDMFScanner::FUDMFScanner()
+{
+	String = StringBuffer;
+	StringBuffer[0] = '\0';
+	StringLen = 0;
+	TokenType = 0;
+	Number = 0;
+	Float = 0;
+	Line = 1;
+	ScriptPtr = ScriptEndPtr = NULL;
+	AlreadyGot = false;
+	AlreadyGotLine = LastGotLine = 1;
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: OpenMem
+//
+//===========================================================================
+
+void FUDMFScanner::OpenMem(const char *name, const char *buffer, int size)
+{
+	OpenString(name, FString(buffer, size));
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: OpenString
+//
+// The buffer is shared, not copied, unless it needs a trailing newline.
+//
+//===========================================================================
+
+void FUDMFScanner::OpenString(const char *name, FString buffer)
+{
+	ScriptBuffer = buffer;
+	ScriptName = name;
+
+	// Same end-of-text handling as FScanner::PrepareScript, so the line
+	// count comes out the same.
+	if (ScriptBuffer.Len() == 0 || ScriptBuffer[ScriptBuffer.Len() - 1] != '\n')
+	{
+		if (ScriptBuffer.Len() > 0 && ScriptBuffer[ScriptBuffer.Len() - 1] == '\0')
+		{
+			ScriptBuffer.LockBuffer()[ScriptBuffer.Len() - 1] = '\n';
+			ScriptBuffer.UnlockBuffer();
+		}
+		else
+		{
+			ScriptBuffer += '\n';
+		}
+	}
+	ScriptPtr = ScriptBuffer.GetChars();
+	ScriptEndPtr = ScriptPtr + ScriptBuffer.Len();
+	Line = 1;
+	AlreadyGot = false;
+	AlreadyGotLine = LastGotLine = 1;
+	String = StringBuffer;
+	StringBuffer[0] = '\0';
+	BigStringBuffer = "";
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: SetString
+//
+//===========================================================================
+
+void FUDMFScanner::SetString(const char *start, int len)
+{
+	StringLen = len;
+	if (len < MAX_STRING_SIZE)
+	{
+		memcpy(StringBuffer, start, len);
+		StringBuffer[len] = '\0';
+		String = StringBuffer;
+	}
+	else
+	{
+		BigStringBuffer = FString(start, len);
+		String = BigStringBuffer.LockBuffer();
+	}
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: GetToken
+//
+// Recognizes identifiers, true and false, numbers, strings and names the
+// same way FScanner's C mode does. Operators are only ever single
+// characters, since nothing in UDMF needs more.
+//
+//===========================================================================
+
+static inline bool IsIdentChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool IsHexDigit(char c)
+{
+	return IsDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool FUDMFScanner::GetToken()
+{
+	if (AlreadyGot)
+	{
+		AlreadyGot = false;
+		return true;
+	}
+
+	const char *p = ScriptPtr;
+	const char *end = ScriptEndPtr;
+
+	// The buffer is always null terminated, so looking one character
+	// ahead is safe even at the very end.
+	for (;;)
+	{
+		if (p >= end)
+		{
+			ScriptPtr = end;
+			return false;
+		}
+		char c = *p;
+		if (c == '\n')
+		{
+			Line++;
+			p++;
+		}
+		else if ((unsigned char)c <= ' ')
+		{
+			// Like FScanner, treat every control character as whitespace.
+			p++;
+		}
+		else if (c == '/' && p[1] == '/')
+		{
+			while (p < end && *p != '\n') p++;
+		}
+		else if (c == '/' && p[1] == '*')
+		{
+			for (p += 2; p < end && !(p[0] == '*' && p[1] == '/'); p++)
+			{
+				if (*p == '\n') Line++;
+			}
+			if (p >= end)
+			{
+				ScriptPtr = end;
+				return false;
+			}
+			p += 2;
+		}
+		else if (c == '#' && (strncmp(p, "#region", 7) == 0 || strncmp(p, "#endregion", 10) == 0))
+		{
+			while (p < end && *p != '\n') p++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	const char *tok = p;
+	char c = *p;
+
+	LastGotLine = Line;
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+	{
+		while (IsIdentChar(*++p)) {}
+		TokenType = TK_Identifier;
+		if (p - tok == 4 && strnicmp(tok, "true", 4) == 0)
+		{
+			TokenType = TK_True;
+		}
+		else if (p - tok == 5 && strnicmp(tok, "false", 5) == 0)
+		{
+			TokenType = TK_False;
+		}
+		SetString(tok, int(p - tok));
+	}
+	else if (IsDigit(c) || (c == '.' && IsDigit(p[1])))
+	{
+		bool isfloat = false;
+
+		if (c == '0' && (p[1] == 'x' || p[1] == 'X') && IsHexDigit(p[2]))
+		{
+			for (p += 2; IsHexDigit(*p); p++) {}
+		}
+		else
+		{
+			while (IsDigit(*p)) p++;
+			if (*p == '.' && (p > tok || IsDigit(p[1])))
+			{
+				isfloat = true;
+				for (p++; IsDigit(*p); p++) {}
+			}
+			if ((*p == 'e' || *p == 'E') && (IsDigit(p[1]) || ((p[1] == '+' || p[1] == '-') && IsDigit(p[2]))))
+			{
+				isfloat = true;
+				for (p += 2; IsDigit(*p); p++) {}
+			}
+		}
+		if (isfloat)
+		{
+			if (*p == 'f' || *p == 'F' || *p == 'l' || *p == 'L') p++;
+		}
+		else
+		{
+			if (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L') p++;
+		}
+		SetString(tok, int(p - tok));
+
+		char *stopper;
+		if (isfloat)
+		{
+			TokenType = TK_FloatConst;
+			Float = strtod(String, &stopper);
+		}
+		else
+		{
+			TokenType = TK_IntConst;
+			Number = strtol(String, &stopper, 0);
+			Float = Number;
+		}
+	}
+	else if (c == '"')
+	{
+		int lines = 0;
+
+		for (p++; p < end && *p != '"'; p++)
+		{
+			if (*p == '\\' && p[1] == '"') p++;
+			else if (*p == '\n') lines++;
+		}
+		if (p >= end)
+		{
+			ScriptError("Unterminated string constant");
+		}
+		SetString(tok + 1, int(p - tok - 1));
+		StringLen = strbin(String);
+		TokenType = TK_StringConst;
+		Line += lines;
+		p++;
+	}
+	else if (c == '\'' && (p = (const char *)memchr(tok + 1, '\'', end - tok - 1)) != NULL &&
+		memchr(tok + 1, '\n', p - tok - 1) == NULL)
+	{
+		SetString(tok + 1, int(p - tok - 1));
+		TokenType = TK_NameConst;
+		p++;
+	}
+	else if (c != '\0' && strchr(";{},:=()[].&!~-+*/%<>^|?", c) != NULL)
+	{
+		SetString(tok, 1);
+		TokenType = c;
+		p++;
+	}
+	else
+	{
+		ScriptError("Unexpected character: %c (ASCII %d)\n", c, c);
+	}
+	ScriptPtr = p;
+	return true;
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: MustGetAnyToken
+//
+//===========================================================================
+
+void FUDMFScanner::MustGetAnyToken()
+{
+	if (!GetToken())
+	{
+		ScriptError("Missing token (unexpected end of file).");
+	}
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: MustGetToken
+//
+//===========================================================================
+
+void FUDMFScanner::MustGetToken(int token)
+{
+	MustGetAnyToken();
+	if (TokenType != token)
+	{
+		FString tok1 = FScanner::TokenName(token);
+		FString tok2 = FScanner::TokenName(TokenType, String);
+		ScriptError("Expected %s but got %s instead.", tok1.GetChars(), tok2.GetChars());
+	}
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: CheckToken
+//
+//===========================================================================
+
+bool FUDMFScanner::CheckToken(int token)
+{
+	if (GetToken())
+	{
+		if (TokenType == token)
+		{
+			return true;
+		}
+		UnGet();
+	}
+	return false;
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: MustGetString
+//
+//===========================================================================
+
+void FUDMFScanner::MustGetString()
+{
+	if (!GetString())
+	{
+		ScriptError("Missing string (unexpected end of file).");
+	}
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: MustGetStringName
+//
+//===========================================================================
+
+void FUDMFScanner::MustGetStringName(const char *name)
+{
+	MustGetString();
+	if (!Compare(name))
+	{
+		ScriptError("Expected '%s', got '%s'.", name, String);
+	}
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: CheckString
+//
+//===========================================================================
+
+bool FUDMFScanner::CheckString(const char *name)
+{
+	if (GetString())
+	{
+		if (Compare(name))
+		{
+			return true;
+		}
+		UnGet();
+	}
+	return false;
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: Compare
+//
+//===========================================================================
+
+bool FUDMFScanner::Compare(const char *text)
+{
+	return stricmp(text, String) == 0;
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: UnGet
+//
+//===========================================================================
+
+void FUDMFScanner::UnGet()
+{
+	AlreadyGot = true;
+	AlreadyGotLine = LastGotLine;
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: ScriptError
+//
+//===========================================================================
+
+void FUDMFScanner::ScriptError(const char *message, ...)
+{
+	FString composed;
+	va_list arglist;
+
+	va_start(arglist, message);
+	composed.VFormat(message, arglist);
+	va_end(arglist);
+
+	I_Error("Script error, \"%s\" line %d:\n%s\n", ScriptName.GetChars(),
+		AlreadyGot? AlreadyGotLine : Line, composed.GetChars());
+}
+
+//===========================================================================
+//
+// FUDMFScanner :: ScriptMessage
+//
+//===========================================================================
+
+void FUDMFScanner::ScriptMessage(const char *message, ...)
+{
+	FString composed;
+	va_list arglist;
+
+	va_start(arglist, message);
+	composed.VFormat(message, arglist);
+	va_end(arglist);
+
+	Printf(TEXTCOLOR_RED "Script error, \"%s\" line %d:\n" TEXTCOLOR_RED "%s\n", ScriptName.GetChars(),
+		AlreadyGot? AlreadyGotLine : Line, composed.GetChars());
+}
+
 //===========================================================================
 //
 // Skip a key or block
 //
 //===========================================================================
 
-void UDMFParserBase::Skip()
+template<class TScanner>
+void TUDMFParserBase<TScanner>::Skip()
 {
 	if (developer) sc.ScriptMessage("Ignoring unknown UDMF key \"%s\".", sc.String);
 	if(sc.CheckToken('{'))
@@ -185,7 +628,8 @@ void UDMFParserBase::Skip()
 //
 //===========================================================================
 
-FName UDMFParserBase::ParseKey(bool checkblock, bool *isblock)
+template<class TScanner>
+FName TUDMFParserBase<TScanner>::ParseKey(bool checkblock, bool *isblock)
 {
 	sc.MustGetString();
 	FName key = sc.String;
@@ -234,7 +678,8 @@ FName UDMFParserBase::ParseKey(bool checkblock, bool *isblock)
 //
 //===========================================================================
 
-int UDMFParserBase::CheckInt(const char *key)
+template<class TScanner>
+int TUDMFParserBase<TScanner>::CheckInt(const char *key)
 {
 	if (sc.TokenType != TK_IntConst)
 	{
@@ -243,7 +688,8 @@ int UDMFParserBase::CheckInt(const char *key)
 	return sc.Number;
 }
 
-double UDMFParserBase::CheckFloat(const char *key)
+template<class TScanner>
+double TUDMFParserBase<TScanner>::CheckFloat(const char *key)
 {
 	if (sc.TokenType != TK_IntConst && sc.TokenType != TK_FloatConst)
 	{
@@ -252,17 +698,20 @@ double UDMFParserBase::CheckFloat(const char *key)
 	return sc.Float;
 }
 
-fixed_t UDMFParserBase::CheckFixed(const char *key)
+template<class TScanner>
+fixed_t TUDMFParserBase<TScanner>::CheckFixed(const char *key)
 {
 	return FLOAT2FIXED(CheckFloat(key));
 }
 
-angle_t UDMFParserBase::CheckAngle(const char *key)
+template<class TScanner>
+angle_t TUDMFParserBase<TScanner>::CheckAngle(const char *key)
 {
 	return angle_t(CheckFloat(key) * ANGLE_90 / 90.);
 }
 
-bool UDMFParserBase::CheckBool(const char *key)
+template<class TScanner>
+bool TUDMFParserBase<TScanner>::CheckBool(const char *key)
 {
 	if (sc.TokenType == TK_True) return true;
 	if (sc.TokenType == TK_False) return false;
@@ -270,7 +719,8 @@ bool UDMFParserBase::CheckBool(const char *key)
 	return false;
 }
 
-const char *UDMFParserBase::CheckString(const char *key)
+template<class TScanner>
+const char *TUDMFParserBase<TScanner>::CheckString(const char *key)
 {
 	if (sc.TokenType != TK_StringConst)
 	{
@@ -279,6 +729,9 @@ const char *UDMFParserBase::CheckString(const char *key)
 	return parsedString;
 }
 
+template class TUDMFParserBase<FUDMFScanner>;
+template class TUDMFParserBase<FScanner>;
+
 //===========================================================================
 //
 // Storage of UDMF user properties
@@ -287,6 +740,8 @@ const char *UDMFParserBase::CheckString(const char *key)
 
 typedef TMap<int, FUDMFKeys> FUDMFKeyMap;
 
+CVAR (Bool, cachetextmap, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG);
+
 
 static FUDMFKeyMap UDMFKeys[4];
 // Things must be handled differently
@@ -388,6 +843,8 @@ class UDMFParser : public UDMFParserBase
 	bool isTranslated;
 	bool isExtended;
 	bool floordrop;
+	bool hasNamespace;
+	int removedLines;
 
 	TArray<line_t> ParsedLines;
 	TArray<side_t> ParsedSides;
@@ -405,8 +862,13 @@ public:
 	{
 		linemap.Clear();
 		fogMap = normMap = NULL;
+		hasNamespace = false;
+		removedLines = 0;
 	}
 
+	bool ReadCache(MapData *map, const FString &key);
+	void WriteCache(MapData *map, const FString &key);
+
 	void AddUserKey(FName key, int kind, int index)
 	{
 		FUDMFKeys &keyarray = UDMFKeys[kind][index];
@@ -1739,6 +2201,7 @@ public:
 				ParsedLines.Delete(i);
 				ForceNodeBuild = true;
 				skipped++;
+				removedLines++;
 			}
 			else
 			{
@@ -1802,87 +2265,103 @@ public:
 
 	//===========================================================================
 	//
-	// Main parsing function
+	// Sets up the parser and the level for the map's namespace
 	//
 	//===========================================================================
 
-	void ParseTextMap(MapData *map)
+	void SetNamespace(FName ns)
 	{
-		char *buffer = new char[map->Size(ML_TEXTMAP)];
-
-		isTranslated = true;
-		isExtended = false;
-		floordrop = false;
-
-		map->Read(ML_TEXTMAP, buffer);
-		sc.OpenMem(Wads.GetLumpFullName(map->lumpnum), buffer, map->Size(ML_TEXTMAP));
-		delete [] buffer;
-		sc.SetCMode(true);
-		if (sc.CheckString("namespace"))
+		namespc = ns;
+		switch(namespc)
 		{
-			sc.MustGetStringName("=");
-			sc.MustGetString();
-			namespc = sc.String;
-			switch(namespc)
-			{
-			case NAME_ZDoom:
-				namespace_bits = Zd;
-				isTranslated = false;
-				break;
-			case NAME_ZDoomTranslated:
-				level.flags2 |= LEVEL2_DUMMYSWITCHES;
-				namespace_bits = Zdt;
-				break;
-			case NAME_Vavoom:
-				namespace_bits = Va;
-				isTranslated = false;
-				break;
-			case NAME_Hexen:
-				namespace_bits = Hx;
-				isTranslated = false;
-				break;
-			case NAME_Doom:
+		case NAME_ZDoom:
+			namespace_bits = Zd;
+			isTranslated = false;
+			break;
+		case NAME_ZDoomTranslated:
+			level.flags2 |= LEVEL2_DUMMYSWITCHES;
+			namespace_bits = Zdt;
+			break;
+		case NAME_Vavoom:
+			namespace_bits = Va;
+			isTranslated = false;
+			break;
+		case NAME_Hexen:
+			namespace_bits = Hx;
+			isTranslated = false;
+			break;
+		case NAME_Doom:
+			namespace_bits = Dm;
+			P_LoadTranslator("xlat/doom_base.txt");
+			level.flags2 |= LEVEL2_DUMMYSWITCHES;
+			floordrop = true;
+			break;
+		case NAME_Heretic:
+			namespace_bits = Ht;
+			P_LoadTranslator("xlat/heretic_base.txt");
+			level.flags2 |= LEVEL2_DUMMYSWITCHES;
+			floordrop = true;
+			break;
+		case NAME_Strife:
+			namespace_bits = St;
+			P_LoadTranslator("xlat/strife_base.txt");
+			level.flags2 |= LEVEL2_DUMMYSWITCHES|LEVEL2_RAILINGHACK;
+			floordrop = true;
+			break;
+		default:
+			Printf("Unknown namespace %s. Using defaults for %s\n", ns.GetChars(), GameTypeName());
+			switch (gameinfo.gametype)
+			{
+			default:			// Shh, GCC
+			case GAME_Doom:
+			case GAME_Chex:
 				namespace_bits = Dm;
 				P_LoadTranslator("xlat/doom_base.txt");
-				level.flags2 |= LEVEL2_DUMMYSWITCHES;
-				floordrop = true;
 				break;
-			case NAME_Heretic:
+			case GAME_Heretic:
 				namespace_bits = Ht;
 				P_LoadTranslator("xlat/heretic_base.txt");
-				level.flags2 |= LEVEL2_DUMMYSWITCHES;
-				floordrop = true;
 				break;
-			case NAME_Strife:
+			case GAME_Strife:
 				namespace_bits = St;
 				P_LoadTranslator("xlat/strife_base.txt");
-				level.flags2 |= LEVEL2_DUMMYSWITCHES|LEVEL2_RAILINGHACK;
-				floordrop = true;
 				break;
-			default:
-				Printf("Unknown namespace %s. Using defaults for %s\n", sc.String, GameTypeName());
-				switch (gameinfo.gametype)
-				{
-				default:			// Shh, GCC
-				case GAME_Doom:
-				case GAME_Chex:
-					namespace_bits = Dm;
-					P_LoadTranslator("xlat/doom_base.txt");
-					break;
-				case GAME_Heretic:
-					namespace_bits = Ht;
-					P_LoadTranslator("xlat/heretic_base.txt");
-					break;
-				case GAME_Strife:
-					namespace_bits = St;
-					P_LoadTranslator("xlat/strife_base.txt");
-					break;
-				case GAME_Hexen:
-					namespace_bits = Hx;
-					isTranslated = false;
-					break;
-				}
+			case GAME_Hexen:
+				namespace_bits = Hx;
+				isTranslated = false;
+				break;
 			}
+		}
+	}
+
+	//===========================================================================
+	//
+	// Main parsing function
+	//
+	//===========================================================================
+
+	void ParseTextMap(MapData *map)
+	{
+		FString text;
+
+		isTranslated = true;
+		isExtended = false;
+		floordrop = false;
+
+		// Read straight into the string the scanner works on.
+		int size = map->Size(ML_TEXTMAP);
+		char *buffer = text.LockNewBuffer(size);
+		map->Read(ML_TEXTMAP, buffer);
+		buffer[size] = '\0';
+		text.UnlockBuffer();
+		sc.OpenString(Wads.GetLumpFullName(map->lumpnum), text);
+		sc.SetCMode(true);
+		if (sc.CheckString("namespace"))
+		{
+			sc.MustGetStringName("=");
+			sc.MustGetString();
+			hasNamespace = true;
+			SetNamespace(sc.String);
 			sc.MustGetStringName(";");
 		}
 		else
@@ -1973,9 +2452,1084 @@ public:
 	}
 };
 
+//===========================================================================
+//
+// Compiled map cache
+//
+// Parsing a big TEXTMAP and building the level's arrays from it makes up
+// most of a UDMF map's setup time. The finished arrays only depend on the
+// map, the loaded resources and a few level settings, so they are written
+// to the cache directory next to the GL nodes and read back with a single
+// read the next time the map is entered. Pointers are stored as indices,
+// names and textures through tables that are resolved against the running
+// game. Anything that does not check out is treated as a cache miss and
+// the map is parsed as usual.
+//
+//===========================================================================
+
+static const DWORD TEXTMAP_CACHE_VERSION = 1;
+
+struct FCachedLineRefs
+{
+	int v1, v2;
+	int sidedef[2];
+	int frontsector, backsector;
+};
+
+struct FCachedColormap
+{
+	int HasColormap;
+	DWORD Color, Fade;
+	int Desaturate;
+};
+
+//===========================================================================
+//
+// Everything the cached data depends on besides the map itself
+//
+//===========================================================================
+
+static FString P_TextMapCacheKey()
+{
+	FString key;
+
+	key.Format("%s|%d|%d|%d|%d|%d|%d|%d|%x|%x|%x|%x|%x|%d|%s",
+		GetVersionString(), int(sizeof(vertex_t)), int(sizeof(sector_t)), int(sizeof(side_t)),
+		int(sizeof(line_t)), int(sizeof(FMapThing)), int(sizeof(FUDMFKey)), int(gameinfo.gametype),
+		level.flags, level.flags2, DWORD(level.outsidefog), DWORD(level.fadeto), NormalLight.Desaturate,
+		skyflatnum.GetIndex(), P_GetTranslatorName());
+
+	for (int i = 0; i < Wads.GetNumWads(); ++i)
+	{
+		const char *filename = Wads.GetWadFullName(i);
+		struct stat info;
+
+		if (filename == NULL || stat(filename, &info) != 0)
+		{
+			key << "|?";
+		}
+		else
+		{
+			key.AppendFormat("|%s|%lld|%lld", filename, (long long)info.st_size, (long long)info.st_mtime);
+		}
+	}
+	return key;
+}
+
+//===========================================================================
+//
+// FTextMapCacheWriter
+//
+//===========================================================================
+
+class FTextMapCacheWriter
+{
+public:
+	TArray<BYTE> Data;
+
+	void Write(const void *data, size_t len)
+	{
+		if (len > 0)
+		{
+			memcpy(&Data[Data.Reserve(unsigned(len))], data, len);
+		}
+	}
+
+	void WriteLong(DWORD val)
+	{
+		Write(&val, sizeof(val));
+	}
+
+	void WriteString(const char *str)
+	{
+		DWORD len = DWORD(strlen(str));
+		WriteLong(len);
+		Write(str, len);
+	}
+
+	void WriteIndex(const void *ptr, const void *base, size_t size)
+	{
+		WriteLong(ptr == NULL ? DWORD(-1) : DWORD(((const BYTE *)ptr - (const BYTE *)base) / size));
+	}
+
+	void AddName(FName name)
+	{
+		Names[int(name)] = true;
+	}
+
+	void AddTexture(FTextureID tex)
+	{
+		if (tex.GetIndex() > 0)
+		{
+			Textures[tex.GetIndex()] = true;
+		}
+	}
+
+	bool WriteTables(FTextMapCacheWriter &out)
+	{
+		TMap<int, bool>::Iterator nit(Names);
+		TMap<int, bool>::Pair *pair;
+
+		out.WriteLong(Names.CountUsed());
+		while (nit.NextPair(pair))
+		{
+			out.WriteLong(DWORD(pair->Key));
+			out.WriteString(FName(ENamedName(pair->Key)).GetChars());
+		}
+
+		TMap<int, bool>::Iterator tit(Textures);
+		out.WriteLong(Textures.CountUsed());
+		while (tit.NextPair(pair))
+		{
+			FTexture *tex = TexMan.ByIndex(pair->Key);
+			if (tex == NULL)
+			{
+				return false;
+			}
+			out.WriteLong(DWORD(pair->Key));
+			out.WriteLong(tex->UseType);
+			out.WriteString(tex->Name);
+		}
+		return true;
+	}
+
+private:
+	TMap<int, bool> Names;
+	TMap<int, bool> Textures;
+};
+
+//===========================================================================
+//
+// FTextMapCacheReader
+//
+// Every count is checked against what is left of the file before anything
+// is allocated for it, so a damaged file can only ever produce a miss.
+//
+//===========================================================================
+
+class FTextMapCacheReader
+{
+public:
+	bool Failed;
+
+	FTextMapCacheReader(const BYTE *data, size_t size)
+		: Failed(false), Ptr(data), End(data + size)
+	{
+	}
+
+	bool AtEnd() const
+	{
+		return Ptr == End;
+	}
+
+	void Read(void *data, size_t len)
+	{
+		if (Failed || size_t(End - Ptr) < len)
+		{
+			Failed = true;
+			memset(data, 0, len);
+			return;
+		}
+		memcpy(data, Ptr, len);
+		Ptr += len;
+	}
+
+	DWORD ReadLong()
+	{
+		DWORD val;
+		Read(&val, sizeof(val));
+		return val;
+	}
+
+	unsigned ReadCount(size_t elemsize)
+	{
+		DWORD count = ReadLong();
+		if (Failed || count > size_t(End - Ptr) / elemsize)
+		{
+			Failed = true;
+			return 0;
+		}
+		return count;
+	}
+
+	FString ReadString()
+	{
+		unsigned len = ReadCount(1);
+		FString str;
+
+		if (len > 0)
+		{
+			str = FString((const char *)Ptr, len);
+			Ptr += len;
+		}
+		return str;
+	}
+
+	// Returns an index into an array of the given size, or -1 for NULL.
+	int ReadIndex(int size, bool nullok = true)
+	{
+		int index = int(ReadLong());
+		if (index < (nullok ? -1 : 0) || index >= size)
+		{
+			Failed = true;
+			return -1;
+		}
+		return index;
+	}
+
+	void ReadTables()
+	{
+		unsigned count = ReadCount(8);
+		for (unsigned i = 0; i < count && !Failed; ++i)
+		{
+			int index = int(ReadLong());
+			Names[index] = FName(ReadString().GetChars());
+		}
+
+		count = ReadCount(12);
+		for (unsigned i = 0; i < count && !Failed; ++i)
+		{
+			int oldnum = int(ReadLong());
+			int texnum = oldnum;
+			int usetype = int(ReadLong());
+			FString name = ReadString();
+			FTexture *tex = TexMan.ByIndex(texnum);
+
+			if (tex == NULL || tex->UseType != usetype || tex->Name.Compare(name) != 0)
+			{
+				// The texture was created at a different position this time.
+				texnum = TexMan.CheckForTexture(name, usetype,
+					FTextureManager::TEXMAN_Overridable|FTextureManager::TEXMAN_TryAny).GetIndex();
+				tex = TexMan.ByIndex(texnum);
+				if (tex == NULL || tex->UseType != usetype || tex->Name.Compare(name) != 0)
+				{
+					Failed = true;
+					return;
+				}
+			}
+			Textures[oldnum] = texnum;
+		}
+	}
+
+	void MapName(FNameNoInit &name)
+	{
+		FName *mapped = Names.CheckKey(int(name));
+		if (mapped == NULL)
+		{
+			Failed = true;
+			name = NAME_None;
+		}
+		else
+		{
+			name = *mapped;
+		}
+	}
+
+	FTextureID MapTexture(FTextureID tex)
+	{
+		if (tex.GetIndex() <= 0)
+		{
+			return tex;
+		}
+		int *mapped = Textures.CheckKey(tex.GetIndex());
+		if (mapped == NULL)
+		{
+			Failed = true;
+			return FNullTextureID();
+		}
+		return FNullTextureID() + *mapped;
+	}
+
+private:
+	const BYTE *Ptr;
+	const BYTE *End;
+	TMap<int, FName> Names;
+	TMap<int, int> Textures;
+};
+
+template<class T> static inline DWORD P_CacheIndex(const T *ptr, const T *base)
+{
+	return ptr == NULL ? DWORD(-1) : DWORD(ptr - base);
+}
+
+//===========================================================================
+//
+// UDMFParser :: WriteCache
+//
+// Stores the level data the parser just created. Called right after
+// ParseTextMap, while the level arrays still hold exactly what the
+// parser made of the map.
+//
+//===========================================================================
+
+void UDMFParser::WriteCache(MapData *map, const FString &key)
+{
+	FTextMapCacheWriter body, file;
+	int i, j;
+
+	body.WriteLong(hasNamespace);
+	body.WriteString(namespc.GetChars());
+	body.WriteLong(removedLines);
+
+	body.WriteLong(numvertexes);
+	body.WriteLong(numvertexdatas);
+	body.WriteLong(numsectors);
+	body.WriteLong(numsides);
+	body.WriteLong(numlines);
+
+	for (i = 0; i < numvertexes; ++i)
+	{
+		body.Write(&vertexes[i].x, sizeof(fixed_t));
+		body.Write(&vertexes[i].y, sizeof(fixed_t));
+	}
+	body.Write(vertexdatas, numvertexdatas * sizeof(*vertexdatas));
+
+	for (i = 0; i < numsectors; ++i)
+	{
+		sector_t *sec = &sectors[i];
+		FCachedColormap cm = { sec->ColorMap != NULL, 0, 0, 0 };
+
+		if (sec->ColorMap != NULL)
+		{
+			cm.Color = sec->ColorMap->Color;
+			cm.Fade = sec->ColorMap->Fade;
+			cm.Desaturate = sec->ColorMap->Desaturate;
+		}
+		body.AddName(sec->SeqName);
+		body.AddName(sec->damagetype);
+		body.AddTexture(sec->planes[sector_t::floor].Texture);
+		body.AddTexture(sec->planes[sector_t::ceiling].Texture);
+		body.Write(sec, sizeof(*sec));
+		body.Write(&cm, sizeof(cm));
+	}
+
+	for (i = 0; i < numsides; ++i)
+	{
+		side_t *sd = &sides[i];
+
+		for (j = 0; j < 3; ++j)
+		{
+			body.AddTexture(sd->textures[j].texture);
+		}
+		body.Write(sd, sizeof(*sd));
+		body.WriteLong(P_CacheIndex(sd->sector, sectors));
+		body.WriteLong(P_CacheIndex(sd->linedef, lines));
+	}
+
+	for (i = 0; i < numlines; ++i)
+	{
+		line_t *ld = &lines[i];
+		FCachedLineRefs refs;
+
+		refs.v1 = P_CacheIndex(ld->v1, vertexes);
+		refs.v2 = P_CacheIndex(ld->v2, vertexes);
+		refs.sidedef[0] = P_CacheIndex(ld->sidedef[0], sides);
+		refs.sidedef[1] = P_CacheIndex(ld->sidedef[1], sides);
+		refs.frontsector = P_CacheIndex(ld->frontsector, sectors);
+		refs.backsector = P_CacheIndex(ld->backsector, sectors);
+		body.Write(ld, sizeof(*ld));
+		body.Write(&refs, sizeof(refs));
+	}
+
+	body.WriteLong(MapThingsConverted.Size());
+	for (unsigned k = 0; k < MapThingsConverted.Size(); ++k)
+	{
+		body.Write(&MapThingsConverted[k], sizeof(FMapThing));
+		body.WriteLong(MapThingsConverted[k].info != NULL);
+	}
+
+	body.WriteLong(MapThingsUserData.Size());
+	for (unsigned k = 0; k < MapThingsUserData.Size(); ++k)
+	{
+		body.AddName(MapThingsUserData[k].Property);
+		body.WriteLong(int(MapThingsUserData[k].Property));
+		body.WriteLong(MapThingsUserData[k].Value);
+	}
+
+	TMap<unsigned, unsigned>::Iterator uit(MapThingsUserDataIndex);
+	TMap<unsigned, unsigned>::Pair *upair;
+	body.WriteLong(MapThingsUserDataIndex.CountUsed());
+	while (uit.NextPair(upair))
+	{
+		body.WriteLong(upair->Key);
+		body.WriteLong(upair->Value);
+	}
+
+	for (i = 0; i < 4; ++i)
+	{
+		FUDMFKeyMap::Iterator kit(UDMFKeys[i]);
+		FUDMFKeyMap::Pair *kpair;
+
+		body.WriteLong(UDMFKeys[i].CountUsed());
+		while (kit.NextPair(kpair))
+		{
+			FUDMFKeys &keys = kpair->Value;
+
+			body.WriteLong(kpair->Key);
+			body.WriteLong(keys.Size());
+			for (unsigned k = 0; k < keys.Size(); ++k)
+			{
+				body.AddName(keys[k].Key);
+				body.WriteLong(int(keys[k].Key));
+				body.WriteLong(keys[k].Type);
+				body.WriteLong(keys[k].IntVal);
+				body.Write(&keys[k].FloatVal, sizeof(double));
+				body.WriteString(keys[k].StringVal);
+			}
+		}
+	}
+
+	const TArray<FTagItem> &tags = tagManager.GetSectorTagList();
+	body.WriteLong(tags.Size());
+	for (unsigned k = 0; k < tags.Size(); ++k)
+	{
+		body.Write(&tags[k], sizeof(FTagItem));
+	}
+	const TArray<FTagItem> &ids = tagManager.GetLineIDList();
+	body.WriteLong(ids.Size());
+	for (unsigned k = 0; k < ids.Size(); ++k)
+	{
+		body.Write(&ids[k], sizeof(FTagItem));
+	}
+
+	body.WriteLong(linemap.Size());
+	for (unsigned k = 0; k < linemap.Size(); ++k)
+	{
+		body.WriteLong(linemap[k]);
+	}
+
+	BYTE md5[16];
+	map->GetChecksum(md5);
+	file.WriteLong(MAKE_ID('U','D','M','C'));
+	file.WriteLong(TEXTMAP_CACHE_VERSION);
+	file.Write(md5, sizeof(md5));
+	file.WriteString(key);
+	if (!body.WriteTables(file))
+	{
+		return;
+	}
+	file.Write(&body.Data[0], body.Data.Size());
+
+	FString path = P_CreateCacheName(map, true, ".tmc");
+	FILE *f = fopen(path, "wb");
+
+	if (f == NULL)
+	{
+		DPrintf("Cannot open compiled map cache %s for writing\n", path.GetChars());
+		return;
+	}
+	if (fwrite(&file.Data[0], 1, file.Data.Size(), f) != file.Data.Size())
+	{
+		Printf("Error saving compiled map to %s\n", path.GetChars());
+	}
+	fclose(f);
+}
+
+//===========================================================================
+//
+// UDMFParser :: ReadCache
+//
+// Everything is read into temporary arrays first. The level is only
+// touched once the whole file has been read and checked.
+//
+//===========================================================================
+
+bool UDMFParser::ReadCache(MapData *map, const FString &key)
+{
+	FString path = P_CreateCacheName(map, false, ".tmc");
+	FILE *f = fopen(path, "rb");
+	TArray<BYTE> data;
+	int len;
+
+	if (f == NULL)
+	{
+		return false;
+	}
+	len = Q_filelength(f);
+	if (len <= 0)
+	{
+		fclose(f);
+		return false;
+	}
+	data.Resize(len);
+	if (fread(&data[0], 1, len, f) != (size_t)len)
+	{
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+
+	FTextMapCacheReader fr(&data[0], len);
+	BYTE md5[16], cachedmd5[16];
+
+	map->GetChecksum(md5);
+	if (fr.ReadLong() != MAKE_ID('U','D','M','C') || fr.ReadLong() != TEXTMAP_CACHE_VERSION)
+	{
+		return false;
+	}
+	fr.Read(cachedmd5, sizeof(cachedmd5));
+	if (fr.Failed || memcmp(md5, cachedmd5, sizeof(md5)) != 0 || fr.ReadString().Compare(key) != 0)
+	{
+		return false;
+	}
+	fr.ReadTables();
+
+	bool cachedNamespace = fr.ReadLong() != 0;
+	FName cachedns = fr.ReadString().GetChars();
+	int removed = int(fr.ReadLong());
+
+	unsigned nverts = fr.ReadCount(2 * sizeof(fixed_t));
+	unsigned nvdatas = fr.ReadCount(sizeof(vertexdata_t));
+	unsigned nsecs = fr.ReadCount(sizeof(sector_t) + sizeof(FCachedColormap));
+	unsigned nsides = fr.ReadCount(sizeof(side_t) + 2 * sizeof(DWORD));
+	unsigned nlines = fr.ReadCount(sizeof(line_t) + sizeof(FCachedLineRefs));
+	if (fr.Failed || nverts == 0 || nsecs == 0 || nlines == 0 || nsides == 0)
+	{
+		return false;
+	}
+
+	TArray<vertex_t> verts;
+	TArray<vertexdata_t> vdatas;
+	verts.Resize(nverts);
+	vdatas.Resize(nvdatas);
+	for (unsigned i = 0; i < nverts; ++i)
+	{
+		fr.Read(&verts[i].x, sizeof(fixed_t));
+		fr.Read(&verts[i].y, sizeof(fixed_t));
+	}
+	if (nvdatas > 0)
+	{
+		fr.Read(&vdatas[0], nvdatas * sizeof(vertexdata_t));
+	}
+
+	TArray<sector_t> secs;
+	TArray<FCachedColormap> colormaps;
+	secs.Resize(nsecs);
+	colormaps.Resize(nsecs);
+	for (unsigned i = 0; i < nsecs && !fr.Failed; ++i)
+	{
+		sector_t *sec = &secs[i];
+
+		fr.Read(sec, sizeof(*sec));
+		fr.Read(&colormaps[i], sizeof(FCachedColormap));
+		fr.MapName(sec->SeqName);
+		fr.MapName(sec->damagetype);
+		for (int j = 0; j < 2; ++j)
+		{
+			sec->planes[j].Texture = fr.MapTexture(sec->planes[j].Texture);
+		}
+	}
+
+	TArray<side_t> sds;
+	TArray<int> sidesectors, sidelines;
+	sds.Resize(nsides);
+	sidesectors.Resize(nsides);
+	sidelines.Resize(nsides);
+	for (unsigned i = 0; i < nsides && !fr.Failed; ++i)
+	{
+		side_t *sd = &sds[i];
+
+		fr.Read(sd, sizeof(*sd));
+		for (int j = 0; j < 3; ++j)
+		{
+			sd->textures[j].texture = fr.MapTexture(sd->textures[j].texture);
+		}
+		sidesectors[i] = fr.ReadIndex(nsecs, false);
+		sidelines[i] = fr.ReadIndex(nlines);
+	}
+
+	TArray<line_t> lds;
+	TArray<FCachedLineRefs> linerefs;
+	lds.Resize(nlines);
+	linerefs.Resize(nlines);
+	for (unsigned i = 0; i < nlines && !fr.Failed; ++i)
+	{
+		FCachedLineRefs &refs = linerefs[i];
+
+		fr.Read(&lds[i], sizeof(line_t));
+		fr.Read(&refs, sizeof(refs));
+		if (refs.v1 < 0 || unsigned(refs.v1) >= nverts || refs.v2 < 0 || unsigned(refs.v2) >= nverts ||
+			refs.sidedef[0] < -1 || refs.sidedef[0] >= int(nsides) || refs.sidedef[1] < -1 || refs.sidedef[1] >= int(nsides) ||
+			refs.frontsector < -1 || refs.frontsector >= int(nsecs) || refs.backsector < -1 || refs.backsector >= int(nsecs))
+		{
+			return false;
+		}
+	}
+
+	unsigned nthings = fr.ReadCount(sizeof(FMapThing) + sizeof(DWORD));
+	TArray<FMapThing> things;
+	things.Resize(nthings);
+	for (unsigned i = 0; i < nthings && !fr.Failed; ++i)
+	{
+		fr.Read(&things[i], sizeof(FMapThing));
+		things[i].info = NULL;
+		if (fr.ReadLong() != 0 && (things[i].info = DoomEdMap.CheckKey(things[i].EdNum)) == NULL)
+		{
+			return false;
+		}
+	}
+
+	unsigned nuserdata = fr.ReadCount(2 * sizeof(DWORD));
+	TArray<FMapThingUserData> userdata;
+	userdata.Resize(nuserdata);
+	for (unsigned i = 0; i < nuserdata && !fr.Failed; ++i)
+	{
+		FNameNoInit prop;
+		prop = ENamedName(fr.ReadLong());
+		fr.MapName(prop);
+		userdata[i].Property = prop;
+		userdata[i].Value = int(fr.ReadLong());
+	}
+
+	unsigned nuserindex = fr.ReadCount(2 * sizeof(DWORD));
+	TMap<unsigned, unsigned> userindex;
+	for (unsigned i = 0; i < nuserindex && !fr.Failed; ++i)
+	{
+		unsigned thing = fr.ReadLong();
+		unsigned start = fr.ReadLong();
+		if (thing >= nthings || start >= nuserdata)
+		{
+			return false;
+		}
+		userindex[thing] = start;
+	}
+
+	FUDMFKeyMap keymaps[4];
+	for (int i = 0; i < 4 && !fr.Failed; ++i)
+	{
+		unsigned nkeymaps = fr.ReadCount(2 * sizeof(DWORD));
+		for (unsigned k = 0; k < nkeymaps && !fr.Failed; ++k)
+		{
+			FUDMFKeys &keys = keymaps[i][int(fr.ReadLong())];
+			unsigned nkeys = fr.ReadCount(4 * sizeof(DWORD) + sizeof(double));
+
+			keys.Resize(nkeys);
+			for (unsigned n = 0; n < nkeys && !fr.Failed; ++n)
+			{
+				FNameNoInit name;
+				name = ENamedName(fr.ReadLong());
+				fr.MapName(name);
+				keys[n].Key = name;
+				keys[n].Type = int(fr.ReadLong());
+				keys[n].IntVal = int(fr.ReadLong());
+				fr.Read(&keys[n].FloatVal, sizeof(double));
+				keys[n].StringVal = fr.ReadString();
+			}
+		}
+	}
+
+	TArray<FTagItem> tags, ids;
+	tags.Resize(fr.ReadCount(sizeof(FTagItem)));
+	for (unsigned i = 0; i < tags.Size() && !fr.Failed; ++i)
+	{
+		fr.Read(&tags[i], sizeof(FTagItem));
+		if (tags[i].target < 0 || unsigned(tags[i].target) >= nsecs)
+		{
+			return false;
+		}
+	}
+	ids.Resize(fr.ReadCount(sizeof(FTagItem)));
+	for (unsigned i = 0; i < ids.Size() && !fr.Failed; ++i)
+	{
+		// Line IDs are added while parsing, before 0-length lines are removed.
+		fr.Read(&ids[i], sizeof(FTagItem));
+		if (ids[i].target < 0 || unsigned(ids[i].target) >= nlines + removed)
+		{
+			return false;
+		}
+	}
+
+	unsigned nlinemap = fr.ReadCount(sizeof(DWORD));
+	TArray<int> cachedlinemap;
+	cachedlinemap.Resize(nlinemap);
+	for (unsigned i = 0; i < nlinemap && !fr.Failed; ++i)
+	{
+		cachedlinemap[i] = int(fr.ReadLong());
+	}
+
+	if (fr.Failed || !fr.AtEnd() || removed < 0)
+	{
+		return false;
+	}
+
+	// Everything checks out, so set up the level like ParseTextMap would have.
+	if (cachedNamespace)
+	{
+		SetNamespace(cachedns);
+	}
+	if (removed > 0)
+	{
+		ForceNodeBuild = true;
+	}
+	removedLines = removed;
+
+	numvertexes = nverts;
+	vertexes = new vertex_t[numvertexes];
+	memcpy(vertexes, &verts[0], numvertexes * sizeof(*vertexes));
+
+	numvertexdatas = nvdatas;
+	vertexdatas = new vertexdata_t[numvertexdatas];
+	if (numvertexdatas > 0)
+	{
+		memcpy(vertexdatas, &vdatas[0], numvertexdatas * sizeof(*vertexdatas));
+	}
+
+	numsectors = nsecs;
+	numsides = nsides;
+	numlines = nlines;
+	sectors = new sector_t[numsectors];
+	sides = new side_t[numsides];
+	lines = new line_t[numlines];
+	memcpy(sectors, &secs[0], numsectors * sizeof(*sectors));
+	memcpy(sides, &sds[0], numsides * sizeof(*sides));
+	memcpy(lines, &lds[0], numlines * sizeof(*lines));
+
+	sectors[0].e = new extsector_t[numsectors];
+	for (int i = 0; i < numsectors; ++i)
+	{
+		FCachedColormap &cm = colormaps[i];
+
+		sector_t *sec = &sectors[i];
+
+		sec->e = &sectors[0].e[i];
+		sec->ColorMap = cm.HasColormap ? GetSpecialLights(cm.Color, cm.Fade, cm.Desaturate) : NULL;
+
+		// None of these are set up by the parser.
+		sec->SoundTarget = NULL;
+		sec->thinglist = NULL;
+		sec->floordata = sec->ceilingdata = sec->lightingdata = NULL;
+		for (int j = 0; j < 4; ++j)
+		{
+			sec->interpolations[j] = NULL;
+		}
+		sec->lines = NULL;
+		sec->heightsec = NULL;
+		sec->touching_thinglist = NULL;
+		sec->SecActTarget = NULL;
+		sec->SkyBoxes[0] = sec->SkyBoxes[1] = NULL;
+		sec->subsectors = NULL;
+		sec->portals[0] = sec->portals[1] = NULL;
+		sec->lighthead = NULL;
+	}
+	for (int i = 0; i < numsides; ++i)
+	{
+		side_t *sd = &sides[i];
+
+		sd->sector = &sectors[sidesectors[i]];
+		sd->linedef = sidelines[i] >= 0 ? &lines[sidelines[i]] : NULL;
+		sd->AttachedDecals = NULL;
+		for (int j = 0; j < 3; ++j)
+		{
+			sd->textures[j].interpolation = NULL;
+		}
+		sd->lighthead = NULL;
+		sd->segs = NULL;
+		sd->numsegs = 0;
+	}
+	for (int i = 0; i < numlines; ++i)
+	{
+		line_t *ld = &lines[i];
+		FCachedLineRefs &refs = linerefs[i];
+
+		ld->v1 = &vertexes[refs.v1];
+		ld->v2 = &vertexes[refs.v2];
+		ld->sidedef[0] = refs.sidedef[0] >= 0 ? &sides[refs.sidedef[0]] : NULL;
+		ld->sidedef[1] = refs.sidedef[1] >= 0 ? &sides[refs.sidedef[1]] : NULL;
+		ld->frontsector = refs.frontsector >= 0 ? &sectors[refs.frontsector] : NULL;
+		ld->backsector = refs.backsector >= 0 ? &sectors[refs.backsector] : NULL;
+		ld->skybox = NULL;
+	}
+
+	MapThingsConverted = things;
+	MapThingsUserData = userdata;
+	MapThingsUserDataIndex.TransferFrom(userindex);
+	for (int i = 0; i < 4; ++i)
+	{
+		UDMFKeys[i].TransferFrom(keymaps[i]);
+	}
+	for (unsigned i = 0; i < tags.Size(); ++i)
+	{
+		tagManager.AddSectorTag(tags[i].target, tags[i].tag);
+	}
+	for (unsigned i = 0; i < ids.Size(); ++i)
+	{
+		tagManager.AddLineID(ids[i].target, ids[i].tag);
+	}
+	linemap = cachedlinemap;
+	return true;
+}
+
+//===========================================================================
+//
+// P_ParseTextMap
+//
+//===========================================================================
+
 void P_ParseTextMap(MapData *map, FMissingTextureTracker &missingtex)
 {
 	UDMFParser parse(missingtex);
+	FString key;
 
+	if (cachetextmap)
+	{
+		key = P_TextMapCacheKey();
+		if (parse.ReadCache(map, key))
+		{
+			return;
+		}
+	}
 	parse.ParseTextMap(map);
+	if (cachetextmap)
+	{
+		parse.WriteCache(map, key);
+	}
+}
+
+//===========================================================================
+//
+// FUDMFBenchParser
+//
+// Walks a TEXTMAP's blocks and keys with the parser base's own key and
+// value handling, and optionally records every value it sees. udmfbench
+// runs it on both scanners to check that they parse the map identically.
+//
+//===========================================================================
+
+struct FUDMFBenchValue
+{
+	FName Block;
+	FName Key;
+	int Type;
+	int Int;
+	double Float;
+	FString String;
+};
+
+template<class TScanner>
+class FUDMFBenchParser : public TUDMFParserBase<TScanner>
+{
+public:
+	void Parse(const FString &text, TArray<FUDMFBenchValue> *values)
+	{
+		this->sc.OpenString("TEXTMAP", text);
+		this->sc.SetCMode(true);
+		while (this->sc.GetString())
+		{
+			bool isblock;
+
+			this->sc.UnGet();
+			FName key = this->ParseKey(true, &isblock);
+			if (!isblock)
+			{
+				AddValue(values, NAME_None, key);
+				continue;
+			}
+			while (!this->sc.CheckToken('}'))
+			{
+				AddValue(values, key, this->ParseKey());
+			}
+		}
+	}
+
+private:
+	void AddValue(TArray<FUDMFBenchValue> *values, FName block, FName key)
+	{
+		FUDMFBenchValue val;
+
+		val.Block = block;
+		val.Key = key;
+		val.Type = this->sc.TokenType;
+		val.Int = 0;
+		val.Float = 0;
+		switch (val.Type)
+		{
+		case TK_IntConst:
+			val.Int = this->CheckInt(key);
+			val.Float = this->CheckFloat(key);
+			break;
+
+		case TK_FloatConst:
+			val.Float = this->CheckFloat(key);
+			break;
+
+		case TK_StringConst:
+			val.String = this->CheckString(key);
+			break;
+
+		case TK_True:
+		case TK_False:
+			val.Int = this->CheckBool(key);
+			break;
+		}
+		if (values != NULL)
+		{
+			values->Push(val);
+		}
+	}
+};
+
+//===========================================================================
+//
+// CCMD udmfbench
+//
+// Runs a map's TEXTMAP through FScanner and FUDMFScanner, reports their
+// throughput, and checks that both return the same tokens and that the
+// UDMF key parsing gets the same values out of both.
+//
+//===========================================================================
+
+CCMD(udmfbench)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: udmfbench <map> [passes]\n");
+		return;
+	}
+
+	MapData *map = P_OpenMapData(argv[1], true);
+	if (map == NULL || !map->isText)
+	{
+		Printf("%s is not a UDMF map\n", argv[1]);
+		delete map;
+		return;
+	}
+
+	int passes = argv.argc() > 2 ? MAX(1, atoi(argv[2])) : 10;
+	int size = map->Size(ML_TEXTMAP);
+	FString text;
+	char *buffer = text.LockNewBuffer(size);
+	map->Read(ML_TEXTMAP, buffer);
+	buffer[size] = '\0';
+	text.UnlockBuffer();
+	delete map;
+
+	cycle_t oldclock, newclock;
+	int oldtokens = 0, newtokens = 0;
+
+	oldclock.Reset();
+	newclock.Reset();
+	for (int i = 0; i < passes; ++i)
+	{
+		FScanner oldsc;
+		FUDMFScanner newsc;
+
+		oldclock.Clock();
+		oldsc.OpenString("TEXTMAP", text);
+		oldsc.SetCMode(true);
+		for (oldtokens = 0; oldsc.GetToken(); ++oldtokens) {}
+		oldclock.Unclock();
+
+		newclock.Clock();
+		newsc.OpenString("TEXTMAP", text);
+		for (newtokens = 0; newsc.GetToken(); ++newtokens) {}
+		newclock.Unclock();
+	}
+
+	// Compare the token streams.
+	FScanner oldsc;
+	FUDMFScanner newsc;
+	int mismatch = -1;
+
+	oldsc.OpenString("TEXTMAP", text);
+	oldsc.SetCMode(true);
+	newsc.OpenString("TEXTMAP", text);
+	for (int i = 0; mismatch < 0; ++i)
+	{
+		bool oldgot = oldsc.GetToken();
+		bool newgot = newsc.GetToken();
+		int oldtype = oldsc.TokenType;
+
+		// FScanner turns C and DECORATE keywords into their own tokens, but
+		// UDMF treats them as plain identifiers.
+		if (newsc.TokenType == TK_Identifier && oldtype >= TK_SequenceStart &&
+			oldtype != TK_StringConst && oldtype != TK_NameConst && oldtype != TK_IntConst &&
+			oldtype != TK_FloatConst && oldtype != TK_True && oldtype != TK_False)
+		{
+			oldtype = TK_Identifier;
+		}
+		if (oldgot != newgot || (oldgot && (oldtype != newsc.TokenType ||
+			strcmp(oldsc.String, newsc.String) != 0 ||
+			(oldsc.TokenType == TK_IntConst && oldsc.Number != newsc.Number) ||
+			(oldsc.TokenType == TK_FloatConst && oldsc.Float != newsc.Float))))
+		{
+			mismatch = i;
+		}
+		else if (!oldgot)
+		{
+			break;
+		}
+	}
+
+	// Parse the keys with both scanners and compare the values.
+	cycle_t oldparseclock, newparseclock;
+
+	oldparseclock.Reset();
+	newparseclock.Reset();
+	for (int i = 0; i < passes; ++i)
+	{
+		FUDMFBenchParser<FScanner> oldparser;
+		FUDMFBenchParser<FUDMFScanner> newparser;
+
+		oldparseclock.Clock();
+		oldparser.Parse(text, NULL);
+		oldparseclock.Unclock();
+
+		newparseclock.Clock();
+		newparser.Parse(text, NULL);
+		newparseclock.Unclock();
+	}
+
+	TArray<FUDMFBenchValue> oldvalues, newvalues;
+	FUDMFBenchParser<FScanner> oldparser;
+	FUDMFBenchParser<FUDMFScanner> newparser;
+	int valuemismatch = -1;
+
+	oldparser.Parse(text, &oldvalues);
+	newparser.Parse(text, &newvalues);
+	for (unsigned i = 0; i < MAX(oldvalues.Size(), newvalues.Size()); ++i)
+	{
+		if (i >= oldvalues.Size() || i >= newvalues.Size())
+		{
+			valuemismatch = i;
+			break;
+		}
+		FUDMFBenchValue &o = oldvalues[i], &n = newvalues[i];
+		if (o.Block != n.Block || o.Key != n.Key || o.Type != n.Type || o.Int != n.Int ||
+			o.Float != n.Float || o.String.Compare(n.String) != 0)
+		{
+			valuemismatch = i;
+			break;
+		}
+	}
+
+	double mb = double(size) * passes / (1024 * 1024);
+	double oldms = oldclock.TimeMS(), newms = newclock.TimeMS();
+	double oldparsems = oldparseclock.TimeMS(), newparsems = newparseclock.TimeMS();
+
+	Printf("%d bytes, %d tokens, %u values, %d passes\n", size, newtokens, newvalues.Size(), passes);
+	Printf("FScanner:           %8.3f ms, %7.2f MB/s\n", oldms / passes, oldms > 0 ? mb * 1000 / oldms : 0.);
+	Printf("FUDMFScanner:       %8.3f ms, %7.2f MB/s\n", newms / passes, newms > 0 ? mb * 1000 / newms : 0.);
+	Printf("FScanner parse:     %8.3f ms, %7.2f MB/s\n", oldparsems / passes, oldparsems > 0 ? mb * 1000 / oldparsems : 0.);
+	Printf("FUDMFScanner parse: %8.3f ms, %7.2f MB/s\n", newparsems / passes, newparsems > 0 ? mb * 1000 / newparsems : 0.);
+	if (mismatch >= 0)
+	{
+		Printf(TEXTCOLOR_RED "Token %d differs: \"%s\" vs \"%s\" (line %d)\n", mismatch, oldsc.String, newsc.String, newsc.Line);
+	}
+	else
+	{
+		Printf("Token streams are identical\n");
+	}
+	if (valuemismatch >= 0)
+	{
+		FUDMFBenchValue *o = unsigned(valuemismatch) < oldvalues.Size() ? &oldvalues[valuemismatch] : NULL;
+		FUDMFBenchValue *n = unsigned(valuemismatch) < newvalues.Size() ? &newvalues[valuemismatch] : NULL;
+
+		Printf(TEXTCOLOR_RED "Value %d differs: %s.%s vs %s.%s\n", valuemismatch,
+			o ? o->Block.GetChars() : "(end)", o ? o->Key.GetChars() : "",
+			n ? n->Block.GetChars() : "(end)", n ? n->Key.GetChars() : "");
+	}
+	else
+	{
+		Printf("Parsed values are identical\n");
+	}
 }
@@ -5,10 +5,81 @@
 #include "m_fixed.h"
 #include "tables.h"
 
-class UDMFParserBase
+//===========================================================================
+//
+// FUDMFScanner
+//
+// UDMF and USDF only use a handful of token types, so they get their own
+// single pass scanner instead of the general purpose one. It produces the
+// same token types and values FScanner does in C mode, but skips the
+// keyword tables and scanner modes, and can take over the lump's text
+// without copying it.
+//
+//===========================================================================
+
+class FUDMFScanner
+{
+public:
+	FUDMFScanner();
+
+	void OpenMem(const char *name, const char *buffer, int size);
+	void OpenString(const char *name, FString buffer);
+	void SetCMode(bool cmode) {}	// UDMF is always C-like
+
+	bool GetToken();
+	void MustGetAnyToken();
+	void MustGetToken(int token);
+	bool CheckToken(int token);
+	bool GetString() { return GetToken(); }
+	void MustGetString();
+	void MustGetStringName(const char *name);
+	bool CheckString(const char *name);
+	bool Compare(const char *text);
+	void UnGet();
+
+	void ScriptError(const char *message, ...);
+	void ScriptMessage(const char *message, ...);
+
+	char *String;
+	int StringLen;
+	int TokenType;
+	int Number;
+	double Float;
+	int Line;
+	FString ScriptName;
+
+private:
+	// Strings longer than this minus one will be dynamically allocated.
+	static const int MAX_STRING_SIZE = 128;
+
+	FString ScriptBuffer;
+	const char *ScriptPtr;
+	const char *ScriptEndPtr;
+	char StringBuffer[MAX_STRING_SIZE];
+	FString BigStringBuffer;
+	bool AlreadyGot;
+	int AlreadyGotLine;
+	int LastGotLine;
+
+	void SetString(const char *start, int len);
+};
+
+//===========================================================================
+//
+// TUDMFParserBase
+//
+// The key/value parsing shared by the TEXTMAP and USDF parsers. The
+// scanner is a template parameter only so that udmfbench can run the same
+// code on top of FScanner and compare the results; the parsers themselves
+// always use FUDMFScanner.
+//
+//===========================================================================
+
+template<class TScanner>
+class TUDMFParserBase
 {
 protected:
-	FScanner sc;
+	TScanner sc;
 	FName namespc;
 	int namespace_bits;
 	FString parsedString;
@@ -33,6 +104,8 @@ protected:
 
 };
 
+typedef TUDMFParserBase<FUDMFScanner> UDMFParserBase;
+
 #define BLOCK_ID (ENamedName)-1
 
 #endif
\ No newline at end of file
@@ -23,6 +23,7 @@
 #include "templates.h"
 #include "doomstat.h"
 #include "v_text.h"
+#include "m_profile.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -51,6 +52,7 @@
 FScanner::FScanner()
 {
 	ScriptOpen = false;
+	ProfileScope = -1;
 }
 
 //==========================================================================
@@ -61,7 +63,7 @@ FScanner::FScanner()
 
 FScanner::~FScanner()
 {
-	// Humm... Nothing to do in here.
+	LoadProfiler.End(ProfileScope);
 }
 
 //==========================================================================
@@ -73,6 +75,7 @@ FScanner::~FScanner()
 FScanner::FScanner(const FScanner &other)
 {
 	ScriptOpen = false;
+	ProfileScope = -1;
 	*this = other;
 }
 
@@ -85,6 +88,7 @@ FScanner::FScanner(const FScanner &other)
 FScanner::FScanner(int lumpnum)
 {
 	ScriptOpen = false;
+	ProfileScope = -1;
 	OpenLumpNum(lumpnum);
 }
 
@@ -229,6 +233,11 @@ void FScanner::OpenString (const char *name, FString buffer)
 void FScanner :: OpenLumpNum (int lump)
 {
 	Close ();
+	if (LoadProfiler.IsEnabled())
+	{
+		// Parsing a lump is timed until the scanner is closed or destroyed.
+		ProfileScope = LoadProfiler.Begin(Wads.GetLumpFullPath(lump));
+	}
 	{
 		FMemLump mem = Wads.ReadLump(lump);
 		ScriptBuffer = mem.GetString();
@@ -291,6 +300,8 @@ void FScanner::PrepareScript ()
 
 void FScanner::Close ()
 {
+	LoadProfiler.End(ProfileScope);
+	ProfileScope = -1;
 	ScriptOpen = false;
 	ScriptBuffer = "";
 	BigStringBuffer = "";
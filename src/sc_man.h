@@ -108,6 +108,7 @@ protected:
 	uint8_t StateMode;
 	bool StateOptions;
 	bool Escape;
+	int ProfileScope;
 	bool ScanValue(bool allowfloat);
 };
 
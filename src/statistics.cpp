@@ -560,7 +560,7 @@ static void SerializeStatistics(FArchive &arc)
 
 #define STAT_ID			MAKE_ID('s','T','a','t')
 
-void STAT_Write(FILE *file)
+void STAT_Write(FileWriter *file)
 {
 	FPNGChunkArchive arc (file, STAT_ID);
 	SerializeStatistics(arc);
@@ -119,6 +119,7 @@ void FAutomapTexture::Unload ()
 {
 	if (Pixels != NULL)
 	{
+		TexPixelCache.Remove(this);
 		delete[] Pixels;
 		Pixels = NULL;
 	}
@@ -157,8 +158,10 @@ const BYTE *FAutomapTexture::GetPixels ()
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	return Pixels;
 }
 
@@ -172,8 +175,10 @@ const BYTE *FAutomapTexture::GetColumn (unsigned int column, const Span **spans_
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	if ((unsigned)column >= (unsigned)Width)
 	{
 		column %= Width;
@@ -398,6 +398,7 @@ void FDDSTexture::Unload ()
 {
 	if (Pixels != NULL)
 	{
+		TexPixelCache.Remove(this);
 		delete[] Pixels;
 		Pixels = NULL;
 	}
@@ -437,8 +438,10 @@ const BYTE *FDDSTexture::GetColumn (unsigned int column, const Span **spans_out)
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	if ((unsigned)column >= (unsigned)Width)
 	{
 		if (WidthMask + 1 == Width)
@@ -471,8 +474,10 @@ const BYTE *FDDSTexture::GetPixels ()
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	return Pixels;
 }
 
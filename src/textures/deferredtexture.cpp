@@ -0,0 +1,616 @@
+/*
+** deferredtexture.cpp
+** Texture proxies that create their real texture on first use
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 RZDoom contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** With tex_deferredload enabled, FTexture::CreateTexture consults a header
+** cache kept in the cache directory. When it knows the lump, only a small
+** proxy carrying the texture's size, offsets and scale is created; the
+** format sniffing and the real texture object are postponed until the
+** texture's pixels are first requested. Lumps the cache does not know yet
+** are created normally and their headers are recorded for the next run.
+*/
+
+#include <sys/stat.h>
+#include <stdio.h>
+
+#include "doomtype.h"
+#include "w_wad.h"
+#include "m_swap.h"
+#include "m_misc.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "cmdlib.h"
+#include "textures/textures.h"
+
+CVAR(Bool, tex_deferredload, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+static const DWORD HEADER_CACHE_VERSION = 1;
+
+//==========================================================================
+//
+// The information needed to stand in for a texture until it is used
+//
+//==========================================================================
+
+struct FTextureHeader
+{
+	enum
+	{
+		HF_Valid = 1,			// The lump could be turned into a texture
+		HF_Masked = 2,
+		HF_WorldPanning = 4,
+		HF_AlphaTexture = 8,
+	};
+
+	SWORD Width, Height;
+	SWORD LeftOffset, TopOffset;
+	fixed_t xScale, yScale;
+	WORD Rotations;
+	WORD Flags;
+};
+
+//==========================================================================
+//
+// FTextureHeaderCache
+//
+// Headers are keyed by the containing file's name, size and modification
+// time plus the lump's name, size and requested use type, so any change to
+// a resource file invalidates all of its entries.
+//
+//==========================================================================
+
+class FTextureHeaderCache
+{
+public:
+	FTextureHeaderCache() : Hits(0), Misses(0), Loaded(false), Dirty(false) {}
+
+	const FTextureHeader *Find(int lumpnum, int usetype, FString &key);
+	void Store(const FString &key, FTexture *tex);
+	void Load();
+	void Save();
+
+	unsigned Hits, Misses;
+
+private:
+	FString GetFileKey(int wadnum);
+	static FString GetCacheName(bool create);
+
+	TMap<FString, FTextureHeader> Headers;
+	TArray<FString> FileKeys;
+	bool Loaded;
+	bool Dirty;
+};
+
+static FTextureHeaderCache HeaderCache;
+
+//==========================================================================
+//
+// FTextureHeaderCache :: GetCacheName
+//
+//==========================================================================
+
+FString FTextureHeaderCache::GetCacheName(bool create)
+{
+	FString path = M_GetCachePath(create);
+	if (create) CreatePath(path);
+	path << "/textureheaders.cache";
+	return path;
+}
+
+//==========================================================================
+//
+// FTextureHeaderCache :: GetFileKey
+//
+//==========================================================================
+
+FString FTextureHeaderCache::GetFileKey(int wadnum)
+{
+	if ((unsigned)wadnum >= FileKeys.Size())
+	{
+		FileKeys.Resize(Wads.GetNumWads());
+	}
+	FString &key = FileKeys[wadnum];
+	if (key.IsEmpty())
+	{
+		const char *filename = Wads.GetWadFullName(wadnum);
+		struct stat info;
+
+		if (filename == NULL || stat(filename, &info) != 0)
+		{
+			key = "?";
+		}
+		else
+		{
+			key.Format("%s|%lld|%lld", filename, (long long)info.st_size, (long long)info.st_mtime);
+		}
+	}
+	return key;
+}
+
+//==========================================================================
+//
+// FTextureHeaderCache :: Find
+//
+// Returns the cached header for the lump, if any. key receives the cache
+// key for a later Store() and is left empty if the lump cannot be cached.
+//
+//==========================================================================
+
+const FTextureHeader *FTextureHeaderCache::Find(int lumpnum, int usetype, FString &key)
+{
+	if (!Loaded)
+	{
+		Load();
+	}
+	FString filekey = GetFileKey(Wads.GetLumpFile(lumpnum));
+	if (filekey[0] == '?')
+	{
+		key = "";
+		return NULL;
+	}
+	key.Format("%s|%s|%d|%d", filekey.GetChars(), Wads.GetLumpFullName(lumpnum), Wads.LumpLength(lumpnum), usetype);
+	FTextureHeader *header = Headers.CheckKey(key);
+	if (header != NULL) Hits++;
+	else Misses++;
+	return header;
+}
+
+//==========================================================================
+//
+// FTextureHeaderCache :: Store
+//
+//==========================================================================
+
+void FTextureHeaderCache::Store(const FString &key, FTexture *tex)
+{
+	FTextureHeader header;
+
+	memset(&header, 0, sizeof(header));
+	if (tex != NULL)
+	{
+		header.Width = tex->GetWidth();
+		header.Height = tex->GetHeight();
+		header.LeftOffset = tex->LeftOffset;
+		header.TopOffset = tex->TopOffset;
+		header.xScale = tex->xScale;
+		header.yScale = tex->yScale;
+		header.Rotations = tex->Rotations;
+		header.Flags = FTextureHeader::HF_Valid |
+			(tex->bMasked ? FTextureHeader::HF_Masked : 0) |
+			(tex->bWorldPanning ? FTextureHeader::HF_WorldPanning : 0) |
+			(tex->bAlphaTexture ? FTextureHeader::HF_AlphaTexture : 0);
+	}
+	Headers[key] = header;
+	Dirty = true;
+}
+
+//==========================================================================
+//
+// FTextureHeaderCache :: Load
+//
+//==========================================================================
+
+void FTextureHeaderCache::Load()
+{
+	Loaded = true;
+	Headers.Clear();
+
+	FILE *f = fopen(GetCacheName(false), "rb");
+	if (f == NULL) return;
+
+	char magic[4];
+	DWORD version, count;
+
+	if (fread(magic, 1, 4, f) != 4 || memcmp(magic, "TXHC", 4) ||
+		fread(&version, 4, 1, f) != 1 || LittleLong(version) != HEADER_CACHE_VERSION ||
+		fread(&count, 4, 1, f) != 1)
+	{
+		fclose(f);
+		return;
+	}
+	count = LittleLong(count);
+	for (DWORD i = 0; i < count; ++i)
+	{
+		WORD keylen;
+		FTextureHeader header;
+
+		if (fread(&keylen, 2, 1, f) != 1) break;
+		keylen = LittleShort(keylen);
+
+		FString key;
+		char *keybuf = key.LockNewBuffer(keylen);
+		bool ok = fread(keybuf, 1, keylen, f) == keylen;
+		key.UnlockBuffer();
+		if (!ok || fread(&header, sizeof(header), 1, f) != 1) break;
+
+		header.Width = LittleShort(header.Width);
+		header.Height = LittleShort(header.Height);
+		header.LeftOffset = LittleShort(header.LeftOffset);
+		header.TopOffset = LittleShort(header.TopOffset);
+		header.xScale = LittleLong(header.xScale);
+		header.yScale = LittleLong(header.yScale);
+		header.Rotations = LittleShort(header.Rotations);
+		header.Flags = LittleShort(header.Flags);
+		Headers[key] = header;
+	}
+	fclose(f);
+}
+
+//==========================================================================
+//
+// FTextureHeaderCache :: Save
+//
+//==========================================================================
+
+void FTextureHeaderCache::Save()
+{
+	if (!Dirty) return;
+	Dirty = false;
+
+	FString path = GetCacheName(true);
+	FILE *f = fopen(path, "wb");
+	if (f == NULL)
+	{
+		Printf("Cannot open texture header cache %s for writing\n", path.GetChars());
+		return;
+	}
+
+	DWORD version = LittleLong(HEADER_CACHE_VERSION);
+	DWORD count = LittleLong(Headers.CountUsed());
+	fwrite("TXHC", 1, 4, f);
+	fwrite(&version, 4, 1, f);
+	fwrite(&count, 4, 1, f);
+
+	TMap<FString, FTextureHeader>::Iterator it(Headers);
+	TMap<FString, FTextureHeader>::Pair *pair;
+	while (it.NextPair(pair))
+	{
+		FTextureHeader header = pair->Value;
+		WORD keylen = LittleShort((WORD)pair->Key.Len());
+
+		header.Width = LittleShort(header.Width);
+		header.Height = LittleShort(header.Height);
+		header.LeftOffset = LittleShort(header.LeftOffset);
+		header.TopOffset = LittleShort(header.TopOffset);
+		header.xScale = LittleLong(header.xScale);
+		header.yScale = LittleLong(header.yScale);
+		header.Rotations = LittleShort(header.Rotations);
+		header.Flags = LittleShort(header.Flags);
+
+		fwrite(&keylen, 2, 1, f);
+		fwrite(pair->Key.GetChars(), 1, pair->Key.Len(), f);
+		fwrite(&header, sizeof(header), 1, f);
+	}
+	fclose(f);
+}
+
+//==========================================================================
+//
+// A texture that creates the real texture from its lump on first use
+//
+//==========================================================================
+
+class FDeferredTexture : public FTexture
+{
+public:
+	FDeferredTexture(int lumpnum, int usetype, const FTextureHeader &header);
+	~FDeferredTexture();
+
+	const BYTE *GetColumn(unsigned int column, const Span **spans_out);
+	const BYTE *GetPixels();
+	void Unload();
+	FTextureFormat GetFormat();
+	int CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate, FCopyInfo *inf = NULL);
+	bool UseBasePalette();
+	bool Prefetch();
+	void FillBuffer(BYTE *buff, int pitch, int height, FTextureFormat fmt);
+	bool CheckModified();
+	void SetFrontSkyLayer();
+	void HackHack(int newheight);
+
+protected:
+	FTexture *Real;
+	BYTE *Pixels;		// Only used if the lump can no longer be read
+	Span **Spans;
+	int CreateUseType;
+	bool Created;
+
+	void Materialize();
+};
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+FDeferredTexture::FDeferredTexture(int lumpnum, int usetype, const FTextureHeader &header)
+: FTexture(NULL, lumpnum), Real(NULL), Pixels(NULL), Spans(NULL), CreateUseType(usetype), Created(false)
+{
+	Width = header.Width;
+	Height = header.Height;
+	LeftOffset = header.LeftOffset;
+	TopOffset = header.TopOffset;
+	xScale = header.xScale;
+	yScale = header.yScale;
+	Rotations = header.Rotations;
+	bMasked = !!(header.Flags & FTextureHeader::HF_Masked);
+	bWorldPanning = !!(header.Flags & FTextureHeader::HF_WorldPanning);
+	bAlphaTexture = !!(header.Flags & FTextureHeader::HF_AlphaTexture);
+	UseType = usetype;
+	CalcBitSize();
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+FDeferredTexture::~FDeferredTexture()
+{
+	Unload();
+	if (Real != NULL)
+	{
+		delete Real;
+		Real = NULL;
+	}
+	if (Spans != NULL)
+	{
+		FreeSpans(Spans);
+	}
+}
+
+//==========================================================================
+//
+// FDeferredTexture :: Materialize
+//
+// Creates the real texture. The proxy stays the texture everybody else
+// knows about, so anything that was changed on it after creation has to be
+// passed on before the real texture builds its pixels.
+//
+//==========================================================================
+
+void FDeferredTexture::Materialize()
+{
+	Created = true;
+	Real = FTexture::CreateRealTexture(SourceLump, CreateUseType);
+	if (Real == NULL)
+	{
+		Printf("Texture %s could not be created from %s\n", Name.GetChars(), Wads.GetLumpFullPath(SourceLump).GetChars());
+		return;
+	}
+	if (Real->GetWidth() != Width || Real->GetHeight() != Height)
+	{
+		// The header cache is stale. This should not happen, but if it
+		// does, use the real texture's size to avoid reading out of bounds.
+		Printf("Texture %s changed size since it was cached\n", Name.GetChars());
+		Width = Real->GetWidth();
+		Height = Real->GetHeight();
+		CalcBitSize();
+	}
+	Real->Name = Name;
+	Real->UseType = UseType;
+	Real->bNoRemap0 = bNoRemap0;
+	Real->bAlphaTexture = bAlphaTexture;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+const BYTE *FDeferredTexture::GetColumn(unsigned int column, const Span **spans_out)
+{
+	if (!Created)
+	{
+		Materialize();
+	}
+	if (Real == NULL)
+	{
+		GetPixels();
+		if (Width == 0)
+		{
+			static const Span EmptyColumn[1] = { { 0, 0 } };
+			if (spans_out != NULL) *spans_out = EmptyColumn;
+			return Pixels;
+		}
+		if (column >= (unsigned)Width) column %= Width;
+		if (spans_out != NULL) *spans_out = Spans[column];
+		return Pixels + column * Height;
+	}
+	const BYTE *column_p = Real->GetColumn(column, spans_out);
+	bMasked = Real->bMasked;
+	return column_p;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+const BYTE *FDeferredTexture::GetPixels()
+{
+	if (!Created)
+	{
+		Materialize();
+	}
+	if (Real != NULL)
+	{
+		const BYTE *pixels = Real->GetPixels();
+		bMasked = Real->bMasked;
+		return pixels;
+	}
+	if (Pixels == NULL)
+	{
+		Pixels = new BYTE[Width * Height];
+		memset(Pixels, 0, Width * Height);
+		bMasked = true;
+		if (Spans == NULL)
+		{
+			Spans = CreateSpans(Pixels);
+		}
+	}
+	return Pixels;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FDeferredTexture::Unload()
+{
+	if (Real != NULL)
+	{
+		Real->Unload();
+	}
+	if (Pixels != NULL)
+	{
+		delete[] Pixels;
+		Pixels = NULL;
+	}
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+FTextureFormat FDeferredTexture::GetFormat()
+{
+	if (!Created) Materialize();
+	return Real != NULL ? Real->GetFormat() : TEX_Pal;
+}
+
+int FDeferredTexture::CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate, FCopyInfo *inf)
+{
+	if (!Created) Materialize();
+	if (Real == NULL) return FTexture::CopyTrueColorPixels(bmp, x, y, rotate, inf);
+	int result = Real->CopyTrueColorPixels(bmp, x, y, rotate, inf);
+	bMasked = Real->bMasked;
+	return result;
+}
+
+bool FDeferredTexture::UseBasePalette()
+{
+	if (!Created) Materialize();
+	return Real != NULL ? Real->UseBasePalette() : true;
+}
+
+bool FDeferredTexture::Prefetch()
+{
+	if (!Created) Materialize();
+	return Real != NULL ? Real->Prefetch() : false;
+}
+
+void FDeferredTexture::FillBuffer(BYTE *buff, int pitch, int height, FTextureFormat fmt)
+{
+	if (!Created) Materialize();
+	if (Real != NULL) Real->FillBuffer(buff, pitch, height, fmt);
+	else FTexture::FillBuffer(buff, pitch, height, fmt);
+}
+
+bool FDeferredTexture::CheckModified()
+{
+	return Real != NULL && Real->CheckModified();
+}
+
+void FDeferredTexture::SetFrontSkyLayer()
+{
+	bNoRemap0 = true;
+	if (Real != NULL) Real->SetFrontSkyLayer();
+}
+
+void FDeferredTexture::HackHack(int newheight)
+{
+	if (!Created) Materialize();
+	if (Real != NULL)
+	{
+		Real->HackHack(newheight);
+		Height = Real->GetHeight();
+		CalcBitSize();
+	}
+}
+
+//==========================================================================
+//
+// DeferredTexture_TryCreate
+//
+// Called by FTexture::CreateTexture. Returns true if the header cache
+// decided the outcome, in which case tex receives either a proxy or NULL
+// for a lump that is known not to be a valid texture.
+//
+//==========================================================================
+
+bool DeferredTexture_TryCreate(int lumpnum, int usetype, FTexture *&tex)
+{
+	if (!tex_deferredload)
+	{
+		return false;
+	}
+
+	FString key;
+	const FTextureHeader *header = HeaderCache.Find(lumpnum, usetype, key);
+	if (header != NULL)
+	{
+		tex = (header->Flags & FTextureHeader::HF_Valid) ? new FDeferredTexture(lumpnum, usetype, *header) : NULL;
+		return true;
+	}
+	if (key.IsNotEmpty())
+	{
+		tex = FTexture::CreateRealTexture(lumpnum, usetype);
+		HeaderCache.Store(key, tex);
+		return true;
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// FTexture :: SaveHeaderCache
+//
+// Called once the texture manager has finished creating all textures.
+//
+//==========================================================================
+
+void FTexture::SaveHeaderCache()
+{
+	if (tex_deferredload)
+	{
+		DPrintf("Texture header cache: %u hits, %u misses\n", HeaderCache.Hits, HeaderCache.Misses);
+		HeaderCache.Save();
+	}
+}
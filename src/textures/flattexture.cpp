@@ -135,6 +135,7 @@ void FFlatTexture::Unload ()
 {
 	if (Pixels != NULL)
 	{
+		TexPixelCache.Remove(this);
 		delete[] Pixels;
 		Pixels = NULL;
 	}
@@ -150,8 +151,10 @@ const BYTE *FFlatTexture::GetColumn (unsigned int column, const Span **spans_out
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	if ((unsigned)column >= (unsigned)Width)
 	{
 		if (WidthMask + 1 == Width)
@@ -180,8 +183,10 @@ const BYTE *FFlatTexture::GetPixels ()
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	return Pixels;
 }
 
@@ -139,6 +139,7 @@ void FIMGZTexture::Unload ()
 {
 	if (Pixels != NULL)
 	{
+		TexPixelCache.Remove(this);
 		delete[] Pixels;
 		Pixels = NULL;
 	}
@@ -154,8 +155,10 @@ const BYTE *FIMGZTexture::GetColumn (unsigned int column, const Span **spans_out
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	if ((unsigned)column >= (unsigned)Width)
 	{
 		if (WidthMask + 1 == Width)
@@ -188,8 +191,10 @@ const BYTE *FIMGZTexture::GetPixels ()
 {
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	return Pixels;
 }
 
@@ -359,6 +359,7 @@ void FMultiPatchTexture::Unload ()
 {
 	if (Pixels != NULL)
 	{
+		TexPixelCache.Remove(this);
 		delete[] Pixels;
 		Pixels = NULL;
 	}
@@ -378,8 +379,10 @@ const BYTE *FMultiPatchTexture::GetPixels ()
 	}
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	return Pixels;
 }
 
@@ -397,8 +400,10 @@ const BYTE *FMultiPatchTexture::GetColumn (unsigned int column, const Span **spa
 	}
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	if ((unsigned)column >= (unsigned)Width)
 	{
 		if (WidthMask + 1 == Width)
@@ -40,8 +40,36 @@
 #include "m_png.h"
 #include "bitmap.h"
 #include "v_palette.h"
+#include "colormatcher.h"
+#include "c_cvars.h"
+#include "m_threadpool.h"
+#include "stats.h"
 #include "textures/textures.h"
 
+CVAR(Bool, tex_asyncdecode, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+class FPNGDecodeJob;
+
+//==========================================================================
+//
+// Everything needed to turn a PNG's IDAT into paletted, column-major
+// pixels. Kept separate from the texture so that a worker thread can
+// decode without touching the texture itself.
+//
+//==========================================================================
+
+struct FPNGDecodeParams
+{
+	int Width, Height;
+	DWORD StartOfIDAT;
+	BYTE BitDepth;
+	BYTE ColorType;
+	BYTE Interlace;
+	bool HaveTrans;
+	WORD NonPaletteTrans[3];
+	const BYTE *PaletteMap;
+};
+
 //==========================================================================
 //
 // A PNG texture
@@ -60,6 +88,10 @@ public:
 	FTextureFormat GetFormat ();
 	int CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate, FCopyInfo *inf = NULL);
 	bool UseBasePalette();
+	bool Prefetch();
+
+	static void DecodePixels (FileReader *lump, BYTE *&pixels, const FPNGDecodeParams &params);
+	static void PublishDecodes ();
 
 protected:
 
@@ -77,11 +109,79 @@ protected:
 	int PaletteSize;
 	DWORD StartOfIDAT;
 
+	FPNGDecodeJob *DecodeJob;	// Pixels holds a placeholder while this is set
+	BYTE AverageColor;
+
 	void MakeTexture ();
+	void GetDecodeParams (FPNGDecodeParams &params);
+	void StartDecode ();
+	void FinishDecode ();
 
 	friend class FTexture;
 };
 
+//==========================================================================
+//
+// A PNG decode running on the thread pool
+//
+//==========================================================================
+
+class FPNGDecodeJob : public FJob
+{
+public:
+	FPNGTexture *Texture;	// NULL once nobody wants the result anymore
+	FMemLump Data;
+	FPNGDecodeParams Params;
+	BYTE PaletteMap[256];
+	BYTE *Pixels;
+	BYTE AverageColor[3];
+	double DecodeMS;
+
+	FPNGDecodeJob() : Texture(NULL), Pixels(NULL), DecodeMS(0) {}
+	~FPNGDecodeJob()
+	{
+		if (Pixels != NULL) delete[] Pixels;
+	}
+
+	void Run()
+	{
+		cycle_t clock;
+		clock.Reset();
+		clock.Clock();
+
+		MemoryReader lump((const char *)Data.GetMem(), (long)Data.GetSize());
+		Pixels = new BYTE[Params.Width * Params.Height];
+		FPNGTexture::DecodePixels(&lump, Pixels, Params);
+
+		// Remember the average color to use as a placeholder the next time
+		// this texture has to be decoded.
+		DWORD rgb[3] = { 0, 0, 0 }, count = 0;
+		int size = Params.Width * Params.Height;
+		for (int i = 0; i < size; ++i)
+		{
+			if (Pixels[i] != 0)
+			{
+				const PalEntry &pe = GPalette.BaseColors[Pixels[i]];
+				rgb[0] += pe.r;
+				rgb[1] += pe.g;
+				rgb[2] += pe.b;
+				count++;
+			}
+		}
+		for (int i = 0; i < 3; ++i)
+		{
+			AverageColor[i] = count > 0 ? BYTE(rgb[i] / count) : 0;
+		}
+
+		clock.Unclock();
+		DecodeMS = clock.TimeMS();
+	}
+};
+
+static TArray<FPNGDecodeJob *> DecodeJobs;
+static TArray<BYTE *> RetiredPixels;
+static TArray<FTexture::Span **> RetiredSpans;
+
 
 //==========================================================================
 //
@@ -198,7 +298,7 @@ FPNGTexture::FPNGTexture (FileReader &lump, int lumpnum, const FString &filename
 						  BYTE depth, BYTE colortype, BYTE interlace)
 : FTexture(NULL, lumpnum), SourceFile(filename), Pixels(0), Spans(0),
   BitDepth(depth), ColorType(colortype), Interlace(interlace), HaveTrans(false),
-  PaletteMap(0), PaletteSize(0), StartOfIDAT(0)
+  PaletteMap(0), PaletteSize(0), StartOfIDAT(0), DecodeJob(NULL), AverageColor(0)
 {
 	union
 	{
@@ -369,8 +469,20 @@ FPNGTexture::~FPNGTexture ()
 
 void FPNGTexture::Unload ()
 {
+	if (DecodeJob != NULL)
+	{
+		// The placeholder's spans don't describe the real image.
+		DecodeJob->Texture = NULL;
+		DecodeJob = NULL;
+		if (Spans != NULL)
+		{
+			RetiredSpans.Push(Spans);
+			Spans = NULL;
+		}
+	}
 	if (Pixels != NULL)
 	{
+		TexPixelCache.Remove(this);
 		delete[] Pixels;
 		Pixels = NULL;
 	}
@@ -407,8 +519,17 @@ const BYTE *FPNGTexture::GetColumn (unsigned int column, const Span **spans_out)
 {
 	if (Pixels == NULL)
 	{
-		MakeTexture ();
+		if (tex_asyncdecode && SourceLump >= 0)
+		{
+			StartDecode ();
+		}
+		else
+		{
+			FPixelCacheDecode decode(this);
+			MakeTexture ();
+		}
 	}
+	TexPixelCache.Touch(this);
 	if ((unsigned)column >= (unsigned)Width)
 	{
 		if (WidthMask + 1 == Width)
@@ -439,10 +560,19 @@ const BYTE *FPNGTexture::GetColumn (unsigned int column, const Span **spans_out)
 
 const BYTE *FPNGTexture::GetPixels ()
 {
+	if (DecodeJob != NULL)
+	{
+		// Whoever wants all pixels at once is usually going to keep them
+		// (e.g. compositing), so a placeholder won't do.
+		ThreadPool.Wait(DecodeJob);
+		FinishDecode ();
+	}
 	if (Pixels == NULL)
 	{
+		FPixelCacheDecode decode(this);
 		MakeTexture ();
 	}
+	TexPixelCache.Touch(this);
 	return Pixels;
 }
 
@@ -452,9 +582,29 @@ const BYTE *FPNGTexture::GetPixels ()
 //
 //==========================================================================
 
+void FPNGTexture::GetDecodeParams (FPNGDecodeParams &params)
+{
+	params.Width = Width;
+	params.Height = Height;
+	params.StartOfIDAT = StartOfIDAT;
+	params.BitDepth = BitDepth;
+	params.ColorType = ColorType;
+	params.Interlace = Interlace;
+	params.HaveTrans = HaveTrans;
+	memcpy(params.NonPaletteTrans, NonPaletteTrans, sizeof(params.NonPaletteTrans));
+	params.PaletteMap = PaletteMap;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 void FPNGTexture::MakeTexture ()
 {
 	FileReader *lump;
+	FPNGDecodeParams params;
 
 	if (SourceLump >= 0)
 	{
@@ -465,15 +615,37 @@ void FPNGTexture::MakeTexture ()
 		lump = new FileReader(SourceFile.GetChars());
 	}
 
+	GetDecodeParams(params);
 	Pixels = new BYTE[Width*Height];
-	if (StartOfIDAT == 0)
+	DecodePixels(lump, Pixels, params);
+	delete lump;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FPNGTexture::DecodePixels (FileReader *lump, BYTE *&Pixels, const FPNGDecodeParams &params)
+{
+	const int Width = params.Width;
+	const int Height = params.Height;
+	const BYTE BitDepth = params.BitDepth;
+	const BYTE ColorType = params.ColorType;
+	const BYTE Interlace = params.Interlace;
+	const bool HaveTrans = params.HaveTrans;
+	const WORD *NonPaletteTrans = params.NonPaletteTrans;
+	const BYTE *PaletteMap = params.PaletteMap;
+
+	if (params.StartOfIDAT == 0)
 	{
 		memset (Pixels, 0x99, Width*Height);
 	}
 	else
 	{
 		DWORD len, id;
-		lump->Seek (StartOfIDAT, SEEK_SET);
+		lump->Seek (params.StartOfIDAT, SEEK_SET);
 		lump->Read(&len, 4);
 		lump->Read(&id, 4);
 
@@ -599,7 +771,128 @@ void FPNGTexture::MakeTexture ()
 			delete[] tempix;
 		}
 	}
-	delete lump;
+}
+
+//==========================================================================
+//
+// FPNGTexture :: StartDecode
+//
+// Queues the decode on the thread pool and fills Pixels with a flat
+// placeholder until the result is published by PublishDecodes. Masked
+// textures get an invisible placeholder, others their average color from
+// the last time they were decoded.
+//
+//==========================================================================
+
+void FPNGTexture::StartDecode ()
+{
+	FPNGDecodeJob *job = new FPNGDecodeJob;
+
+	job->Texture = this;
+	job->Data = Wads.ReadLump(SourceLump);
+	GetDecodeParams(job->Params);
+	if (PaletteMap != NULL)
+	{
+		// The texture may be deleted before the job finishes.
+		memset(job->PaletteMap, 0, 256);
+		memcpy(job->PaletteMap, PaletteMap, PaletteMap == GrayMap ? 256 : PaletteSize);
+		job->Params.PaletteMap = job->PaletteMap;
+	}
+	DecodeJob = job;
+	DecodeJobs.Push(job);
+	ThreadPool.Queue(job);
+
+	Pixels = new BYTE[Width*Height];
+	memset(Pixels, bMasked ? 0 : (AverageColor != 0 ? AverageColor : GrayMap[128]), Width*Height);
+}
+
+//==========================================================================
+//
+// FPNGTexture :: FinishDecode
+//
+// Replaces the placeholder with the decoded pixels. The renderer might
+// still hold pointers into the placeholder and its spans for the rest of
+// this frame, so those are only freed by the next PublishDecodes.
+//
+//==========================================================================
+
+void FPNGTexture::FinishDecode ()
+{
+	FPNGDecodeJob *job = DecodeJob;
+
+	DecodeJob = NULL;
+	job->Texture = NULL;
+
+	if (Pixels != NULL) RetiredPixels.Push(Pixels);
+	if (Spans != NULL) RetiredSpans.Push(Spans);
+	Spans = NULL;
+
+	Pixels = job->Pixels;
+	job->Pixels = NULL;
+	AverageColor = ColorMatcher.Pick(job->AverageColor[0], job->AverageColor[1], job->AverageColor[2]);
+	TexPixelCache.Add(this, Width*Height, job->DecodeMS);
+}
+
+//==========================================================================
+//
+// FPNGTexture :: PublishDecodes
+//
+// Called between frames.
+//
+//==========================================================================
+
+void FPNGTexture::PublishDecodes ()
+{
+	for (unsigned i = 0; i < RetiredPixels.Size(); ++i)
+	{
+		delete[] RetiredPixels[i];
+	}
+	RetiredPixels.Clear();
+	for (unsigned i = 0; i < RetiredSpans.Size(); ++i)
+	{
+		M_Free(RetiredSpans[i]);
+	}
+	RetiredSpans.Clear();
+
+	for (unsigned i = 0; i < DecodeJobs.Size(); )
+	{
+		FPNGDecodeJob *job = DecodeJobs[i];
+		if (!job->IsDone())
+		{
+			++i;
+			continue;
+		}
+		if (job->Texture != NULL)
+		{
+			job->Texture->FinishDecode();
+		}
+		delete job;
+		DecodeJobs.Delete(i);
+	}
+}
+
+void PNGTexture_PublishDecodes()
+{
+	FPNGTexture::PublishDecodes();
+}
+
+//==========================================================================
+//
+// FPNGTexture :: Prefetch
+//
+//==========================================================================
+
+bool FPNGTexture::Prefetch ()
+{
+	if (!tex_asyncdecode || SourceLump < 0)
+	{
+		return false;
+	}
+	if (Pixels == NULL)
+	{
+		StartDecode ();
+	}
+	return true;
 }
 
 //===========================================================================
@@ -44,8 +44,11 @@
 #include "c_dispatch.h"
 #include "v_video.h"
 #include "m_fixed.h"
+#include "stats.h"
 #include "textures/textures.h"
 
+CVAR(Int, tex_cachebudget, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)	// pixel data in MB, 0 = unlimited
+
 typedef bool (*CheckFunc)(FileReader & file);
 typedef FTexture * (*CreateFunc)(FileReader & file, int lumpnum);
 
@@ -75,11 +78,24 @@ FTexture *FlatTexture_TryCreate(FileReader &, int lumpnum);
 FTexture *PatchTexture_TryCreate(FileReader &, int lumpnum);
 FTexture *EmptyTexture_TryCreate(FileReader &, int lumpnum);
 FTexture *AutomapTexture_TryCreate(FileReader &, int lumpnum);
+bool DeferredTexture_TryCreate(int lumpnum, int usetype, FTexture *&tex);
+void PNGTexture_PublishDecodes();
+
+
+// Creates the texture for a lump, or a stand-in that will create it once
+// it is used if tex_deferredload is on and the lump's header is cached.
+FTexture * FTexture::CreateTexture (int lumpnum, int usetype)
+{
+	FTexture *tex;
 
+	if (lumpnum == -1) return NULL;
+	if (DeferredTexture_TryCreate(lumpnum, usetype, tex)) return tex;
+	return CreateRealTexture(lumpnum, usetype);
+}
 
 // Examines the lump contents to decide what type of texture to create,
 // and creates the texture.
-FTexture * FTexture::CreateTexture (int lumpnum, int usetype)
+FTexture * FTexture::CreateRealTexture (int lumpnum, int usetype)
 {
 	static TexCreateInfo CreateInfo[]={
 		{ IMGZTexture_TryCreate,		TEX_Any },
@@ -148,7 +164,7 @@ FTexture::FTexture (const char *name, int lumpnum)
   WidthBits(0), HeightBits(0), xScale(FRACUNIT), yScale(FRACUNIT), SourceLump(lumpnum),
   UseType(TEX_Any), bNoDecals(false), bNoRemap0(false), bWorldPanning(false),
   bMasked(true), bAlphaTexture(false), bHasCanvas(false), bWarped(0), bComplex(false), bMultiPatch(false), bKeepAround(false),
-  Rotations(0xFFFF), SkyOffset(0), Width(0), Height(0), WidthMask(0), Native(NULL)
+  Rotations(0xFFFF), SkyOffset(0), LastUseFrame(0), CacheSlot(-1), Width(0), Height(0), WidthMask(0), Native(NULL)
 {
 	id.SetInvalid();
 	if (name != NULL)
@@ -168,6 +184,7 @@ FTexture::FTexture (const char *name, int lumpnum)
 
 FTexture::~FTexture ()
 {
+	TexPixelCache.Remove(this);
 	FTexture *link = Wads.GetLinkedTexture(SourceLump);
 	if (link == this) Wads.SetLinkedTexture(SourceLump, NULL);
 	KillNative();
@@ -548,6 +565,11 @@ bool FTexture::UseBasePalette()
 	return true; 
 }
 
+bool FTexture::Prefetch()
+{
+	return false;
+}
+
 FTexture *FTexture::GetRedirect(bool wantwarped)
 {
 	return this;
@@ -567,6 +589,146 @@ void FTexture::SetScaledSize(int fitwidth, int fitheight)
 	if (MulScale16(yScale, fitheight) != Height) yScale++;
 }
 
+//==========================================================================
+//
+// Texture pixel cache
+//
+//==========================================================================
+
+FTexturePixelCache TexPixelCache;
+
+FTexturePixelCache::FTexturePixelCache()
+: ResidentBytes(0), Frame(1), Uses(0), Misses(0), Evictions(0),
+  DecodeMS(0), FrameDecodeMS(0), LastFrameDecodeMS(0)
+{
+}
+
+void FTexturePixelCache::Add(FTexture *tex, size_t bytes, double decodems)
+{
+	if (tex->CacheSlot >= 0)
+	{
+		FEntry &entry = Resident[tex->CacheSlot];
+		ResidentBytes -= entry.Bytes;
+		entry.Bytes = bytes;
+	}
+	else
+	{
+		FEntry entry = { tex, bytes };
+		tex->CacheSlot = Resident.Push(entry);
+	}
+	ResidentBytes += bytes;
+	Touch(tex);
+	Misses++;
+	DecodeMS += decodems;
+	FrameDecodeMS += decodems;
+}
+
+void FTexturePixelCache::Remove(FTexture *tex)
+{
+	int slot = tex->CacheSlot;
+	if (slot < 0)
+	{
+		return;
+	}
+	ResidentBytes -= Resident[slot].Bytes;
+	tex->CacheSlot = -1;
+
+	// Move the last entry into the vacated slot.
+	FEntry last;
+	Resident.Pop(last);
+	if ((unsigned)slot < Resident.Size())
+	{
+		Resident[slot] = last;
+		last.Texture->CacheSlot = slot;
+	}
+}
+
+static int SortByLastUse(const void *a, const void *b)
+{
+	DWORD fa = (*(FTexture **)a)->LastUseFrame;
+	DWORD fb = (*(FTexture **)b)->LastUseFrame;
+	return fa < fb ? -1 : fa > fb ? 1 : 0;
+}
+
+// Called between frames, when no pixel pointers are held by the renderer.
+void FTexturePixelCache::NewFrame()
+{
+	// Background decodes become visible at frame boundaries only.
+	PNGTexture_PublishDecodes();
+
+	LastFrameDecodeMS = FrameDecodeMS;
+	FrameDecodeMS = 0;
+	Frame++;
+
+	if (tex_cachebudget <= 0)
+	{
+		return;
+	}
+	size_t budget = size_t(tex_cachebudget) << 20;
+	if (ResidentBytes <= budget)
+	{
+		return;
+	}
+
+	// Never evict anything the frame that just finished drew with.
+	TArray<FTexture *> candidates;
+	for (unsigned i = 0; i < Resident.Size(); ++i)
+	{
+		if (Resident[i].Texture->LastUseFrame + 1 < Frame)
+		{
+			candidates.Push(Resident[i].Texture);
+		}
+	}
+	if (candidates.Size() == 0)
+	{
+		return;
+	}
+	qsort(&candidates[0], candidates.Size(), sizeof(FTexture *), SortByLastUse);
+
+	// Go a little below the budget so that this does not happen every frame.
+	size_t target = budget - budget / 8;
+	for (unsigned i = 0; i < candidates.Size() && ResidentBytes > target; ++i)
+	{
+		candidates[i]->Unload();
+		Evictions++;
+	}
+}
+
+FString FTexturePixelCache::GetStats()
+{
+	FString out, budget;
+	double hitrate = Uses > 0 ? 100. * (Uses - MIN(Uses, Misses)) / Uses : 0;
+
+	if (tex_cachebudget > 0) budget.Format("%d MB", *tex_cachebudget);
+	else budget = "none";
+	out.Format("Textures: %u resident, %.2f MB of pixels, spans not counted (budget %s)\n"
+		"Hit rate %.2f%%, %llu decodes, %llu evictions, decode %.2f ms last frame, %.1f ms total",
+		Resident.Size(), ResidentBytes / 1048576., budget.GetChars(),
+		hitrate, (unsigned long long)Misses, (unsigned long long)Evictions, LastFrameDecodeMS, DecodeMS);
+	return out;
+}
+
+ADD_STAT(texcache)
+{
+	return TexPixelCache.GetStats();
+}
+
+FPixelCacheDecode::FPixelCacheDecode(FTexture *tex)
+: Texture(tex)
+{
+	cycle_t clock;
+	clock.Reset();
+	clock.Unclock();
+	Start = clock.TimeMS();
+}
+
+FPixelCacheDecode::~FPixelCacheDecode()
+{
+	cycle_t clock;
+	clock.Reset();
+	clock.Unclock();
+	TexPixelCache.Add(Texture, Texture->GetWidth() * Texture->GetHeight(), clock.TimeMS() - Start);
+}
 
 FDummyTexture::FDummyTexture ()
 {
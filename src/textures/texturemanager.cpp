@@ -1018,6 +1018,7 @@ void FTextureManager::Init()
 	FixAnimations();
 	InitSwitchList();
 	InitPalettedVersions();
+	FTexture::SaveHeaderCache();
 }
 
 //==========================================================================
@@ -1252,7 +1253,12 @@ void FTextureManager::PrecacheLevel (void)
 
 	for (int i = cnt - 1; i >= 0; i--)
 	{
-		Renderer->PrecacheTexture(ByIndex(i), hitlist[i]);
+		FTexture *tex = ByIndex(i);
+
+		// Textures that can decode in the background will be ready by the
+		// time they are needed, or show a placeholder until then.
+		if (hitlist[i] && tex->Prefetch()) continue;
+		Renderer->PrecacheTexture(tex, hitlist[i]);
 	}
 
 	delete[] hitlist;
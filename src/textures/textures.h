@@ -146,6 +146,8 @@ class FTexture
 public:
 	static FTexture* CreateTexture(const char* name, int lumpnum, int usetype);
 	static FTexture* CreateTexture(int lumpnum, int usetype);
+	static FTexture* CreateRealTexture(int lumpnum, int usetype);
+	static void SaveHeaderCache();
 	virtual ~FTexture();
 
 	SWORD LeftOffset, TopOffset;
@@ -177,6 +179,9 @@ public:
 	WORD Rotations;
 	SWORD SkyOffset;
 
+	DWORD LastUseFrame;		// For FTexturePixelCache
+	int CacheSlot;
+
 	enum // UseTypes
 	{
 		TEX_Any,
@@ -217,6 +222,10 @@ public:
 
 	virtual void Unload() = 0;
 
+	// Starts loading the pixels in the background. Returns false if this
+	// texture can't do that, in which case the caller should load it now.
+	virtual bool Prefetch();
+
 	// Returns the native pixel format for this image
 	virtual FTextureFormat GetFormat();
 
@@ -303,6 +312,66 @@ public:
 };
 
 
+//==========================================================================
+//
+// FTexturePixelCache
+//
+// Keeps track of all textures that hold decoded pixels and the frame each
+// was last used in. Once their total size exceeds tex_cachebudget, the
+// textures that have gone unused the longest are unloaded at the start of
+// the next frame. Textures register themselves when they make their pixels
+// (see FPixelCacheDecode) and must call Remove() when they free them.
+// Only pixel data is tracked; spans outlive Unload() and are not counted.
+//
+//==========================================================================
+
+class FTexturePixelCache
+{
+public:
+	FTexturePixelCache();
+
+	// Counts at most one use per texture per frame, no matter how many
+	// columns are drawn from it.
+	void Touch(FTexture *tex)
+	{
+		if (tex->LastUseFrame != Frame)
+		{
+			tex->LastUseFrame = Frame;
+			Uses++;
+		}
+	}
+	void Add(FTexture *tex, size_t bytes, double decodems);
+	void Remove(FTexture *tex);
+	void NewFrame();
+	FString GetStats();
+
+private:
+	struct FEntry
+	{
+		FTexture *Texture;
+		size_t Bytes;
+	};
+	TArray<FEntry> Resident;
+	size_t ResidentBytes;
+	DWORD Frame;
+	QWORD Uses, Misses, Evictions;
+	double DecodeMS, FrameDecodeMS, LastFrameDecodeMS;
+};
+
+extern FTexturePixelCache TexPixelCache;
+
+// Times a texture's MakeTexture and adds the result to the pixel cache.
+class FPixelCacheDecode
+{
+public:
+	FPixelCacheDecode(FTexture *tex);
+	~FPixelCacheDecode();
+
+private:
+	FTexture *Texture;
+	double Start;
+};
+
 // Texture manager
 class FTextureManager
 {
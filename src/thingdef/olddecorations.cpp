@@ -194,7 +194,7 @@ void ParseOldDecoration(FScanner &sc, EDefinitionType def)
 		info->NumOwnedStates += 1;
 	}
 
-	info->OwnedStates = new FState[info->NumOwnedStates];
+	info->OwnedStates = FState::StaticAllocate(info->NumOwnedStates);
 	memcpy (info->OwnedStates, &StateArray[0], info->NumOwnedStates * sizeof(info->OwnedStates[0]));
 	if (info->NumOwnedStates == 1)
 	{
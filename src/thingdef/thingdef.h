@@ -42,6 +42,7 @@ INTBOOL CheckActorFlag(const AActor* owner, const char* flagname, bool printerro
 //
 //==========================================================================
 class FxExpression;
+struct ExpVal;
 
 struct FStateLabels;
 
@@ -124,12 +125,21 @@ struct FStateExpression
 	const PClass* owner;
 	bool constant;
 	bool cloned;
+	int code;		// Start of compiled code, or one of the FSE_ values below
+};
+
+enum
+{
+	FSE_Uncompiled = -1,	// Compiled on first use
+	FSE_Tree = -2,			// Evaluated by walking the expression tree
 };
 
 class FStateExpressions
 {
 	TArray<FStateExpression> expressions;
 
+	void Compile(int num);
+
 public:
 	~FStateExpressions() { Clear(); }
 	void Clear();
@@ -139,6 +149,10 @@ public:
 	void Copy(int dest, int src, int cnt);
 	int ResolveAll();
 	FxExpression* Get(int no);
+	const PClass *GetOwner(int no) { return expressions[no].owner; }
+	bool Eval(int num, AActor *self, ExpVal &val);
+	bool EvalTree(int num, AActor *self, ExpVal &val);
+	int GetCode(int num);
 	unsigned int Size() { return expressions.Size(); }
 };
 
@@ -191,6 +205,7 @@ struct AFuncDesc
 };
 
 AFuncDesc* FindFunction(const char* string);
+AFuncDesc *FindFunctionByPointer(actionf_p func);
 
 
 void ParseStates(FScanner& sc, FActorInfo* actor, AActor* defaults, Baggage& bag);
@@ -540,6 +540,25 @@ AFuncDesc* FindFunction(const char* string)
 }
 
 
+//==========================================================================
+//
+// Find a function by its address. This is a linear search so it should
+// only be used for diagnostics.
+//
+//==========================================================================
+
+AFuncDesc *FindFunctionByPointer(actionf_p func)
+{
+	for (unsigned i = 0; i < AFTable.Size(); i++)
+	{
+		if (AFTable[i].Function == func)
+		{
+			return &AFTable[i];
+		}
+	}
+	return NULL;
+}
+
 //==========================================================================
 //
 // Find a variable by name using a binary search
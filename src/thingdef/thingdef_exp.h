@@ -143,6 +143,87 @@ struct ExpVal
 };
 
 
+//==========================================================================
+//
+// Compiled expressions
+//
+// Resolved state parameters get compiled to code for a small stack
+// machine, so that evaluating them doesn't need to walk the expression
+// tree. It produces exactly the same values as EvalExpression. Nodes that
+// have no opcode of their own are evaluated through FXOP_EVAL.
+//
+//==========================================================================
+
+enum EFxOp
+{
+	FXOP_RETURN,		// Return the top of the stack
+	FXOP_RETCONST,		// Return constant <Arg>
+	FXOP_CONST,			// Push constant <Arg>
+	FXOP_EVAL,			// Push the value of expression <Ptr>
+	FXOP_SELF,			// Push self
+	FXOP_SELFMEMBER,	// Push self's member variable <Ptr>
+	FXOP_MEMBER,		// Replace object on top of stack with its member variable <Ptr>
+	FXOP_GLOBAL,		// Push global variable <Ptr>
+	FXOP_INTCAST,
+	FXOP_FLOATCAST,
+	FXOP_NEGI,
+	FXOP_NEGF,
+	FXOP_NOTBITWISE,
+	FXOP_NOTBOOL,
+	FXOP_BOOL,
+	FXOP_ABS,
+	FXOP_ADDSUBI,		// Binary operators; <Arg> is the operator token
+	FXOP_ADDSUBF,
+	FXOP_MULDIVI,
+	FXOP_MULDIVF,
+	FXOP_CMPRELI,
+	FXOP_CMPRELF,
+	FXOP_CMPEQI,
+	FXOP_CMPEQF,
+	FXOP_BINARYINT,
+	FXOP_JUMP,			// Jump to <Arg>
+	FXOP_JFALSE,		// Pop and jump to <Arg> if false
+	FXOP_ANDJUMP,		// If false, replace with 0 and jump to <Arg>, otherwise pop
+	FXOP_ORJUMP,		// If true, replace with 1 and jump to <Arg>, otherwise pop
+};
+
+struct FxInsn
+{
+	int Op;
+	int Arg;
+	void *Ptr;
+};
+
+struct FxEmitter
+{
+	TArray<FxInsn> &Code;
+	TArray<ExpVal> &Constants;
+	int Depth;
+	int MaxDepth;
+
+	FxEmitter(TArray<FxInsn> &code, TArray<ExpVal> &constants)
+	: Code(code), Constants(constants)
+	{
+		Depth = MaxDepth = 0;
+	}
+
+	// Returns the instruction's index. <push> is how much the stack grows.
+	int Emit(int op, int arg, void *ptr, int push)
+	{
+		FxInsn insn = { op, arg, ptr };
+		Depth += push;
+		if (Depth > MaxDepth)
+		{
+			MaxDepth = Depth;
+		}
+		return Code.Push(insn);
+	}
+	void SetJump(int insn)
+	{
+		Code[insn].Arg = Code.Size();
+	}
+};
+
 //==========================================================================
 //
 //
@@ -164,6 +245,7 @@ public:
 	FxExpression *ResolveAsBoolean(FCompileContext &ctx);
 	
 	virtual ExpVal EvalExpression (AActor *self);
+	virtual void Emit(FxEmitter &emit);
 	virtual bool isConstant() const;
 	virtual void RequestAddress();
 
@@ -291,6 +373,7 @@ public:
 		return true;
 	}
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 
@@ -311,6 +394,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 
@@ -331,6 +415,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -364,6 +449,7 @@ public:
 	~FxMinusSign();
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -381,6 +467,7 @@ public:
 	~FxUnaryNotBitwise();
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -398,6 +485,7 @@ public:
 	~FxUnaryNotBoolean();
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -431,6 +519,7 @@ public:
 	FxAddSub(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -446,6 +535,7 @@ public:
 	FxMulDiv(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -461,6 +551,7 @@ public:
 	FxCompareRel(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -476,6 +567,7 @@ public:
 	FxCompareEq(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -491,6 +583,7 @@ public:
 	FxBinaryInt(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -511,6 +604,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -531,6 +625,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -550,6 +645,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -644,6 +740,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 	void RequestAddress();
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -664,6 +761,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 	void RequestAddress();
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
@@ -678,6 +776,7 @@ public:
 	FxSelf(const FScriptPosition&);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxEmitter &emit);
 };
 
 //==========================================================================
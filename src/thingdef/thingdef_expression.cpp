@@ -50,6 +50,8 @@
 #include "doomstat.h"
 #include "thingdef_exp.h"
 #include "m_fixed.h"
+#include "c_dispatch.h"
+#include "stats.h"
 
 int testglobalvar = 1337;	// just for having one global variable to test with
 DEFINE_GLOBAL_VARIABLE(testglobalvar)
@@ -102,42 +104,40 @@ DEFINE_MEMBER_VARIABLE(roll, AActor)
 
 int EvalExpressionI (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
-	return x->EvalExpression (self).GetInt();
+	return val.GetInt();
 }
 
 int EvalExpressionCol (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
-	return x->EvalExpression (self).GetColor();
+	return val.GetColor();
 }
 
 FSoundID EvalExpressionSnd (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
-	return x->EvalExpression (self).GetSoundID();
+	return val.GetSoundID();
 }
 
 double EvalExpressionF (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
-	return x->EvalExpression (self).GetFloat();
+	return val.GetFloat();
 }
 
 fixed_t EvalExpressionFix (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
-
-	ExpVal val = x->EvalExpression (self);
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
 	switch (val.Type)
 	{
@@ -152,26 +152,26 @@ fixed_t EvalExpressionFix (DWORD xi, AActor *self)
 
 FName EvalExpressionName (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
-	return x->EvalExpression (self).GetName();
+	return val.GetName();
 }
 
 const PClass * EvalExpressionClass (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
-	return x->EvalExpression (self).GetClass();
+	return val.GetClass();
 }
 
 FState *EvalExpressionState (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
-	if (x == NULL) return 0;
+	ExpVal val;
+	if (!StateParams.Eval(xi, self, val)) return 0;
 
-	return x->EvalExpression (self).GetState();
+	return val.GetState();
 }
 
 
@@ -277,6 +277,17 @@ bool FxExpression::isConstant() const
 //
 //==========================================================================
 
+void FxExpression::Emit(FxEmitter &emit)
+{
+	emit.Emit(FXOP_EVAL, 0, this, 1);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxExpression *FxExpression::Resolve(FCompileContext &ctx)
 {
 	isresolved = true;
@@ -339,6 +350,17 @@ ExpVal FxConstant::EvalExpression (AActor *self)
 //
 //==========================================================================
 
+void FxConstant::Emit(FxEmitter &emit)
+{
+	emit.Emit(FXOP_CONST, emit.Constants.Push(value), NULL, 1);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxExpression *FxConstant::MakeConstant(PSymbol *sym, const FScriptPosition &pos)
 {
 	FxExpression *x;
@@ -445,6 +467,18 @@ ExpVal FxIntCast::EvalExpression (AActor *self)
 	return baseval;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxIntCast::Emit(FxEmitter &emit)
+{
+	basex->Emit(emit);
+	emit.Emit(FXOP_INTCAST, 0, NULL, 0);
+}
+
 
 //==========================================================================
 //
@@ -521,6 +555,18 @@ ExpVal FxFloatCast::EvalExpression (AActor *self)
 	return baseval;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxFloatCast::Emit(FxEmitter &emit)
+{
+	basex->Emit(emit);
+	emit.Emit(FXOP_FLOATCAST, 0, NULL, 0);
+}
+
 
 //==========================================================================
 //
@@ -650,6 +696,18 @@ ExpVal FxMinusSign::EvalExpression (AActor *self)
 	return ret;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxMinusSign::Emit(FxEmitter &emit)
+{
+	Operand->Emit(emit);
+	emit.Emit(ValueType == VAL_Int ? FXOP_NEGI : FXOP_NEGF, 0, NULL, 0);
+}
+
 
 //==========================================================================
 //
@@ -736,6 +794,18 @@ ExpVal FxUnaryNotBitwise::EvalExpression (AActor *self)
 //
 //==========================================================================
 
+void FxUnaryNotBitwise::Emit(FxEmitter &emit)
+{
+	Operand->Emit(emit);
+	emit.Emit(FXOP_NOTBITWISE, 0, NULL, 0);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxUnaryNotBoolean::FxUnaryNotBoolean(FxExpression *operand)
 : FxExpression(operand->ScriptPosition)
 {
@@ -814,6 +884,18 @@ ExpVal FxUnaryNotBoolean::EvalExpression (AActor *self)
 //
 //==========================================================================
 
+void FxUnaryNotBoolean::Emit(FxEmitter &emit)
+{
+	Operand->Emit(emit);
+	emit.Emit(FXOP_NOTBOOL, 0, NULL, 0);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxBinary::FxBinary(int o, FxExpression *l, FxExpression *r)
 : FxExpression(l->ScriptPosition)
 {
@@ -978,6 +1060,19 @@ ExpVal FxAddSub::EvalExpression (AActor *self)
 //
 //==========================================================================
 
+void FxAddSub::Emit(FxEmitter &emit)
+{
+	left->Emit(emit);
+	right->Emit(emit);
+	emit.Emit(ValueType == VAL_Float ? FXOP_ADDSUBF : FXOP_ADDSUBI, Operator, NULL, -1);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxMulDiv::FxMulDiv(int o, FxExpression *l, FxExpression *r)
 : FxBinary(o, l, r)
 {
@@ -1101,6 +1196,19 @@ ExpVal FxMulDiv::EvalExpression (AActor *self)
 //
 //==========================================================================
 
+void FxMulDiv::Emit(FxEmitter &emit)
+{
+	left->Emit(emit);
+	right->Emit(emit);
+	emit.Emit(ValueType == VAL_Float ? FXOP_MULDIVF : FXOP_MULDIVI, Operator, NULL, -1);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxCompareRel::FxCompareRel(int o, FxExpression *l, FxExpression *r)
 : FxBinary(o, l, r)
 {
@@ -1187,6 +1295,20 @@ ExpVal FxCompareRel::EvalExpression (AActor *self)
 	return ret;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxCompareRel::Emit(FxEmitter &emit)
+{
+	left->Emit(emit);
+	right->Emit(emit);
+	emit.Emit(left->ValueType == VAL_Float || right->ValueType == VAL_Float ? FXOP_CMPRELF : FXOP_CMPRELI,
+		Operator, NULL, -1);
+}
+
 
 //==========================================================================
 //
@@ -1290,6 +1412,32 @@ ExpVal FxCompareEq::EvalExpression (AActor *self)
 	return ret;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxCompareEq::Emit(FxEmitter &emit)
+{
+	if (left->ValueType == VAL_Float || right->ValueType == VAL_Float)
+	{
+		left->Emit(emit);
+		right->Emit(emit);
+		emit.Emit(FXOP_CMPEQF, Operator, NULL, -1);
+	}
+	else if (ValueType == VAL_Int)
+	{
+		left->Emit(emit);
+		right->Emit(emit);
+		emit.Emit(FXOP_CMPEQI, Operator, NULL, -1);
+	}
+	else
+	{
+		FxExpression::Emit(emit);
+	}
+}
+
 
 //==========================================================================
 //
@@ -1391,6 +1539,19 @@ ExpVal FxBinaryInt::EvalExpression (AActor *self)
 //
 //==========================================================================
 
+void FxBinaryInt::Emit(FxEmitter &emit)
+{
+	left->Emit(emit);
+	right->Emit(emit);
+	emit.Emit(FXOP_BINARYINT, Operator, NULL, -1);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxBinaryLogical::FxBinaryLogical(int o, FxExpression *l, FxExpression *r)
 : FxExpression(l->ScriptPosition)
 {
@@ -1522,6 +1683,26 @@ ExpVal FxBinaryLogical::EvalExpression (AActor *self)
 	return ret;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxBinaryLogical::Emit(FxEmitter &emit)
+{
+	if (Operator != TK_AndAnd && Operator != TK_OrOr)
+	{
+		FxExpression::Emit(emit);
+		return;
+	}
+	left->Emit(emit);
+	int skip = emit.Emit(Operator == TK_AndAnd ? FXOP_ANDJUMP : FXOP_ORJUMP, 0, NULL, -1);
+	right->Emit(emit);
+	emit.Emit(FXOP_BOOL, 0, NULL, 0);
+	emit.SetJump(skip);
+}
+
 
 //==========================================================================
 //
@@ -1600,6 +1781,24 @@ ExpVal FxConditional::EvalExpression (AActor *self)
 	return e->EvalExpression(self);
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxConditional::Emit(FxEmitter &emit)
+{
+	condition->Emit(emit);
+	int elsejump = emit.Emit(FXOP_JFALSE, 0, NULL, -1);
+	truex->Emit(emit);
+	int endjump = emit.Emit(FXOP_JUMP, 0, NULL, 0);
+	emit.Depth--;	// Only one of truex and falsex leaves a value
+	emit.SetJump(elsejump);
+	falsex->Emit(emit);
+	emit.SetJump(endjump);
+}
+
 //==========================================================================
 //
 //
@@ -1690,6 +1889,18 @@ ExpVal FxAbs::EvalExpression (AActor *self)
 	return value;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxAbs::Emit(FxEmitter &emit)
+{
+	val->Emit(emit);
+	emit.Emit(FXOP_ABS, 0, NULL, 0);
+}
+
 //==========================================================================
 //
 //
@@ -2108,6 +2319,17 @@ ExpVal FxSelf::EvalExpression (AActor *self)
 //
 //==========================================================================
 
+void FxSelf::Emit(FxEmitter &emit)
+{
+	emit.Emit(FXOP_SELF, 0, NULL, 1);
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 FxGlobalVariable::FxGlobalVariable(PSymbolVariable *mem, const FScriptPosition &pos)
 : FxExpression(pos)
 {
@@ -2183,6 +2405,22 @@ ExpVal FxGlobalVariable::EvalExpression (AActor *self)
 	return ret;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxGlobalVariable::Emit(FxEmitter &emit)
+{
+	if (AddressRequested)
+	{
+		FxExpression::Emit(emit);
+		return;
+	}
+	emit.Emit(FXOP_GLOBAL, 0, var, 1);
+}
+
 
 //==========================================================================
 //
@@ -2301,6 +2539,32 @@ ExpVal FxClassMember::EvalExpression (AActor *self)
 	return ret;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FxClassMember::Emit(FxEmitter &emit)
+{
+	if (AddressRequested || classx->ValueType == VAL_Class)
+	{
+		FxExpression::Emit(emit);
+		return;
+	}
+	unsigned int start = emit.Code.Size();
+	classx->Emit(emit);
+	if (emit.Code.Size() == start + 1 && emit.Code.Last().Op == FXOP_SELF)
+	{ // The most common case: a member of the calling actor
+		emit.Code.Last().Op = FXOP_SELFMEMBER;
+		emit.Code.Last().Ptr = membervar;
+	}
+	else
+	{
+		emit.Emit(FXOP_MEMBER, 0, membervar, 0);
+	}
+}
+
 
 
 //==========================================================================
@@ -2903,6 +3167,12 @@ ExpVal FxMultiNameState::EvalExpression (AActor *self)
 
 FStateExpressions StateParams;
 
+// Compiled code for all state parameters
+static TArray<FxInsn> ParamCode;
+static TArray<ExpVal> ParamConstants;
+
+enum { MAX_PARAM_STACK = 16 };
+
 
 //==========================================================================
 //
@@ -2920,6 +3190,8 @@ void FStateExpressions::Clear()
 		}
 	}
 	expressions.Clear();
+	ParamCode.Clear();
+	ParamConstants.Clear();
 }
 
 //==========================================================================
@@ -2936,6 +3208,7 @@ int FStateExpressions::Add(FxExpression *x, const PClass *o, bool c)
 	exp.owner = o;
 	exp.constant = c;
 	exp.cloned = false;
+	exp.code = FSE_Uncompiled;
 	return idx;
 }
 
@@ -2955,6 +3228,7 @@ int FStateExpressions::Reserve(int num, const PClass *cls)
 		exp[i].owner = cls;
 		exp[i].constant = false;
 		exp[i].cloned = false;
+		exp[i].code = FSE_Uncompiled;
 	}
 	return idx;
 }
@@ -2972,6 +3246,7 @@ void FStateExpressions::Set(int num, FxExpression *x, bool cloned)
 		assert(expressions[num].expr == NULL || expressions[num].cloned);
 		expressions[num].expr = x;
 		expressions[num].cloned = cloned;
+		expressions[num].code = FSE_Uncompiled;
 	}
 }
 
@@ -2988,6 +3263,7 @@ void FStateExpressions::Copy(int dest, int src, int cnt)
 		// For now set only a reference because these expressions may change when being resolved
 		expressions[dest+i].expr = (FxExpression*)intptr_t(src+i);
 		expressions[dest+i].cloned = true;
+		expressions[dest+i].code = FSE_Uncompiled;
 	}
 }
 
@@ -3056,3 +3332,494 @@ FxExpression *FStateExpressions::Get(int num)
 	return NULL;
 }
 
+//==========================================================================
+//
+// FStateExpressions :: Compile
+//
+// Constant expressions are folded into a single FXOP_RETCONST. Anything
+// else is compiled with Emit, unless that would not gain anything over
+// evaluating the tree.
+//
+//==========================================================================
+
+void FStateExpressions::Compile(int num)
+{
+	FStateExpression &exp = expressions[num];
+	FxExpression *x = exp.expr;
+
+	if (x == NULL || !x->isresolved)
+	{
+		exp.code = FSE_Tree;
+	}
+	else if (x->isConstant())
+	{
+		FxInsn insn = { FXOP_RETCONST, int(ParamConstants.Push(x->EvalExpression(NULL))), NULL };
+		exp.code = ParamCode.Push(insn);
+	}
+	else
+	{
+		unsigned int start = ParamCode.Size();
+		unsigned int numconst = ParamConstants.Size();
+		FxEmitter emit(ParamCode, ParamConstants);
+
+		x->Emit(emit);
+		emit.Emit(FXOP_RETURN, 0, NULL, -1);
+		if (emit.MaxDepth > MAX_PARAM_STACK || (ParamCode.Size() == start + 2 && ParamCode[start].Op == FXOP_EVAL))
+		{
+			ParamCode.Resize(start);
+			ParamConstants.Resize(numconst);
+			exp.code = FSE_Tree;
+		}
+		else
+		{
+			exp.code = start;
+		}
+	}
+}
+
+//==========================================================================
+//
+// FStateExpressions :: GetCode
+//
+// Returns the start of an expression's compiled code or FSE_Tree.
+//
+//==========================================================================
+
+int FStateExpressions::GetCode(int num)
+{
+	if (num < 0 || num >= int(Size()))
+	{
+		return FSE_Tree;
+	}
+	if (expressions[num].code == FSE_Uncompiled)
+	{
+		Compile(num);
+	}
+	return expressions[num].code;
+}
+
+//==========================================================================
+//
+// ExecuteParamCode
+//
+//==========================================================================
+
+static ExpVal ExecuteParamCode(int start, AActor *self)
+{
+	const FxInsn *code = &ParamCode[0];
+	const FxInsn *pc = code + start;
+	ExpVal stack[MAX_PARAM_STACK];
+	ExpVal *sp = stack;		// First free entry
+	PSymbolVariable *var;
+	char *object;
+
+	for (;; ++pc)
+	{
+		switch (pc->Op)
+		{
+		case FXOP_RETURN:
+			return sp[-1];
+
+		case FXOP_RETCONST:
+			return ParamConstants[pc->Arg];
+
+		case FXOP_CONST:
+			*sp++ = ParamConstants[pc->Arg];
+			break;
+
+		case FXOP_EVAL:
+		{
+			// The expression can run arbitrary code, including compiling other
+			// state parameters, which may move ParamCode.
+			ptrdiff_t at = pc - code;
+			*sp++ = ((FxExpression *)pc->Ptr)->EvalExpression(self);
+			code = &ParamCode[0];
+			pc = code + at;
+			break;
+		}
+
+		case FXOP_SELF:
+			sp->Type = VAL_Object;
+			sp->pointer = self;
+			sp++;
+			break;
+
+		case FXOP_SELFMEMBER:
+			var = (PSymbolVariable *)pc->Ptr;
+			if (self == NULL)
+			{
+				I_Error("Accessing member variable without valid object");
+			}
+			*sp++ = GetVariableValue((char *)self + var->offset, var->ValueType);
+			break;
+
+		case FXOP_MEMBER:
+			var = (PSymbolVariable *)pc->Ptr;
+			object = sp[-1].GetPointer<char>();
+			if (object == NULL)
+			{
+				I_Error("Accessing member variable without valid object");
+			}
+			sp[-1] = GetVariableValue(object + var->offset, var->ValueType);
+			break;
+
+		case FXOP_GLOBAL:
+			var = (PSymbolVariable *)pc->Ptr;
+			*sp++ = GetVariableValue((void *)var->offset, var->ValueType);
+			break;
+
+		case FXOP_INTCAST:
+			sp[-1].Int = sp[-1].GetInt();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_FLOATCAST:
+			sp[-1].Float = sp[-1].GetFloat();
+			sp[-1].Type = VAL_Float;
+			break;
+
+		case FXOP_NEGI:
+			sp[-1].Int = -sp[-1].GetInt();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_NEGF:
+			sp[-1].Float = -sp[-1].GetFloat();
+			sp[-1].Type = VAL_Float;
+			break;
+
+		case FXOP_NOTBITWISE:
+			sp[-1].Int = ~sp[-1].GetInt();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_NOTBOOL:
+			sp[-1].Int = !sp[-1].GetBool();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_BOOL:
+			sp[-1].Int = sp[-1].GetBool();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_ABS:
+			if (sp[-1].Type == VAL_Float)
+			{
+				sp[-1].Float = fabs(sp[-1].Float);
+			}
+			else
+			{
+				sp[-1].Int = abs(sp[-1].Int);
+			}
+			break;
+
+		case FXOP_ADDSUBI:
+		{
+			int v1 = sp[-2].GetInt(), v2 = sp[-1].GetInt();
+			sp--;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int = pc->Arg == '+'? v1 + v2 : pc->Arg == '-'? v1 - v2 : 0;
+			break;
+		}
+
+		case FXOP_ADDSUBF:
+		{
+			double v1 = sp[-2].GetFloat(), v2 = sp[-1].GetFloat();
+			sp--;
+			sp[-1].Type = VAL_Float;
+			sp[-1].Float = pc->Arg == '+'? v1 + v2 : pc->Arg == '-'? v1 - v2 : 0;
+			break;
+		}
+
+		case FXOP_MULDIVI:
+		{
+			int v1 = sp[-2].GetInt(), v2 = sp[-1].GetInt();
+			if (pc->Arg != '*' && v2 == 0)
+			{
+				I_Error("Division by 0");
+			}
+			sp--;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int = pc->Arg == '*'? v1 * v2 : pc->Arg == '/'? v1 / v2 : pc->Arg == '%'? v1 % v2 : 0;
+			break;
+		}
+
+		case FXOP_MULDIVF:
+		{
+			double v1 = sp[-2].GetFloat(), v2 = sp[-1].GetFloat();
+			if (pc->Arg != '*' && v2 == 0)
+			{
+				I_Error("Division by 0");
+			}
+			sp--;
+			sp[-1].Type = VAL_Float;
+			sp[-1].Float = pc->Arg == '*'? v1 * v2 : pc->Arg == '/'? v1 / v2 : pc->Arg == '%'? fmod(v1, v2) : 0;
+			break;
+		}
+
+		case FXOP_CMPRELI:
+		{
+			int v1 = sp[-2].GetInt(), v2 = sp[-1].GetInt();
+			sp--;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int = pc->Arg == '<'? v1 < v2 : pc->Arg == '>'? v1 > v2 :
+				pc->Arg == TK_Geq? v1 >= v2 : pc->Arg == TK_Leq? v1 <= v2 : 0;
+			break;
+		}
+
+		case FXOP_CMPRELF:
+		{
+			double v1 = sp[-2].GetFloat(), v2 = sp[-1].GetFloat();
+			sp--;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int = pc->Arg == '<'? v1 < v2 : pc->Arg == '>'? v1 > v2 :
+				pc->Arg == TK_Geq? v1 >= v2 : pc->Arg == TK_Leq? v1 <= v2 : 0;
+			break;
+		}
+
+		case FXOP_CMPEQI:
+		{
+			int v1 = sp[-2].GetInt(), v2 = sp[-1].GetInt();
+			sp--;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int = pc->Arg == TK_Eq? v1 == v2 : v1 != v2;
+			break;
+		}
+
+		case FXOP_CMPEQF:
+		{
+			double v1 = sp[-2].GetFloat(), v2 = sp[-1].GetFloat();
+			sp--;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int = pc->Arg == TK_Eq? v1 == v2 : v1 != v2;
+			break;
+		}
+
+		case FXOP_BINARYINT:
+		{
+			int v1 = sp[-2].GetInt(), v2 = sp[-1].GetInt();
+			sp--;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int =
+				pc->Arg == TK_LShift? v1 << v2 :
+				pc->Arg == TK_RShift? v1 >> v2 :
+				pc->Arg == TK_URShift? int((unsigned int)(v1) >> v2) :
+				pc->Arg == '&'? v1 & v2 :
+				pc->Arg == '|'? v1 | v2 :
+				pc->Arg == '^'? v1 ^ v2 : 0;
+			break;
+		}
+
+		case FXOP_JUMP:
+			pc = code + pc->Arg - 1;
+			break;
+
+		case FXOP_JFALSE:
+			if (!(--sp)->GetBool())
+			{
+				pc = code + pc->Arg - 1;
+			}
+			break;
+
+		case FXOP_ANDJUMP:
+			if (!sp[-1].GetBool())
+			{
+				sp[-1].Type = VAL_Int;
+				sp[-1].Int = 0;
+				pc = code + pc->Arg - 1;
+			}
+			else
+			{
+				sp--;
+			}
+			break;
+
+		case FXOP_ORJUMP:
+			if (sp[-1].GetBool())
+			{
+				sp[-1].Type = VAL_Int;
+				sp[-1].Int = 1;
+				pc = code + pc->Arg - 1;
+			}
+			else
+			{
+				sp--;
+			}
+			break;
+		}
+	}
+}
+
+//==========================================================================
+//
+// FStateExpressions :: Eval
+//
+// Returns false if there is no expression with this index.
+//
+//==========================================================================
+
+bool FStateExpressions::Eval(int num, AActor *self, ExpVal &val)
+{
+	if (num < 0 || num >= int(Size()))
+	{
+		return false;
+	}
+	int code = expressions[num].code;
+	if (code == FSE_Uncompiled)
+	{
+		Compile(num);
+		code = expressions[num].code;
+	}
+	if (code >= 0)
+	{
+		const FxInsn *insn = &ParamCode[code];
+		val = insn->Op == FXOP_RETCONST ? ParamConstants[insn->Arg] : ExecuteParamCode(code, self);
+		return true;
+	}
+	return EvalTree(num, self, val);
+}
+
+//==========================================================================
+//
+// FStateExpressions :: EvalTree
+//
+// Evaluates the expression without using its compiled code.
+//
+//==========================================================================
+
+bool FStateExpressions::EvalTree(int num, AActor *self, ExpVal &val)
+{
+	FxExpression *x = Get(num);
+	if (x == NULL)
+	{
+		return false;
+	}
+	val = x->EvalExpression(self);
+	return true;
+}
+
+//==========================================================================
+//
+// CCMD decoratebench
+//
+// Evaluates every state parameter <count> times, both from the tree and
+// from the compiled code, and checks that both give the same results.
+// Parameters that may have side effects (random numbers, action specials
+// and anything else that goes through FXOP_EVAL) are skipped. The class
+// defaults stand in for self.
+//
+//==========================================================================
+
+static bool SameValue(const ExpVal &a, const ExpVal &b)
+{
+	if (a.Type != b.Type)
+	{
+		return false;
+	}
+	switch (a.Type)
+	{
+	case VAL_Float:
+		return a.Float == b.Float;
+
+	case VAL_Object:
+	case VAL_Class:
+	case VAL_Pointer:
+	case VAL_State:
+		return a.pointer == b.pointer;
+
+	default:
+		return a.Int == b.Int;
+	}
+}
+
+CCMD (decoratebench)
+{
+	int count = argv.argc() > 1 ? atoi(argv[1]) : 1000;
+	unsigned int folded = 0, compiled = 0, tree = 0, skipped = 0, mismatches = 0;
+	TArray<int> params;
+	TArray<AActor *> selves;
+	cycle_t treetime, codetime;
+	ExpVal val, val2;
+
+	if (count <= 0)
+	{
+		Printf ("Usage: decoratebench [count]\n");
+		return;
+	}
+	val.Type = val2.Type = VAL_Int;
+	val.Int = val2.Int = 0;
+	for (unsigned int i = 0; i < StateParams.Size(); ++i)
+	{
+		int code = StateParams.GetCode(i);
+		if (code == FSE_Tree)
+		{
+			if (StateParams.Get(i) != NULL) tree++;
+			continue;
+		}
+		if (ParamCode[code].Op == FXOP_RETCONST)
+		{
+			folded++;
+		}
+		else
+		{
+			compiled++;
+			for (int pc = code; ParamCode[pc].Op != FXOP_RETURN; ++pc)
+			{
+				if (ParamCode[pc].Op == FXOP_EVAL)
+				{
+					code = FSE_Tree;
+					break;
+				}
+			}
+		}
+		if (code == FSE_Tree || StateParams.GetOwner(i) == NULL)
+		{
+			skipped++;
+			continue;
+		}
+		params.Push(i);
+		selves.Push(GetDefaultByType(StateParams.GetOwner(i)));
+	}
+
+	for (unsigned int i = 0; i < params.Size(); ++i)
+	{
+		StateParams.EvalTree(params[i], selves[i], val);
+		StateParams.Eval(params[i], selves[i], val2);
+		if (!SameValue(val, val2))
+		{
+			mismatches++;
+		}
+	}
+
+	treetime.Reset();
+	treetime.Clock();
+	for (int n = 0; n < count; ++n)
+	{
+		for (unsigned int i = 0; i < params.Size(); ++i)
+		{
+			StateParams.EvalTree(params[i], selves[i], val);
+		}
+	}
+	treetime.Unclock();
+
+	codetime.Reset();
+	codetime.Clock();
+	for (int n = 0; n < count; ++n)
+	{
+		for (unsigned int i = 0; i < params.Size(); ++i)
+		{
+			StateParams.Eval(params[i], selves[i], val);
+		}
+	}
+	codetime.Unclock();
+
+	Printf ("%u parameters: %u folded, %u compiled, %u evaluated from the tree\n",
+		folded + compiled + tree, folded, compiled, tree);
+	Printf ("Benchmarked %u (%u skipped) x %d: tree %.2f ms, compiled %.2f ms\n",
+		params.Size(), skipped, count, treetime.TimeMS(), codetime.TimeMS());
+	if (mismatches > 0)
+	{
+		Printf ("%u parameters evaluated differently!\n", mismatches);
+	}
+}
@@ -334,4 +334,137 @@ void DoBlending_SSE2(const PalEntry* from, PalEntry* to, int count, int r, int g
 		}
 	}
 }
+
+//==========================================================================
+//
+// PNG unfiltering
+//
+// Up is done 16 bytes at a time for any pixel size. Sub does four pixels
+// at once with a prefix sum. Average and Paeth depend on the pixel to the
+// left, so they only get to work on all channels of a pixel in parallel.
+// dest and row may be the same buffer.
+//
+//==========================================================================
+
+static inline __m128i LoadPixel(const BYTE *p, int bpp)
+{
+	int v = 0;
+	memcpy(&v, p, bpp);
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline void StorePixel(BYTE *p, __m128i v, int bpp)
+{
+	int i = _mm_cvtsi128_si32(v);
+	memcpy(p, &i, bpp);
+}
+
+static inline __m128i AbsWords(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static inline __m128i SelectBits(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+void UnfilterRow_SSE2(int width, BYTE *dest, BYTE filter, const BYTE *row, const BYTE *prev, int bpp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int x = 0;
+
+	switch (filter)
+	{
+	case 1:		// Sub
+		if (bpp == 4)
+		{
+			__m128i a = zero;
+			for (; x + 16 <= width; x += 16)
+			{
+				__m128i d = _mm_loadu_si128((const __m128i *)(row + x));
+				d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+				d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+				d = _mm_add_epi8(d, a);
+				_mm_storeu_si128((__m128i *)(dest + x), d);
+				a = _mm_shuffle_epi32(d, _MM_SHUFFLE(3,3,3,3));
+			}
+		}
+		else if (bpp == 3)
+		{
+			const __m128i lowpixel = _mm_cvtsi32_si128(0xFFFFFF);
+			__m128i a = zero;
+			// Four pixels are 12 bytes. Only those may be stored, since the
+			// rest of the load may still be unfiltered input.
+			for (; x + 16 <= width; x += 12)
+			{
+				__m128i d = _mm_loadu_si128((const __m128i *)(row + x));
+				d = _mm_add_epi8(d, _mm_slli_si128(d, 3));
+				d = _mm_add_epi8(d, _mm_slli_si128(d, 6));
+				d = _mm_add_epi8(d, a);
+				_mm_storel_epi64((__m128i *)(dest + x), d);
+				StorePixel(dest + x + 8, _mm_srli_si128(d, 8), 4);
+				a = _mm_and_si128(_mm_srli_si128(d, 9), lowpixel);
+				a = _mm_or_si128(a, _mm_slli_si128(a, 3));
+				a = _mm_or_si128(a, _mm_slli_si128(a, 6));
+			}
+		}
+		for (; x < width; ++x)
+		{
+			dest[x] = row[x] + (x >= bpp ? dest[x - bpp] : 0);
+		}
+		break;
+
+	case 2:		// Up
+		for (; x + 16 <= width; x += 16)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i *)(row + x));
+			__m128i b = _mm_loadu_si128((const __m128i *)(prev + x));
+			_mm_storeu_si128((__m128i *)(dest + x), _mm_add_epi8(d, b));
+		}
+		for (; x < width; ++x)
+		{
+			dest[x] = row[x] + prev[x];
+		}
+		break;
+
+	case 3:		// Average
+	{
+		const __m128i one = _mm_set1_epi8(1);
+		__m128i a = zero;
+		for (; x + bpp <= width; x += bpp)
+		{
+			__m128i b = LoadPixel(prev + x, bpp);
+			// pavgb rounds up, but PNG wants to round down.
+			__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+			a = _mm_add_epi8(LoadPixel(row + x, bpp), avg);
+			StorePixel(dest + x, a, bpp);
+		}
+		break;
+	}
+
+	case 4:		// Paeth
+	{
+		const __m128i lowbytes = _mm_set1_epi16(0xFF);
+		__m128i a = zero, c = zero;
+		for (; x + bpp <= width; x += bpp)
+		{
+			__m128i b = _mm_unpacklo_epi8(LoadPixel(prev + x, bpp), zero);
+			__m128i d = _mm_unpacklo_epi8(LoadPixel(row + x, bpp), zero);
+			__m128i pa = _mm_sub_epi16(b, c);
+			__m128i pb = _mm_sub_epi16(a, c);
+			__m128i pc = AbsWords(_mm_add_epi16(pa, pb));
+			pa = AbsWords(pa);
+			pb = AbsWords(pb);
+			__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+			__m128i pred = SelectBits(_mm_cmpeq_epi16(pb, smallest), b, c);
+			pred = SelectBits(_mm_cmpeq_epi16(pa, smallest), a, pred);
+			a = _mm_and_si128(_mm_add_epi16(d, pred), lowbytes);
+			c = b;
+			StorePixel(dest + x, _mm_packus_epi16(a, zero), bpp);
+		}
+		break;
+	}
+	}
+}
 #endif
\ No newline at end of file
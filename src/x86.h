@@ -107,5 +107,6 @@ struct PalEntry;
 void CheckCPUID(CPUInfo* cpu);
 void DumpCPUInfo(const CPUInfo* cpu);
 void DoBlending_SSE2(const PalEntry* from, PalEntry* to, int count, int r, int g, int b, int a);
+void UnfilterRow_SSE2(int width, BYTE *dest, BYTE filter, const BYTE *row, const BYTE *prev, int bpp);
 
 #endif
@@ -199,4 +199,9 @@ void P_LoadTranslator(const char *lumpname)
 	}
 }
 
+const char *P_GetTranslatorName()
+{
+	return LastTranslator;
+}
+
 